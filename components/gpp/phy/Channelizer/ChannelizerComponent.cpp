@@ -0,0 +1,371 @@
+/**
+ * \file components/gpp/phy/Channelizer/ChannelizerComponent.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ *
+ * \section DESCRIPTION
+ *
+ * Implementation of a polyphase filterbank channelizer.
+ */
+
+#include "ChannelizerComponent.h"
+
+#include <cmath>
+#include <list>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+#include "irisapi/LibraryDefs.h"
+#include "irisapi/Version.h"
+
+using namespace std;
+
+namespace iris
+{
+namespace phy
+{
+
+// export library symbols
+IRIS_COMPONENT_EXPORTS(PhyComponent, ChannelizerComponent);
+
+ChannelizerComponent::ChannelizerComponent(std::string name)
+  : PhyComponent(name,                          // component name
+                "channelizer",                  // component type
+                "A polyphase filterbank channelizer", // description
+                "The Iris Project Developers", // author
+                "0.1")                          // version
+    ,batchSize_(32)
+    ,decimation_(1)
+    ,filterLength_(0)
+    ,power_(false)
+    ,outputCount_(0)
+    ,powerCount_(0)
+    ,bins_(NULL)
+    ,batchFft_(NULL)
+    ,fft_(NULL)
+{
+  registerParameter(
+    "numchannels", "Number of channels (one output port per channel)",
+    "16", false, numChannels_x, Interval<int>(2,4096));
+
+  list<int> rates;
+  rates.push_back(1);
+  rates.push_back(2);
+  registerParameter(
+    "oversample", "Channel sample rate as a multiple of channel spacing (1 or 2)",
+    "1", false, oversample_x, rates);
+
+  registerParameter(
+    "tapsperchannel", "Prototype filter taps per channel",
+    "12", true, tapsPerChannel_x, Interval<int>(1,256));
+
+  list<string> outputs;
+  outputs.push_back("stream");
+  outputs.push_back("power");
+  registerParameter(
+    "output", "Output channel signals (stream) or channel power (power)",
+    "stream", false, output_x, outputs);
+
+  registerParameter(
+    "numaverages", "Channel samples averaged for each power output",
+    "1024", true, numAverages_x, Interval<int>(1,16777216));
+}
+
+ChannelizerComponent::~ChannelizerComponent()
+{
+  destroy();
+}
+
+void ChannelizerComponent::registerPorts()
+{
+  power_ = (output_x == "power");
+  int type = power_ ? TypeInfo< float >::identifier
+                    : TypeInfo< complex<float> >::identifier;
+
+  registerInputPort("input1", TypeInfo< complex<float> >::identifier);
+  portNames_.clear();
+  for(int i=1; i<=numChannels_x; i++)
+  {
+    portNames_.push_back("output" + boost::lexical_cast<string>(i));
+    registerOutputPort(portNames_.back(), type);
+  }
+}
+
+void ChannelizerComponent::calculateOutputTypes(
+    std::map<std::string, int>& inputTypes,
+    std::map<std::string, int>& outputTypes)
+{
+  int type = (output_x == "power") ? TypeInfo< float >::identifier
+                                   : TypeInfo< complex<float> >::identifier;
+  for(int i=1; i<=numChannels_x; i++)
+    outputTypes["output" + boost::lexical_cast<string>(i)] = type;
+}
+
+void ChannelizerComponent::initialize()
+{
+  setup();
+}
+
+void ChannelizerComponent::process()
+{
+  DataSet< Cplx >* in = NULL;
+  getInputDataSet("input1", in);
+
+  // Output j is filtered from history_[j*decimation_, j*decimation_+filterLength_)
+  int numPending = history_.size();
+  history_.insert(history_.end(), in->data.begin(), in->data.end());
+  int size = history_.size();
+  int numOutputs = 0;
+  if(size >= filterLength_)
+    numOutputs = (size-filterLength_)/decimation_ + 1;
+
+  if(numOutputs > 0)
+  {
+    // Time of the last input sample used by the first output
+    double rate = in->sampleRate;
+    double firstTime = in->timeStamp;
+    if(rate > 0)
+      firstTime += (filterLength_-1-numPending)/rate;
+
+    int numPower = (powerCount_+numOutputs)/numAverages_x;
+    if(!power_)
+    {
+      for(int k=0; k<numChannels_x; k++)
+      {
+        getOutputDataSet(portNames_[k], streamSets_[k], numOutputs);
+        streamSets_[k]->timeStamp = firstTime;
+        streamSets_[k]->sampleRate = rate/decimation_;
+      }
+    }
+    else if(numPower > 0)
+    {
+      double powerTime = firstTime;
+      if(rate > 0)
+        powerTime += (numAverages_x-powerCount_-1)*decimation_/rate;
+      for(int k=0; k<numChannels_x; k++)
+      {
+        getOutputDataSet(portNames_[k], powerSets_[k], numPower);
+        powerSets_[k]->timeStamp = powerTime;
+        powerSets_[k]->sampleRate = rate/(decimation_*numAverages_x);
+      }
+    }
+
+    int powerIndex = 0;
+    for(int done=0; done<numOutputs; done+=batchSize_)
+    {
+      int n = min(batchSize_, numOutputs-done);
+      filterBatch(&history_[done*decimation_], n);
+      if(power_)
+        writePower(n, powerIndex);
+      else
+        writeStreams(done, n);
+    }
+
+    for(int k=0; k<numChannels_x; k++)
+    {
+      if(!power_)
+        releaseOutputDataSet(portNames_[k], streamSets_[k]);
+      else if(numPower > 0)
+        releaseOutputDataSet(portNames_[k], powerSets_[k]);
+    }
+    history_.erase(history_.begin(), history_.begin()+numOutputs*decimation_);
+  }
+
+  releaseInputDataSet("input1", in);
+}
+
+void ChannelizerComponent::parameterHasChanged(std::string name)
+{
+  if(name == "tapsperchannel" || name == "numaverages")
+  {
+    destroy();
+    setup();
+  }
+}
+
+/// Design our filter and set up buffers and fft plans.
+void ChannelizerComponent::setup()
+{
+  if(oversample_x == 2 && numChannels_x%2 != 0)
+    throw IrisException("numchannels must be even when oversample is 2.");
+
+  power_ = (output_x == "power");
+  decimation_ = numChannels_x/oversample_x;
+  filterLength_ = numChannels_x*tapsPerChannel_x;
+  outputCount_ = 0;
+  powerCount_ = 0;
+  designFilter();
+
+  fold_.assign(2*numChannels_x, 0);
+  powerSums_.assign(numChannels_x, 0);
+  streamSets_.assign(numChannels_x, NULL);
+  powerSets_.assign(numChannels_x, NULL);
+
+  // Start with a zeroed filter history
+  history_.assign(filterLength_-1, Cplx(0,0));
+
+  bins_ = reinterpret_cast<Cplx*>(
+      fftwf_malloc(sizeof(fftwf_complex)*numChannels_x*batchSize_));
+  fftwf_complex* bins = reinterpret_cast<fftwf_complex*>(bins_);
+  batchFft_ = fftwf_plan_many_dft(1, &numChannels_x, batchSize_,
+                                  bins, NULL, 1, numChannels_x,
+                                  bins, NULL, 1, numChannels_x,
+                                  FFTW_BACKWARD, FFTW_MEASURE);
+  fft_ = fftwf_plan_dft_1d(numChannels_x, bins, bins,
+                           FFTW_BACKWARD, FFTW_MEASURE);
+}
+
+void ChannelizerComponent::destroy()
+{
+  if(batchFft_ != NULL)
+    fftwf_destroy_plan(batchFft_);
+  if(fft_ != NULL)
+    fftwf_destroy_plan(fft_);
+  if(bins_ != NULL)
+    fftwf_free(bins_);
+  batchFft_ = NULL;
+  fft_ = NULL;
+  bins_ = NULL;
+}
+
+/** Design a Blackman windowed-sinc lowpass prototype.
+ *
+ * The cutoff is half the channel spacing, so adjacent channels cross at
+ * -6dB. The filter has unity gain at DC.
+ */
+void ChannelizerComponent::designFilter()
+{
+  int len = filterLength_;
+  double fc = 0.5/numChannels_x;
+  vector<double> h(len);
+  double sum = 0;
+  for(int i=0; i<len; i++)
+  {
+    double t = i-(len-1)/2.0;
+    double sinc = (t == 0) ? 2*fc : sin(2*M_PI*fc*t)/(M_PI*t);
+    double w = 0.42 - 0.5*cos(2*M_PI*i/(len-1)) + 0.08*cos(4*M_PI*i/(len-1));
+    h[i] = sinc*w;
+    sum += h[i];
+  }
+
+  // Reverse so that taps line up with input samples in time order
+  filter_.resize(2*len);
+  for(int i=0; i<len; i++)
+    filter_[2*i] = filter_[2*i+1] = h[len-1-i]/sum;
+}
+
+/** Filter numOutputs channel samples into bins_.
+ *
+ * For each channel sample, the windowed input is multiplied by the
+ * reversed prototype and folded into numChannels_x polyphase sums. An
+ * inverse fft of the sums gives the output of every channel.
+ */
+void ChannelizerComponent::filterBatch(const Cplx* in, int numOutputs)
+{
+  const int m = numChannels_x;
+  for(int j=0; j<numOutputs; j++)
+  {
+    const float* x = reinterpret_cast<const float*>(in + j*decimation_);
+    const float* h = &filter_[0];
+    float* acc = &fold_[0];
+    fill(fold_.begin(), fold_.end(), 0);
+    for(int p=0; p<tapsPerChannel_x; p++, x+=2*m, h+=2*m)
+      for(int i=0; i<2*m; i++)
+        acc[i] += h[i]*x[i];
+
+    // Folded sums are in reverse polyphase order
+    Cplx* bins = bins_ + j*m;
+    for(int i=0; i<m; i++)
+      bins[m-1-i] = Cplx(acc[2*i], acc[2*i+1]);
+  }
+
+  if(numOutputs == batchSize_)
+  {
+    fftwf_execute(batchFft_);
+  }
+  else
+  {
+    for(int j=0; j<numOutputs; j++)
+    {
+      fftwf_complex* bins = reinterpret_cast<fftwf_complex*>(bins_ + j*m);
+      fftwf_execute_dft(fft_, bins, bins);
+    }
+  }
+
+  // Oversampled channels alternate in sign on odd channels
+  if(oversample_x == 2)
+  {
+    for(int j=0; j<numOutputs; j++)
+    {
+      if((outputCount_+j)%2 == 0)
+        continue;
+      Cplx* bins = bins_ + j*m;
+      for(int k=1; k<m; k+=2)
+        bins[k] = -bins[k];
+    }
+  }
+  outputCount_ += numOutputs;
+}
+
+/// Copy channel samples from bins_ to the output DataSets.
+void ChannelizerComponent::writeStreams(int offset, int numOutputs)
+{
+  const int m = numChannels_x;
+  for(int k=0; k<m; k++)
+  {
+    Cplx* out = &streamSets_[k]->data[offset];
+    const Cplx* bins = bins_ + k;
+    for(int j=0; j<numOutputs; j++)
+      out[j] = bins[j*m];
+  }
+}
+
+/// Add channel samples in bins_ to the power sums, outputting when full.
+void ChannelizerComponent::writePower(int numOutputs, int& powerIndex)
+{
+  const int m = numChannels_x;
+  for(int j=0; j<numOutputs; j++)
+  {
+    const float* bins = reinterpret_cast<const float*>(bins_ + j*m);
+    for(int k=0; k<m; k++)
+      powerSums_[k] += bins[2*k]*bins[2*k] + bins[2*k+1]*bins[2*k+1];
+
+    if(++powerCount_ == numAverages_x)
+    {
+      for(int k=0; k<m; k++)
+      {
+        powerSets_[k]->data[powerIndex] = powerSums_[k]/numAverages_x;
+        powerSums_[k] = 0;
+      }
+      powerIndex++;
+      powerCount_ = 0;
+    }
+  }
+}
+
+} // namespace phy
+} // namespace iris
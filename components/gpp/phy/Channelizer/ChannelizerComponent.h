@@ -0,0 +1,120 @@
+/**
+ * \file components/gpp/phy/Channelizer/ChannelizerComponent.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ *
+ * \section DESCRIPTION
+ *
+ * A polyphase filterbank channelizer. Splits a complex<float> input into
+ * numchannels equally spaced channels and outputs either the channel
+ * signals or their power on one output port per channel.
+ */
+
+#ifndef PHY_CHANNELIZERCOMPONENT_H_
+#define PHY_CHANNELIZERCOMPONENT_H_
+
+#include <complex>
+#include <vector>
+#include "fftw3.h"
+#include "irisapi/PhyComponent.h"
+
+namespace iris
+{
+namespace phy
+{
+
+/** A polyphase filterbank channelizer.
+ *
+ * The input band is split into numchannels channels spaced fs/numchannels
+ * apart. Port outputK carries the channel centred on (K-1)*fs/numchannels,
+ * so output1 is centred on DC and the upper half of the ports carry the
+ * negative frequencies, as in an FFT.
+ *
+ * Each channel is filtered by a windowed-sinc prototype with
+ * tapsperchannel taps per channel, using one polyphase FIR pass and one
+ * FFT for all channels. Channels are output critically sampled
+ * (oversample = 1, fs/numchannels) or 2x oversampled (oversample = 2).
+ * With output = "power", each port instead outputs the mean power of
+ * every numaverages channel samples.
+ */
+class ChannelizerComponent
+  : public PhyComponent
+{
+ public:
+  typedef std::complex<float>   Cplx;
+  typedef std::vector<Cplx>     CplxVec;
+  typedef std::vector<float>    FloatVec;
+
+  ChannelizerComponent(std::string name);
+  ~ChannelizerComponent();
+  virtual void calculateOutputTypes(
+      std::map<std::string, int>& inputTypes,
+      std::map<std::string, int>& outputTypes);
+  virtual void registerPorts();
+  virtual void initialize();
+  virtual void process();
+  virtual void parameterHasChanged(std::string name);
+
+ private:
+
+  void setup();
+  void destroy();
+  void designFilter();
+  void filterBatch(const Cplx* in, int numOutputs);
+  void writeStreams(int offset, int numOutputs);
+  void writePower(int numOutputs, int& powerIndex);
+
+  int numChannels_x;          ///< Number of channels (default = 16)
+  int oversample_x;           ///< 1=critically sampled, 2=2x oversampled (default = 1)
+  int tapsPerChannel_x;       ///< Prototype filter taps per channel (default = 12)
+  std::string output_x;       ///< "stream" or "power" (default = stream)
+  int numAverages_x;          ///< Channel samples per power output (default = 1024)
+
+  const int batchSize_;       ///< Channel samples per batched fft.
+  int decimation_;            ///< Input samples per channel sample.
+  int filterLength_;          ///< Length of prototype filter.
+  bool power_;                ///< Output power rather than streams.
+  long outputCount_;          ///< Channel samples since setup.
+  int powerCount_;            ///< Channel samples in current power sums.
+
+  FloatVec filter_;           ///< Reversed prototype, each tap repeated for re and im.
+  FloatVec fold_;             ///< Polyphase partial sums for one channel sample.
+  CplxVec history_;           ///< Input samples still needed by the filterbank.
+  FloatVec powerSums_;        ///< Sum of channel power for each channel.
+  Cplx* bins_;                ///< Folded input, then channel outputs (fftwf_malloc)
+  fftwf_plan batchFft_;       ///< Inverse fft of batchSize_ channel samples.
+  fftwf_plan fft_;            ///< Inverse fft of one channel sample.
+
+  std::vector<std::string> portNames_;          ///< Output port names.
+  std::vector< DataSet<Cplx>* > streamSets_;    ///< Output DataSets (stream)
+  std::vector< DataSet<float>* > powerSets_;    ///< Output DataSets (power)
+};
+
+} // namespace phy
+} // namespace iris
+
+#endif // PHY_CHANNELIZERCOMPONENT_H_
@@ -0,0 +1,208 @@
+/**
+ * \file components/gpp/phy/Channelizer/test/ChannelizerComponent_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for Channelizer component.
+ */
+
+#define BOOST_TEST_MODULE ChannelizerComponent_Test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "../ChannelizerComponent.h"
+#include "utility/DataBufferTrivial.h"
+
+using namespace std;
+using namespace iris;
+using namespace iris::phy;
+
+typedef complex<float>  Cplx;
+typedef vector<Cplx>    CplxVec;
+
+// Sum of tones at the given frequencies (cycles/sample)
+CplxVec tones(int length, float f1, float a1, float f2, float a2)
+{
+  CplxVec v(length);
+  for(int i=0; i<length; i++)
+    v[i] = polar(a1, float(2*M_PI*f1*i)) + polar(a2, float(2*M_PI*f2*i));
+  return v;
+}
+
+// Run input through a channelizer in blocks of the given sizes
+template <class T>
+vector< vector<T> > channelize(ChannelizerComponent& ch, int numChannels,
+                               const CplxVec& input, vector<int> blockSizes)
+{
+  DataBufferTrivial<Cplx> in;
+  vector< DataBufferTrivial<T>* > outs;
+  vector<ReadBufferBase*> iBufs(1, &in);
+  vector<WriteBufferBase*> oBufs;
+  for(int k=0; k<numChannels; k++)
+  {
+    outs.push_back(new DataBufferTrivial<T>);
+    oBufs.push_back(outs.back());
+  }
+  ch.setBuffers(iBufs, oBufs);
+  ch.initialize();
+
+  vector< vector<T> > result(numChannels);
+  int pos = 0;
+  for(int b=0; pos<input.size(); b=(b+1)%blockSizes.size())
+  {
+    int n = min(blockSizes[b], (int)input.size()-pos);
+    DataSet<Cplx>* iSet = NULL;
+    in.getWriteData(iSet, n);
+    copy(input.begin()+pos, input.begin()+pos+n, iSet->data.begin());
+    iSet->sampleRate = 1e6;
+    iSet->timeStamp = pos/1e6;
+    in.releaseWriteData(iSet);
+    ch.process();
+    pos += n;
+
+    for(int k=0; k<numChannels; k++)
+    {
+      while(outs[k]->hasData())
+      {
+        DataSet<T>* oSet = NULL;
+        outs[k]->getReadData(oSet);
+        result[k].insert(result[k].end(), oSet->data.begin(), oSet->data.end());
+        outs[k]->releaseReadData(oSet);
+      }
+    }
+  }
+  for(int k=0; k<numChannels; k++)
+    delete outs[k];
+  return result;
+}
+
+BOOST_AUTO_TEST_SUITE (ChannelizerComponent_Test)
+
+BOOST_AUTO_TEST_CASE(ChannelizerComponent_Basic_Test)
+{
+  BOOST_REQUIRE_NO_THROW(ChannelizerComponent ch("test"));
+}
+
+BOOST_AUTO_TEST_CASE(ChannelizerComponent_Parm_Test)
+{
+  ChannelizerComponent ch("test");
+  BOOST_CHECK(ch.getParameterDefaultValue("numchannels") == "16");
+  BOOST_CHECK(ch.getParameterDefaultValue("oversample") == "1");
+  BOOST_CHECK(ch.getParameterDefaultValue("tapsperchannel") == "12");
+  BOOST_CHECK(ch.getParameterDefaultValue("output") == "stream");
+  BOOST_CHECK(ch.getParameterDefaultValue("numaverages") == "1024");
+}
+
+BOOST_AUTO_TEST_CASE(ChannelizerComponent_Ports_Test)
+{
+  ChannelizerComponent ch("test");
+  ch.setValue("numchannels", 4);
+  BOOST_REQUIRE_NO_THROW(ch.registerPorts());
+
+  vector<Port> oPorts = ch.getOutputPorts();
+  BOOST_REQUIRE(oPorts.size() == 4);
+  BOOST_CHECK(oPorts.back().portName == "output4");
+  BOOST_CHECK(oPorts.back().supportedTypes.front() ==
+      TypeInfo< complex<float> >::identifier);
+
+  ChannelizerComponent pch("test");
+  pch.setValue("numchannels", 4);
+  pch.setValue("output", "power");
+  pch.registerPorts();
+  map<string, int> iTypes,oTypes;
+  iTypes["input1"] = TypeInfo< complex<float> >::identifier;
+  pch.calculateOutputTypes(iTypes,oTypes);
+  BOOST_REQUIRE(oTypes.size() == 4);
+  BOOST_CHECK(oTypes["output1"] == TypeInfo< float >::identifier);
+}
+
+BOOST_AUTO_TEST_CASE(ChannelizerComponent_Stream_Test)
+{
+  // Tones offset from the centres of channels 3 and 6 (-2) of 8
+  int m = 8;
+  float offset = 0.01;
+  CplxVec input = tones(8000, 3.0/m+offset, 1.0, -2.0/m+offset, 0.5);
+
+  for(int oversample=1; oversample<=2; oversample++)
+  {
+    ChannelizerComponent ch("test");
+    ch.setValue("numchannels", m);
+    ch.setValue("oversample", oversample);
+    ch.registerPorts();
+
+    int sizes[] = {1000, 3, 517, 64, 2000};
+    vector<CplxVec> out = channelize<Cplx>(ch, m, input,
+                                           vector<int>(sizes, sizes+5));
+    int decimation = m/oversample;
+    for(int k=0; k<m; k++)
+      BOOST_REQUIRE_EQUAL(out[k].size(), (input.size()-1)/decimation + 1);
+
+    // Skip the filter transient
+    int start = 24*oversample;
+    float step = 2*M_PI*offset*decimation;
+    for(int i=start; i<out[0].size(); i++)
+    {
+      BOOST_CHECK_CLOSE(abs(out[3][i]), 1.0, 1);
+      BOOST_CHECK_CLOSE(abs(out[6][i]), 0.5, 1);
+      BOOST_CHECK_SMALL(abs(out[3][i]*polar(1.0f, -step) - out[3][i-1]), 0.02f);
+      BOOST_CHECK_SMALL(abs(out[6][i]*polar(1.0f, -step) - out[6][i-1]), 0.01f);
+      for(int k=0; k<m; k++)
+        if(k != 3 && k != 6)
+          BOOST_CHECK_SMALL(abs(out[k][i]), 0.01f);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ChannelizerComponent_Power_Test)
+{
+  int m = 4;
+  CplxVec input = tones(4000, 0.25, 2.0, 0.5, 0.1);
+
+  ChannelizerComponent ch("test");
+  ch.setValue("numchannels", m);
+  ch.setValue("output", "power");
+  ch.setValue("numaverages", 100);
+  ch.registerPorts();
+
+  int sizes[] = {333, 1234, 50};
+  vector< vector<float> > out = channelize<float>(ch, m, input,
+                                                  vector<int>(sizes, sizes+3));
+  for(int k=0; k<m; k++)
+    BOOST_REQUIRE_EQUAL(out[k].size(), 10);
+  for(int i=1; i<10; i++)
+  {
+    BOOST_CHECK_SMALL(out[0][i], 1e-4f);
+    BOOST_CHECK_CLOSE(out[1][i], 4.0, 1);
+    BOOST_CHECK_CLOSE(out[2][i], 0.01, 1);
+    BOOST_CHECK_SMALL(out[3][i], 1e-4f);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -34,11 +34,20 @@
 #include "FileRawReaderComponent.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
 
 #include "utility/EndianConversion.h"
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 using namespace std;
 
 namespace iris
@@ -54,8 +63,23 @@ FileRawReaderComponent::FileRawReaderComponent(string name)
                 "FileRawReader",
                 "A filereader",
                 "Paul Sutton",
-                "0.2")
+                "0.2"),
+  fileSize_(0),
+  elementsRead_(0),
+  sampleRate_(0),
+  startElement_(0),
+  elementPos_(0),
+  mapped_(NULL),
+  mappedPos_(0),
+  fd_(-1),
+  currentChunk_(0),
+  chunkPos_(0),
+  directPos_(0),
+  stopReader_(false),
+  paceElements_(0)
 {
+  chunks_[0] = chunks_[1] = NULL;
+
   list<string> allowedTypes;
   allowedTypes.push_back(TypeInfo< uint8_t >::name());
   allowedTypes.push_back(TypeInfo< uint16_t >::name());
@@ -110,6 +134,57 @@ FileRawReaderComponent::FileRawReaderComponent(string name)
                     true,
                     delay_x,
                     Interval<uint32_t>(0,5000000));
+
+  list<string> allowedModes;
+  allowedModes.push_back("stream");
+  allowedModes.push_back("mmap");
+  allowedModes.push_back("direct");
+  registerParameter("mode",
+                    "How to read the file: stream, mmap (memory mapped) or "
+                    "direct (O_DIRECT reads, bypassing the page cache)",
+                    "stream",
+                    false,
+                    mode_x,
+                    allowedModes);
+
+  list<string> allowedPacing;
+  allowedPacing.push_back("delay");
+  allowedPacing.push_back("rate");
+  allowedPacing.push_back("none");
+  registerParameter("pacing",
+                    "How to pace output: delay (wait delay us between blocks), "
+                    "rate (output at samplerate) or none (as fast as possible)",
+                    "delay",
+                    true,
+                    pacing_x,
+                    allowedPacing);
+  registerParameter("samplerate",
+                    "Sample rate of the data in the file (0 = unknown)",
+                    "0",
+                    false,
+                    sampleRate_x);
+
+  list<string> allowedFormats;
+  allowedFormats.push_back("raw");
+  allowedFormats.push_back("sigmf");
+  registerParameter("format",
+                    "File format: raw (data only) or sigmf (data with a SigMF "
+                    "metadata file giving its type, rate and timestamps)",
+                    "raw",
+                    false,
+                    format_x,
+                    allowedFormats);
+  registerParameter("seektime",
+                    "Timestamp to start reading from (< 0 = start of file). "
+                    "Needs a SigMF capture or a samplerate.",
+                    "-1",
+                    false,
+                    seekTime_x);
+}
+
+FileRawReaderComponent::~FileRawReaderComponent()
+{
+  closeFile();
 }
 
 void FileRawReaderComponent::registerPorts()
@@ -139,6 +214,10 @@ void FileRawReaderComponent::calculateOutputTypes(
     std::map<std::string,int>& inputTypes,
     std::map<std::string,int>& outputTypes)
 {
+  //A SigMF capture says what it contains
+  if(format_x == "sigmf")
+    loadMetadata();
+
   //Set output type
   if( dataType_x == "uint8_t" )
     outputTypes["output1"] = TypeInfo< uint8_t >::identifier;
@@ -172,6 +251,8 @@ void FileRawReaderComponent::calculateOutputTypes(
 
 void FileRawReaderComponent::initialize()
 {
+  closeFile();
+
   //Open the file and retrieve its size
   hInFile_.open(fileName_x.c_str(), ios::in|ios::binary|ios::ate);
   if(hInFile_.fail() || hInFile_.bad() || !hInFile_.is_open())
@@ -180,7 +261,125 @@ void FileRawReaderComponent::initialize()
     throw ResourceNotFoundException(
         "Could not open file " + fileName_x + " for reading.");
   }
+  fileSize_ = hInFile_.tellg();
   hInFile_.seekg(0, ios::beg);
+  if(fileSize_ == 0)
+    throw IrisException("File " + fileName_x + " is empty.");
+
+  endian_ = endian_x;
+  sampleRate_ = sampleRate_x;
+  if(format_x == "sigmf")
+  {
+    loadMetadata();
+    endian_ = meta_.isBigEndian() ? "big" : "little";
+    sampleRate_ = meta_.sampleRate;
+  }
+
+  //Find the element to start from
+  uint64_t numElements = fileSize_/elementSize();
+  startElement_ = 0;
+  if(seekTime_x >= 0)
+  {
+    if(format_x == "sigmf")
+      startElement_ = meta_.findSample(seekTime_x);
+    else if(sampleRate_ > 0)
+      startElement_ = (uint64_t)(seekTime_x*sampleRate_+0.5);
+    else
+      LOG(LWARNING) << "No samplerate given - can't seek to " << seekTime_x;
+    if(startElement_ >= numElements)
+    {
+      LOG(LWARNING) << "Seek time " << seekTime_x << " is after the end of "
+                    << fileName_x << " - reading from the start";
+      startElement_ = 0;
+    }
+  }
+  elementPos_ = startElement_;
+  uint64_t startByte = startElement_*elementSize();
+  hInFile_.seekg(startByte, ios::beg);
+
+  if(pacing_x == "rate" && sampleRate_ <= 0)
+    LOG(LWARNING) << "No samplerate given - output will not be paced";
+
+  mode_ = mode_x;
+#ifdef __linux__
+  if(mode_ == "mmap")
+  {
+    int fd = open(fileName_x.c_str(), O_RDONLY);
+    void* p = MAP_FAILED;
+    if(fd >= 0 && fileSize_ == (size_t)fileSize_)
+    {
+      p = mmap(NULL, fileSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+    }
+    if(p == MAP_FAILED)
+    {
+      LOG(LWARNING) << "Could not map " << fileName_x << " (" << strerror(errno)
+                    << ") - reading it as a stream";
+      mode_ = "stream";
+    }
+    else
+    {
+      mapped_ = (char*)p;
+      mappedPos_ = startByte;
+      madvise(mapped_, fileSize_, MADV_SEQUENTIAL);
+    }
+  }
+  if(mode_ == "direct")
+  {
+    fd_ = open(fileName_x.c_str(), O_RDONLY|O_DIRECT);
+    //posix_memalign returns its error rather than setting errno
+    int err = fd_ < 0 ? errno : 0;
+    if(err == 0)
+      err = posix_memalign((void**)&chunks_[0], 4096, directChunkSize);
+    if(err == 0)
+      err = posix_memalign((void**)&chunks_[1], 4096, directChunkSize);
+    if(err != 0)
+    {
+      //Some filesystems (e.g. tmpfs) don't support O_DIRECT
+      LOG(LWARNING) << "Could not open " << fileName_x << " for direct reads ("
+                    << strerror(err) << ") - reading it as a stream";
+      closeFile();
+      hInFile_.open(fileName_x.c_str(), ios::in|ios::binary);
+      hInFile_.seekg(startByte, ios::beg);
+      mode_ = "stream";
+    }
+    directPos_ = startByte;
+  }
+#else
+  if(mode_ != "stream")
+  {
+    LOG(LWARNING) << mode_ << " mode is not supported on this platform - "
+                  << "reading the file as a stream";
+    mode_ = "stream";
+  }
+#endif
+
+  if(mode_ != "stream")
+    hInFile_.close();
+}
+
+void FileRawReaderComponent::start()
+{
+  elementsRead_ = 0;
+  paceStart_ = boost::posix_time::ptime();
+
+  if(mode_ == "direct")
+  {
+    //Reads must be aligned, so start at the block holding the next byte
+    uint64_t aligned = directPos_ & ~(uint64_t)4095;
+    chunkFull_[0] = chunkFull_[1] = false;
+    currentChunk_ = 0;
+    chunkPos_ = directPos_-aligned;
+    stopReader_ = false;
+    readerError_.clear();
+    readerThread_ = boost::thread(&FileRawReaderComponent::directReaderLoop,
+                                  this, aligned);
+  }
+}
+
+void FileRawReaderComponent::stop()
+{
+  stopDirectReader();
 }
 
 void FileRawReaderComponent::process()
@@ -232,7 +431,7 @@ void FileRawReaderComponent::process()
     default:
       break;
   }
-  boost::this_thread::sleep(boost::posix_time::microseconds(delay_x));
+  pace(blockSize_x);
 }
 
 template<typename T>
@@ -243,37 +442,254 @@ void FileRawReaderComponent::readBlock()
   DataSet<T>* writeDataSet = NULL;
   outBuf->getWriteData(writeDataSet, blockSize_x);
 
-  char *bytebuf = reinterpret_cast<char*>(&writeDataSet->data[0]);
-  ifstream::pos_type toread = blockSize_x * sizeof(T);
-
-  //Read a block (loop if necessary)
-  while( toread > 0 )
-  {
-    hInFile_.read(bytebuf, toread);
-    toread -= hInFile_.gcount();
-    bytebuf += hInFile_.gcount();
-    if( hInFile_.eof() )
-    {
-      hInFile_.clear();
-      hInFile_.seekg(0, ios::beg);
-    }
-  }
+  //Read a block (looping at the end of the file)
+  readBytes(reinterpret_cast<char*>(&writeDataSet->data[0]),
+            blockSize_x * sizeof(T));
 
   if (sizeof(T) > 1)
   {
     //Convert endianess
-    if (endian_x == "native")
+    if (endian_ == "native")
       ; // nothing to do
-    else if (endian_x == "little")
+    else if (endian_ == "little")
       transform(writeDataSet->data.begin(), writeDataSet->data.end(),
                 writeDataSet->data.begin(), lit2sys<T> );
-    else if (endian_x == "big")
+    else if (endian_ == "big")
       transform(writeDataSet->data.begin(), writeDataSet->data.end(),
                 writeDataSet->data.begin(), big2sys<T> );
   }
 
+  if(format_x == "sigmf")
+  {
+    double rate;
+    writeDataSet->timeStamp = meta_.findTime(elementPos_, rate);
+    writeDataSet->sampleRate = rate;
+  }
+  else if(sampleRate_ > 0)
+  {
+    writeDataSet->sampleRate = sampleRate_;
+    writeDataSet->timeStamp = (startElement_+elementsRead_)/sampleRate_;
+  }
+  elementsRead_ += blockSize_x;
+  uint64_t numElements = fileSize_/sizeof(T);
+  if(numElements > 0)
+    elementPos_ = (elementPos_+blockSize_x) % numElements;
+
   outBuf->releaseWriteData(writeDataSet);
 }
 
+/// Read the SigMF metadata file and take the data type from it.
+void FileRawReaderComponent::loadMetadata()
+{
+  string name = SigmfMetadata::metaFileName(fileName_x);
+  ifstream in(name.c_str());
+  if(!in.is_open())
+  {
+    LOG(LFATAL) << "Could not open SigMF metadata file " << name;
+    throw ResourceNotFoundException("Could not open SigMF metadata file " + name);
+  }
+  meta_.read(in);
+
+  string type = SigmfMetadata::toIrisType(meta_.datatype);
+  if(type.empty())
+    throw IrisException("Unsupported SigMF datatype " + meta_.datatype +
+                        " in " + name);
+  dataType_x = type;
+}
+
+/// Size in bytes of an element of dataType_x.
+size_t FileRawReaderComponent::elementSize() const
+{
+  if(dataType_x == "uint16_t" || dataType_x == "int16_t")
+    return 2;
+  if(dataType_x == "uint32_t" || dataType_x == "int32_t" || dataType_x == "float")
+    return 4;
+  if(dataType_x == "uint64_t" || dataType_x == "int64_t" ||
+     dataType_x == "double" || dataType_x == "complex<float>")
+    return 8;
+  if(dataType_x == "complex<double>")
+    return 16;
+  if(dataType_x == "long double")
+    return sizeof(long double);
+  if(dataType_x == "complex<long double>")
+    return sizeof(complex<long double>);
+  return 1;
+}
+
+void FileRawReaderComponent::readBytes(char* out, size_t bytes)
+{
+  if(mode_ == "mmap")
+    readMapped(out, bytes);
+  else if(mode_ == "direct")
+    readDirect(out, bytes);
+  else
+    readStream(out, bytes);
+}
+
+void FileRawReaderComponent::readStream(char* out, size_t bytes)
+{
+  while(bytes > 0)
+  {
+    hInFile_.read(out, bytes);
+    bytes -= hInFile_.gcount();
+    out += hInFile_.gcount();
+    if( hInFile_.eof() )
+    {
+      hInFile_.clear();
+      hInFile_.seekg(0, ios::beg);
+    }
+  }
+}
+
+void FileRawReaderComponent::readMapped(char* out, size_t bytes)
+{
+  //Copy straight from the page cache into the output
+  while(bytes > 0)
+  {
+    size_t n = min((uint64_t)bytes, fileSize_-mappedPos_);
+    memcpy(out, mapped_+mappedPos_, n);
+    out += n;
+    bytes -= n;
+    mappedPos_ += n;
+    if(mappedPos_ == fileSize_)
+      mappedPos_ = 0;
+  }
+}
+
+void FileRawReaderComponent::readDirect(char* out, size_t bytes)
+{
+  while(bytes > 0)
+  {
+    {
+      boost::mutex::scoped_lock lock(chunkMutex_);
+      while(!chunkFull_[currentChunk_] && readerError_.empty())
+        chunkCond_.wait(lock);
+      if(!chunkFull_[currentChunk_])
+        throw IrisException("Failed to read " + fileName_x + ": " + readerError_);
+    }
+
+    //The reader thread leaves full chunks alone, so copy without the lock
+    size_t n = min(bytes, chunkBytes_[currentChunk_]-chunkPos_);
+    memcpy(out, chunks_[currentChunk_]+chunkPos_, n);
+    out += n;
+    bytes -= n;
+    chunkPos_ += n;
+    directPos_ = (directPos_+n) % fileSize_;
+
+    if(chunkPos_ == chunkBytes_[currentChunk_])
+    {
+      {
+        boost::mutex::scoped_lock lock(chunkMutex_);
+        chunkFull_[currentChunk_] = false;
+      }
+      chunkCond_.notify_all();
+      currentChunk_ ^= 1;
+      chunkPos_ = 0;
+    }
+  }
+}
+
+/// Fills the two chunks in turn, reading ahead of readDirect().
+void FileRawReaderComponent::directReaderLoop(uint64_t offset)
+{
+#ifdef __linux__
+  int chunk = 0;
+  while(true)
+  {
+    {
+      boost::mutex::scoped_lock lock(chunkMutex_);
+      while(chunkFull_[chunk] && !stopReader_)
+        chunkCond_.wait(lock);
+      if(stopReader_)
+        return;
+    }
+
+    ssize_t n = pread(fd_, chunks_[chunk], directChunkSize, offset);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+    {
+      boost::mutex::scoped_lock lock(chunkMutex_);
+      readerError_ = n < 0 ? strerror(errno) : "unexpected end of file";
+      chunkCond_.notify_all();
+      return;
+    }
+
+    offset += n;
+    if(offset >= fileSize_)
+      offset = 0;
+    {
+      boost::mutex::scoped_lock lock(chunkMutex_);
+      chunkBytes_[chunk] = n;
+      chunkFull_[chunk] = true;
+    }
+    chunkCond_.notify_all();
+    chunk ^= 1;
+  }
+#endif
+}
+
+void FileRawReaderComponent::stopDirectReader()
+{
+  {
+    boost::mutex::scoped_lock lock(chunkMutex_);
+    stopReader_ = true;
+  }
+  chunkCond_.notify_all();
+  readerThread_.join();
+}
+
+void FileRawReaderComponent::closeFile()
+{
+  stopDirectReader();
+  if(hInFile_.is_open())
+    hInFile_.close();
+#ifdef __linux__
+  if(mapped_ != NULL)
+    munmap(mapped_, fileSize_);
+  if(fd_ >= 0)
+    close(fd_);
+#endif
+  mapped_ = NULL;
+  fd_ = -1;
+  free(chunks_[0]);
+  free(chunks_[1]);
+  chunks_[0] = chunks_[1] = NULL;
+}
+
+void FileRawReaderComponent::pace(size_t numElements)
+{
+  namespace bpt = boost::posix_time;
+
+  if(pacing_x == "delay")
+  {
+    boost::this_thread::sleep(bpt::microseconds(delay_x));
+    return;
+  }
+  if(pacing_x != "rate" || sampleRate_ <= 0)
+    return;
+
+  //Sleep until this block is due, against an absolute schedule
+  bpt::ptime now = bpt::microsec_clock::universal_time();
+  if(paceStart_.is_not_a_date_time())
+  {
+    paceStart_ = now;
+    paceElements_ = 0;
+  }
+  paceElements_ += numElements;
+  bpt::ptime due = paceStart_ +
+      bpt::microseconds((boost::int64_t)(paceElements_/sampleRate_*1e6));
+  if(due > now)
+  {
+    boost::this_thread::sleep(due);
+  }
+  else if(now-due > bpt::milliseconds(100))
+  {
+    //Downstream has stalled - start again rather than bursting to catch up
+    paceStart_ = now;
+    paceElements_ = 0;
+  }
+}
+
 } // namespace phy
 } // namespace iris
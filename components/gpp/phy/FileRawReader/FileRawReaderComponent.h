@@ -29,14 +29,24 @@
  * \section DESCRIPTION
  *
  * Source component to read data from file.
+ *
+ * The file can be read through a stream, through a memory mapping or
+ * with O_DIRECT reads on a background thread (for files much larger than
+ * memory), and output can be paced to the sample rate of the data.
+ * SigMF captures can be read from a given time onwards.
  */
 
 #ifndef PHY_FILERAWREADERCOMPONENT_H_
 #define PHY_FILERAWREADERCOMPONENT_H_
 
 #include <fstream>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "irisapi/PhyComponent.h"
+#include "utility/SigmfMetadata.h"
 
 namespace iris
 {
@@ -48,30 +58,84 @@ namespace phy
  * The FileRawReaderComponent reads raw data from a named file
  * and interprets it as a given data type. The size of blocks
  * to read and the data endianness can be specified using parameters.
+ * The file is read repeatedly, starting again at the beginning
+ * when the end is reached.
+ *
+ * If format is "sigmf", the data type, endianness and sample rate are
+ * taken from the SigMF metadata file alongside the data file, and the
+ * output is timestamped from its capture segments. Reading can start
+ * at a given seektime, found with a binary search of the segments.
  */
 class FileRawReaderComponent
   : public PhyComponent
 {
  public:
   FileRawReaderComponent(std::string name);
+  ~FileRawReaderComponent();
   virtual void calculateOutputTypes(
         std::map<std::string, int>& inputTypes,
         std::map<std::string, int>& outputTypes);
   virtual void registerPorts();
   virtual void initialize();
+  virtual void start();
   virtual void process();
+  virtual void stop();
 
  private:
   /// Template function used to read the data
   template<typename T> void readBlock();
 
+  void loadMetadata();
+  std::size_t elementSize() const;
+  void readBytes(char* out, std::size_t bytes);
+  void readStream(char* out, std::size_t bytes);
+  void readMapped(char* out, std::size_t bytes);
+  void readDirect(char* out, std::size_t bytes);
+  void directReaderLoop(uint64_t offset);
+  void stopDirectReader();
+  void closeFile();
+  void pace(std::size_t numElements);
+
   int blockSize_x;          ///< Size of blocks to read from file
   std::string fileName_x;   ///< Name of file to read
   std::string dataType_x;   ///< Interpret the data as this data type
   std::string endian_x;     ///< Endianness of the data
   uint32_t delay_x;         ///< Time to wait between blocks.
+  std::string mode_x;       ///< How to read the file (stream|mmap|direct)
+  std::string pacing_x;     ///< How to pace output (delay|rate|none)
+  double sampleRate_x;      ///< Sample rate of the data (0 = unknown)
+  std::string format_x;     ///< File format (raw|sigmf)
+  double seekTime_x;        ///< Time to start reading from (< 0 = start of file)
 
+  std::string mode_;        ///< Mode in use, after any fallback
   std::ifstream hInFile_;   ///< The file stream
+  uint64_t fileSize_;       ///< Size of the file in bytes
+  uint64_t elementsRead_;   ///< Elements output since start, for timestamps
+  SigmfMetadata meta_;      ///< Metadata, if reading a SigMF capture
+  std::string endian_;      ///< Endianness of the data in use
+  double sampleRate_;       ///< Sample rate in use
+  uint64_t startElement_;   ///< Element reading started at
+  uint64_t elementPos_;     ///< Index of the next element in the file
+
+  char* mapped_;            ///< The whole file, if memory mapped
+  uint64_t mappedPos_;      ///< Read position in the mapping
+
+  static const std::size_t directChunkSize = 4 << 20;  ///< Bytes per O_DIRECT read
+  int fd_;                          ///< File descriptor for O_DIRECT reads
+  char* chunks_[2];                 ///< Aligned buffers, filled alternately
+  std::size_t chunkBytes_[2];       ///< Valid bytes in each buffer
+  bool chunkFull_[2];               ///< Is each buffer ready to be consumed?
+  int currentChunk_;                ///< Buffer being consumed
+  std::size_t chunkPos_;            ///< Read position in current buffer
+  uint64_t directPos_;              ///< File offset of the next byte to consume
+  bool stopReader_;                 ///< Tells the reader thread to exit
+  std::string readerError_;         ///< Set by the reader thread on failure
+  boost::thread readerThread_;
+  boost::mutex chunkMutex_;
+  boost::condition_variable chunkCond_;
+
+  boost::posix_time::ptime paceStart_;  ///< Start of the current paced run
+  uint64_t paceElements_;               ///< Elements output since paceStart_
 };
 
 } // namespace phy
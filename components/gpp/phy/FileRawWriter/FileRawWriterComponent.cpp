@@ -33,12 +33,23 @@
 
 #include "FileRawWriterComponent.h"
 
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
 #include "irisapi/TypeVectors.h"
-#include "utility/RawFileUtility.h"
+#include "utility/EndianConversion.h"
 
 using namespace std;
+namespace bpt = boost::posix_time;
 
 namespace iris
 {
@@ -53,7 +64,18 @@ FileRawWriterComponent::FileRawWriterComponent(string name)
                 "filerawwriter",
                 "A filewriter",
                 "Paul Sutton",
-                "0.1")
+                "0.1"),
+  swap_(false),
+  bufferSize_(0),
+  current_(NULL),
+  currentBytes_(0),
+  fileBytes_(0),
+  stopIo_(false),
+  syncsQueued_(0),
+  syncsDone_(0),
+  fd_(-1),
+  fileIndex_(0),
+  fdDirect_(false)
 {
   /*
    * format:
@@ -74,6 +96,62 @@ FileRawWriterComponent::FileRawWriterComponent(string name)
                     "native",
                     false,
                     endian_x);
+  registerParameter("buffersize",
+                    "Size of each staging buffer in bytes",
+                    "4194304",
+                    false,
+                    bufferSize_x,
+                    Interval<unsigned int>(4096, 1<<30));
+  registerParameter("numbuffers",
+                    "Number of staging buffers",
+                    "4",
+                    false,
+                    numBuffers_x,
+                    Interval<unsigned int>(2, 1024));
+  registerParameter("direct",
+                    "Write with O_DIRECT, bypassing the page cache (Linux only)",
+                    "false",
+                    false,
+                    direct_x);
+  registerParameter("preallocate",
+                    "Bytes of disk space to preallocate for each file (0 = none)",
+                    "0",
+                    false,
+                    preallocate_x);
+  registerParameter("rotatesize",
+                    "Start a new file after this many bytes (0 = never)",
+                    "0",
+                    false,
+                    rotateSize_x);
+  registerParameter("rotatetime",
+                    "Start a new file after this many seconds (0 = never)",
+                    "0",
+                    false,
+                    rotateTime_x);
+
+  list<string> allowedFormats;
+  allowedFormats.push_back("raw");
+  allowedFormats.push_back("sigmf");
+  registerParameter("format",
+                    "File format: raw (data only) or sigmf (data and SigMF "
+                    "metadata with a time index)",
+                    "raw",
+                    false,
+                    format_x,
+                    allowedFormats);
+  registerParameter("frequency",
+                    "Centre frequency of the data, recorded in SigMF metadata "
+                    "(0 = unknown)",
+                    "0",
+                    false,
+                    frequency_x);
+  registerParameter("indexinterval",
+                    "Maximum seconds between SigMF capture segments, which "
+                    "index the file by time",
+                    "1.0",
+                    false,
+                    indexInterval_x,
+                    Interval<double>(0.001, 1e6));
 }
 
 void FileRawWriterComponent::registerPorts()
@@ -97,12 +175,37 @@ void FileRawWriterComponent::calculateOutputTypes(
 
 void FileRawWriterComponent::initialize()
 {
-  hOutFile_.open(fileName_x.c_str(), ios::out|ios::binary);
-  if (hOutFile_.fail() || hOutFile_.bad() || !hOutFile_.is_open())
+  shutdown();
+
+#ifdef BOOST_BIG_ENDIAN
+  swap_ = (endian_x == "little");
+#else
+  swap_ = (endian_x == "big");
+#endif
+
+  //Buffers are whole blocks, aligned for O_DIRECT
+  bufferSize_ = (bufferSize_x+4095) & ~(size_t)4095;
+  for(unsigned i=0; i<numBuffers_x; i++)
   {
-    cout << "Could not open file " << fileName_x << " for writing." << endl;
-    //TODO: Throw an exception
+    void* p = NULL;
+    if(posix_memalign(&p, 4096, bufferSize_) != 0)
+      throw IrisException("Failed to allocate file staging buffers.");
+    buffers_.push_back((char*)p);
+    freeBuffers_.push_back((char*)p);
   }
+
+  fileIndex_ = 0;
+  fileBytes_ = 0;
+  meta_ = SigmfMetadata();
+  if(!openFile())
+  {
+    LOG(LFATAL) << ioError_;
+    throw ResourceNotFoundException(ioError_);
+  }
+
+  stopIo_ = false;
+  syncsQueued_ = syncsDone_ = 0;
+  ioThread_ = boost::thread(&FileRawWriterComponent::ioLoop, this);
 }
 
 void FileRawWriterComponent::process()
@@ -164,22 +267,389 @@ void FileRawWriterComponent::process()
 template<typename T>
 void FileRawWriterComponent::writeBlock()
 {
+  checkIoError();
+
   //Get the input buffer
   ReadBuffer< T >* inBuf = castToType<T>(inputBuffers[0]);
   DataSet<T>* readDataSet = NULL;
   inBuf->getReadData(readDataSet);
 
-  //Write to file
-  RawFileUtility::write(readDataSet->data.begin(), readDataSet->data.end(),
-                        hOutFile_, endian_x);
+  boost::mutex::scoped_lock stageLock(stageMutex_);
+  if(rotateTime_x > 0 && fileBytes_ > 0 &&
+     bpt::microsec_clock::universal_time()-fileStart_ >=
+       bpt::microseconds((boost::int64_t)(rotateTime_x*1e6)))
+  {
+    submit(true);
+  }
+
+  //Stage the data, starting new files at whole elements if rotating by size
+  const char* data = reinterpret_cast<const char*>(&readDataSet->data[0]);
+  size_t bytes = readDataSet->data.size()*sizeof(T);
+  uint64_t perFile = max((uint64_t)sizeof(T), (rotateSize_x/sizeof(T))*sizeof(T));
+  while(bytes > 0)
+  {
+    size_t n = bytes;
+    if(rotateSize_x > 0)
+      n = min((uint64_t)n, perFile-fileBytes_);
+    if(format_x == "sigmf")
+      index(readDataSet, readDataSet->data.size()*sizeof(T)-bytes, n);
+    stage(data, n, swap_word_size<T>::value);
+    data += n;
+    bytes -= n;
+    if(rotateSize_x > 0 && fileBytes_ == perFile)
+      submit(true);
+  }
+  stageLock.unlock();
 
   //Release data set
   inBuf->releaseReadData(readDataSet);
 }
 
+/// Add bytes of data, starting at offset within a DataSet, to the metadata.
+template<typename T>
+void FileRawWriterComponent::index(DataSet<T>* data, size_t offset,
+                                   size_t bytes)
+{
+  if(meta_.datatype.empty())
+  {
+#ifdef BOOST_BIG_ENDIAN
+    bool bigEndian = !swap_;
+#else
+    bool bigEndian = swap_;
+#endif
+    meta_.datatype = SigmfMetadata::toSigmfType(TypeInfo<T>::name(), bigEndian);
+    if(meta_.datatype.empty())
+      throw IrisException("Data type " + TypeInfo<T>::name() +
+                          " can't be written as SigMF.");
+    meta_.frequency = frequency_x;
+  }
+
+  double timeStamp = data->timeStamp;
+  if(data->sampleRate > 0)
+    timeStamp += (offset/sizeof(T))/data->sampleRate;
+  meta_.addData(fileBytes_/sizeof(T), bytes/sizeof(T), timeStamp,
+                data->sampleRate, indexInterval_x);
+}
+
+/// Copy (and byte swap) data into the staging buffers.
+void FileRawWriterComponent::stage(const char* data, size_t bytes, size_t wordSize)
+{
+  if(fileBytes_ == 0)
+    fileStart_ = bpt::microsec_clock::universal_time();
+
+  while(bytes > 0)
+  {
+    if(current_ == NULL)
+    {
+      boost::mutex::scoped_lock lock(ioMutex_);
+      while(freeBuffers_.empty())
+        bufferFreed_.wait(lock);
+      current_ = freeBuffers_.front();
+      freeBuffers_.pop_front();
+    }
+
+    //Buffer and rotation sizes are whole words, so words are never split
+    size_t n = min(bytes, bufferSize_-currentBytes_);
+    if(swap_)
+      swap_bytes_block(data, current_+currentBytes_, n/wordSize, wordSize);
+    else
+      memcpy(current_+currentBytes_, data, n);
+    data += n;
+    bytes -= n;
+    currentBytes_ += n;
+    fileBytes_ += n;
+
+    if(currentBytes_ == bufferSize_)
+      submit(false);
+  }
+}
+
+/// Queue the current buffer for writing.
+void FileRawWriterComponent::submit(bool endOfFile, bool sync)
+{
+  if(current_ == NULL && !endOfFile && !sync)
+    return;
+
+  Job job = {current_, currentBytes_, endOfFile, sync, ""};
+  if((endOfFile || sync) && !meta_.captures.empty())
+  {
+    stringstream ss;
+    meta_.write(ss);
+    job.meta = ss.str();
+  }
+  if(endOfFile)
+  {
+    meta_.captures.clear();
+    meta_.sampleRate = 0;
+  }
+  {
+    boost::mutex::scoped_lock lock(ioMutex_);
+    jobs_.push_back(job);
+    if(sync)
+      syncsQueued_++;
+  }
+  jobQueued_.notify_one();
+
+  current_ = NULL;
+  currentBytes_ = 0;
+  if(endOfFile)
+    fileBytes_ = 0;
+}
+
+void FileRawWriterComponent::checkIoError()
+{
+  boost::mutex::scoped_lock lock(ioMutex_);
+  if(!ioError_.empty())
+    throw IrisException(ioError_);
+}
+
+/// Writes queued buffers until told to stop and the queue is empty.
+void FileRawWriterComponent::ioLoop()
+{
+  while(true)
+  {
+    Job job;
+    {
+      boost::mutex::scoped_lock lock(ioMutex_);
+      while(jobs_.empty() && !stopIo_)
+      {
+        if(rotateTime_x <= 0)
+        {
+          jobQueued_.wait(lock);
+          continue;
+        }
+        lock.unlock();
+        bpt::time_duration wait = checkRotateTime();
+        lock.lock();
+        if(jobs_.empty() && !stopIo_)
+          jobQueued_.timed_wait(lock, wait);
+      }
+      if(jobs_.empty())
+        return;
+      job = jobs_.front();
+      jobs_.pop_front();
+    }
+
+    //After an error, keep recycling buffers so the component doesn't block
+    bool failed;
+    {
+      boost::mutex::scoped_lock lock(ioMutex_);
+      failed = !ioError_.empty();
+    }
+    if(!failed)
+      writeJob(job);
+
+    {
+      boost::mutex::scoped_lock lock(ioMutex_);
+      if(job.data != NULL)
+        freeBuffers_.push_back(job.data);
+      if(job.sync)
+        syncsDone_++;
+    }
+    bufferFreed_.notify_all();
+  }
+}
+
+/** Start a new file if the current one is older than rotatetime.
+ *
+ * Called by the I/O thread while it is idle, so that files rotate on time
+ * even when no data is arriving. If the component thread is staging data,
+ * it checks the time itself.
+ *
+ * @return How long to wait before checking again.
+ */
+bpt::time_duration FileRawWriterComponent::checkRotateTime()
+{
+  bpt::time_duration period = bpt::microseconds((boost::int64_t)(rotateTime_x*1e6));
+  boost::mutex::scoped_lock stageLock(stageMutex_, boost::try_to_lock);
+  if(!stageLock.owns_lock() || fileBytes_ == 0)
+    return period;
+
+  bpt::time_duration age = bpt::microsec_clock::universal_time()-fileStart_;
+  if(age < period)
+    return period-age;
+  submit(true);
+  return period;
+}
+
+bool FileRawWriterComponent::writeJob(const Job& job)
+{
+  if(fd_ < 0 && job.bytes > 0 && !openFile())
+    return false;
+
+  size_t done = 0;
+  while(done < job.bytes)
+  {
+    size_t n = job.bytes-done;
+#ifdef __linux__
+    if(fdDirect_ && n % 4096 != 0)
+    {
+      //O_DIRECT needs whole blocks - write the last part through the cache
+      n &= ~(size_t)4095;
+      if(n == 0)
+      {
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+        fdDirect_ = false;
+        continue;
+      }
+    }
+#endif
+    ssize_t r = ::write(fd_, job.data+done, n);
+    if(r < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      boost::mutex::scoped_lock lock(ioMutex_);
+      ioError_ = "Failed to write to " + currentFileName() + ": " + strerror(errno);
+      return false;
+    }
+    done += r;
+  }
+
+  if(!job.meta.empty() && !writeMeta(job.meta))
+    return false;
+
+  if(job.sync && fd_ >= 0 && fsync(fd_) < 0)
+  {
+    boost::mutex::scoped_lock lock(ioMutex_);
+    ioError_ = "Failed to flush " + currentFileName() + ": " + strerror(errno);
+    return false;
+  }
+
+  if(job.endOfFile)
+  {
+    closeFile();
+    fileIndex_++;
+  }
+  return true;
+}
+
+/// Write the SigMF metadata for the current file.
+bool FileRawWriterComponent::writeMeta(const string& meta)
+{
+  string name = SigmfMetadata::metaFileName(currentFileName());
+  ofstream out(name.c_str());
+  out << meta;
+  out.close();
+  if(out.fail())
+  {
+    boost::mutex::scoped_lock lock(ioMutex_);
+    ioError_ = "Failed to write SigMF metadata to " + name;
+    return false;
+  }
+  return true;
+}
+
+bool FileRawWriterComponent::openFile()
+{
+  string name = currentFileName();
+  int flags = O_WRONLY|O_CREAT|O_TRUNC;
+  fdDirect_ = false;
+#ifdef __linux__
+  if(direct_x)
+  {
+    fd_ = open(name.c_str(), flags|O_DIRECT, 0644);
+    if(fd_ >= 0)
+      fdDirect_ = true;
+    else
+      LOG(LWARNING) << "Could not open " << name << " for direct writes ("
+                    << strerror(errno) << ") - writing through the page cache";
+  }
+#endif
+  if(fd_ < 0)
+    fd_ = open(name.c_str(), flags, 0644);
+  if(fd_ < 0)
+  {
+    boost::mutex::scoped_lock lock(ioMutex_);
+    ioError_ = "Could not open file " + name + " for writing.";
+    return false;
+  }
+
+#ifdef __linux__
+  //Reserve space without changing the file size, so it is right if we stop early
+  if(preallocate_x > 0 &&
+     fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, preallocate_x) < 0)
+  {
+    LOG(LWARNING) << "Could not preallocate " << name << ": " << strerror(errno);
+  }
+#endif
+  return true;
+}
+
+void FileRawWriterComponent::closeFile()
+{
+  if(fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+}
+
+/// Write out everything staged so far and flush the file to disk.
+void FileRawWriterComponent::stop()
+{
+  if(!ioThread_.joinable())
+    return;
+
+  {
+    boost::mutex::scoped_lock stageLock(stageMutex_);
+    submit(false, true);
+  }
+
+  boost::mutex::scoped_lock lock(ioMutex_);
+  while(syncsDone_ != syncsQueued_)
+    bufferFreed_.wait(lock);
+  if(!ioError_.empty())
+    LOG(LERROR) << ioError_;
+}
+
+/// Flush all staged data, stop the I/O thread and free the buffers.
+void FileRawWriterComponent::shutdown()
+{
+  if(ioThread_.joinable())
+  {
+    {
+      boost::mutex::scoped_lock stageLock(stageMutex_);
+      if(!meta_.captures.empty())
+        submit(true);
+      else if(currentBytes_ > 0)
+        submit(false);
+    }
+    {
+      boost::mutex::scoped_lock lock(ioMutex_);
+      stopIo_ = true;
+    }
+    jobQueued_.notify_all();
+    ioThread_.join();
+  }
+  closeFile();
+
+  for(size_t i=0; i<buffers_.size(); i++)
+    free(buffers_[i]);
+  buffers_.clear();
+  freeBuffers_.clear();
+  jobs_.clear();
+  current_ = NULL;
+  currentBytes_ = 0;
+  ioError_.clear();
+}
+
+string FileRawWriterComponent::currentFileName() const
+{
+  if(rotateSize_x == 0 && rotateTime_x <= 0)
+    return fileName_x;
+
+  //Insert the file number before the extension
+  size_t slash = fileName_x.find_last_of("/\\");
+  size_t dot = fileName_x.find_last_of('.');
+  if(dot == string::npos || (slash != string::npos && dot < slash))
+    dot = fileName_x.size();
+  char number[16];
+  snprintf(number, sizeof(number), "_%04d", fileIndex_);
+  return fileName_x.substr(0, dot) + number + fileName_x.substr(dot);
+}
+
 FileRawWriterComponent::~FileRawWriterComponent()
 {
-  hOutFile_.close();
+  shutdown();
 }
 
 } // namespace phy
@@ -29,14 +29,25 @@
  * \section DESCRIPTION
  *
  * Sink component to write data to file.
+ *
+ * Data is converted into large staging buffers which are written to
+ * disk by a background thread, so that slow disk writes do not hold up
+ * the engine. Output can optionally be split across a series of files,
+ * and written as a SigMF capture with a JSON metadata file.
  */
 
 #ifndef PHY_FILERAWWRITERCOMPONENT_H_
 #define PHY_FILERAWWRITERCOMPONENT_H_
 
-#include <fstream>
+#include <deque>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "irisapi/PhyComponent.h"
+#include "utility/SigmfMetadata.h"
 
 namespace iris
 {
@@ -47,6 +58,18 @@ namespace phy
  *
  * The name of the file to write and the endianness of the data can
  * be specified using parameters.
+ *
+ * If rotatesize or rotatetime is set, a new file is started whenever
+ * the current one reaches that size or age. The files are named by
+ * inserting a sequence number before the extension of filename
+ * (e.g. capture_0000.bin, capture_0001.bin, ...).
+ *
+ * If format is "sigmf", each data file gets a SigMF metadata file with
+ * the same name and the extension .sigmf-meta. This records the sample
+ * rate, centre frequency and timestamps of the data, starting a new
+ * capture segment at every timestamp discontinuity and at least every
+ * indexinterval seconds. FileRawReader uses these segments as an index
+ * to seek to a given time.
  */
 class FileRawWriterComponent: public PhyComponent
 {
@@ -59,15 +82,76 @@ class FileRawWriterComponent: public PhyComponent
   virtual void registerPorts();
   virtual void initialize();
   virtual void process();
+  virtual void stop();
 
  private:
+  /// A staging buffer queued for the I/O thread.
+  struct Job
+  {
+    char* data;           ///< The buffer.
+    std::size_t bytes;    ///< Bytes to write.
+    bool endOfFile;       ///< Close the file after writing?
+    bool sync;            ///< Flush the file to disk after writing?
+    std::string meta;     ///< SigMF metadata to write when closing or syncing the file
+  };
+
   /// template function to write data
   template<typename T> void writeBlock();
+  template<typename T> void index(DataSet<T>* data, std::size_t offset,
+                                  std::size_t bytes);
+
+  void stage(const char* data, std::size_t bytes, std::size_t wordSize);
+  void submit(bool endOfFile, bool sync = false);
+  void checkIoError();
+  void ioLoop();
+  boost::posix_time::time_duration checkRotateTime();
+  bool writeJob(const Job& job);
+  bool writeMeta(const std::string& meta);
+  bool openFile();
+  void closeFile();
+  void shutdown();
+  std::string currentFileName() const;
 
   std::string fileName_x;   ///< Name of file to write to
   std::string endian_x;     ///< Endianness of data
+  unsigned int bufferSize_x;  ///< Size of each staging buffer in bytes
+  unsigned int numBuffers_x;  ///< Number of staging buffers
+  bool direct_x;            ///< Write with O_DIRECT, bypassing the page cache?
+  uint64_t preallocate_x;   ///< Bytes to preallocate for each file (0 = none)
+  uint64_t rotateSize_x;    ///< Start a new file after this many bytes (0 = never)
+  double rotateTime_x;      ///< Start a new file after this many seconds (0 = never)
+  std::string format_x;     ///< File format (raw|sigmf)
+  double frequency_x;       ///< Centre frequency of the data, for metadata
+  double indexInterval_x;   ///< Max seconds between SigMF capture segments
+
+  bool swap_;               ///< Do we need to swap byte order?
+  std::size_t bufferSize_;  ///< Staging buffer size, rounded to the block size
+  std::vector<char*> buffers_;    ///< All staging buffers
+
+  // Staging state, also used by the I/O thread to rotate a quiet stream
+  boost::mutex stageMutex_;
+  char* current_;           ///< Buffer being filled
+  std::size_t currentBytes_;  ///< Bytes in current_
+  uint64_t fileBytes_;      ///< Bytes staged for the current file
+  boost::posix_time::ptime fileStart_;  ///< Time the current file was started
+  SigmfMetadata meta_;      ///< Metadata for the current file
+
+  // State shared with the I/O thread
+  std::deque<char*> freeBuffers_;   ///< Buffers ready to be filled
+  std::deque<Job> jobs_;            ///< Buffers waiting to be written
+  bool stopIo_;                     ///< Tells the I/O thread to exit
+  unsigned syncsQueued_;            ///< Sync jobs queued
+  unsigned syncsDone_;              ///< Sync jobs written
+  std::string ioError_;             ///< Set by the I/O thread on failure
+  boost::mutex ioMutex_;
+  boost::condition_variable jobQueued_;
+  boost::condition_variable bufferFreed_;
+  boost::thread ioThread_;
 
-  std::ofstream hOutFile_;  ///< The output file stream
+  // Owned by the I/O thread once started
+  int fd_;                  ///< Current file
+  int fileIndex_;           ///< Sequence number of current file
+  bool fdDirect_;           ///< Is fd_ open with O_DIRECT?
 };
 
 } // namespace phy
@@ -40,7 +40,6 @@
 
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
-#include "modulation/OfdmIndexGenerator.h"
 #include "modulation/Crc.h"
 #include "modulation/Whitener.h"
 #include "utility/RawFileUtility.h"
@@ -62,21 +61,18 @@ OfdmDemodulatorComponent::OfdmDemodulatorComponent(std::string name)
                 "An OFDM demodulation component", // description
                 "Paul Sutton",                    // author
                 "1.0")                            // version
+    ,symbolLength_(0)
     ,numHeaderBytes_(7)
+    ,maxFrameSymbols_(32)
     ,frameDetected_(false)
     ,haveHeader_(false)
-    ,symbolLength_(0)
-    ,rxNumBytes_(0)
-    ,rxNumSymbols_(0)
     ,headerIndex_(0)
     ,frameIndex_(0)
-    ,halfFft_(NULL)
-    ,halfFftData_(NULL)
-    ,fullFft_(NULL)
-    ,fullFftData_(NULL)
     ,numRxFrames_(0)
     ,numRxFails_(0)
-    ,symbolCount_(0)
+    ,halfFftData_(NULL)
+    ,halfFft_(NULL)
+    ,current_(NULL)
 {
   registerParameter(
     "debug", "Whether to write debug data to file.",
@@ -106,6 +102,10 @@ OfdmDemodulatorComponent::OfdmDemodulatorComponent(std::string name)
     "threshold", "Frame detection threshold",
     "0.827", true, threshold_x, Interval<float>(0.0,1.0));
 
+  registerParameter(
+    "numworkers", "Number of worker threads used to demodulate frames (0 = none)",
+    "0", false, numWorkers_x, Interval<int>(0,64));
+
   // Create our pilot sequence
   typedef Cplx c;
   c seq[] = {c(1,0),c(1,0),c(-1,0),c(-1,0),c(-1,0),c(1,0),c(-1,0),c(1,0),};
@@ -135,6 +135,11 @@ void OfdmDemodulatorComponent::initialize()
   setup();
 }
 
+void OfdmDemodulatorComponent::start()
+{
+  startWorkers();
+}
+
 void OfdmDemodulatorComponent::process()
 {
   getInputDataSet("input1", in_);
@@ -156,14 +161,12 @@ void OfdmDemodulatorComponent::process()
   catch(IrisException& e)
   {
     LOG(LWARNING) << e.what();
-    headerIndex_ = 0;
-    frameIndex_ = 0;
-    frameDetected_ = false;
-    haveHeader_ = false;
+    abortFrame();
     numRxFails_++;
   }
 
   releaseInputDataSet("input1", in_);
+  releaseFrames(false);
 
   if(numRxFrames_ >= reportRate_x)
   {
@@ -174,13 +177,25 @@ void OfdmDemodulatorComponent::process()
   }
 }
 
+void OfdmDemodulatorComponent::stop()
+{
+  stopWorkers();
+  releaseFrames(false);
+}
+
 void OfdmDemodulatorComponent::parameterHasChanged(std::string name)
 {
   if(name == "numdatacarriers" || name == "numpilotcarriers" ||
      name == "numguardcarriers" || name == "cyclicprefixlength")
   {
+    // Output the frames demodulated with the old settings first
+    bool running = (workers_.get() != NULL);
+    stopWorkers();
+    releaseFrames(false);
     destroy();
     setup();
+    if(running)
+      startWorkers();
   }
 
   if(name == "threshold")
@@ -189,16 +204,8 @@ void OfdmDemodulatorComponent::parameterHasChanged(std::string name)
 
 void OfdmDemodulatorComponent::setup()
 {
-  // Set up index vectors
-  pilotIndices_.clear();
-  pilotIndices_.resize(numPilotCarriers_x);
-  dataIndices_.clear();
-  dataIndices_.resize(numDataCarriers_x);
-  OfdmIndexGenerator::generateIndices(numDataCarriers_x,
-                                      numPilotCarriers_x,
-                                      numGuardCarriers_x,
-                                      pilotIndices_.begin(), pilotIndices_.end(),
-                                      dataIndices_.begin(), dataIndices_.end());
+  // Set up carrier layout
+  layout_.generate(numDataCarriers_x, numPilotCarriers_x, numGuardCarriers_x);
 
   numBins_ = numDataCarriers_x + numPilotCarriers_x + numGuardCarriers_x + 1;
   symbolLength_ = numBins_ + cyclicPrefixLength_x;
@@ -221,19 +228,56 @@ void OfdmDemodulatorComponent::setup()
   halfFftData_ = reinterpret_cast<Cplx*>(
       fftwf_malloc(sizeof(fftwf_complex) * numBins_/2));
   fill(&halfFftData_[0], &halfFftData_[numBins_/2], Cplx(0,0));
-  fullFftData_ = reinterpret_cast<Cplx*>(
-      fftwf_malloc(sizeof(fftwf_complex) * numBins_));
-  fill(&fullFftData_[0], &fullFftData_[numBins_], Cplx(0,0));
   halfFft_ = fftwf_plan_dft_1d(numBins_/2,
                                (fftwf_complex*)halfFftData_,
                                (fftwf_complex*)halfFftData_,
                                FFTW_FORWARD,
                                FFTW_MEASURE);
-  fullFft_ = fftwf_plan_dft_1d(numBins_,
-                               (fftwf_complex*)fullFftData_,
-                               (fftwf_complex*)fullFftData_,
-                               FFTW_FORWARD,
-                               FFTW_MEASURE);
+
+  // Each worker needs a frame to demodulate while the component thread
+  // receives into another, so keep two per worker.
+  int maxSymbols = max(maxFrameSymbols_, numHeaderSymbols_);
+  int numFrames = max(1, 2*numWorkers_x);
+  frames_.resize(numFrames);
+  freeFrames_.set_capacity(numFrames);
+  queuedFrames_.set_capacity(numFrames);
+  activeFrames_.set_capacity(numFrames);
+  freeFrames_.clear();
+  queuedFrames_.clear();
+  activeFrames_.clear();
+  for(int i=0; i<numFrames; i++)
+  {
+    RxFrame& f = frames_[i];
+    f.samples.assign(symbolLength_*maxSymbols, Cplx(0,0));
+    f.corrector.resize(symbolLength_);
+    f.rotatedPilotIndices.resize(numPilotCarriers_x);
+    f.dataRuns.reserve(layout_.maxRotatedRuns());
+    f.pilotEqualizer.resize(numPilotCarriers_x);
+    f.dataEqualizer.resize(numDataCarriers_x);
+    f.qamSymbols.resize(numDataCarriers_x*maxSymbols);
+    f.data.resize(maxFrameSymbols_*(numDataCarriers_x*QAM16)/8);
+    f.bins = reinterpret_cast<Cplx*>(
+        fftwf_malloc(sizeof(fftwf_complex) * numBins_*maxSymbols));
+    fill(&f.bins[0], &f.bins[numBins_*maxSymbols], Cplx(0,0));
+    freeFrames_.push_back(&f);
+  }
+  current_ = NULL;
+
+  // Header and frame symbols are transformed directly from their containers,
+  // using one plan per symbol count. Plans are unaligned as the fft input
+  // starts part-way into the cyclic prefix of each symbol.
+  int off = cyclicPrefixLength_x-4;
+  frameFfts_.resize(maxSymbols);
+  for(int i=0; i<maxSymbols; i++)
+  {
+    frameFfts_[i] = fftwf_plan_many_dft(1, &numBins_, i+1,
+                                        (fftwf_complex*)&frames_[0].samples[off],
+                                        NULL, 1, symbolLength_,
+                                        (fftwf_complex*)frames_[0].bins,
+                                        NULL, 1, numBins_,
+                                        FFTW_FORWARD,
+                                        FFTW_MEASURE | FFTW_UNALIGNED);
+  }
 
   copy(preamble_.begin(), preamble_.begin()+numBins_/2, halfFftData_);
   fftwf_execute(halfFft_);
@@ -246,24 +290,103 @@ void OfdmDemodulatorComponent::setup()
     RawFileUtility::write(preambleBins_.begin(), preambleBins_.end(),
                           "OutputData/TxPreambleBins");
 
+  // Magnitudes of the known preamble bins, repeated for offset correlation
+  magPreambleBins_.resize(numBins_);
+  transform(preambleBins_.begin(), preambleBins_.end(),
+            magPreambleBins_.begin(), opAbs());
+  FloatVecIt magIt = magPreambleBins_.begin();
+  copy(magIt, magIt+(numBins_/2), magIt+(numBins_/2));
+
+  // Size all scratch containers here so process() doesn't allocate
   rxPreamble_.resize(symbolLength_);
-  corrector_.resize(symbolLength_);
+  rxPreambleBins_.resize(numBins_/2);
+  magRxBins_.resize(numBins_/2);
+  correlations_.resize(33);
+  shortEqualizer_.resize(numBins_/2);
   rxHeader_.resize(symbolLength_*numHeaderSymbols_);
+  headerData_.resize(numHeaderSymbols_*(numDataCarriers_x/8));
   equalizer_.resize(numBins_);
 
   detector_.reset(numBins_,cyclicPrefixLength_x,threshold_x);
+  headerIndex_ = 0;
+  frameIndex_ = 0;
+  frameDetected_ = false;
+  haveHeader_ = false;
 }
 
 void OfdmDemodulatorComponent::destroy()
 {
+  stopWorkers();
   if(halfFft_ != NULL)
     fftwf_destroy_plan(halfFft_);
-  if(fullFft_ != NULL)
-    fftwf_destroy_plan(fullFft_);
+  for(int i=0; i<frameFfts_.size(); i++)
+    fftwf_destroy_plan(frameFfts_[i]);
+  frameFfts_.clear();
   if(halfFftData_ != NULL)
     fftwf_free(halfFftData_);
-  if(fullFftData_ != NULL)
-    fftwf_free(fullFftData_);
+  for(int i=0; i<frames_.size(); i++)
+    fftwf_free(frames_[i].bins);
+  frames_.clear();
+}
+
+void OfdmDemodulatorComponent::startWorkers()
+{
+  if(numWorkers_x == 0 || workers_)
+    return;
+
+  workers_.reset(new boost::thread_group);
+  for(int i=0; i<numWorkers_x; i++)
+    workers_->create_thread(
+        boost::bind(&OfdmDemodulatorComponent::workerThreadFunction, this));
+}
+
+void OfdmDemodulatorComponent::stopWorkers()
+{
+  if(!workers_)
+    return;
+
+  workers_->interrupt_all();
+  workers_->join_all();
+  workers_.reset();
+
+  // Finish any frames which didn't reach a worker
+  while(!queuedFrames_.empty())
+  {
+    RxFrame* frame = queuedFrames_.front();
+    queuedFrames_.pop_front();
+    runFrame(*frame);
+    frame->done = true;
+  }
+}
+
+void OfdmDemodulatorComponent::workerThreadFunction()
+{
+  try
+  {
+    while(true)
+    {
+      RxFrame* frame;
+      {
+        boost::mutex::scoped_lock lock(frameMutex_);
+        while(queuedFrames_.empty())
+          frameQueued_.wait(lock);
+        frame = queuedFrames_.front();
+        queuedFrames_.pop_front();
+      }
+
+      runFrame(*frame);
+
+      {
+        boost::mutex::scoped_lock lock(frameMutex_);
+        frame->done = true;
+      }
+      frameDone_.notify_all();
+    }
+  }
+  catch(boost::thread_interrupted&)
+  {
+    // Worker stopped
+  }
 }
 
 OfdmDemodulatorComponent::CplxVecIt
@@ -276,7 +399,9 @@ OfdmDemodulatorComponent::searchInput(CplxVecIt begin, CplxVecIt end)
   if(frameDetected_)
   {
     int idx = (it-in_->data.begin()) - (numBins_+cyclicPrefixLength_x);
-    timeStamp_ = timeStamp_ + (idx/sampleRate_);
+    current_ = acquireFrame();
+    current_->timeStamp = timeStamp_ + (idx/sampleRate_);
+    current_->sampleRate = sampleRate_;
     extractPreamble();
   }
   return it;
@@ -295,10 +420,15 @@ OfdmDemodulatorComponent::processFrame(CplxVecIt begin, CplxVecIt end)
     }
     else
     {
-      rxFrame_[frameIndex_++] = *begin;
-      if(frameIndex_ == symbolLength_*rxNumSymbols_)
+      current_->samples[frameIndex_++] = *begin;
+      if(frameIndex_ == symbolLength_*current_->numSymbols)
       {
-        demodFrame();
+        dispatchFrame(current_);
+        current_ = NULL;
+        headerIndex_ = 0;
+        frameIndex_ = 0;
+        frameDetected_ = false;
+        haveHeader_ = false;
         return ++begin;
       }
     }
@@ -306,10 +436,120 @@ OfdmDemodulatorComponent::processFrame(CplxVecIt begin, CplxVecIt end)
   return begin;
 }
 
+OfdmDemodulatorComponent::RxFrame* OfdmDemodulatorComponent::acquireFrame()
+{
+  {
+    boost::mutex::scoped_lock lock(frameMutex_);
+    if(!freeFrames_.empty())
+    {
+      RxFrame* frame = freeFrames_.front();
+      freeFrames_.pop_front();
+      return frame;
+    }
+  }
+
+  // All frames are in flight - wait for the oldest one
+  releaseFrames(true);
+  boost::mutex::scoped_lock lock(frameMutex_);
+  RxFrame* frame = freeFrames_.front();
+  freeFrames_.pop_front();
+  return frame;
+}
+
+void OfdmDemodulatorComponent::abortFrame()
+{
+  if(current_ != NULL)
+  {
+    boost::mutex::scoped_lock lock(frameMutex_);
+    freeFrames_.push_back(current_);
+    current_ = NULL;
+  }
+  headerIndex_ = 0;
+  frameIndex_ = 0;
+  frameDetected_ = false;
+  haveHeader_ = false;
+}
+
+void OfdmDemodulatorComponent::dispatchFrame(RxFrame* frame)
+{
+  frame->done = false;
+  if(!workers_)
+  {
+    runFrame(*frame);
+    frame->done = true;
+    boost::mutex::scoped_lock lock(frameMutex_);
+    activeFrames_.push_back(frame);
+    return;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(frameMutex_);
+    activeFrames_.push_back(frame);
+    queuedFrames_.push_back(frame);
+  }
+  frameQueued_.notify_one();
+}
+
+void OfdmDemodulatorComponent::releaseFrames(bool wait)
+{
+  boost::mutex::scoped_lock lock(frameMutex_);
+  while(!activeFrames_.empty())
+  {
+    RxFrame* frame = activeFrames_.front();
+    if(!frame->done)
+    {
+      if(!wait)
+        break;
+      frameDone_.wait(lock);
+      continue;
+    }
+    activeFrames_.pop_front();
+
+    // Frames are output from this thread in the order they were received
+    lock.unlock();
+    outputFrame(*frame);
+    lock.lock();
+    freeFrames_.push_back(frame);
+    wait = false;
+  }
+}
+
+void OfdmDemodulatorComponent::runFrame(RxFrame& frame)
+{
+  try
+  {
+    demodFrame(frame);
+    frame.ok = true;
+  }
+  catch(IrisException& e)
+  {
+    LOG(LWARNING) << e.what();
+    frame.ok = false;
+  }
+}
+
+void OfdmDemodulatorComponent::outputFrame(RxFrame& frame)
+{
+  if(!frame.ok)
+  {
+    numRxFails_++;
+    return;
+  }
+
+  DataSet< uint8_t>* out;
+  getOutputDataSet("output1", out, frame.numBytes);
+  out->sampleRate = frame.sampleRate;
+  out->timeStamp = frame.timeStamp;
+  copy(frame.data.begin(), frame.data.begin()+frame.numBytes,
+       out->data.begin());
+  releaseOutputDataSet("output1", out);
+}
+
 void OfdmDemodulatorComponent::extractPreamble()
 {
-  generateFractionalOffsetCorrector(fracFreqOffset_);
-  correctFractionalOffset(rxPreamble_.begin(), rxPreamble_.end());
+  RxFrame& frame = *current_;
+  generateFractionalOffsetCorrector(frame, fracFreqOffset_);
+  correctFractionalOffset(frame, rxPreamble_.begin(), rxPreamble_.end());
 
   int off = cyclicPrefixLength_x-4;
   CplxVecIt begin = rxPreamble_.begin() + off;
@@ -319,7 +559,7 @@ void OfdmDemodulatorComponent::extractPreamble()
     RawFileUtility::write(begin, end, "OutputData/RxPreamble");
 
   int halfBins = numBins_/2;
-  CplxVec bins(halfBins);
+  CplxVec& bins = rxPreambleBins_;
   copy(begin, end, halfFftData_);
   fftwf_execute(halfFft_);
   copy(halfFftData_, halfFftData_+halfBins, bins.begin());
@@ -338,194 +578,142 @@ void OfdmDemodulatorComponent::extractPreamble()
                           "OutputData/RxPreambleHalfBinsRotated");
 
   generateEqualizer(bins.begin(), bins.end());
+  generateCarrierMaps(frame);
 }
 
 void OfdmDemodulatorComponent::extractHeader()
 {
-  symbolCount_ = 0;
+  RxFrame& frame = *current_;
+  frame.symbolCount = 0;
   numRxFrames_++;
   int bytesPerHeader = numDataCarriers_x/8;
-  ByteVec data(numHeaderSymbols_*bytesPerHeader);
-  ByteVecIt dataIt = data.begin();
-  CplxVecIt symIt = rxHeader_.begin();
-  for(int i=0; i<numHeaderSymbols_; i++)
-  {
-    demodSymbol(symIt, symIt+symbolLength_,
-                dataIt, dataIt+bytesPerHeader, BPSK);
-    symIt += symbolLength_;
-    dataIt += numDataCarriers_x/8;
-    symbolCount_++;
-  }
+  ByteVec& data = headerData_;
+  demodSymbols(frame, rxHeader_.begin(), numHeaderSymbols_,
+               data.begin(), bytesPerHeader, BPSK);
 
   Whitener::whiten(data.begin(), data.end());
 
-  rxCrc_ = 0;
-  rxCrc_ = data[3];
-  rxCrc_ |= (data[2] << 8);
-  rxCrc_ |= (data[1] << 16);
-  rxCrc_ |= (data[0] << 24);
+  frame.crc = 0;
+  frame.crc = data[3];
+  frame.crc |= (data[2] << 8);
+  frame.crc |= (data[1] << 16);
+  frame.crc |= (data[0] << 24);
 
-  rxModulation_ = data[6] & 0xFF;
-  if(rxModulation_!=BPSK && rxModulation_!=QPSK && rxModulation_!=QAM16)
+  frame.modulation = data[6] & 0xFF;
+  if(frame.modulation!=BPSK && frame.modulation!=QPSK && frame.modulation!=QAM16)
     throw IrisException("Invalid modulation depth - dropping frame.");
 
-  rxNumBytes_ = ((data[4]<<8) | data[5]) & 0xFFFF;
-  int bytesPerSymbol = (numDataCarriers_x*rxModulation_)/8;
-  rxNumSymbols_ = ceil(rxNumBytes_/(float)bytesPerSymbol);
-  if(rxNumSymbols_>32 || rxNumSymbols_<1)
+  frame.numBytes = ((data[4]<<8) | data[5]) & 0xFFFF;
+  int bytesPerSymbol = (numDataCarriers_x*frame.modulation)/8;
+  frame.numSymbols = ceil(frame.numBytes/(float)bytesPerSymbol);
+  if(frame.numSymbols>maxFrameSymbols_ || frame.numSymbols<1)
     throw IrisException("Invalid frame length - dropping frame.");
 
-  rxFrame_.resize(rxNumSymbols_*symbolLength_);
   haveHeader_ = true;
 }
 
-void OfdmDemodulatorComponent::demodFrame()
+void OfdmDemodulatorComponent::demodFrame(RxFrame& frame)
 {
-  int bytesPerSymbol = (numDataCarriers_x*rxModulation_)/8;
-  int frameDataLen = (rxNumSymbols_*bytesPerSymbol);
-  frameData_.resize(frameDataLen);
-
-  CplxVecIt inIt = rxFrame_.begin();
-  ByteVecIt outIt = frameData_.begin();
-  for(int i=0;i<rxNumSymbols_;i++)
-  {
-    demodSymbol(inIt, inIt+symbolLength_,
-                outIt, outIt+bytesPerSymbol,
-                rxModulation_);
-    inIt += symbolLength_;
-    outIt += bytesPerSymbol;
-    symbolCount_++;
-  }
+  int bytesPerSymbol = (numDataCarriers_x*frame.modulation)/8;
+  demodSymbols(frame, frame.samples.begin(), frame.numSymbols,
+               frame.data.begin(), bytesPerSymbol, frame.modulation);
 
-  outIt = frameData_.begin();
-  Whitener::whiten(outIt, outIt+rxNumBytes_);
-  uint32_t crc = Crc::generate(outIt, outIt+rxNumBytes_);
-  if(crc != rxCrc_)
+  ByteVecIt outIt = frame.data.begin();
+  uint32_t crc = Whitener::whitenAndCrc(outIt, outIt+frame.numBytes);
+  if(crc != frame.crc)
     throw IrisException("CRC mismatch - dropping frame.");
-
-  DataSet< uint8_t>* out;
-  getOutputDataSet("output1", out, rxNumBytes_);
-  out->sampleRate = sampleRate_;
-  out->timeStamp = timeStamp_;
-  copy(outIt, outIt+rxNumBytes_, out->data.begin());
-  releaseOutputDataSet("output1", out);
-
-  headerIndex_ = 0;
-  frameIndex_ = 0;
-  frameDetected_ = false;
-  haveHeader_ = false;
 }
 
-void OfdmDemodulatorComponent::demodSymbol(CplxVecIt inBegin, CplxVecIt inEnd,
-                                           ByteVecIt outBegin, ByteVecIt outEnd,
-                                           int modulationDepth)
+void OfdmDemodulatorComponent::demodSymbols(RxFrame& frame,
+                                            CplxVecIt inBegin, int numSymbols,
+                                            ByteVecIt outBegin, int bytesPerSymbol,
+                                            int modulationDepth)
 {
-  correctFractionalOffset(inBegin, inEnd);
+  CplxVecIt inIt = inBegin;
+  for(int i=0; i<numSymbols; i++, inIt+=symbolLength_)
+    correctFractionalOffset(frame, inIt, inIt+symbolLength_);
 
   int off = cyclicPrefixLength_x-4;
-  CplxVecIt begin = inBegin + off;
-  CplxVecIt end = inBegin + off + numBins_;
-
-  CplxVec bins(numBins_);
-  copy(begin, end, fullFftData_);
-  fftwf_execute(fullFft_);
-  copy(fullFftData_, fullFftData_+numBins_, bins.begin());
-
-  if(debug_x)
-  {
-    stringstream fileName;
-    fileName << "OutputData//RxSymbolBins" << symbolCount_;
-    RawFileUtility::write(bins.begin(), bins.end(),
-                          fileName.str());
-  }
-
-  int shift = (numBins_-intFreqOffset_*2)%numBins_;
-  rotate(bins.begin(), bins.begin()+shift, bins.end());
+  fftwf_execute_dft(frameFfts_[numSymbols-1],
+                    (fftwf_complex*)&(*(inBegin+off)),
+                    (fftwf_complex*)frame.bins);
 
   if(debug_x)
   {
-    stringstream fileName;
-    fileName << "OutputData//RxSymbolBinsRotated" << symbolCount_;
-    RawFileUtility::write(bins.begin(), bins.end(),
-                          fileName.str());
+    for(int i=0; i<numSymbols; i++)
+    {
+      stringstream fileName;
+      fileName << "OutputData//RxSymbolBins" << frame.symbolCount+i;
+      RawFileUtility::write(frame.bins+i*numBins_, frame.bins+(i+1)*numBins_,
+                            fileName.str());
+    }
   }
 
-  equalizeSymbol(bins.begin(), bins.end());
+  equalizeSymbols(frame, numSymbols);
 
-  if(debug_x)
+  CplxVecIt qamIt = frame.qamSymbols.begin();
+  ByteVecIt outIt = outBegin;
+  for(int i=0; i<numSymbols; i++)
   {
-    stringstream fileName;
-    fileName << "OutputData//RxSymbolBinsEqualized" << symbolCount_;
-    RawFileUtility::write(bins.begin(), bins.end(),
-                          fileName.str());
-  }
-
-  CplxVec qamSymbols;
-  for(int i=0; i<numDataCarriers_x; i++)
-    qamSymbols.push_back(bins[dataIndices_[i]]);
-
+    if(debug_x)
+    {
+      stringstream fileName;
+      fileName << "OutputData//RxSymbolData" << frame.symbolCount;
+      RawFileUtility::write(qamIt, qamIt+numDataCarriers_x,
+                            fileName.str());
+    }
 
-  if(debug_x)
-  {
-    stringstream fileName;
-    fileName << "OutputData//RxSymbolData" << symbolCount_;
-    RawFileUtility::write(qamSymbols.begin(), qamSymbols.end(),
-                          fileName.str());
+    qDemod_.demodulate(qamIt, qamIt+numDataCarriers_x,
+                       outIt, outIt+bytesPerSymbol, modulationDepth);
+    qamIt += numDataCarriers_x;
+    outIt += bytesPerSymbol;
+    frame.symbolCount++;
   }
-
-  qDemod_.demodulate(qamSymbols.begin(), qamSymbols.end(),
-                     outBegin, outEnd, modulationDepth);
 }
 
-void OfdmDemodulatorComponent::generateFractionalOffsetCorrector(float offset)
+void OfdmDemodulatorComponent::generateFractionalOffsetCorrector(RxFrame& frame,
+                                                                 float offset)
 {
   float relFreq = -offset/numBins_;
-  toneGenerator_.generate(corrector_.begin(), corrector_.end(), relFreq);
+  toneGenerator_.generate(frame.corrector.begin(), frame.corrector.end(),
+                          relFreq);
 }
 
-void OfdmDemodulatorComponent::correctFractionalOffset(CplxVecIt begin,
+void OfdmDemodulatorComponent::correctFractionalOffset(RxFrame& frame,
+                                                       CplxVecIt begin,
                                                        CplxVecIt end)
 {
-  transform(begin, end, corrector_.begin(), begin, _1*_2);
+  transform(begin, end, frame.corrector.begin(), begin, _1*_2);
 }
 
 int OfdmDemodulatorComponent::findIntegerOffset(CplxVecIt begin, CplxVecIt end)
 {
-  FloatVec magRxBins(numBins_/2);
-  transform(begin, end, magRxBins.begin(), opAbs());
+  transform(begin, end, magRxBins_.begin(), opAbs());
 
-  FloatVec magTxBins(numBins_);
-  transform(preambleBins_.begin(), preambleBins_.end(),
-            magTxBins.begin(), opAbs());
-  FloatVecIt it = magTxBins.begin();
-  copy(it, it+(numBins_/2), it+(numBins_/2));
-
-  FloatVec correlations;
+  FloatVecIt corrIt = correlations_.begin();
   //Calculate negative offset correlations
-  FloatVecIt txIt = magTxBins.begin()+(numBins_/2);
+  FloatVecIt txIt = magPreambleBins_.begin()+(numBins_/2);
   for(int i=-16; i<0; i++)
   {
-    float res = inner_product(txIt+i, txIt+i+(numBins_/2),
-                              magRxBins.begin(), 0.0f);
-    correlations.push_back(res);
+    *corrIt++ = inner_product(txIt+i, txIt+i+(numBins_/2),
+                              magRxBins_.begin(), 0.0f);
   }
   //Calculate positive offset correlations
-  txIt = magTxBins.begin();
+  txIt = magPreambleBins_.begin();
   for(int i=0; i<17; i++)
   {
-    float res = inner_product(txIt+i, txIt+i+(numBins_/2),
-                              magRxBins.begin(), 0.0f);
-    correlations.push_back(res);
+    *corrIt++ = inner_product(txIt+i, txIt+i+(numBins_/2),
+                              magRxBins_.begin(), 0.0f);
   }
 
-  FloatVecIt result = max_element(correlations.begin(), correlations.end());
-  int off =  (int)distance(correlations.begin(), result) - 16;
+  FloatVecIt result = max_element(correlations_.begin(), correlations_.end());
+  int off =  (int)distance(correlations_.begin(), result) - 16;
   return off;
 }
 
 void OfdmDemodulatorComponent::generateEqualizer(CplxVecIt begin, CplxVecIt end)
 {
-  CplxVec shortEq(numBins_/2);
+  CplxVec& shortEq = shortEqualizer_;
   transform(begin, end, preambleBins_.begin(), shortEq.begin(), _2/_1);
 
   if(debug_x)
@@ -544,23 +732,50 @@ void OfdmDemodulatorComponent::generateEqualizer(CplxVecIt begin, CplxVecIt end)
                           "OutputData/Equalizer");
 }
 
-void OfdmDemodulatorComponent::equalizeSymbol(CplxVecIt begin, CplxVecIt end)
+void OfdmDemodulatorComponent::generateCarrierMaps(RxFrame& frame)
 {
-  transform(begin, end, equalizer_.begin(), begin, _1*_2);
-
-  CplxVec pilots;
+  // Fold the integer offset rotation and equalizer into per-carrier maps
+  const IntVec& pilotIndices = layout_.pilotIndices();
+  const IntVec& dataIndices = layout_.dataIndices();
+  int shift = (numBins_-intFreqOffset_*2)%numBins_;
   for(int i=0; i<numPilotCarriers_x; i++)
-    pilots.push_back(*(begin+pilotIndices_[i]));
+  {
+    frame.rotatedPilotIndices[i] = (pilotIndices[i]+shift)%numBins_;
+    frame.pilotEqualizer[i] = equalizer_[pilotIndices[i]];
+  }
+  for(int i=0; i<numDataCarriers_x; i++)
+    frame.dataEqualizer[i] = equalizer_[dataIndices[i]];
+  layout_.rotateDataRuns(shift, frame.dataRuns);
+}
 
-  CplxVec diffs;
-  for(int i=0; i<numPilotCarriers_x; i++)
-    diffs.push_back(pilotSequence_[i%numPilotCarriers_x]/pilots[i]);
+void OfdmDemodulatorComponent::equalizeSymbols(RxFrame& frame, int numSymbols)
+{
+  const int* pilotIdx = &frame.rotatedPilotIndices[0];
+  const Cplx* pilotEq = &frame.pilotEqualizer[0];
+  const Cplx* dataEq = &frame.dataEqualizer[0];
 
-  Cplx sum = accumulate(diffs.begin(), diffs.end(), Cplx(0,0));
-  float ave = arg(sum/(float)numPilotCarriers_x);
+  for(int s=0; s<numSymbols; s++)
+  {
+    const Cplx* bins = frame.bins + s*numBins_;
+    Cplx* qam = &frame.qamSymbols[s*numDataCarriers_x];
+
+    Cplx sum(0,0);
+    for(int i=0; i<numPilotCarriers_x; i++)
+      sum += pilotSequence_[i]/(bins[pilotIdx[i]]*pilotEq[i]);
+    float ave = arg(sum/(float)numPilotCarriers_x);
 
-  Cplx corrector = Cplx(cos(ave), sin(ave));
-  transform(begin, end, begin, _1*corrector);
+    // Data carriers are gathered a run of consecutive bins at a time
+    Cplx corrector = Cplx(cos(ave), sin(ave));
+    for(int r=0; r<frame.dataRuns.size(); r++)
+    {
+      const OfdmCarrierLayout::Run& run = frame.dataRuns[r];
+      const Cplx* in = bins + run.bin;
+      const Cplx* eq = dataEq + run.offset;
+      Cplx* out = qam + run.offset;
+      for(int i=0; i<run.length; i++)
+        out[i] = (in[i]*eq[i])*corrector;
+    }
+  }
 }
 
 } // namesapce phy
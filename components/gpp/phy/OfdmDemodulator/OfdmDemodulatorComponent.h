@@ -50,12 +50,15 @@
 #define PHY_OFDMDEMODULATORCOMPONENT_H_
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/circular_buffer.hpp>
 #include "fftw3.h"
 
 #include "irisapi/PhyComponent.h"
 #include "modulation/OfdmPreambleDetector.h"
 #include "modulation/ToneGenerator.h"
 #include "modulation/QamDemodulator.h"
+#include "modulation/OfdmCarrierLayout.h"
 #include "modulation/OfdmPreambleGenerator.h"
 #include "math/MathDefines.h"
 
@@ -71,6 +74,10 @@ namespace phy
  *             -----------------------------------                         <br>
  *             | Preamble | Header | Data ...... |                         <br>
  *             -----------------------------------                         <br>
+ *
+ * If numworkers > 0, preamble detection and header decoding stay on the
+ * component thread while captured frames are demodulated by a pool of
+ * worker threads. Frames are output in the order they were received.
  */
 class OfdmDemodulatorComponent
   : public PhyComponent
@@ -93,25 +100,60 @@ public:
       std::map<std::string, int>& outputTypes);
   virtual void registerPorts();
   virtual void initialize();
+  virtual void start();
   virtual void process();
+  virtual void stop();
   virtual void parameterHasChanged(std::string name);
 
 private:
+  /// State and scratch space for a single received frame.
+  struct RxFrame
+  {
+    CplxVec samples;            ///< Received frame symbols.
+    CplxVec corrector;          ///< Fractional frequency offset corrector.
+    IntVec rotatedPilotIndices; ///< Bin indices of pilots after offset correction.
+    OfdmCarrierLayout::RunVec dataRuns; ///< Runs of data carriers after offset correction.
+    CplxVec pilotEqualizer;     ///< Equalizer values for our pilot carriers.
+    CplxVec dataEqualizer;      ///< Equalizer values for our data carriers.
+    CplxVec qamSymbols;         ///< Container for equalized data carriers.
+    ByteVec data;               ///< Container for received frame data.
+    Cplx* bins;                 ///< Output array for multi-symbol ffts.
+    uint32_t crc;               ///< Received framecheck.
+    uint16_t numBytes;          ///< Number of bytes of data in frame.
+    uint8_t modulation;         ///< Modulation depth of frame.
+    int numSymbols;             ///< Number of OFDM symbols in frame.
+    int symbolCount;            ///< Index of symbol in frame (for debug).
+    double timeStamp;           ///< Timestamp of frame.
+    double sampleRate;          ///< Sample rate of frame.
+    bool done;                  ///< Has the frame been demodulated?
+    bool ok;                    ///< Was the frame demodulated successfully?
+  };
+
   void setup();
   void destroy();
+  void startWorkers();
+  void stopWorkers();
+  void workerThreadFunction();
   CplxVecIt searchInput(CplxVecIt begin, CplxVecIt end);
   CplxVecIt processFrame(CplxVecIt begin, CplxVecIt end);
+  RxFrame* acquireFrame();
+  void abortFrame();
+  void dispatchFrame(RxFrame* frame);
+  void releaseFrames(bool wait);
+  void runFrame(RxFrame& frame);
+  void outputFrame(RxFrame& frame);
   void extractPreamble();
   void extractHeader();
-  void demodFrame();
-  void demodSymbol(CplxVecIt inBegin, CplxVecIt inEnd,
-                   ByteVecIt outBegin, ByteVecIt outEnd,
-                   int modulationDepth);
-  void generateFractionalOffsetCorrector(float offset);
-  void correctFractionalOffset(CplxVecIt begin, CplxVecIt end);
+  void demodFrame(RxFrame& frame);
+  void demodSymbols(RxFrame& frame, CplxVecIt inBegin, int numSymbols,
+                    ByteVecIt outBegin, int bytesPerSymbol,
+                    int modulationDepth);
+  void generateFractionalOffsetCorrector(RxFrame& frame, float offset);
+  void correctFractionalOffset(RxFrame& frame, CplxVecIt begin, CplxVecIt end);
   int findIntegerOffset(CplxVecIt begin, CplxVecIt end);
   void generateEqualizer(CplxVecIt begin, CplxVecIt end);
-  void equalizeSymbol(CplxVecIt begin, CplxVecIt end);
+  void generateCarrierMaps(RxFrame& frame);
+  void equalizeSymbols(RxFrame& frame, int numSymbols);
 
   struct opAbs{float operator()(Cplx i) const{return abs(i);};};
 
@@ -122,10 +164,12 @@ private:
   int numGuardCarriers_x;     ///< Guard subcarriers (default = 55)
   int cyclicPrefixLength_x;   ///< Length of cyclic prefix (default = 16)
   float threshold_x;          ///< Frame detection threshold (default = 0.827)
+  int numWorkers_x;           ///< Worker threads for demodulation (default = 0)
 
   int symbolLength_;          ///< Length of each OFDM symbol including prefix.
   int numBins_;               ///< Number of bins for our FFT.
   const int numHeaderBytes_;  ///< Number of bytes used for header.
+  const int maxFrameSymbols_; ///< Maximum number of OFDM symbols in a frame.
   int numHeaderSymbols_;      ///< Number of header symbols in this frame.
   double timeStamp_;          ///< Timestamp of current frame
   double sampleRate_;         ///< Sample rate of current frame
@@ -135,31 +179,37 @@ private:
   int frameIndex_;            ///< Index into container for frame symbols.
   float fracFreqOffset_;      ///< Fractional frequency offset of current frame.
   int intFreqOffset_;         ///< Integer frequency offset of current frame.
-  uint32_t rxCrc_;            ///< Received framecheck.
-  uint16_t rxNumBytes_;       ///< Number of bytes of data in received frame.
-  uint8_t rxModulation_;      ///< Modulation depth of received frame.
-  int rxNumSymbols_;          ///< Number of OFDM symbols in received frame.
   int numRxFrames_;           ///< Count of total detected frames.
   int numRxFails_;            ///< Count of frames we failed to demod.
-  int symbolCount_;           ///< Index of symbol in current frame.
 
   DataSet< Cplx >* in_;       ///< Pointer to an input DataSet.
-  IntVec pilotIndices_;       ///< Indices for our pilot carriers.
-  IntVec dataIndices_;        ///< Indices for our data carriers.
+  OfdmCarrierLayout layout_;  ///< Layout of our pilot and data carriers.
   CplxVec preamble_;          ///< Contains our known frame preamble.
   CplxVec preambleBins_;      ///< Contains bins of our known preamble.
   CplxVec pilotSequence_;     ///< Contains our known pilot symbols.
   CplxVec rxPreamble_;        ///< Container for received preamble.
   CplxVec rxHeader_;          ///< Container for received header.
-  CplxVec rxFrame_;           ///< Container for received frame.
+  CplxVec rxPreambleBins_;    ///< Bins of received preamble.
+  FloatVec magPreambleBins_;  ///< Magnitudes of known preamble bins (repeated).
+  FloatVec magRxBins_;        ///< Magnitudes of received preamble bins.
+  FloatVec correlations_;     ///< Integer offset correlation results.
+  CplxVec shortEqualizer_;    ///< Half-length equalizer from preamble.
+  ByteVec headerData_;        ///< Container for received header data.
   CplxVec equalizer_;         ///< The equalizer for the current frame.
-  CplxVec corrector_;         ///< Fractional frequency offset corrector.
-  ByteVec frameData_;         ///< Container for received frame data.
 
   Cplx* halfFftData_;         ///< Input/output array for half-length fft
   fftwf_plan halfFft_;        ///< Half-length fft plan
-  Cplx* fullFftData_;         ///< Input/output array for full-length fft
-  fftwf_plan fullFft_;        ///< Full-length fft plan
+  std::vector<fftwf_plan> frameFfts_; ///< Multi-symbol fft plans (n-1 for n symbols)
+
+  std::vector<RxFrame> frames_;                 ///< Pool of frame containers.
+  RxFrame* current_;                            ///< Frame currently being received.
+  boost::circular_buffer<RxFrame*> freeFrames_;   ///< Frames ready for reuse.
+  boost::circular_buffer<RxFrame*> queuedFrames_; ///< Frames waiting for a worker.
+  boost::circular_buffer<RxFrame*> activeFrames_; ///< Dispatched frames, in order.
+  boost::mutex frameMutex_;                     ///< Guards the frame queues.
+  boost::condition_variable frameQueued_;       ///< Signals workers of new frames.
+  boost::condition_variable frameDone_;         ///< Signals demodulated frames.
+  boost::scoped_ptr< boost::thread_group > workers_; ///< Demodulation worker threads.
 
   OfdmPreambleDetector detector_;       ///< Our preamble detector.
   ToneGenerator toneGenerator_;         ///< Our tone generator.
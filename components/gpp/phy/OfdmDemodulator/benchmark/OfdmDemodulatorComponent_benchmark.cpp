@@ -32,9 +32,14 @@
  */
 
 #include "../OfdmDemodulatorComponent.h"
+#include <cstdlib>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include "OfdmDemodulatorBenchmarkData.h"
 #include "utility/DataBufferTrivial.h"
+#include "utility/AllocationCounter.h"
+
+// Count heap allocations in this executable
+IRIS_ALLOCATION_COUNTER_OPERATORS
 
 using namespace std;
 using namespace iris;
@@ -47,22 +52,28 @@ int main(int argc, char* argv[])
   typedef vector<Cplx>      CplxVec;
   typedef CplxVec::iterator CplxVecIt;
 
+  // Optionally demodulate frames on a pool of worker threads
+  int numWorkers = argc > 1 ? atoi(argv[1]) : 0;
+
   OfdmDemodulatorComponent mod("test");
   mod.setValue("numdatacarriers", 40);
   mod.setValue("numpilotcarriers", 8);
   mod.setValue("numguardcarriers", 15);
   mod.setValue("cyclicprefixlength", 8);
+  mod.setValue("reportrate", 100000); // Keep stats logging out of the run
+  mod.setValue("numworkers", numWorkers);
   mod.registerPorts();
 
   map<string, int> iTypes,oTypes;
   iTypes["input1"] = TypeInfo< Cplx >::identifier;
   mod.calculateOutputTypes(iTypes,oTypes);
 
-  DataBufferTrivial< Cplx > in;
-  DataBufferTrivial< uint8_t > out;
-
   // Create enough data for "numFrames" full frames
+  // Output buffer is presized so that any allocation comes from the component
   int numFrames = 10000;
+  DataBufferTrivial< Cplx > in;
+  DataBufferTrivial< uint8_t > out(numFrames+1, 1024);
+
   int frameSize = OfdmDemodulatorBenchmarkData::testFrame1.size();
   DataSet< Cplx >* iSet = NULL;
   in.getWriteData(iSet, frameSize*numFrames);
@@ -77,12 +88,23 @@ int main(int argc, char* argv[])
 
   mod.setBuffers(&in,&out);
   mod.initialize();
+  mod.start();
 
   bp::ptime t1(bp::microsec_clock::local_time());
+  AllocationCounter::start();
   mod.process();
+  long numAllocs = AllocationCounter::stop();
+  mod.stop();
   bp::ptime t2(bp::microsec_clock::local_time());
 
   bp::time_duration time = t2-t1;
   float megSampsPerSec = (numFrames*frameSize/1.0e6)*(1.0e9/time.total_nanoseconds());
   cout << "Rate = " << megSampsPerSec << " MS/sec" << endl;
+
+  if(numAllocs != 0)
+  {
+    cout << "Error: " << numAllocs << " heap allocations during process()" << endl;
+    return 1;
+  }
+  return 0;
 }
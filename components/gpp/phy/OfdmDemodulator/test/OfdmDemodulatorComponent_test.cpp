@@ -38,6 +38,10 @@
 #include "../OfdmDemodulatorComponent.h"
 #include "OfdmDemodulatorTestData.h"
 #include "utility/DataBufferTrivial.h"
+#include "utility/AllocationCounter.h"
+
+// Count heap allocations in this executable
+IRIS_ALLOCATION_COUNTER_OPERATORS
 
 using namespace std;
 using namespace iris;
@@ -183,4 +187,174 @@ BOOST_AUTO_TEST_CASE(OfdmDemodulatorComponent_Demod_Test2)
   out.releaseReadData(oSet);
 }
 
+BOOST_AUTO_TEST_CASE(OfdmDemodulatorComponent_NoAlloc_Test)
+{
+  typedef complex<float>    Cplx;
+  typedef vector<Cplx>      CplxVec;
+  typedef CplxVec::iterator CplxVecIt;
+
+  OfdmDemodulatorComponent mod("test");
+  mod.setValue("numdatacarriers", 40);
+  mod.setValue("numpilotcarriers", 8);
+  mod.setValue("numguardcarriers", 15);
+  mod.setValue("cyclicprefixlength", 8);
+  mod.registerPorts();
+
+  map<string, int> iTypes,oTypes;
+  iTypes["input1"] = TypeInfo< Cplx >::identifier;
+  mod.calculateOutputTypes(iTypes,oTypes);
+
+  // Size the output buffer so it doesn't allocate either
+  int numFrames = 10;
+  DataBufferTrivial< Cplx > in;
+  DataBufferTrivial< uint8_t > out(numFrames+1, 1024);
+
+  int frameSize = OfdmDemodulatorTestData::testFrame1.size();
+  DataSet< Cplx >* iSet = NULL;
+  in.getWriteData(iSet, frameSize*numFrames);
+  CplxVecIt it = iSet->data.begin();
+  for(int i=0;i<numFrames;i++,it+=frameSize)
+  {
+    copy(OfdmDemodulatorTestData::testFrame1.begin(),
+         OfdmDemodulatorTestData::testFrame1.end(),
+         it);
+  }
+  in.releaseWriteData(iSet);
+
+  mod.setBuffers(&in,&out);
+  mod.initialize();
+
+  AllocationCounter::start();
+  mod.process();
+  long numAllocs = AllocationCounter::stop();
+  BOOST_CHECK_EQUAL(numAllocs, 0);
+
+  for(int i=0; i<numFrames; i++)
+  {
+    BOOST_REQUIRE(out.hasData());
+    DataSet< uint8_t >* oSet = NULL;
+    out.getReadData(oSet);
+    for(int j=0; j<oSet->data.size(); j++)
+      BOOST_CHECK(oSet->data[j]==j);
+    out.releaseReadData(oSet);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(OfdmDemodulatorComponent_Workers_Test)
+{
+  typedef complex<float>    Cplx;
+  typedef vector<Cplx>      CplxVec;
+  typedef CplxVec::iterator CplxVecIt;
+
+  OfdmDemodulatorComponent mod("test");
+  mod.setValue("numdatacarriers", 40);
+  mod.setValue("numpilotcarriers", 8);
+  mod.setValue("numguardcarriers", 15);
+  mod.setValue("cyclicprefixlength", 8);
+  mod.setValue("numworkers", 2);
+  mod.registerPorts();
+
+  map<string, int> iTypes,oTypes;
+  iTypes["input1"] = TypeInfo< Cplx >::identifier;
+  mod.calculateOutputTypes(iTypes,oTypes);
+
+  int numFrames = 20;
+  DataBufferTrivial< Cplx > in;
+  DataBufferTrivial< uint8_t > out(numFrames+1, 1024);
+
+  int frameSize = OfdmDemodulatorTestData::testFrame1.size();
+  DataSet< Cplx >* iSet = NULL;
+  in.getWriteData(iSet, frameSize*numFrames);
+  iSet->timeStamp = 0;
+  iSet->sampleRate = 1;
+  CplxVecIt it = iSet->data.begin();
+  for(int i=0;i<numFrames;i++,it+=frameSize)
+  {
+    copy(OfdmDemodulatorTestData::testFrame1.begin(),
+         OfdmDemodulatorTestData::testFrame1.end(),
+         it);
+  }
+  in.releaseWriteData(iSet);
+
+  mod.setBuffers(&in,&out);
+  mod.initialize();
+  mod.start();
+  mod.process();
+
+  // Frames still in flight are output when the component stops
+  mod.stop();
+
+  double lastTimeStamp = -1;
+  for(int i=0; i<numFrames; i++)
+  {
+    BOOST_REQUIRE(out.hasData());
+    DataSet< uint8_t >* oSet = NULL;
+    out.getReadData(oSet);
+    BOOST_CHECK(oSet->timeStamp > lastTimeStamp);
+    lastTimeStamp = oSet->timeStamp;
+    for(int j=0; j<oSet->data.size(); j++)
+      BOOST_CHECK(oSet->data[j]==j);
+    out.releaseReadData(oSet);
+  }
+  BOOST_CHECK(!out.hasData());
+}
+
+BOOST_AUTO_TEST_CASE(OfdmDemodulatorComponent_Reconfigure_Test)
+{
+  typedef complex<float>    Cplx;
+  typedef vector<Cplx>      CplxVec;
+  typedef CplxVec::iterator CplxVecIt;
+
+  OfdmDemodulatorComponent mod("test");
+  mod.setValue("numdatacarriers", 40);
+  mod.setValue("numpilotcarriers", 8);
+  mod.setValue("numguardcarriers", 15);
+  mod.setValue("cyclicprefixlength", 8);
+  mod.setValue("numworkers", 2);
+  mod.registerPorts();
+
+  map<string, int> iTypes,oTypes;
+  iTypes["input1"] = TypeInfo< Cplx >::identifier;
+  mod.calculateOutputTypes(iTypes,oTypes);
+
+  int numFrames = 4;
+  DataBufferTrivial< Cplx > in;
+  DataBufferTrivial< uint8_t > out(numFrames+1, 1024);
+
+  int frameSize = OfdmDemodulatorTestData::testFrame1.size();
+  DataSet< Cplx >* iSet = NULL;
+  in.getWriteData(iSet, frameSize*numFrames);
+  iSet->timeStamp = 0;
+  iSet->sampleRate = 1;
+  CplxVecIt it = iSet->data.begin();
+  for(int i=0;i<numFrames;i++,it+=frameSize)
+  {
+    copy(OfdmDemodulatorTestData::testFrame1.begin(),
+         OfdmDemodulatorTestData::testFrame1.end(),
+         it);
+  }
+  in.releaseWriteData(iSet);
+
+  mod.setBuffers(&in,&out);
+  mod.initialize();
+  mod.start();
+  mod.process();
+
+  // Frames in flight are output, in order, before the component is set up again
+  mod.parameterHasChanged("cyclicprefixlength");
+
+  double lastTimeStamp = -1;
+  for(int i=0; i<numFrames; i++)
+  {
+    BOOST_REQUIRE(out.hasData());
+    DataSet< uint8_t >* oSet = NULL;
+    out.getReadData(oSet);
+    BOOST_CHECK(oSet->timeStamp > lastTimeStamp);
+    lastTimeStamp = oSet->timeStamp;
+    out.releaseReadData(oSet);
+  }
+  BOOST_CHECK(!out.hasData());
+  mod.stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
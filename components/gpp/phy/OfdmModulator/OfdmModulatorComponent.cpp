@@ -35,17 +35,14 @@
 
 #include <cmath>
 #include <algorithm>
-#include <boost/lambda/lambda.hpp>
 
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
-#include "modulation/OfdmIndexGenerator.h"
 #include "modulation/Crc.h"
 #include "modulation/Whitener.h"
 #include "utility/RawFileUtility.h"
 
 using namespace std;
-using namespace boost::lambda;
 
 namespace iris
 {
@@ -65,8 +62,8 @@ OfdmModulatorComponent::OfdmModulatorComponent(std::string name)
     ,numHeaderSymbols_(0)
     ,sampleRate_(0)
     ,timeStamp_(0)
-    ,fft_(NULL)
-    ,fftBins_(NULL)
+    ,frameBins_(NULL)
+    ,scale_(1)
 {
   registerParameter(
     "debug", "Whether to output debug data.",
@@ -139,12 +136,11 @@ void OfdmModulatorComponent::process()
   do
   {
     int sizeThisFrame;
-    if(numSymbols >= maxSymbolsPerFrame_x)
+    if(numSymbols > maxSymbolsPerFrame_x)
       sizeThisFrame = maxSymbolsPerFrame_x * bytesPerSymbol_;
     else
       sizeThisFrame = size;
 
-    createHeader(it, it+sizeThisFrame);
     createFrame(it, it+sizeThisFrame);
 
     numSymbols -= maxSymbolsPerFrame_x;
@@ -160,7 +156,7 @@ void OfdmModulatorComponent::parameterHasChanged(std::string name)
 {
   if(name == "numdatacarriers" || name == "numpilotcarriers" ||
      name == "numguardcarriers" || name == "cyclicprefixlength" ||
-     name == "modulationdepth")
+     name == "modulationdepth" || name == "maxsymbolsperframe")
   {
     destroy();
     setup();
@@ -170,16 +166,8 @@ void OfdmModulatorComponent::parameterHasChanged(std::string name)
 /// Set up all our index vectors and containers.
 void OfdmModulatorComponent::setup()
 {
-  // Set up index vectors
-  pilotIndices_.clear();
-  pilotIndices_.resize(numPilotCarriers_x);
-  dataIndices_.clear();
-  dataIndices_.resize(numDataCarriers_x);
-  OfdmIndexGenerator::generateIndices(numDataCarriers_x,
-                                      numPilotCarriers_x,
-                                      numGuardCarriers_x,
-                                      pilotIndices_.begin(), pilotIndices_.end(),
-                                      dataIndices_.begin(), dataIndices_.end());
+  // Set up carrier layout
+  layout_.generate(numDataCarriers_x, numPilotCarriers_x, numGuardCarriers_x);
 
   // Create preamble
   numBins_ = numDataCarriers_x + numPilotCarriers_x + numGuardCarriers_x + 1;
@@ -190,19 +178,38 @@ void OfdmModulatorComponent::setup()
                                 numGuardCarriers_x,
                                 preamble_.begin(), preamble_.end());
 
-  // Set up containers
-  fftBins_ = reinterpret_cast<Cplx*>(
-      fftwf_malloc(sizeof(fftwf_complex) * numBins_));
-  fill(&fftBins_[0], &fftBins_[numBins_], Cplx(0,0));
-  fft_ = fftwf_plan_dft_1d(numBins_,
-                           (fftwf_complex*)fftBins_,
-                           (fftwf_complex*)fftBins_,
-                           FFTW_BACKWARD,
-                           FFTW_MEASURE);
-  symbol_.clear();
-  symbol_.resize(numBins_);
   int bytesPerSymbol = numDataCarriers_x/8;
   numHeaderSymbols_ = (int)ceil(numHeaderBytes_/(float)bytesPerSymbol);
+
+  // Header and data symbols for a whole frame are transformed together,
+  // writing straight into the output. A frame of n symbols uses the plans
+  // for the powers of two which sum to n. Plans are unaligned as the output
+  // position depends on the frame.
+  int maxSymbols = numHeaderSymbols_ + maxSymbolsPerFrame_x;
+  int symLength = numBins_ + cyclicPrefixLength_x;
+  frameBins_ = reinterpret_cast<Cplx*>(
+      fftwf_malloc(sizeof(fftwf_complex) * numBins_*maxSymbols));
+  CplxVec scratch(symLength*maxSymbols);
+  for(int batch=1; batch<=maxSymbols; batch*=2)
+  {
+    ffts_.push_back(fftwf_plan_many_dft(1, &numBins_, batch,
+                                        (fftwf_complex*)frameBins_,
+                                        NULL, 1, numBins_,
+                                        (fftwf_complex*)&scratch[0],
+                                        NULL, 1, symLength,
+                                        FFTW_BACKWARD,
+                                        FFTW_MEASURE | FFTW_UNALIGNED));
+  }
+
+  // Guard carriers stay empty, as the ifft doesn't overwrite its input
+  fill(&frameBins_[0], &frameBins_[numBins_*maxSymbols], Cplx(0,0));
+
+  // Fold the ifft scaling into the carrier mapping
+  scale_ = 1.0f/(numPilotCarriers_x + numDataCarriers_x);
+  scaledPilots_.resize(numPilotCarriers_x);
+  for(int i=0; i<numPilotCarriers_x; i++)
+    scaledPilots_[i] = pilotSequence_[i%pilotSequence_.size()]*scale_;
+
   header_.resize(numHeaderSymbols_*bytesPerSymbol);
   //Whitener::whiten(header_.begin(), header_.end());
   modHeader_.resize(numHeaderSymbols_*numDataCarriers_x);
@@ -215,15 +222,17 @@ void OfdmModulatorComponent::setup()
   qMod_.modulate(pad_.begin(), pad_.end(),
                  modPad_.begin(), modPad_.end(),
                  modulationDepth_x);
-
+  modData_.reserve(maxSymbolsPerFrame_x*numDataCarriers_x);
 }
 
 void OfdmModulatorComponent::destroy()
 {
-  if(fftBins_ != NULL)
-    fftwf_free(fftBins_);
-  if(fft_ != NULL)
-    fftwf_destroy_plan(fft_);
+  if(frameBins_ != NULL)
+    fftwf_free(frameBins_);
+  frameBins_ = NULL;
+  for(int i=0; i<ffts_.size(); i++)
+    fftwf_destroy_plan(ffts_[i]);
+  ffts_.clear();
 }
 
 /** Create a header for the current frame.
@@ -235,20 +244,18 @@ void OfdmModulatorComponent::destroy()
  * data  |   CRC| Frame size(bytes)| QAM encoding|        padding|         <br>
  *       ---------------------------------------------------------         <br>
  *
- * @param begin Iterator to first byte of tx data.
- * @param end   Iterator to one past last byte of tx data.
+ * @param crc   CRC of the tx data.
+ * @param size  Number of bytes of tx data.
  */
-void OfdmModulatorComponent::createHeader(ByteVecIt begin, ByteVecIt end)
+void OfdmModulatorComponent::createHeader(uint32_t crc, uint16_t size)
 {
   //Add the CRC
-  uint32_t crc = Crc::generate(begin,end);
   header_[0] = (crc>>24) & 0xFF;
   header_[1] = (crc>>16) & 0xFF;
   header_[2] = (crc>>8) & 0xFF;
   header_[3] = crc & 0xFF;
 
   //Add frame size
-  uint16_t size = end-begin;
   header_[4] = (size>>8) & 0xFF;
   header_[5] = size & 0xFF;
 
@@ -276,9 +283,10 @@ void OfdmModulatorComponent::createFrame(ByteVecIt begin, ByteVecIt end)
   int numOfdmSymbols = ceil((end-begin)/(float)bytesPerSymbol_);
   int ofdmSymLength = numBins_+cyclicPrefixLength_x;
 
-  // Whiten
+  // CRC and whiten the data in a single pass, then create and whiten header
+  uint32_t crc = Whitener::crcAndWhiten(begin, end);
+  createHeader(crc, end-begin);
   Whitener::whiten(header_.begin(), header_.end());
-  Whitener::whiten(begin, end);
 
   // Modulate and pad
   qMod_.modulate(header_.begin(), header_.end(),
@@ -291,6 +299,16 @@ void OfdmModulatorComponent::createFrame(ByteVecIt begin, ByteVecIt end)
   for(; modIt!=modData_.end(); modIt++,padIt++)
     *modIt = *padIt;
 
+  // Map carriers for all header and data symbols
+  mapSymbols(modHeader_.begin(), numHeaderSymbols_, frameBins_);
+  mapSymbols(modData_.begin(), numOfdmSymbols,
+             frameBins_ + numHeaderSymbols_*numBins_);
+
+  if(debug_x)
+    RawFileUtility::write(&frameBins_[0],
+                          &frameBins_[(numHeaderSymbols_+numOfdmSymbols)*numBins_],
+                          "OutputData/TxSymbolBins");
+
   // Get a DataSet
   int frameLength = (1+numHeaderSymbols_+numOfdmSymbols+1) * (ofdmSymLength);
   DataSet< complex<float> >* out = NULL;
@@ -302,21 +320,11 @@ void OfdmModulatorComponent::createFrame(ByteVecIt begin, ByteVecIt end)
   // Copy preamble
   it = copyWithCp(preamble_.begin(), preamble_.end(), it, it+ofdmSymLength);
 
-  // Create and copy header symbol(s)
-  CplxVecIt headIt = modHeader_.begin();
-  for(; headIt != modHeader_.end(); headIt += numDataCarriers_x)
-  {
-    createSymbol(headIt, headIt+numDataCarriers_x, symbol_.begin(),symbol_.end());
-    it = copyWithCp(symbol_.begin(), symbol_.end(), it, it+ofdmSymLength);
-  }
+  // Transform header and data symbols straight into the output
+  it = transformSymbols(numHeaderSymbols_+numOfdmSymbols, it);
 
-  // Create and copy data symbols
-  CplxVecIt inIt = modData_.begin();
-  for(int i=0; i<numOfdmSymbols; i++, inIt += numDataCarriers_x)
-  {
-    createSymbol(inIt, inIt+numDataCarriers_x, symbol_.begin(), symbol_.end());
-    it = copyWithCp(symbol_.begin(), symbol_.end(), it, it+ofdmSymLength);
-  }
+  // Frame guard
+  fill(it, it+ofdmSymLength, Cplx(0,0));
 
   if(debug_x)
     RawFileUtility::write(out->data.begin(), out->data.end(),
@@ -325,43 +333,76 @@ void OfdmModulatorComponent::createFrame(ByteVecIt begin, ByteVecIt end)
   releaseOutputDataSet("output1", out);
 }
 
-/** Create a single OFDM symbol.
+/** Map QAM symbols onto the carriers of a set of OFDM symbols.
  *
- * Our pilot and data index vectors are used to map QAM symbols onto carriers
- * and an FFT is used to create the time-domain OFDM symbol.
+ * Our carrier layout is used to map QAM symbols onto carriers, a run of
+ * consecutive data carriers at a time, scaling each carrier for the ifft.
+ * Guard carriers are left untouched.
  *
- * @param inBegin   Iterator to first input QAM symbol.
- * @param inEnd     Iterator to one past last input QAM symbol.
- * @param outBegin  Iterator to first sample of the output OFDM symbol.
- * @param outEnd    Iterator to one past last sample of the output symbol.
+ * @param inBegin     Iterator to first input QAM symbol.
+ * @param numSymbols  Number of OFDM symbols to map.
+ * @param bins        Carriers of the first OFDM symbol.
  */
-void OfdmModulatorComponent::createSymbol(CplxVecIt inBegin, CplxVecIt inEnd,
-                                          CplxVecIt outBegin, CplxVecIt outEnd)
+void OfdmModulatorComponent::mapSymbols(CplxVecIt inBegin, int numSymbols,
+                                        Cplx* bins)
 {
-  if(outEnd-outBegin < numBins_)
-    throw IrisException("Insufficient storage provided for createSymbol output.");
+  if(numSymbols == 0)
+    return;
 
-  fill(&fftBins_[0], &fftBins_[numBins_], Cplx(0,0));
+  const int* pilotIdx = &layout_.pilotIndices()[0];
+  const OfdmCarrierLayout::RunVec& runs = layout_.dataRuns();
+  const Cplx* pilots = &scaledPilots_[0];
+  const Cplx* in = &(*inBegin);
 
-  int i = 0;
-  IntVecIt it = pilotIndices_.begin();
-  for(; it!=pilotIndices_.end(); it++, i++)
-    fftBins_[*it] = pilotSequence_[i%pilotSequence_.size()];
-  for(it=dataIndices_.begin(); it!= dataIndices_.end(); it++)
-    fftBins_[*it] = *inBegin++;
+  for(int s=0; s<numSymbols; s++, bins+=numBins_, in+=numDataCarriers_x)
+  {
+    for(int i=0; i<numPilotCarriers_x; i++)
+      bins[pilotIdx[i]] = pilots[i];
+    for(int r=0; r<runs.size(); r++)
+    {
+      Cplx* out = bins + runs[r].bin;
+      const Cplx* data = in + runs[r].offset;
+      for(int i=0; i<runs[r].length; i++)
+        out[i] = data[i]*scale_;
+    }
+  }
+}
 
-  if(debug_x)
-    RawFileUtility::write(&fftBins_[0], &fftBins_[numBins_],
-                          "OutputData/TxSymbolBins");
+/** Transform mapped carriers to OFDM symbols with cyclic prefixes.
+ *
+ * The ifft output is written directly after the space for each cyclic
+ * prefix, which is then filled from the end of the symbol.
+ *
+ * @param numSymbols  Number of OFDM symbols in frameBins_.
+ * @param outBegin    Iterator to first sample of the first output symbol.
+ * @return            Iterator to one past the last output sample.
+ */
+OfdmModulatorComponent::CplxVecIt
+OfdmModulatorComponent::transformSymbols(int numSymbols, CplxVecIt outBegin)
+{
+  int cp = cyclicPrefixLength_x;
+  int symLength = numBins_ + cp;
 
-  fftwf_execute(fft_);
-  copy(&fftBins_[0], &fftBins_[numBins_], outBegin);
-  float scaleFactor = numPilotCarriers_x + numDataCarriers_x;
-  transform(outBegin, outEnd, outBegin, _1/scaleFactor);
+  int done = 0;
+  for(int i=ffts_.size()-1; i>=0; i--)
+  {
+    int batch = 1<<i;
+    if(numSymbols-done < batch)
+      continue;
+    fftwf_execute_dft(ffts_[i],
+                      (fftwf_complex*)(frameBins_ + done*numBins_),
+                      (fftwf_complex*)&(*(outBegin + done*symLength + cp)));
+    done += batch;
+  }
+
+  CplxVecIt it = outBegin;
+  for(int i=0; i<numSymbols; i++, it+=symLength)
+    copy(it+numBins_, it+symLength, it);
 
   if(debug_x)
-    RawFileUtility::write(outBegin, outEnd,
-                          "OutputData/TxSymbol");
+    RawFileUtility::write(outBegin, it, "OutputData/TxSymbols");
+
+  return it;
 }
 
 OfdmModulatorComponent::CplxVecIt
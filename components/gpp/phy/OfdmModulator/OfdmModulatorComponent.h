@@ -53,6 +53,7 @@
 #include <boost/scoped_ptr.hpp>
 #include "fftw3.h"
 #include "modulation/QamModulator.h"
+#include "modulation/OfdmCarrierLayout.h"
 #include "modulation/OfdmPreambleGenerator.h"
 #include "irisapi/PhyComponent.h"
 
@@ -94,10 +95,10 @@ class OfdmModulatorComponent
 
   void setup();
   void destroy();
-  void createHeader(ByteVecIt begin, ByteVecIt end);
+  void createHeader(uint32_t crc, uint16_t size);
   void createFrame(ByteVecIt begin, ByteVecIt end);
-  void createSymbol(CplxVecIt inBegin, CplxVecIt inEnd,
-                    CplxVecIt outBegin, CplxVecIt outEnd);
+  void mapSymbols(CplxVecIt inBegin, int numSymbols, Cplx* bins);
+  CplxVecIt transformSymbols(int numSymbols, CplxVecIt outBegin);
   CplxVecIt copyWithCp(CplxVecIt inBegin, CplxVecIt inEnd,
                        CplxVecIt outBegin, CplxVecIt outEnd);
 
@@ -116,19 +117,19 @@ class OfdmModulatorComponent
   double timeStamp_;          ///< Timestamp of current frame
   double sampleRate_;         ///< Sample rate of current frame
 
-  IntVec pilotIndices_;       ///< Indices for our pilot carriers.
-  IntVec dataIndices_;        ///< Indices for our data carriers.
+  OfdmCarrierLayout layout_;  ///< Layout of our pilot and data carriers.
   ByteVec header_;            ///< Contains the header data for each frame.
-  Cplx* fftBins_;             ///< Allocated using fftwf_malloc (SIMD aligned)
+  Cplx* frameBins_;           ///< Carriers for every symbol of a frame (fftwf_malloc)
   CplxVec preamble_;          ///< Contains our frame preamble.
   CplxVec pilotSequence_;     ///< Contains our pilot symbols.
+  CplxVec scaledPilots_;      ///< Pilot symbols with ifft scaling applied.
+  float scale_;               ///< Scaling applied to carriers before the ifft.
   CplxVec modHeader_;         ///< Contains our modulated header data.
   CplxVec modData_;           ///< Contains our modulated data.
   ByteVec pad_;               ///< Padding data.
   CplxVec modPad_;            ///< Used to pad out the last symbol, if required.
-  CplxVec symbol_;            ///< Contains a single OFDM symbol.
 
-  fftwf_plan fft_;                      ///< Our FFT object pointer.
+  std::vector<fftwf_plan> ffts_;        ///< Batched ifft plans for 1,2,4... symbols.
   QamModulator qMod_;                   ///< Our QAM modulator.
   OfdmPreambleGenerator preambleGen_;   ///< Our preamble generator.
 
@@ -125,6 +125,57 @@ BOOST_AUTO_TEST_CASE(OfdmModulatorComponent_Process_Test)
   BOOST_CHECK(oSet->data.size() == 35*544); // #symbols * #samplesPerSymbol
   out.releaseReadData(oSet);
 }
+BOOST_AUTO_TEST_CASE(OfdmModulatorComponent_CyclicPrefix_Test)
+{
+  OfdmModulatorComponent mod("test");
+  mod.setValue("numdatacarriers", 40);
+  mod.setValue("numpilotcarriers", 8);
+  mod.setValue("numguardcarriers", 15);
+  mod.setValue("cyclicprefixlength", 8);
+  mod.setValue("maxsymbolsperframe", 4);
+  mod.registerPorts();
+
+  map<string, int> iTypes,oTypes;
+  iTypes["input1"] = TypeInfo< uint8_t >::identifier;
+  mod.calculateOutputTypes(iTypes,oTypes);
+
+  DataBufferTrivial<uint8_t> in;
+  DataBufferTrivial< complex<float> > out;
+
+  // Enough data for one full frame and one of three symbols
+  DataSet<uint8_t>* iSet = NULL;
+  in.getWriteData(iSet, 7*5); // #dataSymbols * #bytesPerSymbol
+  for(int i=0;i<7*5;i++)
+    iSet->data[i] = i%255;
+  in.releaseWriteData(iSet);
+
+  mod.setBuffers(&in,&out);
+  mod.initialize();
+  BOOST_REQUIRE_NO_THROW(mod.process());
+
+  int symLength = 72;
+  int numSymbols[] = {8, 7}; // Including preamble, 2 header and guard
+  for(int f=0;f<2;f++)
+  {
+    BOOST_REQUIRE(out.hasData());
+    DataSet< complex<float> >* oSet = NULL;
+    out.getReadData(oSet);
+    BOOST_REQUIRE(oSet->data.size() == numSymbols[f]*symLength);
+
+    // Each symbol's cyclic prefix repeats its last samples
+    for(int s=0;s<numSymbols[f]-1;s++)
+    {
+      int start = s*symLength;
+      for(int i=0;i<8;i++)
+        BOOST_CHECK(oSet->data[start+i] == oSet->data[start+64+i]);
+    }
+
+    // Frame guard is empty
+    for(int i=(numSymbols[f]-1)*symLength;i<oSet->data.size();i++)
+      BOOST_CHECK(oSet->data[i] == complex<float>(0,0));
+    out.releaseReadData(oSet);
+  }
+}
 /*
 BOOST_AUTO_TEST_CASE(OfdmModulatorComponent_Generate_Data)
 {
@@ -1,5 +1,5 @@
 /**
- * \file components/gpp/phy/Example/ExampleComponent.cpp
+ * \file components/gpp/phy/Periodogram/PeriodogramComponent.cpp
  * \version 1.0
  *
  * \section COPYRIGHT
@@ -33,6 +33,14 @@
 
 #include "PeriodogramComponent.h"
 
+#include <cmath>
+#include <algorithm>
+#include <list>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
 
@@ -46,12 +54,72 @@ namespace phy
 // export library symbols
 IRIS_COMPONENT_EXPORTS(PhyComponent, PeriodogramComponent);
 
+/// Powers below this (zero and denormals) are output as this (-300 dB).
+static const float minPower = 1e-30f;
+
+/** Convert power values to dB in place.
+ *
+ * The SSE2 version splits each value into exponent and mantissa and
+ * uses a short atanh series for the log of the mantissa. Values are
+ * accurate to around 1e-5 dB. Both versions clamp powers to minPower
+ * first, so zero gives the same floor rather than -inf.
+ */
+static void toDecibels(float* data, int n)
+{
+  int i=0;
+#ifdef __SSE2__
+  const __m128 lowest = _mm_set1_ps(minPower);
+  const __m128 tenLog10Two = _mm_set1_ps(3.0102999566f);  // 10*log10(2)
+  const __m128 tenLog10E = _mm_set1_ps(4.3429448190f);    // 10*log10(e)
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 sqrtTwo = _mm_set1_ps(1.41421356f);
+  const __m128i mantMask = _mm_set1_epi32(0x007fffff);
+  const __m128i oneBits = _mm_set1_epi32(0x3f800000);
+  const __m128i bias = _mm_set1_epi32(127);
+  for(; i+4<=n; i+=4)
+  {
+    __m128i bits = _mm_castps_si128(_mm_max_ps(_mm_loadu_ps(data+i), lowest));
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), bias);
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mantMask), oneBits));
+
+    // Move mantissa from [1,2) to [sqrt(0.5),sqrt(2))
+    __m128 big = _mm_cmpgt_ps(m, sqrtTwo);
+    m = _mm_or_ps(_mm_andnot_ps(big, m), _mm_and_ps(big, _mm_mul_ps(m, half)));
+    e = _mm_sub_epi32(e, _mm_castps_si128(big));
+
+    // ln(m) = 2*atanh(t), t = (m-1)/(m+1)
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 p = _mm_add_ps(_mm_set1_ps(1.0f/5), _mm_mul_ps(t2, _mm_set1_ps(1.0f/7)));
+    p = _mm_add_ps(_mm_set1_ps(1.0f/3), _mm_mul_ps(t2, p));
+    p = _mm_add_ps(one, _mm_mul_ps(t2, p));
+    __m128 lnM = _mm_mul_ps(_mm_add_ps(t, t), p);
+
+    __m128 db = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(e), tenLog10Two),
+                           _mm_mul_ps(lnM, tenLog10E));
+    _mm_storeu_ps(data+i, db);
+  }
+#endif
+  for(; i<n; i++)
+    data[i] = 10*log10f(max(data[i], minPower));
+}
+
 PeriodogramComponent::PeriodogramComponent(std::string name)
   : PhyComponent(name,                      // component name
                 "Periodogram",              // component type
                 "A Periodogram component",  // description
                 "Wei Liu",                  // author
-                "0.1")                      // version
+                "0.2")                      // version
+    ,hop_(1)
+    ,exponential_(false)
+    ,numSegments_(0)
+    ,totalSegments_(0)
+    ,timeStamp_(0)
+    ,sampleRate_(0)
+    ,fftIn_(NULL)
+    ,fftOut_(NULL)
+    ,fft_(NULL)
 {
   registerParameter(
       "number_of_complex_samples",          // name
@@ -65,7 +133,8 @@ PeriodogramComponent::PeriodogramComponent(std::string name)
  	 "output block size by periodogram", 
  	 "1024", 
 	  true, 
-	  x_blocksize);
+	  x_blocksize,
+	  Interval<int>(2,1048576));
   registerParameter(
 	  "shift",
 	  "if fftshift is requested, 1 means yes",
@@ -75,10 +144,46 @@ PeriodogramComponent::PeriodogramComponent(std::string name)
   registerParameter(
 	  "window",
 	  "if han window is applied, 1 means yes",
-	  "0",
+	  "1",
 	  false, 
 	  x_window);
+  registerParameter(
+	  "overlap",
+	  "fraction of each segment which overlaps the next",
+	  "0.5",
+	  true,
+	  x_overlap,
+	  Interval<float>(0.0,0.99));
+
+  list<string> averaging;
+  averaging.push_back("linear");
+  averaging.push_back("exponential");
+  registerParameter(
+	  "averaging",
+	  "averaging of segments, linear or exponential",
+	  "linear",
+	  true,
+	  x_averaging,
+	  averaging);
+  registerParameter(
+	  "numaverages",
+	  "segments averaged per output with linear averaging, 0 means one output per input block",
+	  "0",
+	  true,
+	  x_numaverages,
+	  Interval<int>(0,1048576));
+  registerParameter(
+	  "alpha",
+	  "weight of each new segment with exponential averaging",
+	  "0.1",
+	  true,
+	  x_alpha,
+	  Interval<float>(0.0,1.0));
+}
 
+PeriodogramComponent::~PeriodogramComponent()
+{
+  destroy();
 }
 
 void PeriodogramComponent::registerPorts()
@@ -97,6 +202,14 @@ void PeriodogramComponent::calculateOutputTypes(
 
 void PeriodogramComponent::initialize()
 {
+  setup();
+}
+
+void PeriodogramComponent::parameterHasChanged(std::string name)
+{
+  if(name == "blocksize" || name == "overlap" || name == "averaging" ||
+     name == "numaverages" || name == "alpha")
+    setup();
 }
 
 void PeriodogramComponent::process()
@@ -104,230 +217,148 @@ void PeriodogramComponent::process()
   //Get a DataSet from the input DataBuffer
   DataSet< complex<float> >* readDataSet = NULL;
   getInputDataSet("input1", readDataSet);
-  std::size_t size = readDataSet->data.size();
+  timeStamp_ = readDataSet->timeStamp;
+  sampleRate_ = readDataSet->sampleRate;
 
-  //Get a DataSet from the output DataBuffer
-  DataSet< float >* writeDataSet = NULL;
-  getOutputDataSet("output1", writeDataSet, x_blocksize);
-
-  //FFT process
-		
-	//float *data =(float*) malloc (size*sizeof(float));
-	float data[2*size],PSDresult[x_blocksize];	
-        for(int i=0;i<size;i++)
-        {
-            data[2*i+1]=readDataSet->data[i].real();
-            data[2*i]=readDataSet->data[i].imag();
-        }
-	periodogram(size,x_blocksize,data,PSDresult);
-	log10Array(PSDresult,x_blocksize);
-	for(int i=0;i<x_blocksize;i++)
-	{
-	    writeDataSet->data[i] = PSDresult[i];
-	}
+  if(!readDataSet->data.empty())
+    addSamples(&readDataSet->data[0], readDataSet->data.size());
 
-  //Copy the timestamp and sample rate for the DataSets
-  writeDataSet->timeStamp = readDataSet->timeStamp;
-  writeDataSet->sampleRate = readDataSet->sampleRate;
+  // Without a fixed number of averages, output once per input block
+  if((exponential_ || x_numaverages == 0) && numSegments_ > 0)
+    writeOutput();
 
-  //Release the DataSets
   releaseInputDataSet("input1", readDataSet);
-  releaseOutputDataSet("output1", writeDataSet);
 }
 
-float PeriodogramComponent::FFT (float data[], unsigned long number_of_complex_samples, int isign)
-	{
-	    //variables for trigonometric recurrences
-
-	    unsigned long n,mmax,m,j,istep,i;
-	    double wtemp,wr,wpr,wpi,wi,theta,tempr,tempi;
-
-	    //the complex array is real+complex so the array 
-
-	    // has a size n = 2* number of complex samples
-
-	    // real part is the data[index] and the complex part is the data[index+1]
-
-	    n=number_of_complex_samples * 2; 
-
-	    //binary inversion (note that 
-
-	    //the indexes start from 1 which means that the
-
-	    //real part of the complex is on the odd-indexes
-
-	    //and the complex part is on the even-indexes
-
-	     j=0;
-	    for (i=0;i<n/2;i+=2) {
-		if (j > i) {
-		    //swap the real part
-
-		    SWAP(data[j],data[i]);
-		    //swap the complex part
-
-		    SWAP(data[j+1],data[i+1]);
-		    // checks if the changes occurs in the first half
-
-		    // and use the mirrored effect on the second half
-
-		    if((j/2)<(n/4)){
-		        //swap the real part
-
-		        SWAP(data[(n-(i+2))],data[(n-(j+2))]);
-		        //swap the complex part
-
-		        SWAP(data[(n-(i+2))+1],data[(n-(j+2))+1]);
-		    }
-		}
-		m=n/2;
-		while (m >= 2 && j >= m) {
-		    j -= m;
-		    m = m/2;
-		}
-		j += m;
-	    }
-		//Danielson-Lanzcos routine 
-
-	    mmax=2;
-	    //external loop
-
-	    while (n > mmax)
-	    {
-		istep = mmax<<  1;
-		theta=(2*M_PI/mmax);
-		wtemp=sin(0.5*theta);
-		wpr = -2.0*wtemp*wtemp;
-		wpi=sin(theta);
-		wr=1.0;
-		wi=0.0;
-		//internal loops
-
-		for (m=1;m<mmax;m+=2) {
-		    for (i= m;i<=n;i+=istep) {
-		        j=i+mmax;
-		        tempr=wr*data[j-1]-wi*data[j];
-		        tempi=wr*data[j]+wi*data[j-1];
-		        data[j-1]=data[i-1]-tempr;
-		        data[j]=data[i]-tempi;
-		        data[i-1] += tempr;
-		        data[i] += tempi;
-		    }
-		    wr=(wtemp=wr)*wpr-wi*wpi+wr;
-		    wi=wi*wpr+wtemp*wpi+wi;
-		}
-		mmax=istep;
-	    }
-		return data[0];
-	}
-
-	int PeriodogramComponent::PSDlog (float data[], float dataOut[],int N)
-	{
-		int i;
-		for(i=0;i<2*N;i+=2)
-		{ 
-			dataOut[i/2]=data[i]*data[i]+data[i+1]*data[i+1];
-			dataOut[i/2]=10*log10f(dataOut[i/2]);
-		}
-		return 0;
-
-	}
-	int PeriodogramComponent::PSD (float data[], float dataOut[],int N)
-	{
-		int i;
-		for(i=0;i<2*N;i+=2)
-		{ 
-			dataOut[i/2]=data[i]*data[i]+data[i+1]*data[i+1];
-		}
-		return 0;
-
-	}
-		// Shift the center frequency to the middle and mirror the left part
-	void PeriodogramComponent::PSDshift(float data[],float dataOut[],unsigned long number_of_total_samples)
-	{
-		int i;
-		for(i = 0;i<number_of_total_samples/2;i++)
-		{
-			dataOut[i] = data[i+number_of_total_samples/2];
-		}
-		for(i = number_of_total_samples/2;i<number_of_total_samples;i++)
-		{
-			dataOut[i] = data[i-number_of_total_samples/2];
-		}
-
-	}
-	// the same as han window in matlab and octave
-	int PeriodogramComponent::winHan(int N,float windowedData[])
-	{
-		float *window = (float*) malloc (N*sizeof(float));	
-		int i;
-		for(i=0;i<N;i++)
-		{
-			window[i]=0.5*( 1-cos( 2*pi*(i+1)/(N+1) ) );
-		}
-		for(i=0;i<2*N;i+=2)
-		{
-			windowedData[i]*=window[i/2];
-			windowedData[i+1]*=window[i/2];
-		}
-		free((void*)window);
-		return 0;
-	}
-	// totallength and N are number of complex samples
-	void PeriodogramComponent::periodogram(int totallength,int N,float data[],float result[])
-	{
-		 int num_of_block = 2*totallength/N-1;
-		 float datablock[2*N],PSDresult[N],PSDresultshift[N];
-		 int offset;
-		 clearArray(result,N);
-		 for( int i= 1;i<=num_of_block;i++)
-		 {
-		     offset = N/2*(i-1);
-		     copyblock(offset,N,data,datablock);
-		     winHan(N,datablock);
-		     FFT (datablock, N, 1);
-		     PSD(datablock,PSDresult,N);
-		     PSDshift(PSDresult,PSDresultshift,N);
-		     addArray(result,PSDresultshift,N);
-		 }
-		 avgArray(result,N,num_of_block);
-	}
-	void PeriodogramComponent::copyblock(int start,int N,float data[],float dataOut[])
-	{
-		for(int i = 0;i<2*N;i++){
-			dataOut[i] = data[start+i];
-		}
-	}
-	void PeriodogramComponent::addArray(float arrayA[],float arrayB[],int length)
-	{
-		for(int i=0;i<length;i++)
-		{
-			arrayA[i] = arrayA[i] + arrayB[i];
-		}
-		
-	}
-	void PeriodogramComponent::clearArray(float arrayA[],int length)
-	{
-		for(int i=0;i<length;i++)
-		{
-			arrayA[i] = 0.0;
-		}
-	}
-	void PeriodogramComponent::avgArray(float arrayA[],int length,int dev)
-	{
-		for(int i=0;i<length;i++)
-		{
-			arrayA[i] /= dev ;
-		}
-		
-	}
-	void PeriodogramComponent::log10Array(float arrayA[],int length)
-	{
-		for(int i=0;i<length;i++){
-			arrayA[i] = 10*log10f(arrayA[i]);
-		}		
-	}
+void PeriodogramComponent::setup()
+{
+  destroy();
+
+  int n = x_blocksize;
+  hop_ = max(1, (int)floor(n*(1-x_overlap)+0.5));
+  exponential_ = (x_averaging == "exponential");
+  numSegments_ = 0;
+  totalSegments_ = 0;
+
+  // The same as the hann window in matlab and octave
+  window_.resize(n);
+  for(int i=0;i<n;i++)
+    window_[i] = x_window ? 0.5*(1-cos(2*M_PI*(i+1)/(n+1))) : 1;
+
+  average_.assign(n, 0);
+  pending_.clear();
+  pending_.reserve(n);
+
+  fftIn_ = reinterpret_cast<Cplx*>(fftwf_malloc(sizeof(fftwf_complex)*n));
+  fftOut_ = reinterpret_cast<Cplx*>(fftwf_malloc(sizeof(fftwf_complex)*n));
+  fft_ = fftwf_plan_dft_1d(n,
+                           reinterpret_cast<fftwf_complex*>(fftIn_),
+                           reinterpret_cast<fftwf_complex*>(fftOut_),
+                           FFTW_FORWARD,
+                           FFTW_MEASURE);
+}
 
+void PeriodogramComponent::destroy()
+{
+  if(fft_ != NULL)
+    fftwf_destroy_plan(fft_);
+  if(fftIn_ != NULL)
+    fftwf_free(fftIn_);
+  if(fftOut_ != NULL)
+    fftwf_free(fftOut_);
+  fft_ = NULL;
+  fftIn_ = NULL;
+  fftOut_ = NULL;
+}
+
+/** Split input into segments, carrying partial segments to the next call.
+ *
+ * pending_ holds the input samples which come before in[0] in the
+ * next segment. Segments held entirely in the input are used in place.
+ */
+void PeriodogramComponent::addSamples(const Cplx* in, std::size_t n)
+{
+  const size_t segLength = x_blocksize;
+  while(pending_.size() + n >= segLength)
+  {
+    size_t numPending = pending_.size();
+    addSegment(numPending ? &pending_[0] : in, numPending, in);
+
+    // Move on to the start of the next segment
+    if((size_t)hop_ >= numPending)
+    {
+      in += hop_ - numPending;
+      n -= hop_ - numPending;
+      pending_.clear();
+    }
+    else
+    {
+      pending_.erase(pending_.begin(), pending_.begin()+hop_);
+    }
+  }
+  pending_.insert(pending_.end(), in, in+n);
+}
+
+/// Add a segment made up of numFirst samples from first, then from second.
+void PeriodogramComponent::addSegment(const Cplx* first, int numFirst,
+                                      const Cplx* second)
+{
+  const int n = x_blocksize;
+  for(int i=0;i<numFirst;i++)
+    fftIn_[i] = first[i]*window_[i];
+  for(int i=numFirst;i<n;i++)
+    fftIn_[i] = second[i-numFirst]*window_[i];
+
+  fftwf_execute(fft_);
+
+  const float* bins = reinterpret_cast<const float*>(fftOut_);
+  float* avg = &average_[0];
+  ++totalSegments_;
+  if(exponential_)
+  {
+    // Average linearly until alpha outweighs the first segments
+    float a = max(x_alpha, 1.0f/totalSegments_);
+    for(int i=0;i<n;i++)
+    {
+      float p = bins[2*i]*bins[2*i] + bins[2*i+1]*bins[2*i+1];
+      avg[i] += a*(p-avg[i]);
+    }
+  }
+  else
+  {
+    for(int i=0;i<n;i++)
+      avg[i] += bins[2*i]*bins[2*i] + bins[2*i+1]*bins[2*i+1];
+  }
+
+  if(++numSegments_ == x_numaverages && !exponential_)
+    writeOutput();
+}
+
+void PeriodogramComponent::writeOutput()
+{
+  const int n = x_blocksize;
+  DataSet< float >* writeDataSet = NULL;
+  getOutputDataSet("output1", writeDataSet, n);
+  float* out = &writeDataSet->data[0];
+
+  // Scale and (optionally) shift the center frequency to the middle
+  float scale = exponential_ ? 1.0f : 1.0f/numSegments_;
+  int shift = x_shift ? n/2 : 0;
+  for(int i=0;i<n-shift;i++)
+    out[i] = average_[i+shift]*scale;
+  for(int i=n-shift;i<n;i++)
+    out[i] = average_[i+shift-n]*scale;
+  toDecibels(out, n);
+
+  if(!exponential_)
+    fill(average_.begin(), average_.end(), 0);
+  numSegments_ = 0;
+
+  //Copy the timestamp and sample rate for the DataSets
+  writeDataSet->timeStamp = timeStamp_;
+  writeDataSet->sampleRate = sampleRate_;
+  releaseOutputDataSet("output1", writeDataSet);
+}
 
 } // namesapce phy
 } // namespace iris
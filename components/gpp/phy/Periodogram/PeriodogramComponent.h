@@ -28,14 +28,16 @@
  *
  * \section DESCRIPTION
  *
- * A Periodogram PhyComponent
+ * A Periodogram PhyComponent. Estimates the power spectral density of
+ * its input using Welch's method.
  */
 
 #ifndef PHY_PERIODOGRAMCOMPONENT_H_
 #define PHY_PERIODOGRAMCOMPONENT_H_
-#define SWAP(a,b) tempr=(a);(a)=(b);(b)=tempr
-#define pi 3.14159
 
+#include <complex>
+#include <vector>
+#include "fftw3.h"
 #include "irisapi/PhyComponent.h"
 
 namespace iris
@@ -45,13 +47,20 @@ namespace phy
 
 /**  A Periodogram PhyComponent
  *
- * Copy this component, rename folder, .h and .cpp files.
- * Edit all files for your new component and build.
+ * Splits the input stream into overlapping segments of blocksize samples,
+ * windows and transforms each segment and averages the power spectra.
+ * Segments may span input DataSets. Averaging is either linear, over a
+ * fixed number of segments or over the segments of each input DataSet,
+ * or exponential. The output is in dB.
  */
 class PeriodogramComponent
   : public PhyComponent
 {
  public:
+  typedef std::complex<float>   Cplx;
+  typedef std::vector<Cplx>     CplxVec;
+  typedef std::vector<float>    FloatVec;
+
 	/** Construct this component.
 	 *
 	 * Call the constructor on PhyComponent and pass in all details
@@ -59,6 +68,7 @@ class PeriodogramComponent
 	 * \param name the name given to this component in the radio config
 	 */
   PeriodogramComponent(std::string name);
+  ~PeriodogramComponent();
 
   /** Calculate the output types generated by this component.
    *
@@ -89,27 +99,41 @@ class PeriodogramComponent
 	 */
   virtual void process();
 
+  /// Set up the estimator again when a parameter changes.
+  virtual void parameterHasChanged(std::string name);
+
  private:
 
-	// Periodogram pin number
-	int x_number_of_complex_samples;
-	int x_shift;
-	int x_window,x_blocksize;
-        float FFT(float data[], unsigned long number_of_complex_samples, int isign);
-	int PSDlog (float data[], float dataOut[],int N);
-	int PSD (float data[], float dataOut[],int N);
-	void PSDshift(float data[],float dataOut[],unsigned long number_of_total_samples);
-	int winHan(int N,float windowedData[]);
-	void periodogram(int totallength,int N,float data[],float result[]);
-	void copyblock(int start,int N,float data[],float dataOut[]);
-	void addArray(float arrayA[],float arrayB[],int length);
-	void clearArray(float arrayA[],int length);
-	void avgArray(float arrayA[],int length,int dev);
-	void log10Array(float arrayA[],int length);
+  void setup();
+  void destroy();
+  void addSamples(const Cplx* in, std::size_t n);
+  void addSegment(const Cplx* first, int numFirst, const Cplx* second);
+  void writeOutput();
+
+  int x_number_of_complex_samples;
+  int x_shift;                ///< Apply fftshift to output (1 = yes)
+  int x_window;               ///< Apply Hann window to segments (1 = yes)
+  int x_blocksize;            ///< Segment and output length
+  float x_overlap;            ///< Fraction of each segment overlapping the next
+  std::string x_averaging;    ///< "linear" or "exponential"
+  int x_numaverages;          ///< Segments per output (linear, 0 = per DataSet)
+  float x_alpha;              ///< Weight of each new segment (exponential)
 
+  int hop_;                   ///< Samples between segment starts.
+  bool exponential_;          ///< Exponential (rather than linear) averaging.
+  int numSegments_;           ///< Segments added since the last output.
+  int totalSegments_;         ///< Segments added since setup.
+  double timeStamp_;          ///< Timestamp of current input.
+  double sampleRate_;         ///< Sample rate of current input.
+  FloatVec window_;           ///< Window applied to each segment.
+  FloatVec average_;          ///< Sum or average of segment power spectra.
+  CplxVec pending_;           ///< Input samples of a partial segment.
+  Cplx* fftIn_;               ///< Windowed segment (fftwf_malloc)
+  Cplx* fftOut_;              ///< Spectrum of segment (fftwf_malloc)
+  fftwf_plan fft_;            ///< Our forward fft plan.
 };
 
 } // namespace phy
 } // namespace iris
 
-#endif // PHY_EXAMPLECOMPONENT_H_
+#endif // PHY_PERIODOGRAMCOMPONENT_H_
@@ -0,0 +1,229 @@
+/**
+ * \file components/gpp/phy/Periodogram/test/PeriodogramComponent_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ * 
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for Periodogram component.
+ */
+
+#define BOOST_TEST_MODULE PeriodogramComponent_Test
+
+#include <boost/test/unit_test.hpp>
+
+#include "../PeriodogramComponent.h"
+#include "utility/DataBufferTrivial.h"
+
+using namespace std;
+using namespace iris;
+using namespace iris::phy;
+
+typedef complex<float>  Cplx;
+typedef vector<Cplx>    CplxVec;
+typedef vector<float>   FloatVec;
+
+// A tone at the given frequency (cycles/sample)
+CplxVec tone(int length, float f, float a)
+{
+  CplxVec v(length);
+  for(int i=0; i<length; i++)
+    v[i] = polar(a, float(2*M_PI*f*i));
+  return v;
+}
+
+// Run input through a periodogram in blocks of the given sizes
+vector<FloatVec> estimate(PeriodogramComponent& p, const CplxVec& input,
+                          vector<int> blockSizes)
+{
+  DataBufferTrivial<Cplx> in;
+  DataBufferTrivial<float> out;
+  p.registerPorts();
+  p.setBuffers(&in, &out);
+  p.initialize();
+
+  vector<FloatVec> result;
+  int pos = 0;
+  for(int b=0; pos<input.size(); b=(b+1)%blockSizes.size())
+  {
+    int n = min(blockSizes[b], (int)input.size()-pos);
+    DataSet<Cplx>* iSet = NULL;
+    in.getWriteData(iSet, n);
+    copy(input.begin()+pos, input.begin()+pos+n, iSet->data.begin());
+    iSet->sampleRate = 1e6;
+    iSet->timeStamp = pos/1e6;
+    in.releaseWriteData(iSet);
+    p.process();
+    pos += n;
+
+    while(out.hasData())
+    {
+      DataSet<float>* oSet = NULL;
+      out.getReadData(oSet);
+      result.push_back(oSet->data);
+      out.releaseReadData(oSet);
+    }
+  }
+  return result;
+}
+
+BOOST_AUTO_TEST_SUITE (PeriodogramComponent_Test)
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Basic_Test)
+{
+  BOOST_REQUIRE_NO_THROW(PeriodogramComponent p("test"));
+}
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Parm_Test)
+{
+  PeriodogramComponent p("test");
+  BOOST_CHECK(p.getParameterDefaultValue("blocksize") == "1024");
+  BOOST_CHECK(p.getParameterDefaultValue("overlap") == "0.5");
+  BOOST_CHECK(p.getParameterDefaultValue("averaging") == "linear");
+  BOOST_CHECK(p.getParameterDefaultValue("numaverages") == "0");
+  BOOST_CHECK(p.getParameterDefaultValue("alpha") == "0.1");
+}
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Ports_Test)
+{
+  PeriodogramComponent p("test");
+  BOOST_REQUIRE_NO_THROW(p.registerPorts());
+
+  vector<Port> iPorts = p.getInputPorts();
+  BOOST_REQUIRE(iPorts.size() == 1);
+  BOOST_CHECK(iPorts.front().portName == "input1");
+  BOOST_CHECK(iPorts.front().supportedTypes.front() ==
+      TypeInfo< complex<float> >::identifier);
+
+  vector<Port> oPorts = p.getOutputPorts();
+  BOOST_REQUIRE(oPorts.size() == 1);
+  BOOST_CHECK(oPorts.front().portName == "output1");
+  BOOST_CHECK(oPorts.front().supportedTypes.front() ==
+      TypeInfo< float >::identifier);
+}
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Tone_Test)
+{
+  // Unwindowed tone in bin 8 of 64, shifted to bin 40
+  PeriodogramComponent p("test");
+  p.setValue("blocksize", 64);
+  p.setValue("window", 0);
+  vector<FloatVec> out = estimate(p, tone(512, 8.0/64, 1.0), vector<int>(1, 512));
+  BOOST_REQUIRE_EQUAL(out.size(), 1u);
+  BOOST_REQUIRE_EQUAL(out[0].size(), 64u);
+  BOOST_CHECK_CLOSE(out[0][40], 20*log10(64.0), 0.01);
+  for(int i=0; i<64; i++)
+    if(i != 40)
+      BOOST_CHECK_LT(out[0][i], -40);
+}
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Floor_Test)
+{
+  // Zero power gives the same floor in every bin, whichever way it is
+  // converted to dB (blocksize 6 isn't a multiple of the vector width)
+  PeriodogramComponent p("test");
+  p.setValue("blocksize", 6);
+  vector<FloatVec> out = estimate(p, CplxVec(60), vector<int>(1, 60));
+  BOOST_REQUIRE_EQUAL(out.size(), 1u);
+  for(int i=0; i<6; i++)
+    BOOST_CHECK_CLOSE(out[0][i], -300.0f, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Split_Test)
+{
+  // Segments split across input blocks give the same estimates
+  CplxVec input = tone(2048, 0.1, 1.0);
+  CplxVec other = tone(2048, -0.27, 0.3);
+  for(int i=0; i<2048; i++)
+    input[i] += other[i] * float(i%7);
+
+  PeriodogramComponent whole("test");
+  whole.setValue("blocksize", 64);
+  whole.setValue("numaverages", 4);
+  vector<FloatVec> expected = estimate(whole, input, vector<int>(1, 2048));
+
+  // 63 segments with a hop of 32, so 15 outputs of 4
+  BOOST_REQUIRE_EQUAL(expected.size(), 15u);
+
+  PeriodogramComponent split("test");
+  split.setValue("blocksize", 64);
+  split.setValue("numaverages", 4);
+  int sizes[] = {7, 100, 33, 1, 64, 500};
+  vector<FloatVec> out = estimate(split, input, vector<int>(sizes, sizes+6));
+  BOOST_REQUIRE_EQUAL(out.size(), expected.size());
+  for(size_t k=0; k<out.size(); k++)
+    for(int i=0; i<64; i++)
+      BOOST_CHECK_SMALL(out[k][i] - expected[k][i], 1e-3f);
+}
+
+BOOST_AUTO_TEST_CASE(PeriodogramComponent_Exponential_Test)
+{
+  // 16 segments of a tone, then 32 at twice the amplitude
+  CplxVec input = tone(3072, 8.0/64, 1.0);
+  for(int i=1024; i<3072; i++)
+    input[i] *= 2;
+  int sizes[] = {100, 1000, 37, 291};
+  vector<int> blocks(sizes, sizes+4);
+
+  // Linear, over all the segments
+  PeriodogramComponent linear("test");
+  linear.setValue("blocksize", 64);
+  linear.setValue("window", 0);
+  linear.setValue("overlap", 0.0f);
+  linear.setValue("numaverages", 48);
+  vector<FloatVec> lin = estimate(linear, input, blocks);
+  BOOST_REQUIRE_EQUAL(lin.size(), 1u);
+  double power = (16*64.0*64 + 32*128.0*128)/48;
+  BOOST_CHECK_CLOSE(lin[0][40], 10*log10(power), 0.01);
+
+  // Exponential, output for each input block which completes a segment
+  // (all but the 37 sample one at 1100). While 1/segments is
+  // greater than alpha, the average is linear.
+  PeriodogramComponent slow("test");
+  slow.setValue("blocksize", 64);
+  slow.setValue("window", 0);
+  slow.setValue("overlap", 0.0f);
+  slow.setValue("averaging", "exponential");
+  slow.setValue("alpha", 0.01f);
+  vector<FloatVec> exp = estimate(slow, input, blocks);
+  BOOST_REQUIRE_EQUAL(exp.size(), 9u);
+  BOOST_CHECK_CLOSE(exp.back()[40], lin[0][40], 0.01);
+
+  // With a large alpha, the estimate follows the louder tone
+  PeriodogramComponent fast("test");
+  fast.setValue("blocksize", 64);
+  fast.setValue("window", 0);
+  fast.setValue("overlap", 0.0f);
+  fast.setValue("averaging", "exponential");
+  fast.setValue("alpha", 0.5f);
+  exp = estimate(fast, input, blocks);
+  BOOST_REQUIRE_EQUAL(exp.size(), 9u);
+  BOOST_CHECK_CLOSE(exp[0][40], 20*log10(64.0), 0.01);
+  BOOST_CHECK_CLOSE(exp.back()[40], 20*log10(128.0), 0.01);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -45,6 +45,11 @@
 
 #include <stdio.h>
 #include <map>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 using namespace boost::assign;
@@ -82,11 +87,20 @@ RtlRxComponent::RtlRxComponent(std::string name)
 		//registerParameter("bw", "Bandwidth in Hz","0",false,bw_x);
 		registerParameter("deviceindex", "Device Index","0",false,device_index_x, Interval<int>(0,4));
 
+		registerEvent("overflow", "Total number of device buffers dropped because the receive ring was full", TypeInfo< uint32_t >::identifier);
+
+		rtl_dev = NULL;
 		running_d = false;
 		currentTimestamp_d = 0.0;
 		skipped_d = 0;
 		rtl_clock_freq_d = 0;
 		tuner_clock_freq_d = 0;
+		write_count_d = 0;
+		read_count_d = 0;
+		read_offset_d = 0;
+		pending_dropped_d = 0;
+		overflows_d = 0;
+		reported_overflows_d = 0;
 }
 
 RtlRxComponent::~RtlRxComponent()
@@ -99,16 +113,6 @@ RtlRxComponent::~RtlRxComponent()
     		rtlsdr_close(rtl_dev);
     		rtl_dev = NULL;
     	}
-
-    	if (buf_d) {
-    	    for(unsigned int i = 0; i < buf_num_d; ++i) {
-    	      if (buf_d[i])
-    	        free(buf_d[i]);
-    	    }
-
-    	    free(buf_d);
-    	    buf_d = NULL;
-    	  }
     }
 
 void RtlRxComponent::registerPorts()
@@ -161,21 +165,6 @@ void RtlRxComponent::initialize()
 				*/
 				
 				
-				//Set up lut for tranforming raw data to complex<float> 
-				//See http://sdr.osmocom.org/trac/attachment/wiki/rtl-sdr/rtl2832-cfile.png
-				
-				//First deinterleave 8-bit I and Q samples, depending on endian convention. Then add a constant (-127) and multiply by 0.008.
-				  for (unsigned int i = 0; i <= 0xffff; i++)
-				  {
-					#ifdef BOOST_LITTLE_ENDIAN
-						lut_d.push_back(std::complex<float> ( (float(i & 0xff) - 127.5f) * (1.0f/128.0f),
-														   (float(i >> 8) - 127.5f) * (1.0f/128.0f) ) );
-					#else // BOOST_BIG_ENDIAN
-						lut_d.push_back(std::complex<float> ( (float(i >> 8) - 127.5f) * (1.0f/128.0f),
-														   (float(i & 0xff) - 127.5f) * (1.0f/128.0f) ) );
-					#endif
-				  }
-				
 				//Set properties on device
 				
 				LOG(LINFO) << "Setting RX Rate: " << (rate_x/1e6) << "Msps...";
@@ -250,20 +239,16 @@ void RtlRxComponent::initialize()
 				
 				//boost::this_thread::sleep(boost::posix_time::seconds(1)); //allow for some setup time	  
 				
-				//Allocate recv buffer and metadata
-				buf_num_d = BUF_NUM;
-				buf_head_d = buf_used_d = buf_offset_d = 0;
-				samp_avail_d = BUF_SIZE / BYTES_PER_SAMPLE;
-				
-				buf_d = (unsigned short **) malloc(buf_num_d * sizeof(unsigned short *));
-
-				if (buf_d)
-				{
-				   for(unsigned int i = 0; i < buf_num_d; ++i)
-				      buf_d[i] = (unsigned short *) malloc(BUF_SIZE);
-				}
+				//Allocate the receive ring
+				ring_d.assign(BUF_NUM * BUF_SIZE, 0);
+				ring_len_d.assign(BUF_NUM, 0);
+				ring_dropped_d.assign(BUF_NUM, 0);
+				write_count_d = 0;
+				read_count_d = 0;
+				read_offset_d = 0;
 				
 				//Create a new thread for the wait & read function
+				running_d = true;
 				thread_d = boost::thread(rtlsdrWait, this);
 				
 			}
@@ -284,83 +269,58 @@ void RtlRxComponent::initialize()
 
  void RtlRxComponent::process()
     {
-    	running_d = true;
-    	std::vector<std::complex<float> > out;
-    	
     	//Get a DataSet from the output DataBuffer
     	DataSet< complex<float> >* writeDataSet = NULL;
 		getOutputDataSet("output1", writeDataSet, outputBlockSize_x);
-    	
-    	try
-    	{
-    		{	//Get lock on mutex
-				boost::mutex::scoped_lock lock( buf_mutex_d );
-				
-				while (buf_used_d < 3 && running_d) //Collect at least 3 buffers on other thread
-					buf_cond_d.wait( lock );		//Hold lock
-    		}
-    		//Release lock
-    		
-			unsigned short *buf = buf_d[buf_head_d] + buf_offset_d;
-			
-			//ASSUMPTION: outputBlockSize_x < BUF_SIZE / BYTES_PER_SAMPLE
-			
-			//If we can only proccess a section of the buffer, read up to this point
-			if (writeDataSet->data.size() <= samp_avail_d) 
+		complex<float> *out = &writeDataSet->data[0];
+		int size = writeDataSet->data.size();
+		uint32_t dropped = 0;
+
+		//Convert samples straight from the ring, moving across buffers as needed
+		int done = 0;
+		while (done < size)
+		{
+			unsigned int readCount = read_count_d.load(boost::memory_order_relaxed);
+			if (write_count_d.load(boost::memory_order_acquire) == readCount)
 			{
-				for (int i = 0; i < writeDataSet->data.size(); ++i)
-				{
-					//Vector of std::complex<float>
-					out.push_back(lut_d[ *(buf + i) ]);				//Pass each IQ sample to out through the lut
-				}
-			
-				buf_offset_d += writeDataSet->data.size();
-				samp_avail_d -= writeDataSet->data.size();
-				
-			} 
-			
-			else 	// Else read remainder of buffer
+				if (!running_d)
+					throw IrisException("Rtl device stopped streaming.");
+				boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+				continue;
+			}
+
+			unsigned int slot = readCount % BUF_NUM;
+			if (read_offset_d == 0)
+				dropped += ring_dropped_d[slot];
+
+			const unsigned char *buf = &ring_d[slot * BUF_SIZE];
+			int avail = ring_len_d[slot] / BYTES_PER_SAMPLE - read_offset_d;
+			int num = min(avail, size - done);
+			convertSamples(buf + read_offset_d * BYTES_PER_SAMPLE, num, out + done);
+			done += num;
+			read_offset_d += num;
+
+			//Hand the buffer back to the device thread
+			if (num == avail)
 			{
-				
-				for (int i = 0; i < samp_avail_d; ++i)
-				{
-					out.push_back(lut_d[ *(buf + i) ]);					//Pass each IQ sample to out through the lut
-				}
-				
-				// Move to next buffer and free current buffer.
-				{
-					//Get lock on mutex
-				boost::mutex::scoped_lock lock(buf_mutex_d);
-				buf_head_d = (buf_head_d + 1) % buf_num_d;
-				buf_used_d--;
-				}
-				//Release lock
-				
-				buf = buf_d[buf_head_d];
-			
-				int remaining = writeDataSet->data.size() - samp_avail_d;
-			
-				for (int i = 0; i < remaining; ++i)
-				{
-					out.push_back(lut_d[ *(buf + i) ]);					//Pass each IQ sample to out through the lut
-				}
-				
-				buf_offset_d = remaining;
-				samp_avail_d = (BUF_SIZE / BYTES_PER_SAMPLE) - remaining;
-			  }
-			
-			//Copy the input DataSet to the output DataSet
-			copy(out.begin(), out.end(), writeDataSet->data.begin());	
+				read_offset_d = 0;
+				read_count_d.store(readCount + 1, boost::memory_order_release);
+			}
+		}
 
+		//Report overflows
+		unsigned int overflows = overflows_d.load(boost::memory_order_relaxed);
+		if (overflows != reported_overflows_d)
+		{
+			LOG(LWARNING) << "Dropped " << overflows - reported_overflows_d
+			              << " device buffers (" << overflows << " in total)";
+			reported_overflows_d = overflows;
+			activateEvent("overflow", (uint32_t)overflows);
 		}
-    	catch(...)
-    	{
-    	    throw IrisException("Unexpected exception caught");
-    	}
     	
-		//Set the metadata
+		//Set the metadata, skipping over any dropped samples
 		double rate = rtlsdr_get_sample_rate(rtl_dev);
-		currentTimestamp_d = currentTimestamp_d + time_spec_t(0, outputBlockSize_x, rate);
+		currentTimestamp_d = currentTimestamp_d + time_spec_t(0, outputBlockSize_x + dropped, rate);
 		
 		writeDataSet->sampleRate = rate;
 		writeDataSet->timeStamp = currentTimestamp_d.get_real_secs();
@@ -369,7 +329,36 @@ void RtlRxComponent::initialize()
 		releaseOutputDataSet("output1", writeDataSet);	
     }
 
-
+	/*! Convert 8 bit unsigned IQ samples to complex<float>
+	 *
+	 *	Each byte maps to (x - 127.5) / 128. I comes before Q in the device buffer.
+	 */
+	void RtlRxComponent::convertSamples(const unsigned char *in, int num, complex<float> *out)
+	{
+		float *outFloat = reinterpret_cast<float*>(out);
+		int numBytes = num * BYTES_PER_SAMPLE;
+		int i = 0;
+#ifdef __SSE2__
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 offset = _mm_set1_ps(127.5f);
+		const __m128 scale = _mm_set1_ps(1.0f/128.0f);
+		for (; i + 16 <= numBytes; i += 16)
+		{
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+			__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+			__m128i words[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+			                    _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+			for (int j = 0; j < 4; j++)
+			{
+				__m128 f = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(words[j]), offset), scale);
+				_mm_storeu_ps(outFloat + i + 4*j, f);
+			}
+		}
+#endif
+		for (; i < numBytes; i++)
+			outFloat[i] = (float(in[i]) - 127.5f) * (1.0f/128.0f);
+	}
 
 	/*! The callback function that gets called by the device every time samples are available. 
 	 *
@@ -389,28 +378,23 @@ void RtlRxComponent::initialize()
     		skipped_d++;
     		return;
     	}
-    	//LOG(LINFO) << "Log: Read";
-    	{	
-    		//Get lock on mutex
-    		boost::mutex::scoped_lock lock( buf_mutex_d );
-    		
-    		int buf_tail_d = (buf_head_d + buf_used_d) % buf_num_d;
-    			memcpy(buf_d[buf_tail_d], buf, len);
-    		
-    		if (buf_used_d == buf_num_d)
-    		{
-    			//std::cerr << "O" << std::flush;
-    			buf_head_d = (buf_head_d + 1) % buf_num_d;
-    		} 
-    		else 
-    		{
-    			buf_used_d++;
-    		}
+
+    	len = min(len, (uint32_t)BUF_SIZE);
+    	unsigned int writeCount = write_count_d.load(boost::memory_order_relaxed);
+    	if (writeCount - read_count_d.load(boost::memory_order_acquire) == BUF_NUM)
+    	{
+    		//Ring is full - drop this buffer rather than block the device
+    		pending_dropped_d += len / BYTES_PER_SAMPLE;
+    		overflows_d.fetch_add(1, boost::memory_order_relaxed);
+    		return;
     	}
-    	//Release lock
-    	
-    	//LOG(LINFO) << "Log: Read Success";
-    	buf_cond_d.notify_one();
+
+    	unsigned int slot = writeCount % BUF_NUM;
+    	memcpy(&ring_d[slot * BUF_SIZE], buf, len);
+    	ring_len_d[slot] = len;
+    	ring_dropped_d[slot] = pending_dropped_d;
+    	pending_dropped_d = 0;
+    	write_count_d.store(writeCount + 1, boost::memory_order_release);
     }
     
     /*! The read function that waits for the device to output samples 
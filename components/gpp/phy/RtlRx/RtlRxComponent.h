@@ -37,6 +37,7 @@
 #include "irisapi/PhyComponent.h"
 
 #include <boost/thread.hpp>
+#include <boost/atomic.hpp>
 
 #include "rtlsdr_ranges.h"
 #include "rtlsdr_time_spec.h"
@@ -110,20 +111,24 @@ private:
 	rtl::gain_range_t range;
 	rtl::time_spec_t currentTimestamp_d;
 	
-	bool running_d;
+	boost::atomic<bool> running_d;
 	unsigned int skipped_d;			//Skip a certain number of buffers while the receiver is initialising.
-	unsigned int buf_num_d;			//Number of buffers
-	unsigned int buf_head_d;
-	unsigned int buf_used_d;
-	unsigned int buf_offset_d;
-	boost::mutex buf_mutex_d;		//Need to have seperate threads for reading and outputting the samples 
-	boost::condition_variable buf_cond_d;
 	boost::thread thread_d;
-	unsigned short **buf_d;
-	int samp_avail_d;
 	int rtl_clock_freq_d; 
 	int tuner_clock_freq_d;
-	std::vector<std::complex<float> > lut_d;
+
+	// Single-producer/single-consumer ring of device buffers. The device
+	// thread fills the slot at write_count_d, process() reads the slot at
+	// read_count_d. Counts only ever increase; each is written by one thread.
+	std::vector<unsigned char> ring_d;		//BUF_NUM buffers of BUF_SIZE bytes
+	std::vector<uint32_t> ring_len_d;		//Bytes in each buffer
+	std::vector<uint32_t> ring_dropped_d;		//Samples dropped before each buffer
+	boost::atomic<unsigned int> write_count_d;	//Buffers written by the device thread
+	boost::atomic<unsigned int> read_count_d;	//Buffers consumed by process()
+	unsigned int read_offset_d;			//Samples consumed from current buffer
+	uint32_t pending_dropped_d;			//Samples dropped since last buffer written (device thread)
+	boost::atomic<unsigned int> overflows_d;	//Buffers dropped because the ring was full
+	unsigned int reported_overflows_d;		//Overflows reported with the overflow event
 	
 
 	// Exposed Parameters
@@ -146,6 +151,7 @@ private:
 	void rtlsdrCallbackHelp(unsigned char *buf, uint32_t len);
 	static void rtlsdrWait(RtlRxComponent *obj);
 	void rtlsdrWaitHelp();
+	static void convertSamples(const unsigned char *in, int num, std::complex<float> *out);
 
 };
 
@@ -33,6 +33,8 @@
 
 #include "TcpSocketRxComponent.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/thread/thread.hpp> //For sleep()
 
 #include "irisapi/LibraryDefs.h"
@@ -56,8 +58,10 @@ TcpSocketRxComponent::TcpSocketRxComponent(string name)
                 "A TCP socket receiver",
                 "Paul Sutton",
                 "0.1"),
-  buffer_(NULL),
-  connected_(false)
+  socket_(NULL),
+  acceptor_(NULL),
+  connected_(false),
+  bStopping_(false)
 {
   //Register all parameters
   /*
@@ -84,6 +88,22 @@ TcpSocketRxComponent::TcpSocketRxComponent(string name)
                     "uint8_t",
                     false,
                     outputType_x);
+  registerParameter("framing",
+                    "Is data sent as frames, each starting with a SampleHeader? "
+                    "(if not, bufferSize bytes are read for each output)",
+                    "false",
+                    false,
+                    framing_x);
+  registerParameter("maxFrameSize",
+                    "Largest frame accepted, in bytes",
+                    "67108864",
+                    false,
+                    maxFrameSize_x);
+  registerParameter("receiveBufferSize",
+                    "Size of the socket receive buffer in bytes (0 = system default)",
+                    "0",
+                    false,
+                    receiveBufferSize_x);
 }
 
 void TcpSocketRxComponent::registerPorts()
@@ -136,14 +156,11 @@ void TcpSocketRxComponent::calculateOutputTypes(
 
 void TcpSocketRxComponent::initialize()
 {
-  //Create our buffer
-  buffer_ = new char[bufferSize_x];
-
   //Create socket and acceptor
   try
   {
     socket_ = new boost::asio::ip::tcp::socket(ioService_);
-    acceptor_ = new tcp::acceptor(ioService_, tcp::endpoint(tcp::v4(), port_x));
+    acceptor_ = new tcp::acceptor(ioService_);
   }
   catch(boost::system::system_error &e)
   {
@@ -153,11 +170,29 @@ void TcpSocketRxComponent::initialize()
 
 void TcpSocketRxComponent::start()
 {
+  bStopping_ = false;
+  connected_ = false;
+
+  //Clear out any handlers left over from the last run
+  work_.reset();
+  ioService_.reset();
+  ioService_.poll();
+  ioService_.reset();
+  work_.reset(new boost::asio::io_service::work(ioService_));
+
   //Open socket
   try
   {
     if(!acceptor_->is_open())
+    {
       acceptor_->open(tcp::v4());
+      acceptor_->set_option(tcp::acceptor::reuse_address(true));
+      if(receiveBufferSize_x > 0)
+        acceptor_->set_option(
+            tcp::socket::receive_buffer_size(receiveBufferSize_x));
+      acceptor_->bind(tcp::endpoint(tcp::v4(), port_x));
+      acceptor_->listen();
+    }
   }
   catch(boost::system::system_error &e)
   {
@@ -224,70 +259,260 @@ void TcpSocketRxComponent::process()
 template<typename T>
 void TcpSocketRxComponent::writeOutput()
 {
-  std::size_t size;
+  if(bStopping_)
+    return;
 
-  try
+  if(framing_x)
+    readFrame<T>();
+  else
+    readBlock<T>();
+}
+
+template<typename T>
+void TcpSocketRxComponent::readBlock()
+{
+  size_t numT = bufferSize_x/sizeof(T);
+  if(numT == 0)
+  {
+    LOG(LERROR) << "bufferSize of " << bufferSize_x
+                << " is too small for one element of data";
+    return;
+  }
+
+  //Don't take an output DataSet until there is data to put in it
+  if(!waitForData())
+    return;
+
+  //Get the output buffer
+  WriteBuffer< T >* outBuf = castToType<T>(outputBuffers[0]);
+  DataSet<T>* writeDataSet = NULL;
+  outBuf->getWriteData(writeDataSet, numT);
+
+  //Read straight into the output, carrying on after a reconnection
+  char* out = (char*)&writeDataSet->data[0];
+  size_t total = numT*sizeof(T);
+  size_t filled = 0;
+  while(filled < total)
   {
     if(!connected_)
     {
-      //Listen for connection if necessary
-      acceptor_->accept(*socket_);
-      connected_ = true;
+      if(!accept())
+        break;
+      //A new stream starts on an element boundary - drop any partial
+      //element left by the old one
+      if(filled % sizeof(T) != 0)
+      {
+        LOG(LINFO) << "Connection dropped part way through an element - dropped "
+                   << filled % sizeof(T) << " bytes";
+        filled -= filled % sizeof(T);
+      }
     }
-
-    //Get data from socket
-    //size = socket_->receive(boost::asio::buffer(d_buffer, x_bufferSize));
-    size = boost::asio::read(*socket_, boost::asio::buffer(buffer_, bufferSize_x));
+    size_t received = 0;
+    read(out+filled, total-filled, received);
+    filled += received;
   }
-  catch(boost::system::system_error &e)
+
+  //Stopped part way through - drop what we have. The DataSet can't be
+  //handed back, so it goes out empty.
+  if(filled < total)
   {
-    LOG(LERROR) << "Error listening on socket: " << e.what();
-    boost::this_thread::sleep(boost::posix_time::milliseconds(5000));
-    return;
+    LOG(LINFO) << "Stopped part way through a block - dropped " << filled
+               << " bytes";
+    writeDataSet->data.clear();
   }
 
-  //Check that we've an integer number of data types in the datagram
-  float f = size/(float)sizeof(T);
-  float intpart, rem;
-  rem = modf(f, &intpart);
-  if(rem != 0)
+  //Release the buffer
+  outBuf->releaseWriteData(writeDataSet);
+}
+
+template<typename T>
+void TcpSocketRxComponent::readFrame()
+{
+  //Read a valid header, reconnecting as needed
+  SampleHeader header;
+  uint8_t headerBytes[SampleHeader::size];
+  while(true)
   {
-    LOG(LERROR) << "Did not receive an integer number of elements. Input size = " << size;
+    if(!connected_ && !accept())
+      return;
+    size_t received = 0;
+    if(!read(headerBytes, SampleHeader::size, received))
+      continue;
+    if(!header.decode(headerBytes, SampleHeader::size) ||
+       header.length % sizeof(T) != 0 || header.length > maxFrameSize_x)
+    {
+      LOG(LERROR) << "Received an invalid frame header - dropping connection";
+      disconnect();
+      continue;
+    }
+    break;
   }
-  int numT = (int)intpart;
 
-  //Get the output buffer
+  size_t numT = header.length/sizeof(T);
+  if(numT == 0)
+    return;
+
+  //Get the output buffer and read the payload straight into it
   WriteBuffer< T >* outBuf = castToType<T>(outputBuffers[0]);
   DataSet<T>* writeDataSet = NULL;
   outBuf->getWriteData(writeDataSet, numT);
 
-  //Copy data into output
-  T* bufT = (T*)buffer_;
-  copy(bufT, bufT+numT, writeDataSet->data.begin());
+  char* out = (char*)&writeDataSet->data[0];
+  size_t received = 0;
+  if(!read(out, header.length, received))
+  {
+    if(bStopping_)
+    {
+      //As for a partial block, drop it
+      LOG(LINFO) << "Stopped part way through a frame - dropped "
+                 << received << " bytes";
+      writeDataSet->data.clear();
+    }
+    else
+    {
+      LOG(LWARNING) << "Connection lost part way through a frame - "
+                    << header.length-received << " bytes are missing";
+      fill(out+received, out+header.length, 0);
+    }
+  }
 
-  //Release the buffer
+  writeDataSet->timeStamp = header.timeStamp;
+  writeDataSet->sampleRate = header.sampleRate;
   outBuf->releaseWriteData(writeDataSet);
 }
 
-void TcpSocketRxComponent::stop()
+bool TcpSocketRxComponent::accept()
 {
-  //Close acceptor
-  try
+  while(!bStopping_)
   {
-    acceptor_->close();
-    socket_->close();
+    opDone_ = false;
+    acceptor_->async_accept(*socket_,
+                            boost::bind(&TcpSocketRxComponent::handleAccept,
+                                        this,
+                                        boost::asio::placeholders::error));
+    if(!wait())
+      return false;
+    if(!opError_)
+    {
+      connected_ = true;
+      boost::system::error_code ec;
+      LOG(LINFO) << "Accepted connection from " << socket_->remote_endpoint(ec);
+      return true;
+    }
+    if(opError_ == boost::asio::error::operation_aborted)
+      return false;
+
+    //Don't spin if accept keeps failing (e.g. out of file descriptors)
+    LOG(LERROR) << "Error listening on socket: " << opError_.message();
+    socket_->close(opError_);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
   }
-  catch(boost::system::system_error &e)
+  return false;
+}
+
+/// Wait until the connection has data to read (or has closed).
+bool TcpSocketRxComponent::waitForData()
+{
+  while(!bStopping_)
   {
-    LOG(LERROR) << "Failed to close socket: " << e.what();
+    if(!connected_ && !accept())
+      return false;
+    boost::system::error_code ec;
+    if(socket_->available(ec) > 0)
+      return true;
+
+    opDone_ = false;
+    socket_->async_read_some(boost::asio::null_buffers(),
+                             boost::bind(&TcpSocketRxComponent::handleRead,
+                                         this,
+                                         boost::asio::placeholders::error,
+                                         boost::asio::placeholders::bytes_transferred));
+    if(!wait())
+      return false;
+    if(!opError_)
+      return true;
+    if(opError_ != boost::asio::error::operation_aborted)
+      LOG(LERROR) << "Error reading from socket: " << opError_.message();
+    disconnect();
   }
+  return false;
 }
 
-TcpSocketRxComponent::~TcpSocketRxComponent()
+bool TcpSocketRxComponent::read(void* data, size_t bytes, size_t& received)
 {
-  //Destroy our buffer
-  delete [] buffer_;
+  opDone_ = false;
+  opBytes_ = 0;
+  boost::asio::async_read(*socket_, boost::asio::buffer(data, bytes),
+                          boost::bind(&TcpSocketRxComponent::handleRead,
+                                      this,
+                                      boost::asio::placeholders::error,
+                                      boost::asio::placeholders::bytes_transferred));
+  bool completed = wait();
+  received = opBytes_;
+  if(completed && !opError_)
+    return true;
+
+  if(completed && opError_ == boost::asio::error::eof)
+    LOG(LINFO) << "Connection closed by peer";
+  else if(completed && !bStopping_ &&
+          opError_ != boost::asio::error::operation_aborted)
+    LOG(LERROR) << "Error reading from socket: " << opError_.message();
+  disconnect();
+  return false;
+}
 
+/// Run the io_service until the pending operation completes.
+bool TcpSocketRxComponent::wait()
+{
+  while(!opDone_)
+  {
+    if(ioService_.run_one() == 0)
+      return false; // Stopped
+  }
+  return true;
+}
+
+void TcpSocketRxComponent::disconnect()
+{
+  boost::system::error_code ec;
+  socket_->close(ec);
+  connected_ = false;
+}
+
+void TcpSocketRxComponent::handleAccept(const boost::system::error_code& error)
+{
+  opError_ = error;
+  opDone_ = true;
+}
+
+void TcpSocketRxComponent::handleRead(const boost::system::error_code& error,
+                                      size_t bytes)
+{
+  opError_ = error;
+  opBytes_ = bytes;
+  opDone_ = true;
+}
+
+void TcpSocketRxComponent::handleStop()
+{
+  //Closing the acceptor and socket aborts any pending accept or read
+  boost::system::error_code ec;
+  acceptor_->close(ec);
+  if(ec)
+    LOG(LERROR) << "Failed to close socket: " << ec.message();
+  disconnect();
+}
+
+void TcpSocketRxComponent::stop()
+{
+  //The sockets are only touched from the thread running the io_service,
+  //so close them there
+  bStopping_ = true;
+  ioService_.post(boost::bind(&TcpSocketRxComponent::handleStop, this));
+}
+
+TcpSocketRxComponent::~TcpSocketRxComponent()
+{
   //Destroy socket and acceptor
   delete socket_;
   delete acceptor_;
@@ -29,15 +29,22 @@
  * \section DESCRIPTION
  *
  * A source component which listens to a TCP socket.
+ *
+ * Data is either read as a plain stream of elements or as frames, each
+ * starting with a SampleHeader giving its length, timeStamp and
+ * sampleRate. Data is read straight into the output DataSets.
  */
 
 #ifndef PHY_TCPSOCKETRXCOMPONENT_H_
 #define PHY_TCPSOCKETRXCOMPONENT_H_
 
 #include "irisapi/PhyComponent.h"
+#include "utility/SampleHeader.h"
 
 //For boost asio sockets
 #include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/atomic.hpp>
 
 namespace iris
 {
@@ -48,6 +55,10 @@ namespace phy
  *
  * The TcpSocketRxComponent receives data from a TCP socket. The port number,
  * buffer size and data type can be specified using parameters.
+ *
+ * The socket is driven asynchronously so that stop() can interrupt a
+ * pending accept or read. If the connection is lost, the component
+ * listens for a new one straight away.
  */
 class TcpSocketRxComponent
   : public PhyComponent
@@ -67,19 +78,40 @@ class TcpSocketRxComponent
  private:
   /// Template function used to write the output.
   template<typename T> void writeOutput();
+  /// Read a block of bufferSize_x bytes from the stream.
+  template<typename T> void readBlock();
+  /// Read one frame, with its SampleHeader.
+  template<typename T> void readFrame();
+
+  bool accept();
+  bool waitForData();
+  bool read(void* data, std::size_t bytes, std::size_t& received);
+  bool wait();
+  void disconnect();
+  void handleAccept(const boost::system::error_code& error);
+  void handleRead(const boost::system::error_code& error, std::size_t bytes);
+  void handleStop();
 
   unsigned short port_x;      ///< Port number to bind to.
   unsigned int bufferSize_x;  ///< Size of buffers to be generated.
   std::string outputType_x;   ///< Data type of output.
+  bool framing_x;             ///< Is data framed with SampleHeaders?
+  unsigned int maxFrameSize_x;  ///< Largest frame payload accepted, in bytes.
+  unsigned int receiveBufferSize_x; ///< Socket receive buffer in bytes (0 = system default).
 
   int outputTypeId_;          ///< The ID of the output data type
 
   boost::asio::io_service ioService_;
+  boost::scoped_ptr<boost::asio::io_service::work> work_;  ///< Keeps ioService_ running between operations.
   boost::asio::ip::tcp::socket* socket_;
   boost::asio::ip::tcp::acceptor* acceptor_;
 
-  char* buffer_;
   bool connected_;
+  boost::atomic<bool> bStopping_;       ///< Set by stop(), from another thread.
+
+  boost::atomic<bool> opDone_;          ///< Has the pending operation completed?
+  boost::system::error_code opError_;   ///< Result of the last operation.
+  std::size_t opBytes_;                 ///< Bytes read by the last operation.
 };
 
 } // namespace phy
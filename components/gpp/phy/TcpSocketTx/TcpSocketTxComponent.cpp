@@ -0,0 +1,360 @@
+/**
+ * \file components/gpp/phy/TcpSocketTx/TcpSocketTxComponent.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ *
+ * \section DESCRIPTION
+ *
+ * Implementation of a sink component which writes to a TCP socket.
+ */
+
+#include "TcpSocketTxComponent.h"
+
+#include <boost/bind.hpp>
+
+#include "irisapi/LibraryDefs.h"
+#include "irisapi/Version.h"
+#include "irisapi/TypeVectors.h"
+
+using namespace std;
+using namespace boost::asio::ip;
+
+namespace iris
+{
+namespace phy
+{
+
+// export library symbols
+IRIS_COMPONENT_EXPORTS(PhyComponent, TcpSocketTxComponent);
+
+TcpSocketTxComponent::TcpSocketTxComponent(string name)
+  : PhyComponent(name,
+                "tcpsockettx",
+                "A TCP socket transmitter",
+                "The Iris Project Developers",
+                "0.1"),
+  socket_(NULL),
+  timer_(NULL),
+  connected_(false),
+  bStopping_(false),
+  sequence_(0)
+{
+  //Register all parameters
+  /*
+   * format:
+   * registerParameter(name,
+   *                   description,
+   *                   default value,
+   *                   dynamic?,
+   *                   parameter,
+   *                   allowed values)
+   */
+  registerParameter("address",
+                    "Address of the target machine",
+                    "127.0.0.1",
+                    false,
+                    address_x);
+  registerParameter("port",
+                    "Port of the target machine",
+                    "1234",
+                    false,
+                    port_x);
+  registerParameter("framing",
+                    "Send each DataSet as a frame, starting with a SampleHeader?",
+                    "false",
+                    false,
+                    framing_x);
+  registerParameter("reconnectInterval",
+                    "Time between connection attempts in ms",
+                    "100",
+                    false,
+                    reconnectInterval_x);
+  registerParameter("sendBufferSize",
+                    "Size of the socket send buffer in bytes (0 = system default)",
+                    "0",
+                    false,
+                    sendBufferSize_x);
+}
+
+void TcpSocketTxComponent::registerPorts()
+{
+  //Register all ports
+  //This component supports all data types
+  vector<int> validTypes = convertToTypeIdVector<IrisDataTypes>();
+
+  //format:        (name, vector of valid types)
+  registerInputPort("input1", validTypes);
+}
+
+void TcpSocketTxComponent::calculateOutputTypes(
+    std::map<std::string,int>& inputTypes,
+    std::map<std::string,int>& outputTypes)
+{
+  //No output
+}
+
+void TcpSocketTxComponent::initialize()
+{
+  //Create socket and timer
+  try
+  {
+    socket_ = new tcp::socket(ioService_);
+    timer_ = new boost::asio::deadline_timer(ioService_);
+  }
+  catch(boost::system::system_error &e)
+  {
+    LOG(LERROR) << "Failed to create socket: " << e.what();
+  }
+}
+
+void TcpSocketTxComponent::start()
+{
+  bStopping_ = false;
+  connected_ = false;
+  sequence_ = 0;
+
+  //Clear out any handlers left over from the last run
+  work_.reset();
+  ioService_.reset();
+  ioService_.poll();
+  ioService_.reset();
+  work_.reset(new boost::asio::io_service::work(ioService_));
+}
+
+void TcpSocketTxComponent::process()
+{
+  switch(inputBuffers[0]->getTypeIdentifier())
+  {
+  case 0:
+    writeInput<uint8_t>();
+    break;
+  case 1:
+    writeInput<uint16_t>();
+    break;
+  case 2:
+    writeInput<uint32_t>();
+    break;
+  case 3:
+    writeInput<uint64_t>();
+    break;
+  case 4:
+    writeInput<int8_t>();
+    break;
+  case 5:
+    writeInput<int16_t>();
+    break;
+  case 6:
+    writeInput<int32_t>();
+    break;
+  case 7:
+    writeInput<int64_t>();
+    break;
+  case 8:
+    writeInput<float>();
+    break;
+  case 9:
+    writeInput<double>();
+    break;
+  case 10:
+    writeInput<long double>();
+    break;
+  case 11:
+    writeInput< complex<float> >();
+    break;
+  case 12:
+    writeInput< complex<double> >();
+    break;
+  case 13:
+    writeInput<complex< long double> >();
+    break;
+  default:
+    break;
+  }
+}
+
+template<typename T>
+void TcpSocketTxComponent::writeInput()
+{
+  //Get a read buffer
+  ReadBuffer<T>* inBuf = castToType<T>(inputBuffers[0]);
+  DataSet<T>* readDataSet = NULL;
+  inBuf->getReadData(readDataSet);
+
+  size_t bytes = readDataSet->data.size()*sizeof(T);
+  if(bytes > 0 && (connected_ || connect()))
+  {
+    //Header and data go out in one gathered write, straight from the DataSet
+    uint8_t headerBytes[SampleHeader::size];
+    vector<boost::asio::const_buffer> buffers;
+    if(framing_x)
+    {
+      SampleHeader header;
+      header.sequence = sequence_++;
+      header.length = bytes;
+      header.timeStamp = readDataSet->timeStamp;
+      header.sampleRate = readDataSet->sampleRate;
+      header.encode(headerBytes);
+      buffers.push_back(boost::asio::buffer(headerBytes, SampleHeader::size));
+    }
+    buffers.push_back(boost::asio::buffer(&readDataSet->data[0], bytes));
+
+    if(!write(buffers) && !bStopping_)
+    {
+      LOG(LWARNING) << "Connection to " << address_x << ", port " << port_x
+                    << " lost - dropped " << readDataSet->data.size()
+                    << " elements";
+    }
+  }
+
+  inBuf->releaseReadData(readDataSet);
+}
+
+bool TcpSocketTxComponent::connect()
+{
+  tcp::endpoint endPoint;
+  try
+  {
+    endPoint = tcp::endpoint(address::from_string(address_x), port_x);
+  }
+  catch(boost::system::system_error &e)
+  {
+    LOG(LERROR) << "Invalid address " << address_x << ": " << e.what();
+    return false;
+  }
+
+  bool reported = false;
+  while(!bStopping_)
+  {
+    opDone_ = false;
+    socket_->async_connect(endPoint,
+                           boost::bind(&TcpSocketTxComponent::handleOp,
+                                       this,
+                                       boost::asio::placeholders::error));
+    if(!wait())
+      return false;
+    if(!opError_)
+    {
+      boost::system::error_code ec;
+      socket_->set_option(tcp::no_delay(true), ec);
+      if(sendBufferSize_x > 0)
+        socket_->set_option(tcp::socket::send_buffer_size(sendBufferSize_x), ec);
+      connected_ = true;
+      LOG(LINFO) << "Connected to " << address_x << ", port " << port_x;
+      return true;
+    }
+    if(opError_ == boost::asio::error::operation_aborted)
+      return false;
+
+    if(!reported)
+    {
+      LOG(LWARNING) << "Failed to connect to " << address_x << ", port "
+                    << port_x << ": " << opError_.message() << " - retrying";
+      reported = true;
+    }
+    disconnect();
+
+    //Wait before trying again
+    opDone_ = false;
+    timer_->expires_from_now(boost::posix_time::milliseconds(reconnectInterval_x));
+    timer_->async_wait(boost::bind(&TcpSocketTxComponent::handleOp,
+                                   this,
+                                   boost::asio::placeholders::error));
+    if(!wait())
+      return false;
+  }
+  return false;
+}
+
+bool TcpSocketTxComponent::write(const vector<boost::asio::const_buffer>& buffers)
+{
+  opDone_ = false;
+  boost::asio::async_write(*socket_, buffers,
+                           boost::bind(&TcpSocketTxComponent::handleOp,
+                                       this,
+                                       boost::asio::placeholders::error));
+  bool completed = wait();
+  if(completed && !opError_)
+    return true;
+
+  if(completed && !bStopping_ &&
+     opError_ != boost::asio::error::operation_aborted)
+    LOG(LERROR) << "An error occurred while sending data to " << address_x
+                << ", port " << port_x << ": " << opError_.message();
+  disconnect();
+  return false;
+}
+
+/// Run the io_service until the pending operation completes.
+bool TcpSocketTxComponent::wait()
+{
+  while(!opDone_)
+  {
+    if(ioService_.run_one() == 0)
+      return false; // Stopped
+  }
+  return true;
+}
+
+void TcpSocketTxComponent::disconnect()
+{
+  boost::system::error_code ec;
+  socket_->close(ec);
+  connected_ = false;
+}
+
+void TcpSocketTxComponent::handleOp(const boost::system::error_code& error)
+{
+  opError_ = error;
+  opDone_ = true;
+}
+
+void TcpSocketTxComponent::handleStop()
+{
+  //Closing the socket and cancelling the timer aborts any pending
+  //connect, write or wait
+  boost::system::error_code ec;
+  timer_->cancel(ec);
+  disconnect();
+}
+
+void TcpSocketTxComponent::stop()
+{
+  //The socket is only touched from the thread running the io_service,
+  //so close it there
+  bStopping_ = true;
+  ioService_.post(boost::bind(&TcpSocketTxComponent::handleStop, this));
+}
+
+TcpSocketTxComponent::~TcpSocketTxComponent()
+{
+  //Destroy socket and timer
+  delete timer_;
+  delete socket_;
+}
+
+} // namespace phy
+} // namespace iris
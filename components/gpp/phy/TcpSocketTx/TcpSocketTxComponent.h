@@ -0,0 +1,109 @@
+/**
+ * \file components/gpp/phy/TcpSocketTx/TcpSocketTxComponent.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A sink component which writes to a TCP socket.
+ *
+ * Data is either written as a plain stream of elements or as frames,
+ * each starting with a SampleHeader giving its length, timeStamp and
+ * sampleRate. Frames can be read by the TcpSocketRx component.
+ */
+
+#ifndef PHY_TCPSOCKETTXCOMPONENT_H_
+#define PHY_TCPSOCKETTXCOMPONENT_H_
+
+#include "irisapi/PhyComponent.h"
+#include "utility/SampleHeader.h"
+
+//For boost asio sockets
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/atomic.hpp>
+
+namespace iris
+{
+namespace phy
+{
+
+/** A PhyComponent which transmits data over a TCP socket.
+ *
+ * The TcpSocketTxComponent connects to a specified IP address and port
+ * and writes each input DataSet to the connection. Until a connection
+ * is made, it is retried every reconnectInterval ms. If the connection
+ * is lost, the DataSet which was being written is dropped.
+ */
+class TcpSocketTxComponent
+  : public PhyComponent
+{
+ public:
+  TcpSocketTxComponent(std::string name);
+  ~TcpSocketTxComponent();
+  virtual void calculateOutputTypes(
+    std::map<std::string, int>& inputTypes,
+    std::map<std::string, int>& outputTypes);
+  virtual void registerPorts();
+  virtual void initialize();
+  virtual void start();
+  virtual void process();
+  virtual void stop();
+
+ private:
+  /// Template function used to write the input.
+  template<typename T> void writeInput();
+
+  bool connect();
+  bool write(const std::vector<boost::asio::const_buffer>& buffers);
+  bool wait();
+  void disconnect();
+  void handleOp(const boost::system::error_code& error);
+  void handleStop();
+
+  std::string address_x;      ///< The IP address to connect to.
+  unsigned short port_x;      ///< The destination port number.
+  bool framing_x;             ///< Start each DataSet with a SampleHeader?
+  unsigned int reconnectInterval_x; ///< Time between connection attempts in ms.
+  unsigned int sendBufferSize_x;  ///< Socket send buffer in bytes (0 = system default).
+
+  boost::asio::io_service ioService_;
+  boost::scoped_ptr<boost::asio::io_service::work> work_;  ///< Keeps ioService_ running between operations.
+  boost::asio::ip::tcp::socket* socket_;
+  boost::asio::deadline_timer* timer_;
+
+  bool connected_;
+  boost::atomic<bool> bStopping_;       ///< Set by stop(), from another thread.
+  uint32_t sequence_;         ///< Sequence number of the next frame.
+
+  boost::atomic<bool> opDone_;          ///< Has the pending operation completed?
+  boost::system::error_code opError_;   ///< Result of the last operation.
+};
+
+} // namespace phy
+} // namespace iris
+
+#endif // PHY_TCPSOCKETTXCOMPONENT_H_
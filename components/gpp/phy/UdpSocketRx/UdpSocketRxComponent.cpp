@@ -33,6 +33,10 @@
 
 #include "UdpSocketRxComponent.h"
 
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
 
@@ -53,7 +57,11 @@ UdpSocketRxComponent::UdpSocketRxComponent(string name)
                 "A udp socket rx",
                 "Paul Sutton",
                 "0.1")
+  ,socket_(NULL)
+  ,buffer_(NULL)
   ,bStopping_(false)
+  ,next_(0)
+  ,offset_(0)
 {
   //Register all parameters
   /*
@@ -80,6 +88,43 @@ UdpSocketRxComponent::UdpSocketRxComponent(string name)
                     "uint8_t",
                     false,
                     outputType_x);
+  registerParameter("blockSize",
+                    "Number of elements in each output DataSet "
+                    "(0 = output each datagram on its own)",
+                    "0",
+                    false,
+                    blockSize_x);
+  registerParameter("batchSize",
+                    "Maximum number of datagrams received in one system call",
+                    "32",
+                    false,
+                    batchSize_x,
+                    Interval<unsigned int>(1,1024));
+  registerParameter("receiveBufferSize",
+                    "Size of the socket receive buffer in bytes "
+                    "(0 = system default)",
+                    "0",
+                    false,
+                    receiveBufferSize_x);
+  registerParameter("header",
+                    "Do datagrams start with a SampleHeader?",
+                    "false",
+                    false,
+                    header_x);
+  registerParameter("kernelTimeStamps",
+                    "Timestamp datagrams on arrival in the kernel "
+                    "(used when there is no header)",
+                    "false",
+                    false,
+                    kernelTimeStamps_x);
+
+  registerEvent("lostdatagrams",
+                "Total number of datagrams missing from the header sequence",
+                TypeInfo< uint32_t >::identifier);
+  registerEvent("droppeddatagrams",
+                "Total number of datagrams dropped because they were "
+                "truncated, late or had an invalid header",
+                TypeInfo< uint32_t >::identifier);
 }
 
 void UdpSocketRxComponent::registerPorts()
@@ -144,8 +189,29 @@ void UdpSocketRxComponent::calculateOutputTypes(
 
 void UdpSocketRxComponent::initialize()
 {
-  //Create our buffer
-  buffer_ = new char[bufferSize_x];
+  if(header_x && bufferSize_x <= SampleHeader::size)
+    throw IrisException("bufferSize must be larger than the SampleHeader.");
+
+  //Create our buffer, with room for a batch of datagrams
+  delete [] buffer_;
+  buffer_ = new char[(size_t)bufferSize_x*batchSize_x];
+  datagrams_.reserve(batchSize_x);
+  datagrams_.clear();
+  next_ = offset_ = 0;
+
+#ifdef __linux__
+  msgs_.resize(batchSize_x);
+  iovecs_.resize(batchSize_x);
+  control_.resize(CMSG_SPACE(sizeof(timespec))*batchSize_x);
+#else
+  if(kernelTimeStamps_x)
+    LOG(LWARNING) << "Kernel timestamps are not supported on this platform";
+#endif
+
+  haveSequence_ = false;
+  nextSequence_ = 0;
+  lostDatagrams_ = reorderedDatagrams_ = droppedDatagrams_ = 0;
+  reportedLost_ = reportedDropped_ = 0;
 
   //Create socket
   try
@@ -164,6 +230,27 @@ void UdpSocketRxComponent::start()
   try
   {
     socket_->open(udp::v4());
+    if(receiveBufferSize_x > 0)
+    {
+      socket_->set_option(
+          udp::socket::receive_buffer_size(receiveBufferSize_x));
+      udp::socket::receive_buffer_size actual;
+      socket_->get_option(actual);
+      if(actual.value() < (int)receiveBufferSize_x)
+        LOG(LWARNING) << "Requested receive buffer of " << receiveBufferSize_x
+                      << " bytes but got " << actual.value()
+                      << " - check net.core.rmem_max";
+    }
+#ifdef __linux__
+    if(kernelTimeStamps_x)
+    {
+      int on = 1;
+      if(setsockopt(socket_->native_handle(), SOL_SOCKET, SO_TIMESTAMPNS,
+                    &on, sizeof(on)) < 0)
+        LOG(LWARNING) << "Failed to enable kernel timestamps: "
+                      << strerror(errno);
+    }
+#endif
     socket_->bind(udp::endpoint(udp::v4(), port_x));
   }
   catch(boost::system::system_error &e)
@@ -233,53 +320,287 @@ void UdpSocketRxComponent::writeOutput()
 {
   if(!bStopping_)
   {
-    //Get data from socket
-    std::size_t size;
-    try
-    {
-      udp::endpoint sender_endpoint;
-      size = socket_->receive_from(boost::asio::buffer(buffer_, bufferSize_x), sender_endpoint);
-    }
-    catch(boost::system::system_error &e)
-    {
-      if(!bStopping_)
-      {
-        LOG(LERROR) << "Error receiving from socket: " << e.what();
-      }
+    if(blockSize_x == 0)
+      writeDatagrams<T>();
+    else
+      writeBlock<T>();
+    reportCounters();
+  }
+}
+
+template<typename T>
+void UdpSocketRxComponent::writeDatagrams()
+{
+  while(next_ == datagrams_.size())
+  {
+    if(!receiveBatch())
       return;
-    }
+  }
+
+  WriteBuffer< T >* outBuf = castToType<T>(outputBuffers[0]);
+  for(; next_ < datagrams_.size(); next_++)
+  {
+    Datagram& d = datagrams_[next_];
 
     //Check that we've an integer number of data types in the datagram
-    float f = size/(float)sizeof(T);
-    float intpart, rem;
-    rem = modf(f, &intpart);
-    if(rem != 0)
+    if(d.length % sizeof(T) != 0)
     {
       LOG(LERROR) << "Did not receive an integer number of elements - data will be lost";
     }
-    int numT = (int)intpart;
+    size_t numT = d.length/sizeof(T);
+    if(numT == 0)
+      continue;
 
     //Get the output buffer
-    WriteBuffer< T >* outBuf = castToType<T>(outputBuffers[0]);
     DataSet<T>* writeDataSet = NULL;
     outBuf->getWriteData(writeDataSet, numT);
 
     //Copy data into output
-    T* bufT = (T*)buffer_;
+    T* bufT = (T*)d.data;
     copy(bufT, bufT+numT, writeDataSet->data.begin());
+    if(header_x || kernelTimeStamps_x)
+    {
+      writeDataSet->timeStamp = d.timeStamp;
+      if(d.sampleRate > 0)
+        writeDataSet->sampleRate = d.sampleRate;
+    }
 
     //Release the buffer
     outBuf->releaseWriteData(writeDataSet);
   }
 }
 
+template<typename T>
+void UdpSocketRxComponent::writeBlock()
+{
+  //Don't take an output DataSet until there is data to put in it
+  while(next_ == datagrams_.size())
+  {
+    if(!receiveBatch())
+      return;
+  }
+
+  WriteBuffer< T >* outBuf = castToType<T>(outputBuffers[0]);
+  DataSet<T>* writeDataSet = NULL;
+  outBuf->getWriteData(writeDataSet, blockSize_x);
+
+  //Fill the DataSet with the bytes of consecutive datagrams
+  char* out = (char*)&writeDataSet->data[0];
+  size_t total = (size_t)blockSize_x*sizeof(T);
+  size_t filled = 0;
+  while(filled < total)
+  {
+    if(next_ == datagrams_.size())
+    {
+      if(receiveBatch())
+        continue;
+      break;
+    }
+
+    Datagram& d = datagrams_[next_];
+    if(offset_ == 0 && d.length % sizeof(T) != 0)
+    {
+      //Drop the partial element so later elements stay aligned
+      LOG(LERROR) << "Did not receive an integer number of elements - data will be lost";
+      d.length -= d.length % sizeof(T);
+      if(d.length == 0)
+      {
+        next_++;
+        continue;
+      }
+    }
+    if(filled == 0 && (header_x || kernelTimeStamps_x))
+    {
+      writeDataSet->timeStamp = d.timeStamp;
+      if(d.sampleRate > 0)
+      {
+        writeDataSet->timeStamp += (offset_/sizeof(T))/d.sampleRate;
+        writeDataSet->sampleRate = d.sampleRate;
+      }
+    }
+
+    size_t n = min(d.length-offset_, total-filled);
+    memcpy(out+filled, d.data+offset_, n);
+    filled += n;
+    offset_ += n;
+    if(offset_ == d.length)
+    {
+      next_++;
+      offset_ = 0;
+    }
+  }
+
+  //Stopped or socket error part way through - drop what we have. The
+  //DataSet can't be handed back, so it goes out empty.
+  if(filled < total)
+  {
+    LOG(LINFO) << "Stopped part way through a block - dropped " << filled
+               << " bytes";
+    writeDataSet->data.clear();
+  }
+
+  outBuf->releaseWriteData(writeDataSet);
+}
+
+bool UdpSocketRxComponent::receiveBatch()
+{
+  datagrams_.clear();
+  next_ = offset_ = 0;
+
+#ifdef __linux__
+  size_t controlSize = CMSG_SPACE(sizeof(timespec));
+  for(size_t i=0; i<batchSize_x; i++)
+  {
+    iovecs_[i].iov_base = buffer_+i*bufferSize_x;
+    iovecs_[i].iov_len = bufferSize_x;
+    msghdr& h = msgs_[i].msg_hdr;
+    memset(&h, 0, sizeof(h));
+    h.msg_iov = &iovecs_[i];
+    h.msg_iovlen = 1;
+    if(kernelTimeStamps_x)
+    {
+      h.msg_control = &control_[i*controlSize];
+      h.msg_controllen = controlSize;
+    }
+  }
+
+  //Block for the first datagram, then take whatever else is queued
+  int n;
+  do
+  {
+    n = recvmmsg(socket_->native_handle(), &msgs_[0], batchSize_x,
+                 MSG_WAITFORONE, NULL);
+  }
+  while(n < 0 && errno == EINTR && !bStopping_);
+
+  if(n <= 0 || bStopping_)
+  {
+    if(n < 0 && !bStopping_)
+      LOG(LERROR) << "Error receiving from socket: " << strerror(errno);
+    return false;
+  }
+
+  for(int i=0; i<n; i++)
+  {
+    msghdr& h = msgs_[i].msg_hdr;
+    if(h.msg_flags & MSG_TRUNC)
+    {
+      droppedDatagrams_++;
+      continue;
+    }
+
+    Datagram d = {(char*)iovecs_[i].iov_base, msgs_[i].msg_len, 0, 0};
+    if(kernelTimeStamps_x)
+    {
+      for(cmsghdr* c = CMSG_FIRSTHDR(&h); c != NULL; c = CMSG_NXTHDR(&h, c))
+      {
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+        {
+          timespec ts;
+          memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+          d.timeStamp = ts.tv_sec + ts.tv_nsec*1e-9;
+        }
+      }
+    }
+    if(checkHeader(d.data, d.length, d))
+      datagrams_.push_back(d);
+  }
+#else
+  //No batched receive available - take one datagram at a time
+  std::size_t size;
+  try
+  {
+    udp::endpoint sender_endpoint;
+    size = socket_->receive_from(boost::asio::buffer(buffer_, bufferSize_x), sender_endpoint);
+  }
+  catch(boost::system::system_error &e)
+  {
+    if(!bStopping_)
+    {
+      LOG(LERROR) << "Error receiving from socket: " << e.what();
+    }
+    return false;
+  }
+  if(bStopping_)
+    return false;
+
+  Datagram d = {buffer_, size, 0, 0};
+  if(checkHeader(d.data, d.length, d))
+    datagrams_.push_back(d);
+#endif
+
+  return true;
+}
+
+bool UdpSocketRxComponent::checkHeader(char* data, size_t size, Datagram& d)
+{
+  if(!header_x)
+    return true;
+
+  SampleHeader h;
+  if(!h.decode((uint8_t*)data, size) || h.length != size-SampleHeader::size)
+  {
+    droppedDatagrams_++;
+    return false;
+  }
+
+  //Sequence numbers wrap, so compare using the signed difference
+  int32_t diff = (int32_t)(h.sequence-nextSequence_);
+  if(haveSequence_ && diff < 0)
+  {
+    //A late or duplicate datagram - unless the sender has restarted
+    if(diff >= -(int32_t)(4*batchSize_x))
+    {
+      reorderedDatagrams_++;
+      droppedDatagrams_++;
+      return false;
+    }
+    LOG(LINFO) << "Sequence restarted at " << h.sequence;
+  }
+  else if(haveSequence_ && diff > 0)
+  {
+    lostDatagrams_ += diff;
+  }
+  haveSequence_ = true;
+  nextSequence_ = h.sequence+1;
+
+  d.data = data+SampleHeader::size;
+  d.length = h.length;
+  d.timeStamp = h.timeStamp;
+  d.sampleRate = h.sampleRate;
+  return true;
+}
+
+void UdpSocketRxComponent::reportCounters()
+{
+  if(lostDatagrams_ != reportedLost_)
+  {
+    LOG(LWARNING) << "Lost " << lostDatagrams_-reportedLost_
+                  << " datagrams (" << lostDatagrams_ << " in total)";
+    reportedLost_ = lostDatagrams_;
+    activateEvent("lostdatagrams", lostDatagrams_);
+  }
+  if(droppedDatagrams_ != reportedDropped_)
+  {
+    LOG(LWARNING) << "Dropped " << droppedDatagrams_-reportedDropped_
+                  << " truncated, late or invalid datagrams ("
+                  << droppedDatagrams_ << " in total, "
+                  << reorderedDatagrams_ << " late)";
+    reportedDropped_ = droppedDatagrams_;
+    activateEvent("droppeddatagrams", droppedDatagrams_);
+  }
+}
+
 void UdpSocketRxComponent::stop()
 {
   //Close socket
   try
   {
     bStopping_ = true;
-    socket_->shutdown(udp::socket::shutdown_receive);
+    //Wakes up a blocked receive - reports an error for an unconnected
+    //socket even when it succeeds, so ignore it
+    boost::system::error_code ec;
+    socket_->shutdown(udp::socket::shutdown_receive, ec);
     socket_->close();
   }
   catch(boost::system::system_error &e)
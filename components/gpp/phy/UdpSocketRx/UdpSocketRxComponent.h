@@ -29,16 +29,27 @@
  * \section DESCRIPTION
  *
  * A source component which listens to a UDP socket.
+ *
+ * Datagrams can be received in batches (using recvmmsg where available)
+ * and coalesced into output DataSets of a fixed block size. Datagrams
+ * may optionally carry a SampleHeader, which is used to detect lost
+ * datagrams and to set the timeStamp and sampleRate of the output.
  */
 
 #ifndef PHY_UDPSOCKETRXCOMPONENT_H_
 #define PHY_UDPSOCKETRXCOMPONENT_H_
 
+#include <vector>
 #include "irisapi/PhyComponent.h"
+#include "utility/SampleHeader.h"
 
 //For boost asio sockets
 #include <boost/asio.hpp>
 
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
 namespace iris
 {
 namespace phy
@@ -48,6 +59,10 @@ namespace phy
  *
  * The UdpSocketRxComponent receives data from a UDP socket. The port
  * number, buffer size and data type can be set using parameters.
+ *
+ * If blockSize is 0, each datagram is output as a DataSet of its own.
+ * Otherwise, datagrams are concatenated and output in DataSets of
+ * blockSize elements.
  */
 class UdpSocketRxComponent
   : public PhyComponent
@@ -65,18 +80,58 @@ public:
   virtual void stop();
 
 private:
+  /// A received datagram waiting to be output.
+  struct Datagram
+  {
+    char* data;             ///< Start of payload.
+    std::size_t length;     ///< Payload length in bytes.
+    double timeStamp;       ///< Timestamp of first byte of payload.
+    double sampleRate;      ///< Sample rate (0 if unknown).
+  };
+
   /// Template function to write output.
   template<typename T> void writeOutput();
+  /// Output one DataSet per datagram.
+  template<typename T> void writeDatagrams();
+  /// Output one DataSet of blockSize_x elements.
+  template<typename T> void writeBlock();
 
-  unsigned short port_x;      ///< The port to receive from.
-  unsigned int bufferSize_x;  ///< Size of the buffer used to receive datagrams.
-  std::string outputType_x;   ///< The data type of output data.
+  bool receiveBatch();
+  bool checkHeader(char* data, std::size_t size, Datagram& d);
+  void reportCounters();
+
+  unsigned short port_x;          ///< The port to receive from.
+  unsigned int bufferSize_x;      ///< Size of the buffer used to receive datagrams.
+  std::string outputType_x;       ///< The data type of output data.
+  unsigned int blockSize_x;       ///< Elements per output DataSet (0 = one per datagram).
+  unsigned int batchSize_x;       ///< Max datagrams received per system call.
+  unsigned int receiveBufferSize_x; ///< Socket receive buffer in bytes (0 = system default).
+  bool header_x;                  ///< Do datagrams start with a SampleHeader?
+  bool kernelTimeStamps_x;        ///< Timestamp datagrams on arrival in the kernel?
 
   int outputTypeId_;
   boost::asio::io_service ioService_;
   boost::asio::ip::udp::socket* socket_;
-  char* buffer_;
+  char* buffer_;                  ///< Storage for batchSize_x datagrams.
   bool bStopping_;
+
+  std::vector<Datagram> datagrams_; ///< Datagrams from the last batch.
+  std::size_t next_;              ///< Next datagram to output.
+  std::size_t offset_;            ///< Bytes of next datagram already output.
+
+  bool haveSequence_;             ///< Have we seen a sequence number yet?
+  uint32_t nextSequence_;         ///< Expected next sequence number.
+  uint32_t lostDatagrams_;        ///< Datagrams missing from the sequence.
+  uint32_t reorderedDatagrams_;   ///< Datagrams arriving late or duplicated.
+  uint32_t droppedDatagrams_;     ///< Datagrams dropped as truncated, late or invalid.
+  uint32_t reportedLost_;         ///< Lost count at the last report.
+  uint32_t reportedDropped_;      ///< Dropped count at the last report.
+
+#ifdef __linux__
+  std::vector<mmsghdr> msgs_;     ///< Message headers for recvmmsg.
+  std::vector<iovec> iovecs_;     ///< One iovec per datagram.
+  std::vector<char> control_;     ///< Ancillary data for kernel timestamps.
+#endif
 };
 
 } // namespace phy
@@ -33,11 +33,24 @@
 
 #include "UdpSocketTxComponent.h"
 
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
 
 using namespace std;
 using namespace boost::asio::ip;
+namespace bpt = boost::posix_time;
 
 namespace iris
 {
@@ -74,6 +87,38 @@ UdpSocketTxComponent::UdpSocketTxComponent(string name)
                     "1234",
                     false,
                     port_x);
+  registerParameter("packetSize",
+                    "Maximum size of each datagram in bytes, including any header "
+                    "(0 = send each DataSet as one datagram)",
+                    "0",
+                    false,
+                    packetSize_x);
+  registerParameter("batchSize",
+                    "Maximum number of datagrams sent in one system call",
+                    "32",
+                    false,
+                    batchSize_x,
+                    Interval<unsigned int>(1,1024));
+  registerParameter("sendBufferSize",
+                    "Size of the socket send buffer in bytes (0 = system default)",
+                    "0",
+                    false,
+                    sendBufferSize_x);
+  registerParameter("header",
+                    "Start each datagram with a SampleHeader?",
+                    "false",
+                    false,
+                    header_x);
+  registerParameter("gso",
+                    "Use UDP segmentation offload to send batches (Linux only)",
+                    "false",
+                    false,
+                    gso_x);
+  registerParameter("rate",
+                    "Pace output to this many elements per second (0 = unpaced)",
+                    "0",
+                    false,
+                    rate_x);
   socket_ = NULL;
   endPoint_ = NULL;
 }
@@ -110,12 +155,31 @@ void UdpSocketTxComponent::calculateOutputTypes(
 
 void UdpSocketTxComponent::initialize()
 {
+  if(packetSize_x > 0 && header_x && packetSize_x <= SampleHeader::size)
+    throw IrisException("packetSize must be larger than the SampleHeader.");
+
+  sequence_ = 0;
+  paceStart_ = bpt::ptime();
+  paceElements_ = 0;
+  headers_.resize(SampleHeader::size*batchSize_x);
+#ifdef __linux__
+  iovecs_.resize(2*batchSize_x);
+  msgs_.resize(batchSize_x);
+  gso_ = gso_x;
+#else
+  if(gso_x)
+    LOG(LWARNING) << "UDP segmentation offload is not supported on this platform";
+  gso_ = false;
+#endif
+
   //Create socket
   try
   {
       socket_ = new boost::asio::ip::udp::socket(ioService_);
       socket_->open(udp::v4());
       endPoint_ = new udp::endpoint(address::from_string(address_x), port_x);
+      if(sendBufferSize_x > 0)
+        socket_->set_option(udp::socket::send_buffer_size(sendBufferSize_x));
   }
   catch(boost::system::system_error &e)
   {
@@ -187,9 +251,32 @@ void UdpSocketTxComponent::writeOutput()
   DataSet<T>* readDataSet = NULL;
   inBuf->getReadData(readDataSet);
 
+  if(packetSize_x > 0)
+  {
+    if(!readDataSet->data.empty())
+      sendDataSet((char*)&readDataSet->data[0],
+                  readDataSet->data.size()*sizeof(T), sizeof(T),
+                  readDataSet->timeStamp, readDataSet->sampleRate);
+    inBuf->releaseReadData(readDataSet);
+    return;
+  }
+
+  pace(readDataSet->data.size());
   try
   {
-    socket_->send_to(boost::asio::buffer(readDataSet->data), *endPoint_);
+    if(header_x)
+    {
+      encodeHeader(&headers_[0], readDataSet->data.size()*sizeof(T),
+                   readDataSet->timeStamp, readDataSet->sampleRate);
+      vector<boost::asio::const_buffer> bufs;
+      bufs.push_back(boost::asio::buffer(&headers_[0], SampleHeader::size));
+      bufs.push_back(boost::asio::buffer(readDataSet->data));
+      socket_->send_to(bufs, *endPoint_);
+    }
+    else
+    {
+      socket_->send_to(boost::asio::buffer(readDataSet->data), *endPoint_);
+    }
   }
   catch (boost::system::system_error &e)
   {
@@ -200,12 +287,204 @@ void UdpSocketTxComponent::writeOutput()
   inBuf->releaseReadData(readDataSet);
 }
 
+void UdpSocketTxComponent::sendDataSet(char* data, size_t bytes,
+                                       size_t elementSize, double timeStamp,
+                                       double sampleRate)
+{
+  size_t headerSize = header_x ? SampleHeader::size : 0;
+  size_t payload = ((packetSize_x-headerSize)/elementSize)*elementSize;
+  if(payload == 0)
+  {
+    LOG(LERROR) << "packetSize of " << packetSize_x
+                << " is too small for one element of data";
+    return;
+  }
+
+  //Offload can send at most 64 segments in one 64KB message
+  size_t maxBatch = batchSize_x;
+  if(gso_)
+    maxBatch = min(maxBatch, min((size_t)64, 65000/(payload+headerSize)));
+  maxBatch = max(maxBatch, (size_t)1);
+
+  size_t numPackets = (bytes+payload-1)/payload;
+  for(size_t packet=0; packet<numPackets; )
+  {
+    size_t n = min(numPackets-packet, maxBatch);
+    size_t numElements = 0;
+    for(size_t i=0; i<n; i++)
+    {
+      size_t offset = (packet+i)*payload;
+      size_t length = min(payload, bytes-offset);
+      uint8_t* header = &headers_[i*SampleHeader::size];
+      if(header_x)
+      {
+        double t = timeStamp;
+        if(sampleRate > 0)
+          t += (offset/elementSize)/sampleRate;
+        encodeHeader(header, length, t, sampleRate);
+      }
+#ifdef __linux__
+      iovec* iov = &iovecs_[i*(header_x ? 2 : 1)];
+      if(header_x)
+      {
+        iov->iov_base = header;
+        iov->iov_len = headerSize;
+        iov++;
+      }
+      iov->iov_base = data+offset;
+      iov->iov_len = length;
+#else
+      vector<boost::asio::const_buffer> bufs;
+      if(header_x)
+        bufs.push_back(boost::asio::buffer(header, headerSize));
+      bufs.push_back(boost::asio::buffer(data+offset, length));
+      pace(length/elementSize);
+      try
+      {
+        socket_->send_to(bufs, *endPoint_);
+      }
+      catch (boost::system::system_error &e)
+      {
+        LOG(LERROR) << "An error occurred while sending data to " << address_x << ", port " << port_x << \
+            ": " << e.what();
+        return;
+      }
+#endif
+      numElements += length/elementSize;
+    }
+
+#ifdef __linux__
+    pace(numElements);
+    if(!sendBatch(n, payload+headerSize))
+      return;
+#endif
+    packet += n;
+  }
+}
+
+bool UdpSocketTxComponent::sendBatch(size_t numPackets, size_t segmentSize)
+{
+#ifdef __linux__
+  int fd = socket_->native_handle();
+  size_t iovPerPacket = header_x ? 2 : 1;
+
+  if(gso_ && numPackets > 1)
+  {
+    //Send the whole batch as one message, split into datagrams by the kernel
+    msghdr h;
+    memset(&h, 0, sizeof(h));
+    h.msg_name = endPoint_->data();
+    h.msg_namelen = endPoint_->size();
+    h.msg_iov = &iovecs_[0];
+    h.msg_iovlen = numPackets*iovPerPacket;
+
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(control, 0, sizeof(control));
+    h.msg_control = control;
+    h.msg_controllen = sizeof(control);
+    cmsghdr* c = CMSG_FIRSTHDR(&h);
+    c->cmsg_level = SOL_UDP;
+    c->cmsg_type = UDP_SEGMENT;
+    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t size = segmentSize;
+    memcpy(CMSG_DATA(c), &size, sizeof(size));
+
+    ssize_t r;
+    do
+    {
+      r = sendmsg(fd, &h, 0);
+    }
+    while(r < 0 && errno == EINTR);
+    if(r >= 0)
+      return true;
+
+    if(errno != EINVAL && errno != EIO && errno != ENOPROTOOPT)
+    {
+      LOG(LERROR) << "An error occurred while sending data to " << address_x
+                  << ", port " << port_x << ": " << strerror(errno);
+      return false;
+    }
+    LOG(LWARNING) << "UDP segmentation offload is not available ("
+                  << strerror(errno) << ") - using sendmmsg";
+    gso_ = false;
+  }
+
+  for(size_t i=0; i<numPackets; i++)
+  {
+    msghdr& h = msgs_[i].msg_hdr;
+    memset(&h, 0, sizeof(h));
+    h.msg_name = endPoint_->data();
+    h.msg_namelen = endPoint_->size();
+    h.msg_iov = &iovecs_[i*iovPerPacket];
+    h.msg_iovlen = iovPerPacket;
+  }
+
+  size_t sent = 0;
+  while(sent < numPackets)
+  {
+    int r = sendmmsg(fd, &msgs_[sent], numPackets-sent, 0);
+    if(r < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      LOG(LERROR) << "An error occurred while sending data to " << address_x
+                  << ", port " << port_x << ": " << strerror(errno);
+      return false;
+    }
+    sent += r;
+  }
+#endif
+  return true;
+}
+
+void UdpSocketTxComponent::encodeHeader(uint8_t* out, size_t length,
+                                        double timeStamp, double sampleRate)
+{
+  SampleHeader h;
+  h.sequence = sequence_++;
+  h.length = length;
+  h.timeStamp = timeStamp;
+  h.sampleRate = sampleRate;
+  h.encode(out);
+}
+
+void UdpSocketTxComponent::pace(size_t numElements)
+{
+  if(rate_x <= 0)
+    return;
+
+  bpt::ptime now = bpt::microsec_clock::universal_time();
+  if(paceStart_.is_not_a_date_time())
+  {
+    paceStart_ = now;
+    paceElements_ = 0;
+  }
+
+  bpt::ptime due = paceStart_ +
+      bpt::microseconds((boost::int64_t)(paceElements_/rate_x*1e6));
+  if(due > now)
+  {
+    boost::this_thread::sleep(due);
+  }
+  else if(now-due > bpt::milliseconds(100))
+  {
+    //Input has stalled - start again rather than bursting to catch up
+    paceStart_ = now;
+    paceElements_ = 0;
+  }
+  paceElements_ += numElements;
+}
+
 UdpSocketTxComponent::~UdpSocketTxComponent()
 {
   try
   {
-    socket_->shutdown(udp::socket::shutdown_send);
-    socket_->close();
+    if(socket_ != NULL)
+    {
+      boost::system::error_code ec;
+      socket_->shutdown(udp::socket::shutdown_send, ec);
+      socket_->close();
+    }
   }
   catch (boost::system::system_error &e)
   {
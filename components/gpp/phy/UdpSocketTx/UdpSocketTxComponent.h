@@ -29,15 +29,26 @@
  * \section DESCRIPTION
  *
  * A sink component which writes to a UDP socket.
+ *
+ * DataSets can be split into datagrams of a fixed maximum size, each
+ * optionally starting with a SampleHeader, and sent in batches using
+ * sendmmsg or UDP generic segmentation offload where available.
  */
 
 #ifndef PHY_UDPSOCKETTXCOMPONENT_H_
 #define PHY_UDPSOCKETTXCOMPONENT_H_
 
+#include <vector>
 #include "irisapi/PhyComponent.h"
+#include "utility/SampleHeader.h"
 
 //For boost asio sockets
 #include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
 
 namespace iris
 {
@@ -48,6 +59,10 @@ namespace phy
  *
  * The UdpSocketTxComponent transmits data over a UDP socket
  * to a specified IP address and port.
+ *
+ * If packetSize is 0, each DataSet is sent as a single datagram.
+ * Otherwise, DataSets are split into datagrams of at most packetSize
+ * bytes. Datagrams never split an element of data.
  */
 class UdpSocketTxComponent
   : public PhyComponent
@@ -66,13 +81,37 @@ private:
   /// Template function to write output.
   template<typename T> void writeOutput();
 
+  void sendDataSet(char* data, std::size_t bytes, std::size_t elementSize,
+                   double timeStamp, double sampleRate);
+  bool sendBatch(std::size_t numPackets, std::size_t segmentSize);
+  void encodeHeader(uint8_t* out, std::size_t length, double timeStamp,
+                    double sampleRate);
+  void pace(std::size_t numElements);
+
   std::string address_x;  //!< The IP address to send to
   unsigned short port_x;  //!< The destination port number
+  unsigned int packetSize_x;  //!< Max datagram size in bytes (0 = one datagram per DataSet)
+  unsigned int batchSize_x;   //!< Max datagrams sent in one system call
+  unsigned int sendBufferSize_x;  //!< Socket send buffer in bytes (0 = system default)
+  bool header_x;          //!< Start each datagram with a SampleHeader?
+  bool gso_x;             //!< Use UDP generic segmentation offload?
+  double rate_x;          //!< Target rate in elements per second (0 = unpaced)
 
   boost::asio::io_service ioService_;
   boost::asio::ip::udp::socket* socket_;
   boost::asio::ip::udp::endpoint* endPoint_;
 
+  uint32_t sequence_;             //!< Sequence number of the next datagram
+  bool gso_;                      //!< Is segmentation offload in use?
+  std::vector<uint8_t> headers_;  //!< Encoded headers for a batch
+  boost::posix_time::ptime paceStart_;  //!< Start of the current paced run
+  double paceElements_;           //!< Elements sent since paceStart_
+
+#ifdef __linux__
+  std::vector<iovec> iovecs_;     //!< Header and payload of each datagram
+  std::vector<mmsghdr> msgs_;     //!< Message headers for sendmmsg
+#endif
+
 };
 
 } // namespace phy
@@ -0,0 +1,178 @@
+/**
+ * \file components/gpp/stack/Aggregator/AggregatorComponent.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Implementation of a stack component which packs small packets together
+ * into one PHY frame and splits large packets across several.
+ */
+
+#include "AggregatorComponent.h"
+
+#include "irisapi/LibraryDefs.h"
+#include "irisapi/Version.h"
+
+using namespace std;
+
+namespace iris
+{
+namespace stack
+{
+
+//! Export library symbols
+IRIS_COMPONENT_EXPORTS(StackComponent, AggregatorComponent);
+
+AggregatorComponent::AggregatorComponent(std::string name)
+  : StackComponent(name,
+                   "aggregator",
+                   "Packs packets into PHY frames, fragmenting large ones",
+                   "The Iris Project Developers",
+                   "0.1")
+  ,packetsSent_(0)
+  ,framesSent_(0)
+{
+  //Format: registerParameter(name, description, default, dynamic?, parameter, allowed values);
+  registerParameter("framesize", "Max bytes in a PHY frame", "768", false, frameSize_x, Interval<uint32_t>(16, 65535));
+  registerParameter("maxdelay", "Time in us to wait for more packets to fill a frame", "0", true, maxDelay_x, Interval<uint32_t>(0, 1000000));
+  registerParameter("queuesize", "Max packets waiting to be sent", "100", false, queueSize_x, Interval<int>(1, 1048576));
+}
+
+void AggregatorComponent::initialize()
+{
+  txQueue_.reset(new PacketQueue(queueSize_x));
+  aggregator_.reset(new FrameAggregator(frameSize_x));
+}
+
+void AggregatorComponent::start()
+{
+  txThread_.reset(new boost::thread(boost::bind(&AggregatorComponent::txThreadFunction, this)));
+}
+
+void AggregatorComponent::stop()
+{
+  txThread_->interrupt();
+  txThread_->join();
+
+  LOG(LINFO) << "Sent " << packetsSent_ << " packets in " << framesSent_ << " frames.";
+  LOG(LINFO) << "Received " << reassembler_.subframes() << " subframes, "
+             << reassembler_.badSubframes() << " with bad crc, "
+             << reassembler_.droppedSdus() << " packets missing fragments.";
+}
+
+void AggregatorComponent::processMessageFromAbove(boost::shared_ptr<StackDataSet> set)
+{
+  txQueue_->push(set);
+}
+
+void AggregatorComponent::processMessageFromBelow(boost::shared_ptr<StackDataSet> set)
+{
+  rxFrame_.assign(set->data.begin(), set->data.end());
+  if(rxFrame_.empty())
+    return;
+  reassembler_.receive(&rxFrame_[0], rxFrame_.size(), rxPackets_);
+
+  for(size_t i=0; i<rxPackets_.size(); i++)
+  {
+    boost::shared_ptr<StackDataSet> packet(new StackDataSet);
+    packet->data.assign(rxPackets_[i].begin(), rxPackets_[i].end());
+    packet->timeStamp = set->timeStamp;
+    sendUpwards(packet);
+  }
+  rxPackets_.clear();
+}
+
+void AggregatorComponent::txThreadFunction()
+{
+  try
+  {
+    std::vector< boost::shared_ptr<StackDataSet> > packets;
+    while(true)
+    {
+      boost::this_thread::interruption_point();
+
+      txQueue_->popBatch(packets, maxBatchSize);
+      addPackets(packets);
+
+      // Wait a while for more packets to fill up the last frame
+      if(maxDelay_x > 0)
+      {
+        boost::system_time deadline = boost::get_system_time() +
+            boost::posix_time::microseconds(maxDelay_x);
+        boost::system_time now;
+        while(!aggregator_->lastFrameFull() && (now = boost::get_system_time()) < deadline)
+        {
+          txQueue_->popBatch(packets, maxBatchSize, deadline-now);
+          addPackets(packets);
+          sendFrames(false);
+        }
+      }
+
+      sendFrames(true);
+    }
+  }
+  catch(IrisException& ex)
+  {
+    LOG(LFATAL) << "Error in Aggregator component: " << ex.what() << " - Tx thread exiting.";
+  }
+  catch(boost::thread_interrupted)
+  {
+    LOG(LINFO) << "Thread " << boost::this_thread::get_id() << " in stack component interrupted.";
+  }
+}
+
+void AggregatorComponent::addPackets(std::vector< boost::shared_ptr<StackDataSet> >& packets)
+{
+  for(size_t i=0; i<packets.size(); i++)
+  {
+    std::deque<uint8_t>& data = packets[i]->data;
+    try
+    {
+      aggregator_->add(data.begin(), data.end());
+      packetsSent_++;
+    }
+    catch(IrisException& ex)
+    {
+      LOG(LWARNING) << "Dropped packet of " << data.size() << " bytes: " << ex.what();
+    }
+  }
+  packets.clear();
+}
+
+void AggregatorComponent::sendFrames(bool all)
+{
+  while(aggregator_->pop(txFrame_, all))
+  {
+    boost::shared_ptr<StackDataSet> out(new StackDataSet);
+    out->data.assign(txFrame_.begin(), txFrame_.end());
+    sendDownwards(out);
+    framesSent_++;
+  }
+}
+
+} // namespace stack
+} // namespace iris
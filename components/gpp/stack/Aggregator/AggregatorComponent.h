@@ -0,0 +1,103 @@
+/**
+ * \file components/gpp/stack/Aggregator/AggregatorComponent.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A stack component which packs small packets together into one PHY
+ * frame and splits large packets across several.
+ */
+
+#ifndef STACK_AGGREGATORCOMPONENT_H_
+#define STACK_AGGREGATORCOMPONENT_H_
+
+#include "irisapi/StackComponent.h"
+#include "utility/LockFreeQueue.h"
+#include "utility/FrameAggregation.h"
+
+namespace iris
+{
+namespace stack
+{
+
+/** A StackComponent to aggregate and fragment packets for the PHY.
+ *
+ * Sits between a MAC and a PHY such as the OFDM modulator/demodulator.
+ * Packets from above are packed into frames of up to framesize bytes,
+ * so that many small packets share one preamble and PHY header, and
+ * packets too big for one frame are fragmented. Each packet or fragment
+ * carries its own crc, so a damaged one does not lose the rest of the
+ * frame. The framesize should be at most the number of bytes the PHY
+ * sends in one frame (for the OFDM modulator, maxsymbolsperframe times
+ * the bytes per symbol).
+ *
+ * Frames from below are unpacked and the packets sent up.
+ */
+class AggregatorComponent
+  : public StackComponent
+{
+public:
+  typedef LockFreeQueue< boost::shared_ptr<StackDataSet> > PacketQueue;
+
+  AggregatorComponent(std::string name);
+  virtual void initialize();
+  virtual void start();
+  virtual void stop();
+  virtual void processMessageFromAbove(boost::shared_ptr<StackDataSet> set);
+  virtual void processMessageFromBelow(boost::shared_ptr<StackDataSet> set);
+
+private:
+  /// Entry point for the thread which packs and sends frames.
+  void txThreadFunction();
+  /// Add packets to the aggregator.
+  void addPackets(std::vector< boost::shared_ptr<StackDataSet> >& packets);
+  /// Send frames down, including the one being filled if all is set.
+  void sendFrames(bool all);
+
+  //Exposed parameters
+  uint32_t frameSize_x;     ///< Max bytes in a PHY frame.
+  uint32_t maxDelay_x;      ///< Time to wait for packets to fill a frame (us).
+  int queueSize_x;          ///< Max packets waiting to be sent.
+
+  static const int maxBatchSize = 64; ///< Max packets taken from the queue at once
+
+  boost::scoped_ptr<PacketQueue> txQueue_;      ///< Packets from above.
+  boost::scoped_ptr<FrameAggregator> aggregator_;
+  std::vector<uint8_t> txFrame_;                 ///< Frame being sent.
+  FrameReassembler reassembler_;
+  std::vector<uint8_t> rxFrame_;                ///< Frame being unpacked.
+  std::vector< std::vector<uint8_t> > rxPackets_; ///< Packets unpacked.
+  uint64_t packetsSent_;    ///< Packets packed into frames.
+  uint64_t framesSent_;     ///< Frames sent down.
+
+  boost::scoped_ptr< boost::thread > txThread_;
+};
+
+} // namespace stack
+} // namespace iris
+
+#endif // STACK_AGGREGATORCOMPONENT_H_
@@ -36,6 +36,10 @@
 #include "irisapi/Version.h"
 #include "AlohaMacComponent.h"
 #include "utility/StackHelper.h"
+#include <cmath>
+#include <ctime>
+#include <boost/functional/hash.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
 
 using namespace std;
 using boost::mutex;
@@ -57,16 +61,42 @@ AlohaMacComponent::AlohaMacComponent(std::string name)
                    "A simple Aloha MAC component",
                    "Andre Puschmann",
                    "0.1")
+  ,binaryHeader_(false)
+  ,localAddr_(0)
+  ,destAddr_(0)
   ,txSeqNo_(1)
   ,rxSeqNo_(0)
-  ,rxPktBuffer_(100)
-  ,txPktBuffer_(100)
+  ,selectiveRepeat_(false)
+  ,txBase_(1)
+  ,nextBackoff_(0)
+  ,srtt_(0)
+  ,rttVar_(0)
+  ,rto_(0)
+  ,haveRtt_(false)
 {
   //Format: registerParameter(name, description, default, dynamic?, parameter, allowed values);
-  registerParameter("localaddress", "Address of this client", "f009e090e90e", false, localAddress_x);
-  registerParameter("destinationaddress", "Address of the destination client", "00f0f0f0f0f0", false, destinationAddress_x);
+  registerParameter("localaddress", "Address of this client (12 hex digits)", "f009e090e90e", false, localAddress_x);
+  registerParameter("destinationaddress", "Address of the destination client (12 hex digits)", "00f0f0f0f0f0", false, destinationAddress_x);
   registerParameter("acktimeout", "Time to wait for ACK packets in ms", "100", false, ackTimeout_x);
   registerParameter("maxretry", "Number of retransmissions", "100", false, maxRetry_x);
+  registerParameter("queuesize", "Max frames waiting to be sent or received", "100", false, queueSize_x, Interval<int>(1, 1048576));
+
+  std::list<std::string> policies;
+  policies.push_back("block");
+  policies.push_back("dropoldest");
+  policies.push_back("dropnewest");
+  registerParameter("queuepolicy", "What to do with a new frame when a queue is full: block, dropoldest or dropnewest", "block", false, queuePolicy_x, policies);
+
+  std::list<std::string> modes;
+  modes.push_back("stopandwait");
+  modes.push_back("selectiverepeat");
+  registerParameter("arqmode", "How frames are acknowledged: stopandwait or selectiverepeat", "stopandwait", false, arqMode_x, modes);
+  registerParameter("windowsize", "Max frames in flight in selectiverepeat mode", "16", false, windowSize_x, Interval<int>(1, 64));
+
+  std::list<std::string> formats;
+  formats.push_back("binary");
+  formats.push_back("protobuf");
+  registerParameter("headerformat", "Frame header: binary, or protobuf to work with older nodes", "protobuf", false, headerFormat_x, formats);
 
 }
 
@@ -79,27 +109,49 @@ AlohaMacComponent::~AlohaMacComponent()
 void AlohaMacComponent::initialize()
 {
   maxRetry_x++; // first attempt does not count as retransmission
+
+  binaryHeader_ = (headerFormat_x == "binary");
+  localAddr_ = MacHeader::parseAddress(localAddress_x);
+  destAddr_ = MacHeader::parseAddress(destinationAddress_x);
+
+  FrameQueue::Policy policy = FrameQueue::policyFromString(queuePolicy_x);
+  rxPktBuffer_.reset(new FrameQueue(queueSize_x, policy));
+  txPktBuffer_.reset(new FrameQueue(queueSize_x, policy));
+
+  // seed the backoff differently on each node
+  rng_.seed(static_cast<uint32_t>(std::time(NULL) ^ boost::hash<std::string>()(localAddress_x)));
+
+  selectiveRepeat_ = (arqMode_x == "selectiverepeat");
+  txWindow_.assign(windowSize_x, TxFrame());
+  rxWindow_ = ReceiveWindow< boost::shared_ptr<StackDataSet> >(windowSize_x);
+  rxInOrder_.reserve(windowSize_x);
+  txBase_ = txSeqNo_;
+  rto_ = ackTimeout_x;
+  haveRtt_ = false;
 }
 
 
 void AlohaMacComponent::processMessageFromAbove(boost::shared_ptr<StackDataSet> incomingFrame)
 {
   //StackHelper::printDataset(incomingFrame, "vanilla from above");
-  txPktBuffer_.pushDataSet(incomingFrame);
+  txPktBuffer_->push(incomingFrame);
 }
 
 
 void AlohaMacComponent::processMessageFromBelow(boost::shared_ptr<StackDataSet> incomingFrame)
 {
   //StackHelper::printDataset(incomingFrame, "vanilla from below");
-  rxPktBuffer_.pushDataSet(incomingFrame);
+  rxPktBuffer_->push(incomingFrame);
 }
 
 
 void AlohaMacComponent::start()
 {
   rxThread_.reset(new boost::thread(boost::bind( &AlohaMacComponent::rxThreadFunction, this)));
-  txThread_.reset(new boost::thread(boost::bind( &AlohaMacComponent::txThreadFunction, this)));
+  if (selectiveRepeat_)
+    txThread_.reset(new boost::thread(boost::bind( &AlohaMacComponent::txWindowThreadFunction, this)));
+  else
+    txThread_.reset(new boost::thread(boost::bind( &AlohaMacComponent::txThreadFunction, this)));
 }
 
 void AlohaMacComponent::stop()
@@ -109,6 +161,19 @@ void AlohaMacComponent::stop()
   rxThread_->join();
   txThread_->interrupt();
   txThread_->join();
+
+  logQueueStats("Rx", *rxPktBuffer_);
+  logQueueStats("Tx", *txPktBuffer_);
+  if (selectiveRepeat_)
+    LOG(LINFO) << "Smoothed RTT " << srtt_ << " ms, RTO " << rto_ << " ms.";
+}
+
+
+void AlohaMacComponent::logQueueStats(const char* name, const FrameQueue& queue)
+{
+  LOG(LINFO) << name << " queue: " << queue.pushed() << " frames, max depth "
+             << queue.highWater() << " of " << queue.capacity() << ", "
+             << queue.dropped() << " dropped.";
 }
 
 
@@ -134,51 +199,71 @@ void AlohaMacComponent::rxThreadFunction()
 
   try
   {
+    std::vector< boost::shared_ptr<StackDataSet> > frames;
     while(true)
     {
       boost::this_thread::interruption_point();
 
-      shared_ptr<StackDataSet> frame = rxPktBuffer_.popDataSet();
+      // take all waiting frames at once
+      rxPktBuffer_->popBatch(frames, maxBatchSize);
 
-      AlohaPacket newPacket;
-      StackHelper::deserializeAndStripDataset(frame, newPacket);
+      for (size_t i = 0; i < frames.size(); i++) {
+        boost::shared_ptr<StackDataSet> frame = frames[i];
 
-      if (localAddress_x == newPacket.destination()) {
-        switch(newPacket.type()) {
-        case AlohaPacket::DATA:
-        {
-          LOG(LINFO) << "Got DATA " << newPacket.seqno() << " from " << newPacket.source();
-          sendAckPacket(newPacket.source(), newPacket.seqno());
+        MacHeader header;
+        uint64_t ackBitmap;
+        uint32_t windowBase;
+        if (!stripHeader(frame, header, ackBitmap, windowBase)) {
+          LOG(LERROR) << "Received invalid frame.";
+          continue;
+        }
 
-          // check if packet contains new data
-          if (newPacket.seqno() > rxSeqNo_ || newPacket.seqno() == 1) {
-            // send new data packet up
-            sendDownwards("topoutputport", frame);
-            rxSeqNo_ = newPacket.seqno(); // update seqno
-            if (newPacket.seqno() == 1) LOG(LINFO) << "Receiver restart detected.";
+        if (localAddr_ == header.destination) {
+          switch(header.type) {
+          case AlohaPacket::DATA:
+          {
+            LOG(LINFO) << "Got DATA " << header.seqno << " from " << MacHeader::formatAddress(header.source);
+            if (selectiveRepeat_) {
+              receiveWindowFrame(frame, header, windowBase);
+              break;
+            }
+            sendAckPacket(header.source, header.seqno);
+
+            // check if packet contains new data
+            if (header.seqno > rxSeqNo_ || header.seqno == 1) {
+              // send new data packet up
+              sendDownwards("topoutputport", frame);
+              rxSeqNo_ = header.seqno; // update seqno
+              if (header.seqno == 1) LOG(LINFO) << "Receiver restart detected.";
+            }
+            break;
           }
-          break;
-        }
-        case AlohaPacket::ACK:
-        {
-          LOG(LINFO) << "Got ACK  " << newPacket.seqno();
-          boost::unique_lock<boost::mutex> lock(seqNoMutex_);
-          if (newPacket.seqno() == txSeqNo_) {
-            // received right ACK
-            lock.unlock();
-            ackArrivedCond_.notify_one();
-          } else if (newPacket.seqno() > txSeqNo_) {
-            LOG(LERROR) << "Received future ACK.";
-          } else {
-            LOG(LERROR) << "Received too old ACK";
+          case AlohaPacket::ACK:
+          {
+            LOG(LINFO) << "Got ACK  " << header.seqno;
+            if (selectiveRepeat_) {
+              receiveWindowAck(header, ackBitmap);
+              break;
+            }
+            boost::unique_lock<boost::mutex> lock(seqNoMutex_);
+            if (header.seqno == txSeqNo_) {
+              // received right ACK
+              lock.unlock();
+              ackArrivedCond_.notify_one();
+            } else if (header.seqno > txSeqNo_) {
+              LOG(LERROR) << "Received future ACK.";
+            } else {
+              LOG(LERROR) << "Received too old ACK";
+            }
+            break;
+          }
+          default:
+            LOG(LERROR) << "Undefined packet type.";
+            break;
           }
-          break;
-        }
-        default:
-          LOG(LERROR) << "Undefined packet type.";
-          break;
         }
       }
+      frames.clear();
     } // while
   }
   catch(IrisException& ex)
@@ -199,47 +284,128 @@ void AlohaMacComponent::txThreadFunction()
 
   try
   {
+    std::vector< boost::shared_ptr<StackDataSet> > frames;
     while(true)
     {
       boost::this_thread::interruption_point();
 
-      shared_ptr<StackDataSet> frame = txPktBuffer_.popDataSet();
-
-      boost::unique_lock<boost::mutex> lock(seqNoMutex_);
-      AlohaPacket dataPacket;
-      dataPacket.set_source(localAddress_x);
-      dataPacket.set_destination(destinationAddress_x);
-      dataPacket.set_type(AlohaPacket::DATA);
-      dataPacket.set_seqno(txSeqNo_);
-      StackHelper::mergeAndSerializeDataset(frame, dataPacket);
-
-      bool stop_signal = false;
-      int txCounter = 1;
-      while (not stop_signal) {
-        // send packet to PHY
-        LOG(LINFO) << "Tx DATA  " << txSeqNo_;
-        sendDownwards(frame);
-
-        // wait for ACK
-        if (ackArrivedCond_.timed_wait(lock, boost::posix_time::milliseconds(ackTimeout_x)) == false) {
-          // returns false if timeout was reached
-          LOG(LINFO) << "ACK time out for " << txCounter << ". transmission of " << txSeqNo_;
-          // wait random time before trying again, here between ackTimeout and 2*ackTimeout
-          int collisionTimeout = rand() % ackTimeout_x;
-          collisionTimeout = std::min(ackTimeout_x + collisionTimeout, 2 * ackTimeout_x);
-          boost::this_thread::sleep(boost::posix_time::milliseconds(collisionTimeout));
-        } else {
-          // ACK received before timeout
-          stop_signal = true;
+      txPktBuffer_->popBatch(frames, maxBatchSize);
+
+      for (size_t i = 0; i < frames.size(); i++) {
+        boost::shared_ptr<StackDataSet> frame = frames[i];
+
+        boost::unique_lock<boost::mutex> lock(seqNoMutex_);
+        MacHeader header;
+        header.type = AlohaPacket::DATA;
+        header.destination = destAddr_;
+        header.source = localAddr_;
+        header.seqno = txSeqNo_;
+        addHeader(frame, header);
+
+        bool stop_signal = false;
+        int txCounter = 1;
+        while (not stop_signal) {
+          // send packet to PHY
+          LOG(LINFO) << "Tx DATA  " << txSeqNo_;
+          sendDownwards(frame);
+
+          // wait for ACK
+          if (ackArrivedCond_.timed_wait(lock, boost::posix_time::milliseconds(ackTimeout_x)) == false) {
+            // returns false if timeout was reached
+            LOG(LINFO) << "ACK time out for " << txCounter << ". transmission of " << txSeqNo_;
+            // wait random time before trying again, here between ackTimeout and 2*ackTimeout
+            int collisionTimeout = randomBackoff(ackTimeout_x);
+            collisionTimeout = std::min(ackTimeout_x + collisionTimeout, 2 * ackTimeout_x);
+            boost::this_thread::sleep(boost::posix_time::milliseconds(collisionTimeout));
+          } else {
+            // ACK received before timeout
+            stop_signal = true;
+          }
+
+          if (++txCounter > maxRetry_x) stop_signal = true;
         }
 
-        if (++txCounter > maxRetry_x) stop_signal = true;
+        // increment seqno for next data packet and release lock
+        txSeqNo_++;
+        if (txSeqNo_ == std::numeric_limits<uint32_t>::max()) txSeqNo_ = 1;
+        lock.unlock();
       }
+      frames.clear();
+    }
+  }
+  catch(IrisException& ex)
+  {
+    LOG(LFATAL) << "Error in AlohaMac component: " << ex.what() << " - Tx thread exiting.";
+  }
+  catch(boost::thread_interrupted)
+  {
+    LOG(LINFO) << "Thread " << boost::this_thread::get_id() << " in stack component interrupted.";
+  }
+}
 
-      // increment seqno for next data packet and release lock
-      txSeqNo_++;
-      if (txSeqNo_ == std::numeric_limits<uint32_t>::max()) txSeqNo_ = 1;
-      lock.unlock();
+
+void AlohaMacComponent::txWindowThreadFunction()
+{
+  boost::this_thread::sleep(boost::posix_time::seconds(1));
+  LOG(LINFO) << "Tx thread started (selective repeat, window " << windowSize_x << ").";
+
+  try
+  {
+    std::vector< boost::shared_ptr<StackDataSet> > frames;
+    std::vector<uint32_t> expired;
+    boost::unique_lock<boost::mutex> lock(seqNoMutex_);
+    tickStart_ = boost::posix_time::microsec_clock::universal_time();
+    timers_ = TimerWheel<uint32_t>();
+    timers_.reserve(windowSize_x);
+    nextBackoff_ = 0;
+    txWindow_.assign(windowSize_x, TxFrame());
+    txBase_ = txSeqNo_;
+    while(true)
+    {
+      boost::this_thread::interruption_point();
+
+      // retransmit frames whose timers have run out
+      expired.clear();
+      TimerWheel<uint32_t>::Tick now = currentTick();
+      timers_.advance(now, expired);
+      if (!expired.empty()) {
+        // back off, but only once per RTO however many frames time out
+        if (now >= nextBackoff_) {
+          rto_ = std::min(rto_ * 2, double(maxRtoFactor * ackTimeout_x));
+          nextBackoff_ = now + TimerWheel<uint32_t>::Tick(rto_);
+        }
+        for (size_t i = 0; i < expired.size(); i++)
+          retransmitWindowFrame(expired[i]);
+        while (txBase_ != txSeqNo_ && !txWindow_[txBase_ % windowSize_x].frame)
+          txBase_++;
+      }
+
+      // start again from 1 when the seqnos run out
+      if (txSeqNo_ == std::numeric_limits<uint32_t>::max() && txBase_ == txSeqNo_)
+        txBase_ = txSeqNo_ = 1;
+
+      bool timing = !timers_.empty();
+      TimerWheel<uint32_t>::Tick wait = timers_.nextExpiry();
+      size_t space = windowSpace();
+      if (space > 0) {
+        // wait for new frames, or for the next timer
+        lock.unlock();
+        if (!timing)
+          txPktBuffer_->popBatch(frames, space);
+        else
+          txPktBuffer_->popBatch(frames, space, boost::posix_time::milliseconds(wait));
+        lock.lock();
+
+        for (size_t i = 0; i < frames.size(); i++)
+          sendWindowFrame(frames[i]);
+        frames.clear();
+      } else {
+        // window is full, wait for ACKs or the next timer
+        if (!timing)
+          ackArrivedCond_.wait(lock);
+        else
+          ackArrivedCond_.timed_wait(lock, boost::posix_time::milliseconds(wait));
+      }
     }
   }
   catch(IrisException& ex)
@@ -253,21 +419,271 @@ void AlohaMacComponent::txThreadFunction()
 }
 
 
-void AlohaMacComponent::sendAckPacket(const string destination, uint32_t seqno)
+void AlohaMacComponent::sendWindowFrame(boost::shared_ptr<StackDataSet> frame)
+{
+  uint32_t seqno = txSeqNo_++;
+  MacHeader header;
+  header.type = AlohaPacket::DATA;
+  header.destination = destAddr_;
+  header.source = localAddr_;
+  header.seqno = seqno;
+  addHeader(frame, header, 0, txBase_);
+
+  TxFrame& tx = txWindow_[seqno % windowSize_x];
+  tx.frame = frame;
+  tx.txCount = 1;
+  tx.sentTime = boost::posix_time::microsec_clock::universal_time();
+
+  LOG(LINFO) << "Tx DATA  " << seqno;
+  sendDownwards(frame);
+  tx.timer = timers_.start(seqno, TimerWheel<uint32_t>::Tick(rto_));
+}
+
+
+void AlohaMacComponent::retransmitWindowFrame(uint32_t seqno)
+{
+  TxFrame& tx = txWindow_[seqno % windowSize_x];
+  tx.timer = TimerWheel<uint32_t>::Handle();   // has expired
+  if (!tx.frame)
+    return;
+
+  LOG(LINFO) << "ACK time out for " << tx.txCount << ". transmission of " << seqno;
+  if (tx.txCount >= maxRetry_x) {
+    LOG(LERROR) << "Giving up on DATA " << seqno;
+    tx.frame.reset();
+    return;
+  }
+
+  tx.txCount++;
+  LOG(LINFO) << "Tx DATA  " << seqno;
+  sendDownwards(tx.frame);
+
+  // wait a random extra time of up to an RTO, so that colliding senders spread out
+  int rto = int(rto_);
+  tx.timer = timers_.start(seqno, rto + randomBackoff(rto));
+}
+
+
+void AlohaMacComponent::receiveWindowFrame(boost::shared_ptr<StackDataSet> frame, const MacHeader& header, uint32_t windowBase)
 {
-  AlohaPacket ackPacket;
-  ackPacket.set_source(localAddress_x);
-  ackPacket.set_destination(destination);
-  ackPacket.set_type(AlohaPacket::ACK);
-  ackPacket.set_seqno(seqno);
-
-  shared_ptr<StackDataSet> buffer(new StackDataSet);
-  StackHelper::mergeAndSerializeDataset(buffer, ackPacket);
+  uint32_t seqno = header.seqno;
+  if (seqno == 1 && rxWindow_.lastInOrder() >= uint32_t(windowSize_x)) {
+    LOG(LINFO) << "Receiver restart detected.";
+    rxWindow_.reset();
+  }
+
+  // move past any frames the sender has given up on, keep new frames
+  // within the window, and pass on those now in order
+  if (windowBase > rxWindow_.lastInOrder() + 1)
+    LOG(LINFO) << "Sender gave up on DATA " << rxWindow_.lastInOrder() + 1 << " to " << windowBase - 1;
+  rxWindow_.skipTo(windowBase, rxInOrder_);
+  rxWindow_.add(seqno, frame, rxInOrder_);
+  for (size_t i = 0; i < rxInOrder_.size(); i++)
+    sendDownwards("topoutputport", rxInOrder_[i]);
+  rxInOrder_.clear();
+
+  // ACK everything received so far
+  sendAckPacket(header.source, rxWindow_.lastInOrder(), rxWindow_.heldBitmap());
+}
+
+
+void AlohaMacComponent::receiveWindowAck(const MacHeader& header, uint64_t ackBitmap)
+{
+  boost::unique_lock<boost::mutex> lock(seqNoMutex_);
+  uint32_t lastInOrder = header.seqno;
+  if (lastInOrder >= txSeqNo_) {
+    LOG(LERROR) << "Received future ACK.";
+    return;
+  }
+
+  boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+  for (uint32_t seqno = txBase_; seqno <= lastInOrder && seqno != txSeqNo_; seqno++)
+    frameAcked(seqno, now);
+  for (int i = 0; i < 64 && (ackBitmap >> i) != 0; i++) {
+    uint64_t seqno = uint64_t(lastInOrder) + 2 + i;
+    if (((ackBitmap >> i) & 1) && seqno >= txBase_ && seqno < txSeqNo_)
+      frameAcked(uint32_t(seqno), now);
+  }
+
+  // slide the window past the ACKed frames
+  uint32_t oldBase = txBase_;
+  while (txBase_ != txSeqNo_ && !txWindow_[txBase_ % windowSize_x].frame)
+    txBase_++;
+  lock.unlock();
+  if (txBase_ != oldBase)
+    ackArrivedCond_.notify_one();
+}
+
+
+void AlohaMacComponent::frameAcked(uint32_t seqno, boost::posix_time::ptime now)
+{
+  TxFrame& tx = txWindow_[seqno % windowSize_x];
+  if (!tx.frame)
+    return;
+  timers_.cancel(tx.timer);
+  // only frames sent once give a clear round trip time (Karn's algorithm)
+  if (tx.txCount == 1)
+    updateRto((now - tx.sentTime).total_microseconds() / 1000.0);
+  tx.frame.reset();
+}
+
+
+void AlohaMacComponent::updateRto(double rtt)
+{
+  // as in RFC 6298
+  if (!haveRtt_) {
+    srtt_ = rtt;
+    rttVar_ = rtt / 2;
+    haveRtt_ = true;
+  } else {
+    rttVar_ = 0.75 * rttVar_ + 0.25 * std::fabs(srtt_ - rtt);
+    srtt_ = 0.875 * srtt_ + 0.125 * rtt;
+  }
+  rto_ = srtt_ + std::max(1.0, 4 * rttVar_);
+  rto_ = std::max(rto_, double(minRto));
+  rto_ = std::min(rto_, double(maxRtoFactor * ackTimeout_x));
+}
+
+
+size_t AlohaMacComponent::windowSpace() const
+{
+  if (txSeqNo_ == std::numeric_limits<uint32_t>::max())
+    return 0;
+  return windowSize_x - (txSeqNo_ - txBase_);
+}
+
+
+TimerWheel<uint32_t>::Tick AlohaMacComponent::currentTick() const
+{
+  return (boost::posix_time::microsec_clock::universal_time() - tickStart_).total_milliseconds();
+}
+
+
+int AlohaMacComponent::randomBackoff(int max)
+{
+  if (max <= 0)
+    return 0;
+  boost::random::uniform_int_distribution<int> dist(0, max - 1);
+  return dist(rng_);
+}
+
+
+/// Get an empty frame for an ACK.
+/// Frames no longer held below are reused; clearing keeps their storage.
+boost::shared_ptr<StackDataSet> AlohaMacComponent::getAckFrame()
+{
+  for (size_t i = 0; i < ackPool_.size(); i++)
+  {
+    if (ackPool_[i].unique())
+    {
+      ackPool_[i]->data.clear();
+      ackPool_[i]->timeStamp = 0;
+      return ackPool_[i];
+    }
+  }
+
+  boost::shared_ptr<StackDataSet> frame(new StackDataSet);
+  if (ackPool_.size() < size_t(ackPoolSize))
+    ackPool_.push_back(frame);
+  return frame;
+}
+
+
+void AlohaMacComponent::sendAckPacket(uint64_t destination, uint32_t seqno, uint64_t ackBitmap)
+{
+  MacHeader header;
+  header.type = AlohaPacket::ACK;
+  header.destination = destination;
+  header.source = localAddr_;
+  header.seqno = seqno;
+
+  boost::shared_ptr<StackDataSet> buffer = getAckFrame();
+  addHeader(buffer, header, ackBitmap);
   //StackHelper::printDataset(buffer, "ACK Tx");
 
   sendDownwards("bottomoutputport", buffer);
   LOG(LINFO) << "Tx  ACK  " << seqno;
 }
 
+
+void AlohaMacComponent::addHeader(boost::shared_ptr<StackDataSet> frame, const MacHeader& header, uint64_t ackBitmap, uint32_t windowBase)
+{
+  if (binaryHeader_) {
+    // an ACK bitmap is sent as an 8 byte payload
+    if (ackBitmap != 0) {
+      for (int i = 7; i >= 0; i--)
+        frame->data.push_back(uint8_t(ackBitmap >> (8 * i)));
+    }
+    // in selective-repeat mode DATA frames start with the window base
+    if (selectiveRepeat_ && header.type == AlohaPacket::DATA) {
+      for (int i = 0; i < 4; i++)
+        frame->data.push_front(uint8_t(windowBase >> (8 * i)));
+    }
+    MacHeader h = header;
+    h.push(frame->data);
+    return;
+  }
+
+  AlohaPacket packet;
+  packet.set_source(addressString(header.source));
+  packet.set_destination(addressString(header.destination));
+  packet.set_type(AlohaPacket::PacketType(header.type));
+  packet.set_seqno(header.seqno);
+  if (ackBitmap != 0)
+    packet.set_ackbitmap(ackBitmap);
+  if (windowBase != 0)
+    packet.set_windowbase(windowBase);
+  StackHelper::mergeAndSerializeDataset(frame, packet);
+}
+
+
+bool AlohaMacComponent::stripHeader(boost::shared_ptr<StackDataSet> frame, MacHeader& header, uint64_t& ackBitmap, uint32_t& windowBase)
+{
+  ackBitmap = 0;
+  windowBase = 0;
+  if (binaryHeader_) {
+    if (!header.pull(frame->data))
+      return false;
+    if (header.type == AlohaPacket::ACK && frame->data.size() >= 8) {
+      for (int i = 0; i < 8; i++)
+        ackBitmap = (ackBitmap << 8) | frame->data[i];
+    }
+    if (selectiveRepeat_ && header.type == AlohaPacket::DATA) {
+      if (frame->data.size() < 4)
+        return false;
+      for (int i = 0; i < 4; i++)
+        windowBase = (windowBase << 8) | frame->data[i];
+      frame->data.erase(frame->data.begin(), frame->data.begin() + 4);
+    }
+    return true;
+  }
+
+  AlohaPacket packet;
+  if (!StackHelper::deserializeAndStripDataset(frame, packet))
+    return false;
+  try {
+    header.destination = MacHeader::parseAddress(packet.destination());
+    header.source = MacHeader::parseAddress(packet.source());
+  } catch(IrisException&) {
+    return false;
+  }
+  header.type = packet.type();
+  header.seqno = packet.seqno();
+  ackBitmap = packet.ackbitmap();
+  windowBase = packet.windowbase();
+  return true;
+}
+
+
+std::string AlohaMacComponent::addressString(uint64_t address) const
+{
+  // use the addresses as they were given where possible
+  if (address == localAddr_)
+    return localAddress_x;
+  if (address == destAddr_)
+    return destinationAddress_x;
+  return MacHeader::formatAddress(address);
+}
+
 } // namespace stack
 } // namespace iris
@@ -30,6 +30,19 @@
  *
  * Implementation of a simple Aloha MAC component.
  *
+ * Frames are sent either stop-and-wait (one frame at a time, each waiting
+ * for its ACK) or with selective-repeat ARQ, where up to a window of frames
+ * are in flight, each with its own retransmission timer. In
+ * selective-repeat mode an ACK carries the last in-order seqno received
+ * plus a bitmap of the frames received beyond it, and the retransmission
+ * timeout adapts to the measured round trip time (RFC 6298). Each DATA
+ * frame carries the oldest seqno the sender still has in flight, so the
+ * receiver can move past frames the sender has given up on. Both ends of
+ * a link must use the same mode.
+ *
+ * Frames carry either a compact binary MacHeader or, for compatibility
+ * with older nodes, an AlohaPacket protobuf header.
+ *
  */
 
 #ifndef STACK_ALOHAMACCOMPONENT_H_
@@ -38,6 +51,11 @@
 #include "irisapi/StackComponent.h"
 #include <stdio.h>
 #include "alohamac.pb.h"
+#include "utility/LockFreeQueue.h"
+#include "utility/TimerWheel.h"
+#include "utility/ReceiveWindow.h"
+#include "utility/MacHeader.h"
+#include <boost/random/mersenne_twister.hpp>
 
 namespace iris
 {
@@ -48,6 +66,8 @@ class AlohaMacComponent
   : public StackComponent
 {
 public:
+  typedef LockFreeQueue< boost::shared_ptr<StackDataSet> > FrameQueue;
+
   AlohaMacComponent(std::string name);
   virtual ~AlohaMacComponent();
 
@@ -66,21 +86,73 @@ private:
   std::string destinationAddress_x;   ///< Address of destination client
   int ackTimeout_x;                   ///< Time to wait for ACK packets (ms)
   int maxRetry_x;                     ///< Number of retransmissions
+  int queueSize_x;                    ///< Max frames waiting in each direction
+  std::string queuePolicy_x;          ///< What to do when a queue is full
+  std::string arqMode_x;              ///< stopandwait or selectiverepeat
+  int windowSize_x;                   ///< Max frames in flight (selectiverepeat)
+  std::string headerFormat_x;         ///< binary or protobuf
 
   // local variables
-  StackDataBuffer rxPktBuffer_, txPktBuffer_;
+  bool binaryHeader_;         ///< Use MacHeader rather than AlohaPacket
+  uint64_t localAddr_;        ///< localAddress_x as a number
+  uint64_t destAddr_;         ///< destinationAddress_x as a number
+  boost::scoped_ptr<FrameQueue> rxPktBuffer_, txPktBuffer_;
+  static const int maxBatchSize = 32; ///< Max frames taken from a queue at once
   uint32_t txSeqNo_;          ///< sequence number of outgoing data packets
   uint32_t rxSeqNo_;          ///< sequence number of incoming data packets
   boost::condition_variable ackArrivedCond_;
   boost::mutex seqNoMutex_;
+  boost::random::mt19937 rng_;  ///< for random backoff
+  std::vector< boost::shared_ptr<StackDataSet> > ackPool_; ///< ACK frames, reused once sent (rx thread only)
+  static const int ackPoolSize = 8;   ///< Max ACK frames kept for reuse
+
+  /// A frame sent and waiting for its ACK (selective-repeat).
+  struct TxFrame
+  {
+    boost::shared_ptr<StackDataSet> frame;  ///< NULL once ACKed or given up
+    int txCount;                            ///< Transmissions so far
+    boost::posix_time::ptime sentTime;      ///< Time of first transmission
+    TimerWheel<uint32_t>::Handle timer;     ///< Retransmission timer
+  };
+
+  // selective-repeat state
+  bool selectiveRepeat_;
+  std::vector<TxFrame> txWindow_;     ///< Frames in flight, by seqno % window size
+  uint32_t txBase_;                   ///< Oldest seqno not yet ACKed
+  ReceiveWindow< boost::shared_ptr<StackDataSet> > rxWindow_; ///< Frames received out of order
+  std::vector< boost::shared_ptr<StackDataSet> > rxInOrder_;  ///< Frames to pass up
+  TimerWheel<uint32_t> timers_;       ///< Retransmission timers, 1 tick = 1 ms
+  boost::posix_time::ptime tickStart_;///< Time of tick 0
+  TimerWheel<uint32_t>::Tick nextBackoff_; ///< Don't back off the RTO again before this tick
+  double srtt_;                       ///< Smoothed round trip time (ms)
+  double rttVar_;                     ///< Round trip time variation (ms)
+  double rto_;                        ///< Retransmission timeout (ms)
+  bool haveRtt_;                      ///< Has a round trip been measured?
+  static const int minRto = 2;        ///< Min retransmission timeout (ms)
+  static const int maxRtoFactor = 16; ///< Max retransmission timeout (x acktimeout)
 
   // thread pointers
   boost::scoped_ptr< boost::thread > rxThread_, txThread_;
 
   // private functions
-  void sendAckPacket(const std::string destination, uint32_t seqno);
+  void sendAckPacket(uint64_t destination, uint32_t seqno, uint64_t ackBitmap = 0);
+  boost::shared_ptr<StackDataSet> getAckFrame();
+  void addHeader(boost::shared_ptr<StackDataSet> frame, const MacHeader& header, uint64_t ackBitmap = 0, uint32_t windowBase = 0);
+  bool stripHeader(boost::shared_ptr<StackDataSet> frame, MacHeader& header, uint64_t& ackBitmap, uint32_t& windowBase);
+  std::string addressString(uint64_t address) const;
   void rxThreadFunction();
   void txThreadFunction();
+  void txWindowThreadFunction();
+  void sendWindowFrame(boost::shared_ptr<StackDataSet> frame);
+  void retransmitWindowFrame(uint32_t seqno);
+  void receiveWindowFrame(boost::shared_ptr<StackDataSet> frame, const MacHeader& header, uint32_t windowBase);
+  void receiveWindowAck(const MacHeader& header, uint64_t ackBitmap);
+  void frameAcked(uint32_t seqno, boost::posix_time::ptime now);
+  void updateRto(double rtt);
+  size_t windowSpace() const;
+  TimerWheel<uint32_t>::Tick currentTick() const;
+  int randomBackoff(int max);
+  void logQueueStats(const char* name, const FrameQueue& queue);
 
 
 };
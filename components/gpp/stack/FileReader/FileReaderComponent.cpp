@@ -157,27 +157,19 @@ void FileReaderComponent::fileReadingLoop()
 
 void FileReaderComponent::readBlock(boost::shared_ptr<StackDataSet> readDataBuffer)
 {
-  char *bytebuffer = new char[blockSize_x];
-  char * bytebufferBackup = bytebuffer;
-  ifstream::pos_type toread = blockSize_x * sizeof(uint8_t);
-
-  //Read a block (loop if necessary)
-  while( toread > 0 )
+  //Read a block straight from the file buffer (loop if necessary)
+  streambuf* buf = hInFile_.rdbuf();
+  while( readDataBuffer->data.size() < (size_t)blockSize_x )
   {
-    hInFile_.read(bytebuffer, toread);
-    for(int i=0; i < hInFile_.gcount(); i++)
-    {
-      readDataBuffer->data.push_back(*bytebuffer);
-      bytebuffer++;
-    }
-    toread -= hInFile_.gcount();
-    if( hInFile_.eof() )
+    int c = buf->sbumpc();
+    if( c == char_traits<char>::eof() )
     {
       hInFile_.clear();
       hInFile_.seekg(0, ios::beg);
+      continue;
     }
+    readDataBuffer->data.push_back(static_cast<uint8_t>(c));
   }
-  delete[] bytebufferBackup;
   LOG(LDEBUG) << "One block read.";
   count_++;
   if(count_==packets_x)
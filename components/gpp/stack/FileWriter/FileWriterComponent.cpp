@@ -33,9 +33,11 @@
 
 #include "FileWriterComponent.h"
 
+#include <algorithm>
+#include <iterator>
+
 #include "irisapi/LibraryDefs.h"
 #include "irisapi/Version.h"
-#include "utility/RawFileUtility.h"
 
 using namespace std;
 
@@ -100,7 +102,8 @@ void FileWriterComponent::processMessageFromBelow(boost::shared_ptr<StackDataSet
 
 void FileWriterComponent::writeBlock(boost::shared_ptr<StackDataSet> toWrite)
 {
-  RawFileUtility::write(toWrite->data.begin(), toWrite->data.end(), hOutFile_);
+  //Write straight from the deque into the file buffer
+  copy(toWrite->data.begin(), toWrite->data.end(), ostreambuf_iterator<char>(hOutFile_));
 }
 
 } // namespace stack
@@ -59,6 +59,8 @@ TunTapComponent::TunTapComponent(std::string name)
                    "Interface to tun/tap virtual network devices",
                    "Andre Puschmann",
                    "0.1")
+  ,stopFd_(-1)
+  ,piSize_(0)
 {
   //Format: registerParameter(name, description, default, dynamic?, parameter, allowed values);
   registerParameter("device",
@@ -71,28 +73,75 @@ TunTapComponent::TunTapComponent(std::string name)
                     "true",
                     true,
                     readFromBelow_x);
+  registerParameter("numqueues",
+                    "Number of device queues, each read by its own thread",
+                    "1",
+                    false,
+                    numQueues_x,
+                    Interval<int>(1, 16));
+  registerParameter("vnethdr",
+                    "Exchange a virtio-net header with the kernel on each packet",
+                    "false",
+                    false,
+                    vnetHdr_x);
+  registerParameter("readbatch",
+                    "Max packets read from a queue each time it wakes up",
+                    "32",
+                    false,
+                    readBatch_x,
+                    Interval<int>(1, 1024));
 }
 
 
 void TunTapComponent::initialize()
 {
+#ifndef IFF_MULTI_QUEUE
+  if(numQueues_x > 1)
+    throw InvalidParameterException("Multiple queues are not supported by this kernel.");
+#endif
 }
 
 
 void TunTapComponent::processMessage(boost::shared_ptr<StackDataSet> incomingFrame)
 {
   size_t frameSize = incomingFrame->data.size();
-  size_t writtenBytes;
-
+  ssize_t writtenBytes;
+  struct iovec iov[3];
+  int iovCount = 0;
+  VnetHeader vnetHdr;
 
   //LOG(LDEBUG) << "processMessage() called.";
-  assert(frameSize <= MAX_BUF_SIZE);
-  for (int i = 0; i < (int)frameSize; i++)
-    buffer_[i] = incomingFrame->data[i];
+  if (tunFds_.empty())
+    return;
+
+  // a packet must be written in one go, so make it contiguous
+  PacketPtr packet = PacketPool::defaultPool().copy(incomingFrame->data.begin(),
+                                                    incomingFrame->data.end(), 0);
+
+  // the virtio-net header goes between the packet info and the packet.
+  // Our packets are whole, with their checksums done, so it is all zero.
+  if (vnetHdr_x)
+  {
+    size_t piSize = std::min(piSize_, frameSize);
+    iov[iovCount].iov_base = packet->data();
+    iov[iovCount++].iov_len = piSize;
+    memset(&vnetHdr, 0, sizeof(vnetHdr));
+    iov[iovCount].iov_base = &vnetHdr;
+    iov[iovCount++].iov_len = sizeof(vnetHdr);
+    iov[iovCount].iov_base = packet->data() + piSize;
+    iov[iovCount++].iov_len = frameSize - piSize;
+    frameSize += sizeof(vnetHdr);
+  }
+  else
+  {
+    iov[iovCount].iov_base = packet->data();
+    iov[iovCount++].iov_len = frameSize;
+  }
 
-  writtenBytes = write(tunFd_, buffer_, frameSize);
+  // writes may come from any queue
+  writtenBytes = writev(tunFds_[0], iov, iovCount);
 
-  if (writtenBytes != frameSize)
+  if (writtenBytes != (ssize_t)frameSize)
     LOG(LERROR) << "Less bytes written to tun/tap device then requested.";
   else
   {
@@ -125,32 +174,68 @@ void TunTapComponent::start()
 {
   //LOG(LDEBUG) << "start() called.";
 
-  // Connect to the device
-  strcpy(tunName_, tunTapDevice_x.c_str());
+  // Connect to the device, opening each queue in turn
+  strncpy(tunName_, tunTapDevice_x.c_str(), IFNAMSIZ-1);
+  tunName_[IFNAMSIZ-1] = '\0';
   int flags = strstr(tunName_, "tap") == NULL ? IFF_TUN : IFF_TAP | IFF_NO_PI;
-  if ((tunFd_ = allocateTunDevice(tunName_, flags)) >= 0)
+  piSize_ = (flags & IFF_NO_PI) ? 0 : sizeof(struct tun_pi);
+  if (vnetHdr_x)
+    flags |= IFF_VNET_HDR;
+#ifdef IFF_MULTI_QUEUE
+  if (numQueues_x > 1)
+    flags |= IFF_MULTI_QUEUE;
+#endif
+
+  for (int i = 0; i < numQueues_x; i++)
   {
-    LOG(LINFO) << "Successfully attached to tun/tap device "
-      << tunTapDevice_x;
-  }
-  else
-  {
-    LOG(LFATAL) << "Error allocating tun/tap interface.";
-    return;
+    int fd = allocateTunDevice(tunName_, flags);
+    if (fd < 0)
+    {
+      LOG(LFATAL) << "Error allocating tun/tap interface.";
+      closeDevice();
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    tunFds_.push_back(fd);
   }
 
-  // start thread
-  rxThread_.reset(new boost::thread(boost::bind( &TunTapComponent::rxThreadFunction, this)));
+  // offload checksums to us, so they are done by the queue threads
+  // rather than by the sender. Segmentation stays with the kernel.
+  if (vnetHdr_x && ioctl(tunFds_[0], TUNSETOFFLOAD, TUN_F_CSUM) < 0)
+    LOG(LWARNING) << "Could not turn on checksum offload on " << tunName_;
+
+  LOG(LINFO) << "Successfully attached to tun/tap device "
+    << tunName_ << " with " << tunFds_.size() << " queue(s)";
+
+  // start a thread for each queue
+  stopFd_ = eventfd(0, 0);
+  for (size_t i = 0; i < tunFds_.size(); i++)
+    rxThreads_.create_thread(boost::bind( &TunTapComponent::rxThreadFunction, this, tunFds_[i]));
 }
 
 
 void TunTapComponent::stop()
 {
-  if (rxThread_) {
-    rxThread_->interrupt();
-    rxThread_->join();
+  rxThreads_.interrupt_all();
+  if (stopFd_ >= 0)
+  {
+    uint64_t one = 1;
+    if (write(stopFd_, &one, sizeof(one)) < 0)
+      LOG(LERROR) << "Failed to wake rx threads.";
   }
-  close(tunFd_);
+  rxThreads_.join_all();
+  closeDevice();
+}
+
+
+void TunTapComponent::closeDevice()
+{
+  for (size_t i = 0; i < tunFds_.size(); i++)
+    close(tunFds_[i]);
+  tunFds_.clear();
+  if (stopFd_ >= 0)
+    close(stopFd_);
+  stopFd_ = -1;
 }
 
 
@@ -165,13 +250,27 @@ void TunTapComponent::registerPorts()
 }
 
 
-void TunTapComponent::rxThreadFunction()
+void TunTapComponent::rxThreadFunction(int fd)
 {
   //LOG(LINFO) << "RX thread started, listening on tun/tap device " << x_tunTapDevice;
-  fd_set socketSet;
-  struct timeval selectTimeout;
-  char buffer[MAX_BUF_SIZE];
-  int nread;
+  struct epoll_event event;
+  struct epoll_event events[2];
+  std::vector<uint8_t> buffer(MAX_BUF_SIZE);
+  ssize_t nread;
+
+  // wait for packets on our queue, or for stop() to signal stopFd_
+  int epollFd = epoll_create(2);
+  if (epollFd < 0)
+  {
+    LOG(LFATAL) << "Error creating epoll instance - RX thread exiting.";
+    return;
+  }
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+  event.data.fd = stopFd_;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd_, &event);
 
   try
   {
@@ -180,34 +279,35 @@ void TunTapComponent::rxThreadFunction()
     {
       boost::this_thread::interruption_point();
 
-      // reset socket set and add tap descriptor
-      FD_ZERO(&socketSet);
-      FD_SET(tunFd_, &socketSet);
-
-      // initialize timeout
-      selectTimeout.tv_sec = 1;
-      selectTimeout.tv_usec = 0;
-
-      // suspend thread until we receive a packet or timeout
-      if (select(tunFd_ + 1, &socketSet, NULL, NULL, &selectTimeout) == 0) {
-        //LOG(LDEBUG) << "Timeout while waiting for incoming packet.";
-      } else {
-        if (FD_ISSET(tunFd_, &socketSet)) {
-          if ((nread = read(tunFd_, buffer, MAX_BUF_SIZE)) < 0)
-          {
+      // suspend thread until we receive a packet or are stopped
+      if (epoll_wait(epollFd, events, 2, -1) < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw SystemException("Error waiting for tun/tap interface.");
+      }
+      boost::this_thread::interruption_point();
+
+      // drain the queue, up to a batch of packets at a time
+      for (int i = 0; i < readBatch_x; i++)
+      {
+        if ((nread = readPacket(fd, &buffer[0], buffer.size())) < 0)
+        {
+          if (errno != EAGAIN && errno != EWOULDBLOCK)
             LOG(LFATAL) << "Error while reading from tun/tap interface.";
-            continue;
-          }
-          LOG(LDEBUG) << "Read " << nread << " bytes from device "
-            << tunName_;
+          break;
+        }
+        if (nread == 0)
+          continue;
+        LOG(LDEBUG) << "Read " << nread << " bytes from device "
+          << tunName_;
 
-          // copy received data into new StackDataSet
-          shared_ptr<StackDataSet> packetBuffer(new StackDataSet);
-          packetBuffer->data.assign(buffer, buffer + nread);
+        // copy received data into new StackDataSet
+        shared_ptr<StackDataSet> packetBuffer(new StackDataSet);
+        packetBuffer->data.assign(buffer.begin(), buffer.begin() + nread);
 
-          // send downwards
-          sendDownwards("bottomoutputport", packetBuffer);
-        }
+        // send downwards
+        sendDownwards("bottomoutputport", packetBuffer);
       }
     } // while (true)
     throw SystemException("Rx thread stopped unexpectedly.");
@@ -222,6 +322,84 @@ void TunTapComponent::rxThreadFunction()
     LOG(LINFO) << "Thread " << boost::this_thread::get_id()
       << " in stack component interrupted.";
   }
+  close(epollFd);
+}
+
+
+/* Read a packet from a queue of the device.
+*
+* With a virtio-net header, the header is read into a struct of its own
+* and the packet (and any packet info) into buffer. A packet which needs
+* its checksum filled in is finished off here and a segmentation offload
+* packet, which we have not asked for, is dropped.
+*
+* Returns the number of bytes in buffer, 0 for a dropped packet or -1 on
+* error (with errno set).
+*/
+ssize_t TunTapComponent::readPacket(int fd, uint8_t* buffer, size_t size)
+{
+  if (!vnetHdr_x)
+    return read(fd, buffer, size);
+
+  VnetHeader vnetHdr;
+  struct iovec iov[3];
+  iov[0].iov_base = buffer;
+  iov[0].iov_len = piSize_;
+  iov[1].iov_base = &vnetHdr;
+  iov[1].iov_len = sizeof(vnetHdr);
+  iov[2].iov_base = buffer + piSize_;
+  iov[2].iov_len = size - piSize_;
+
+  ssize_t nread = readv(fd, iov, 3);
+  if (nread < 0)
+    return nread;
+  if (nread < (ssize_t)(piSize_ + sizeof(vnetHdr)))
+    return 0;
+  nread -= sizeof(vnetHdr);
+
+  if (vnetHdr.gsoType != VnetHeader::GSO_NONE)
+  {
+    LOG(LWARNING) << "Dropped segmentation offload packet from " << tunName_;
+    return 0;
+  }
+  if ((vnetHdr.flags & VnetHeader::F_NEEDS_CSUM) &&
+      !completeChecksum(buffer + piSize_, nread - piSize_,
+                        vnetHdr.csumStart, vnetHdr.csumOffset))
+  {
+    LOG(LWARNING) << "Dropped packet with bad checksum offsets from " << tunName_;
+    return 0;
+  }
+  return nread;
+}
+
+
+/* Fill in a partial checksum, as the kernel would for a device without
+* checksum offload. The checksum field holds the pseudo-header sum; add
+* the ones' complement sum of the packet from start and store the result
+* there.
+*/
+bool TunTapComponent::completeChecksum(uint8_t* packet, size_t size,
+                                       size_t start, size_t offset)
+{
+  if (start + offset + 2 > size)
+    return false;
+
+  uint32_t sum = 0;
+  size_t i = start;
+  for (; i + 1 < size; i += 2)
+    sum += (packet[i] << 8) | packet[i+1];
+  if (i < size)
+    sum += packet[i] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  // a zero checksum means none for UDP, so send it as 0xffff
+  uint16_t checksum = ~sum & 0xffff;
+  if (checksum == 0)
+    checksum = 0xffff;
+  packet[start+offset] = checksum >> 8;
+  packet[start+offset+1] = checksum & 0xff;
+  return true;
 }
 
 
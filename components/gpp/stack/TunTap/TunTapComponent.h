@@ -31,6 +31,10 @@
  * This component implements a software connector between Iris and
  * virtual network device drivers TUN/TAP on Linux/Unix systems.
  *
+ * The device can be opened with several queues (IFF_MULTI_QUEUE), each
+ * read by its own thread, and with a virtio-net header on each packet
+ * (IFF_VNET_HDR) so that the kernel can leave packet checksums to us.
+ *
  */
 
 #ifndef STACK_TUNTAPCOMPONENT_H_
@@ -44,11 +48,17 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <boost/format.hpp>
+#include "utility/PacketBuffer.h"
 
-#define MAX_BUF_SIZE (10 * 1024) // should be enough for now
+#define MAX_BUF_SIZE (64 * 1024 + 4) // largest packet plus packet info
 
 namespace iris
 {
@@ -71,19 +81,44 @@ public:
   virtual void stop();
 
 private:
+  /// The virtio-net header passed with each packet when IFF_VNET_HDR is
+  /// set (linux/virtio_net.h can't be included from C++).
+  struct VnetHeader
+  {
+    enum
+    {
+      F_NEEDS_CSUM = 1,       ///< Checksum from csumStart needs filling in
+      GSO_NONE = 0            ///< Not a segmentation offload packet
+    };
+    uint8_t flags;
+    uint8_t gsoType;
+    uint16_t hdrLen;
+    uint16_t gsoSize;
+    uint16_t csumStart;
+    uint16_t csumOffset;
+  };
+
   //Exposed parameters
   bool readFromBelow_x;       ///< Accept blocks from below (istead of above)
   std::string tunTapDevice_x; ///< Name of the Tun/Tap device to attach to
+  int numQueues_x;            ///< Number of device queues (and rx threads)
+  bool vnetHdr_x;             ///< Use a virtio-net header on each packet
+  int readBatch_x;            ///< Max packets read per wakeup
 
   char tunName_[IFNAMSIZ];
-  int tunFd_;
-  char buffer_[MAX_BUF_SIZE];
-  boost::scoped_ptr< boost::thread > rxThread_;
+  std::vector<int> tunFds_;   ///< One descriptor per device queue
+  int stopFd_;                ///< eventfd to wake the rx threads
+  size_t piSize_;             ///< Bytes of packet info in front of each packet
+  boost::thread_group rxThreads_;
 
   // private functions
   void processMessage(boost::shared_ptr<StackDataSet> incomingFrame);
-  void rxThreadFunction();
+  void rxThreadFunction(int fd);
+  ssize_t readPacket(int fd, uint8_t* buffer, size_t size);
+  void closeDevice();
   int allocateTunDevice(char *dev, int flags);
+  static bool completeChecksum(uint8_t* packet, size_t size,
+                               size_t start, size_t offset);
 
 };
 
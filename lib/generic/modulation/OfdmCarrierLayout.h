@@ -0,0 +1,196 @@
+/**
+ * \file lib/generic/modulation/OfdmCarrierLayout.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * The carrier layout of an OFDM symbol. Holds the pilot and data carrier
+ * indices along with the contiguous runs of data carriers, so that data
+ * can be mapped to and from carriers with block copies rather than
+ * one index per carrier.
+ */
+
+#ifndef MOD_OFDMCARRIERLAYOUT_H_
+#define MOD_OFDMCARRIERLAYOUT_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "irisapi/Exceptions.h"
+#include "modulation/OfdmIndexGenerator.h"
+
+namespace iris
+{
+
+/** The layout of pilot and data carriers in an OFDM symbol.
+ *
+ * Data carriers are described as runs of consecutive bins. The data for
+ * each run is stored consecutively, in the same order as the data indices
+ * given by OfdmIndexGenerator.
+ */
+class OfdmCarrierLayout
+{
+ public:
+  typedef std::vector<int>     IntVec;
+
+  /// A run of consecutive data carriers.
+  struct Run
+  {
+    int bin;      ///< Index of first bin in run.
+    int offset;   ///< Index of first data carrier in run.
+    int length;   ///< Number of carriers in run.
+  };
+  typedef std::vector<Run>     RunVec;
+
+  OfdmCarrierLayout()
+    :numBins_(0)
+  {}
+
+  /** Generate the layout for a given set of carriers.
+   *
+   * @param numData   Number of data carriers (not including pilots).
+   * @param numPilot  Number of pilot carriers.
+   * @param numGuard  Number of guard carriers (not including DC carrier).
+   */
+  void generate(int numData, int numPilot, int numGuard)
+  {
+    numBins_ = numData+numPilot+numGuard+1;
+    pilotIndices_.assign(numPilot, 0);
+    dataIndices_.assign(numData, 0);
+    OfdmIndexGenerator::generateIndices(numData, numPilot, numGuard,
+                                        pilotIndices_.begin(), pilotIndices_.end(),
+                                        dataIndices_.begin(), dataIndices_.end());
+
+    dataRuns_.clear();
+    for(int i=0; i<numData; i++)
+    {
+      if(!dataRuns_.empty() &&
+         dataRuns_.back().bin+dataRuns_.back().length == dataIndices_[i])
+      {
+        dataRuns_.back().length++;
+      }
+      else
+      {
+        Run r = {dataIndices_[i], i, 1};
+        dataRuns_.push_back(r);
+      }
+    }
+  }
+
+  /** Get the data runs after rotating all carriers by shift bins.
+   *
+   * Runs which wrap past the last bin are split in two. Output is
+   * cleared first; reserve maxRotatedRuns() to avoid allocation.
+   *
+   * @param shift Number of bins to rotate by (0 <= shift < numBins).
+   * @param out   Output runs.
+   */
+  void rotateDataRuns(int shift, RunVec& out) const
+  {
+    if(shift < 0 || shift >= numBins_)
+      throw IrisException("Invalid shift for rotateDataRuns.");
+
+    out.clear();
+    for(int i=0; i<dataRuns_.size(); i++)
+    {
+      Run r = dataRuns_[i];
+      r.bin += shift;
+      if(r.bin >= numBins_)
+      {
+        r.bin -= numBins_;
+        out.push_back(r);
+      }
+      else if(r.bin+r.length > numBins_)
+      {
+        Run wrapped = {0, r.offset+numBins_-r.bin, r.bin+r.length-numBins_};
+        r.length -= wrapped.length;
+        out.push_back(r);
+        out.push_back(wrapped);
+      }
+      else
+      {
+        out.push_back(r);
+      }
+    }
+  }
+
+  /** Copy data carriers out of the bins of a symbol.
+   *
+   * @param bins  The bins of one OFDM symbol.
+   * @param out   Output for numData() carriers.
+   */
+  template <class T>
+  void gather(const T* bins, T* out) const
+  {
+    for(int i=0; i<dataRuns_.size(); i++)
+    {
+      const Run& r = dataRuns_[i];
+      std::copy(bins+r.bin, bins+r.bin+r.length, out+r.offset);
+    }
+  }
+
+  /** Copy data into the data carriers of a symbol.
+   *
+   * @param in    Input of numData() carriers.
+   * @param bins  The bins of one OFDM symbol.
+   */
+  template <class T>
+  void scatter(const T* in, T* bins) const
+  {
+    for(int i=0; i<dataRuns_.size(); i++)
+    {
+      const Run& r = dataRuns_[i];
+      std::copy(in+r.offset, in+r.offset+r.length, bins+r.bin);
+    }
+  }
+
+  /// Number of bins in the symbol, including guards and DC.
+  int numBins() const { return numBins_; }
+  /// Number of data carriers.
+  int numData() const { return dataIndices_.size(); }
+  /// Number of pilot carriers.
+  int numPilot() const { return pilotIndices_.size(); }
+  /// Maximum number of runs output by rotateDataRuns().
+  int maxRotatedRuns() const { return dataRuns_.size()+1; }
+
+  const IntVec& pilotIndices() const { return pilotIndices_; }
+  const IntVec& dataIndices() const { return dataIndices_; }
+  const RunVec& dataRuns() const { return dataRuns_; }
+
+  /// Convenience function for logging.
+  static std::string getName(){ return "OfdmCarrierLayout"; }
+
+ private:
+  int numBins_;           ///< Number of bins in the symbol.
+  IntVec pilotIndices_;   ///< Indices of pilot carriers.
+  IntVec dataIndices_;    ///< Indices of data carriers.
+  RunVec dataRuns_;       ///< Runs of consecutive data carriers.
+};
+
+} // namespace iris
+
+#endif // MOD_OFDMCARRIERLAYOUT_H_
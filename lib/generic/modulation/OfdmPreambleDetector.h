@@ -32,21 +32,29 @@
  * using Schmidl & Cox algorithm (Schmidl, Timothy M., and Donald C. Cox.
  * "Robust frequency and timing synchronization for OFDM."
  * IEEE Transactions on communications 45.12 (1997): 1613-1621.).
+ *
+ * Input is processed in blocks. The correlation (P) and power (E) terms
+ * for a whole block are computed with SSE where available, followed by
+ * a light serial pass for the running sums and peak detection.
  */
 
 #ifndef MOD_OFDMPREAMBLEDETECTOR_H_
 #define MOD_OFDMPREAMBLEDETECTOR_H_
 
 #include <complex>
-#include <boost/noncopyable.hpp>
-#include <boost/circular_buffer.hpp>
+#include <vector>
+#include <cstring>
 #include <algorithm>
+#include <boost/noncopyable.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "irisapi/Exceptions.h"
 #include "irisapi/TypeInfo.h"
 #include "irisapi/Logging.h"
 #include "math/MathDefines.h"
-#include "math/Dsp.h"
 
 namespace iris
 {
@@ -56,11 +64,9 @@ class OfdmPreambleDetector
   : boost::noncopyable
 {
 public:
-  typedef std::complex<float>             Cplx;
-  typedef boost::circular_buffer<Cplx>    CplxBuf;
-  typedef CplxBuf::iterator               CplxBufIt;
-  typedef boost::circular_buffer<float>   FloatBuf;
-  typedef FloatBuf::iterator              FloatBufIt;
+  typedef std::complex<float>   Cplx;
+  typedef std::vector<Cplx>     CplxVec;
+  typedef std::vector<float>    FloatVec;
 
   /** Create an OFDM preamble detector.
    *
@@ -71,26 +77,16 @@ public:
   OfdmPreambleDetector(int symbolLen = 256,
                        int cyclicPrefixLen = 16,
                        float threshold = 0.827)
-    :sLen_(symbolLen)
-    ,cpLen_(cyclicPrefixLen)
-    ,thresh_(threshold*cyclicPrefixLen)
-    ,symbolBuffer_(symbolLen+cyclicPrefixLen)
-    ,halfBuffer_(symbolLen/2, Cplx(0,0))
-    ,eBuffer_(symbolLen, Cplx(0,0))
-    ,pBuffer_(symbolLen/2, Cplx(0,0))
-    ,vBuffer_(cyclicPrefixLen, 0.0)
-    ,vDebugBuffer_(symbolLen, 0.0)
-    ,currentP_(0,0)
-    ,currentE_(0,0)
-    ,vMovingAve_(0.0)
-    ,lastVma_(0.0)
-  {}
+  {
+    reset(symbolLen, cyclicPrefixLen, threshold);
+  }
 
   /** Search for a preamble in the range [inBegin, inEnd).
    *
    * A detected preamble will be copied into the range
    * [preambleBegin, preambleEnd). If no preamble is detected,
-   * the returned iterator == inEnd.
+   * the returned iterator == inEnd. The frequency offset and SNR
+   * are only updated when a preamble is detected.
    *
    * @param inBegin         Iterator to first input signal sample.
    * @param inEnd           Iterator to one past last input sample.
@@ -108,7 +104,16 @@ public:
 
   /// Reset the detector (keep current parameters).
   void reset()
-  {reset(sLen_,cpLen_,thresh_/cpLen_);}
+  {
+    std::fill(samples_.begin(), samples_.end(), Cplx(0,0));
+    std::fill(pTerms_.begin(), pTerms_.end(), Cplx(0,0));
+    std::fill(eTerms_.begin(), eTerms_.end(), 0.0f);
+    std::fill(vTerms_.begin(), vTerms_.end(), 0.0f);
+    currentP_ = Cplx(0,0);
+    currentE_ = 0;
+    vMovingAve_ = 0;
+    lastVma_ = 0;
+  }
 
   /// Reset the detector.
   void reset(int symbolLen, int cyclicPrefixLen, float threshold)
@@ -116,35 +121,41 @@ public:
     sLen_ = symbolLen;
     cpLen_ = cyclicPrefixLen;
     thresh_ = threshold*cyclicPrefixLen;
-    symbolBuffer_.assign(sLen_+cpLen_, Cplx(0,0));
-    halfBuffer_.assign(sLen_/2, Cplx(0,0));
-    eBuffer_.assign(sLen_, Cplx(0,0));
-    pBuffer_.assign(sLen_/2, Cplx(0,0));
-    vBuffer_.assign(cpLen_, 0);
-    vDebugBuffer_.assign(sLen_, 0);
-    currentP_ = Cplx(0,0);
-    currentE_ = Cplx(0,0);
-    vMovingAve_ = 0;
+    samples_.resize(sLen_+cpLen_+blockLen_);
+    pTerms_.resize(sLen_/2+blockLen_);
+    eTerms_.resize(sLen_+blockLen_);
+    vTerms_.resize(cpLen_+blockLen_);
+    pRe_.resize(blockLen_);
+    pIm_.resize(blockLen_);
+    eSums_.resize(blockLen_);
+    reset();
   }
 
   /// Convenience function for logging.
   static std::string getName(){ return "OfdmPreambleDetector"; }
 
 private:
-  CplxBuf symbolBuffer_;    ///< Holds last full symbol (including CP).
-  CplxBuf halfBuffer_;      ///< Holds last half-symbol.
-  CplxBuf eBuffer_;         ///< Holds last symbol length of e values.
-  CplxBuf pBuffer_;         ///< Holds last half-symbol length of p values.
-  FloatBuf vBuffer_;        ///< Holds last CP length of v values.
-  FloatBuf vDebugBuffer_;   ///< Holds last symbol length of v values for debug.
+  int searchBlock(int n);
+  void calculateTerms(const Cplx* in, const Cplx* mid, int n,
+                      Cplx* pOut, float* eOut);
+  void calculateV(const float* pRe, const float* pIm, const float* e,
+                  int n, float* vOut);
+
+  static const int blockLen_ = 1024;  ///< Samples processed per block.
+
+  CplxVec samples_;         ///< Last symbol (including CP) plus current block.
+  CplxVec pTerms_;          ///< Last half-symbol of p values plus current block.
+  FloatVec eTerms_;         ///< Last symbol of e values plus current block.
+  FloatVec vTerms_;         ///< Last CP length of v values plus current block.
+  FloatVec pRe_, pIm_;      ///< Running P values for current block.
+  FloatVec eSums_;          ///< Running E values for current block.
 
   Cplx currentP_;               ///< Current P (correlation value)
-  Cplx currentE_;               ///< Current E (power value)
+  float currentE_;              ///< Current E (power value)
   float vMovingAve_, lastVma_;  ///< Moving averages of V (normalized correlation)
-  float maxVal_, maxValThresh_; ///< Used for peak detection.
-  int sLen_, cpLen_;            ///< Symbol length, CP length, extension length
+  float detectedV_;             ///< V value at the detected peak.
+  int sLen_, cpLen_;            ///< Symbol length, CP length
   float thresh_;                ///< Detection threshold.
-
 };
 
 template <class Iterator>
@@ -156,72 +167,181 @@ Iterator OfdmPreambleDetector::search(Iterator inBegin,
                                       float &freqOffset,
                                       float &snr)
 {
-  int counter=-1;
+  int histLen = sLen_+cpLen_;
 
-  for(; inBegin != inEnd; ++inBegin)
+  while(inBegin != inEnd)
   {
-    counter++;
-
-    //Add current sample to symbolBuffer_
-    symbolBuffer_.push_back(*inBegin);
-
-    Cplx  nextSymbol = *inBegin;
-    Cplx  midSymbol = halfBuffer_.front();
-
-    //Add current sample to the halfBuffer_
-    halfBuffer_.push_back(*inBegin);
-
-    //Iterate for P
-    Cplx  nextP = conj(nextSymbol)*midSymbol;
-    Cplx  tailP = pBuffer_.front();
-    currentP_ += (nextP - tailP);
-    pBuffer_.push_back(nextP);
-
-    //Iterate for E
-    Cplx  nextE = conj(nextSymbol)*nextSymbol;
-    Cplx  tailE = eBuffer_.front();
-    currentE_ += (nextE - tailE);
-    eBuffer_.push_back(nextE);
-
-    //Use P and E values to calculate V
-    //float magP = abs(currentP_);
-    //float magE = abs(currentE_);
-    float magP = fastMag(currentP_);
-    float magE = fastMag(currentE_);
-    float den = magE*magE;
-    float v = (den == 0) ? 0 : ((2*magP)*(2*magP))/den;
-
-    //Estimate the SNR
-    snr = 10*log10(sqrtf(v)/(1-sqrtf(v)));
-
-    //Iterate for the moving average value of V
-    lastVma_ = vMovingAve_;
-    vMovingAve_ += (v - vBuffer_.front());
-    vBuffer_.push_back(v);
-    vDebugBuffer_.push_back(v);
+    int n = inEnd-inBegin;
+    if(n > blockLen_)
+      n = blockLen_;
+    std::copy(inBegin, inBegin+n, samples_.begin()+histLen);
 
-    //Check the moving average V value for threshold and peak
-    if(vMovingAve_ > thresh_ && vMovingAve_ < lastVma_)
+    int index = searchBlock(n);
+    if(index >= 0)
     {
       detected = true;
 
       //We've detected the peak - copy the preamble into output vector
-      if((preambleEnd-preambleBegin) < sLen_+cpLen_)
+      if((preambleEnd-preambleBegin) < histLen)
         throw IrisException("Insufficient storage provided for preamble output");
-      std::copy(symbolBuffer_.begin(), symbolBuffer_.end(), preambleBegin);
+      std::copy(samples_.begin()+index+1,
+                samples_.begin()+index+1+histLen,
+                preambleBegin);
 
       //Phase of P gives the fractional frequency offset
       freqOffset = arg(currentP_);
       freqOffset = -(freqOffset)/(float)IRIS_PI;
 
+      //Estimate the SNR
+      snr = 10*log10(sqrtf(detectedV_)/(1-sqrtf(detectedV_)));
+
       reset();
-      return ++inBegin;
+      return inBegin+index+1;
     }
+    inBegin += n;
   }
 
   return inBegin;
 }
 
+/** Run the detector over the n samples at the end of samples_.
+ *
+ * \return  Index of the detected peak within the block or -1.
+ */
+inline int OfdmPreambleDetector::searchBlock(int n)
+{
+  int halfLen = sLen_/2;
+  Cplx* x = &samples_[sLen_+cpLen_];
+  Cplx* p = &pTerms_[halfLen];
+  float* e = &eTerms_[sLen_];
+  float* v = &vTerms_[cpLen_];
+
+  calculateTerms(x, x-halfLen, n, p, e);
+
+  //Running sums of P and E over the block
+  for(int i=0; i<n; i++)
+  {
+    currentP_ += (p[i] - p[i-halfLen]);
+    currentE_ += (e[i] - e[i-sLen_]);
+    pRe_[i] = currentP_.real();
+    pIm_[i] = currentP_.imag();
+    eSums_[i] = currentE_;
+  }
+
+  calculateV(&pRe_[0], &pIm_[0], &eSums_[0], n, v);
+
+  //Check the moving average V value for threshold and peak
+  for(int i=0; i<n; i++)
+  {
+    lastVma_ = vMovingAve_;
+    vMovingAve_ += (v[i] - v[i-cpLen_]);
+    if(vMovingAve_ > thresh_ && vMovingAve_ < lastVma_)
+    {
+      currentP_ = Cplx(pRe_[i], pIm_[i]);
+      detectedV_ = v[i];
+      return i;
+    }
+  }
+
+  //Keep the history needed for the next block
+  memmove(&samples_[0], &samples_[n], (sLen_+cpLen_)*sizeof(Cplx));
+  memmove(&pTerms_[0], &pTerms_[n], halfLen*sizeof(Cplx));
+  memmove(&eTerms_[0], &eTerms_[n], sLen_*sizeof(float));
+  memmove(&vTerms_[0], &vTerms_[n], cpLen_*sizeof(float));
+  return -1;
+}
+
+/// p = conj(in)*mid and e = |in|^2 for n samples.
+inline void OfdmPreambleDetector::calculateTerms(const Cplx* in,
+                                                 const Cplx* mid,
+                                                 int n,
+                                                 Cplx* pOut,
+                                                 float* eOut)
+{
+  int i=0;
+#ifdef __SSE2__
+  const float* a = reinterpret_cast<const float*>(in);
+  const float* b = reinterpret_cast<const float*>(mid);
+  float* p = reinterpret_cast<float*>(pOut);
+  const __m128 sign = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+  for(; i+4<=n; i+=4, a+=8, b+=8, p+=8)
+  {
+    for(int j=0; j<2; j++)
+    {
+      // Two samples per register: [re0 im0 re1 im1]
+      __m128 va = _mm_loadu_ps(a+4*j);
+      __m128 vb = _mm_loadu_ps(b+4*j);
+      __m128 vbSwap = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2,3,0,1));
+      __m128 t1 = _mm_mul_ps(va, vb);      // ar*br, ai*bi
+      __m128 t2 = _mm_mul_ps(va, vbSwap);  // ar*bi, ai*br
+      __m128 even = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(2,0,2,0));
+      __m128 odd = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(3,1,3,1));
+      __m128 res = _mm_add_ps(even, _mm_mul_ps(odd, sign)); // re0 re1 im0 im1
+      _mm_storeu_ps(p+4*j, _mm_unpacklo_ps(res, _mm_movehl_ps(res, res)));
+    }
+
+    __m128 lo = _mm_loadu_ps(a);
+    __m128 hi = _mm_loadu_ps(a+4);
+    lo = _mm_mul_ps(lo, lo);
+    hi = _mm_mul_ps(hi, hi);
+    __m128 re2 = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2,0,2,0));
+    __m128 im2 = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3,1,3,1));
+    _mm_storeu_ps(eOut+i, _mm_add_ps(re2, im2));
+  }
+#endif
+  for(; i<n; i++)
+  {
+    pOut[i] = conj(in[i])*mid[i];
+    eOut[i] = in[i].real()*in[i].real() + in[i].imag()*in[i].imag();
+  }
+}
+
+/** v = (2|P|)^2/|E|^2 for n samples.
+ *
+ * Magnitudes use the same alpha*max + beta*min estimate as fastMag()
+ * (see math/Dsp.h).
+ */
+inline void OfdmPreambleDetector::calculateV(const float* pRe,
+                                             const float* pIm,
+                                             const float* e,
+                                             int n,
+                                             float* vOut)
+{
+  const float alpha = 0.947543636291f;
+  const float beta = 0.392485425092f;
+  int i=0;
+#ifdef __SSE2__
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 vAlpha = _mm_set1_ps(alpha);
+  const __m128 vBeta = _mm_set1_ps(beta);
+  const __m128 vTwo = _mm_set1_ps(2.0f);
+  const __m128 vZero = _mm_setzero_ps();
+  for(; i+4<=n; i+=4)
+  {
+    __m128 absI = _mm_and_ps(_mm_loadu_ps(pRe+i), absMask);
+    __m128 absQ = _mm_and_ps(_mm_loadu_ps(pIm+i), absMask);
+    __m128 magP = _mm_add_ps(_mm_mul_ps(vAlpha, _mm_max_ps(absI, absQ)),
+                             _mm_mul_ps(vBeta, _mm_min_ps(absI, absQ)));
+    __m128 magE = _mm_mul_ps(vAlpha, _mm_and_ps(_mm_loadu_ps(e+i), absMask));
+    __m128 num = _mm_mul_ps(vTwo, magP);
+    num = _mm_mul_ps(num, num);
+    __m128 den = _mm_mul_ps(magE, magE);
+    __m128 nonZero = _mm_cmpneq_ps(den, vZero);
+    __m128 v = _mm_div_ps(num, _mm_or_ps(den, _mm_andnot_ps(nonZero, vTwo)));
+    _mm_storeu_ps(vOut+i, _mm_and_ps(v, nonZero));
+  }
+#endif
+  for(; i<n; i++)
+  {
+    float absI = fabs(pRe[i]);
+    float absQ = fabs(pIm[i]);
+    float magP = alpha*std::max(absI, absQ) + beta*std::min(absI, absQ);
+    float magE = alpha*fabs(e[i]);
+    float den = magE*magE;
+    vOut[i] = (den == 0) ? 0 : ((2*magP)*(2*magP))/den;
+  }
+}
+
 } // namespace iris
 
 #endif // MOD_OFDMPREAMBLEDETECTOR_H_
@@ -32,6 +32,10 @@
  * can be used to demodulate using M-ary QAM with a constellation on
  * a rectangular lattice. Expects constellations which are Gray coded
  * with average unit energy.
+ *
+ * Hard decisions are made without data-dependent branches, using SSE2 on
+ * contiguous input where available. Soft decisions produce one log
+ * likelihood ratio per bit, as float or saturated int8_t.
  */
 
 #ifndef MOD_QAMDEMODULATOR_H_
@@ -39,6 +43,13 @@
 
 #include <complex>
 #include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "irisapi/Exceptions.h"
 #include "irisapi/TypeInfo.h"
@@ -52,6 +63,10 @@ namespace iris
  *
  * Objects of this class provide M-ary QAM demodulation. Expects constellations
  * which are Gray coded with average unit energy.
+ *
+ * Soft outputs are log likelihood ratios log(P(b=0)/P(b=1)) using the
+ * simplified max-log approximation, so a negative LLR decides a 1 bit.
+ * LLRs are given in the same bit order as the packed hard output.
  */
 class QamDemodulator
 {
@@ -60,11 +75,6 @@ class QamDemodulator
   typedef std::complex<float>   Cplx;
   typedef std::vector<Cplx>     CplxVec;
 
-  QamDemodulator()
-  {
-    createQam16Lut();
-  }
-
   /** Demodulate a set of QAM complex<float> symbols to uint8_t bytes.
    * Defaults to BPSK.
    *
@@ -73,6 +83,7 @@ class QamDemodulator
    * @param outBegin  Iterator to first output byte.
    * @param outEnd    Iterator to one past last output byte.
    * @param M         Modulation depth (1=BPSK, 2=QPSK, 4=QAM16)
+   * @return          Iterator to the last output byte written.
    */
   template <class InputInterator, class OutputIterator>
   OutputIterator demodulate(InputInterator inBegin,
@@ -88,119 +99,365 @@ class QamDemodulator
     if((outEnd-outBegin)*8/M > inEnd-inBegin)
       LOG(LWARNING) << "Output size larger than required for demodulate.";
 
-    int count=0;
-    int symIndex,pointsPerQuadrant;
-    Cplx tempV;
-    float biasValues[2]={2.0f/sqrtf(10.0f),0.0f};
+    if(M != QPSK && M != QAM16)
+      M = BPSK;
+    int symbolsPerByte = 8/M;
+    int numBytes = (inEnd-inBegin)/symbolsPerByte;
+
+    // Whole bytes are sliced straight from contiguous input
+    const float* in = numBytes > 0 ? contiguous(inBegin) : NULL;
+    int count = 0;
+    if(in != NULL)
+    {
+      switch (M)
+      {
+        case QPSK:
+          sliceQpsk(in, numBytes, outBegin);
+          break;
+        case QAM16:
+          sliceQam16(in, numBytes, outBegin);
+          break;
+        default:
+          sliceBpsk(in, numBytes, outBegin);
+          break;
+      }
+      count = numBytes*symbolsPerByte;
+      std::advance(inBegin, count);
+    }
+
+    // Generic iterators and any partial byte at the end
+    for(;inBegin!=inEnd;inBegin++)
+    {
+      if(count%symbolsPerByte == 0 && count!=0)
+        outBegin++;
+      *outBegin = *outBegin<<M | symbolBits(*inBegin, M);
+      count++;
+    }
+
+    return outBegin;
+  }
+
+  /** Demodulate a set of QAM complex<float> symbols to per-bit LLRs.
+   * Defaults to BPSK.
+   *
+   * Output may be float or int8_t. int8_t outputs are rounded and
+   * saturated to +/-127, so scale should be chosen accordingly.
+   *
+   * @param inBegin   Iterator to first input QAM symbol.
+   * @param inEnd     Iterator to one past last input QAM symbol.
+   * @param outBegin  Iterator to first output LLR.
+   * @param outEnd    Iterator to one past last output LLR.
+   * @param M         Modulation depth (1=BPSK, 2=QPSK, 4=QAM16)
+   * @param scale     Scale applied to each LLR (e.g. derived from noise variance).
+   * @return          Iterator to one past the last LLR written.
+   */
+  template <class InputInterator, class OutputIterator>
+  OutputIterator demodulateSoft(InputInterator inBegin,
+                                InputInterator inEnd,
+                                OutputIterator outBegin,
+                                OutputIterator outEnd,
+                                unsigned int M,
+                                float scale = 1.0f)
+  {
+    typedef typename std::iterator_traits<OutputIterator>::value_type LlrType;
+
+    if(M != QPSK && M != QAM16)
+      M = BPSK;
 
+    // Check for sufficient output size
+    if((outEnd-outBegin) < (inEnd-inBegin)*M)
+      throw IrisException("Insufficient storage provided for demodulateSoft output.");
+
+    if((outEnd-outBegin) > (inEnd-inBegin)*M)
+      LOG(LWARNING) << "Output size larger than required for demodulateSoft.";
+
+    // Work through the input in blocks held on the stack
+    float llrs[blockSymbols_*QAM16];
+    int numSymbols = inEnd-inBegin;
+    const float* in = numSymbols > 0 ? contiguous(inBegin) : NULL;
+    while(numSymbols > 0)
+    {
+      int n = std::min(numSymbols, (int)blockSymbols_);
+      if(in != NULL)
+      {
+        softSymbols(in, n, llrs, M, scale);
+        in += 2*n;
+      }
+      else
+      {
+        for(int i=0; i<n; i++, inBegin++)
+        {
+          Cplx s = *inBegin;
+          softSymbols(reinterpret_cast<const float*>(&s), 1,
+                      llrs+i*M, M, scale);
+        }
+      }
+      outBegin = storeLlrs(llrs, n*M, outBegin, (LlrType*)0);
+      numSymbols -= n;
+    }
+
+    return outBegin;
+  }
+
+  /// Convenience function for logging.
+  std::string getName(){ return "QamDemodulator"; }
+
+
+ private:
+  static const int blockSymbols_ = 64;  ///< Symbols per soft-output block.
+
+  /// Contiguous input can be read directly as interleaved floats.
+  static const float* contiguous(CplxVec::iterator it)
+  {
+    return reinterpret_cast<const float*>(&*it);
+  }
+  static const float* contiguous(CplxVec::const_iterator it)
+  {
+    return reinterpret_cast<const float*>(&*it);
+  }
+  static const float* contiguous(Cplx* it)
+  {
+    return reinterpret_cast<const float*>(it);
+  }
+  static const float* contiguous(const Cplx* it)
+  {
+    return reinterpret_cast<const float*>(it);
+  }
+  template <class Iterator>
+  static const float* contiguous(Iterator)
+  {
+    return NULL;
+  }
+
+  /// Threshold between the inner and outer 16-QAM levels.
+  static float qam16Bias()
+  {
+    return 2.0f/sqrtf(10.0f);
+  }
+
+  /// Hard decision bits for a single symbol, MSB first.
+  static unsigned int symbolBits(Cplx s, unsigned int M)
+  {
+    float re = s.real();
+    float im = s.imag();
+    float bias = qam16Bias();
+    switch (M)
+    {
+      case QPSK:
+        return (re > 0)<<1 | (im > 0);
+      case QAM16:
+        return (re > 0)<<3 | (im > 0)<<2 |
+               ((re > bias) | !(re > -bias))<<1 |
+               ((im > bias) | !(im > -bias));
+      default:
+        return !(re > 0);
+    }
+  }
+
+  /** Slice whole bytes of BPSK symbols from interleaved floats.
+   * On return, out refers to the last byte written.
+   */
+  template <class OutputIterator>
+  static void sliceBpsk(const float* in, int numBytes, OutputIterator& out)
+  {
+    for(int i=0; i<numBytes; i++, in+=16)
+    {
+      if(i != 0)
+        out++;
+#ifdef __SSE2__
+      // Gather real parts in reverse so the first symbol lands in the MSB
+      __m128 zero = _mm_setzero_ps();
+      __m128 a0 = _mm_loadu_ps(in);
+      __m128 a1 = _mm_loadu_ps(in+4);
+      __m128 a2 = _mm_loadu_ps(in+8);
+      __m128 a3 = _mm_loadu_ps(in+12);
+      __m128 hi = _mm_shuffle_ps(a1, a0, _MM_SHUFFLE(0,2,0,2));
+      __m128 lo = _mm_shuffle_ps(a3, a2, _MM_SHUFFLE(0,2,0,2));
+      int bits = _mm_movemask_ps(_mm_cmpgt_ps(hi, zero))<<4 |
+                 _mm_movemask_ps(_mm_cmpgt_ps(lo, zero));
+      *out = ~bits & 0xFF;
+#else
+      unsigned int byte = 0;
+      for(int j=0; j<8; j++)
+        byte = byte<<1 | !(in[2*j] > 0);
+      *out = byte;
+#endif
+    }
+  }
+
+  /** Slice whole bytes of QPSK symbols from interleaved floats.
+   * On return, out refers to the last byte written.
+   */
+  template <class OutputIterator>
+  static void sliceQpsk(const float* in, int numBytes, OutputIterator& out)
+  {
+    for(int i=0; i<numBytes; i++, in+=8)
+    {
+      if(i != 0)
+        out++;
+#ifdef __SSE2__
+      __m128 zero = _mm_setzero_ps();
+      __m128 a0 = _mm_loadu_ps(in);
+      __m128 a1 = _mm_loadu_ps(in+4);
+      a0 = _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(0,1,2,3));
+      a1 = _mm_shuffle_ps(a1, a1, _MM_SHUFFLE(0,1,2,3));
+      *out = _mm_movemask_ps(_mm_cmpgt_ps(a0, zero))<<4 |
+             _mm_movemask_ps(_mm_cmpgt_ps(a1, zero));
+#else
+      unsigned int byte = 0;
+      for(int j=0; j<8; j++)
+        byte = byte<<1 | (in[j] > 0);
+      *out = byte;
+#endif
+    }
+  }
+
+  /** Slice whole bytes of 16-QAM symbols from interleaved floats.
+   * On return, out refers to the last byte written.
+   */
+  template <class OutputIterator>
+  static void sliceQam16(const float* in, int numBytes, OutputIterator& out)
+  {
+    float bias = qam16Bias();
+#ifdef __SSE2__
+    __m128 zero = _mm_setzero_ps();
+    __m128 pos = _mm_set1_ps(bias);
+    __m128 neg = _mm_set1_ps(-bias);
+#endif
+    for(int i=0; i<numBytes; i++, in+=4)
+    {
+      if(i != 0)
+        out++;
+#ifdef __SSE2__
+      // Lanes reversed to im1 re1 im0 re0 so masks read MSB first
+      __m128 a = _mm_loadu_ps(in);
+      a = _mm_shuffle_ps(a, a, _MM_SHUFFLE(0,1,2,3));
+      int sign = _mm_movemask_ps(_mm_cmpgt_ps(a, zero));
+      int outer = _mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(a, pos),
+                                            _mm_cmpngt_ps(a, neg)));
+      *out = (sign&0xC)<<4 | (outer&0xC)<<2 | (sign&0x3)<<2 | (outer&0x3);
+#else
+      unsigned int byte = 0;
+      for(int j=0; j<4; j+=2)
+      {
+        float re = in[j];
+        float im = in[j+1];
+        byte = byte<<4 | (re > 0)<<3 | (im > 0)<<2 |
+               ((re > bias) | !(re > -bias))<<1 |
+               ((im > bias) | !(im > -bias));
+      }
+      *out = byte;
+#endif
+    }
+  }
+
+  /// Calculate LLRs for n symbols of interleaved floats.
+  static void softSymbols(const float* in, int n, float* out,
+                          unsigned int M, float scale)
+  {
+    float bias = qam16Bias();
+    int i = 0;
     switch (M)
     {
-      case QPSK: //QPSK
-        for(;inBegin!=inEnd;inBegin++)
+      case QPSK:
+        // Bits are set for positive components
+#ifdef __SSE2__
         {
-          if(count%4 == 0 && count!=0)
-            outBegin++;
-          //slice to demodulate
-          if((*inBegin).real() > 0)
-            if((*inBegin).imag() > 0)
-              *outBegin = *outBegin<<2 | 0x3;
-            else
-              *outBegin = *outBegin<<2 | 0x2;
-          else
-            if((*inBegin).imag() > 0)
-              *outBegin = *outBegin<<2 | 0x1;
-            else
-              *outBegin = *outBegin<<2 | 0x0;
-          count++;
+          __m128 s = _mm_set1_ps(-scale);
+          for(; i+2<=n; i+=2)
+            _mm_storeu_ps(out+2*i, _mm_mul_ps(_mm_loadu_ps(in+2*i), s));
+        }
+#endif
+        for(; i<n; i++)
+        {
+          out[2*i] = -scale*in[2*i];
+          out[2*i+1] = -scale*in[2*i+1];
         }
         break;
-      case QAM16: //16 QAM
-        for(;inBegin!=inEnd;inBegin++)
+      case QAM16:
+        // Sign bits as QPSK, then inner/outer level bits
+#ifdef __SSE2__
         {
-          if(count%2 == 0 && count!=0)
-            outBegin++;
-
-          symIndex = 0;
-          pointsPerQuadrant = 4;
-          tempV = *inBegin;
-          for(int j=0;j<2;j++)
+          __m128 s = _mm_set1_ps(-scale);
+          __m128 m = _mm_set1_ps(scale);
+          __m128 b = _mm_set1_ps(bias);
+          __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+          for(; i+2<=n; i+=2)
           {
-            if (tempV.real() > 0)
-            {
-              if (tempV.imag() > 0)
-              {
-                tempV = tempV + Cplx(-biasValues[j],-biasValues[j]);
-              }
-              else
-              {
-                tempV = tempV + Cplx(-biasValues[j],biasValues[j]);
-                symIndex += 3*pointsPerQuadrant;
-              }
-            }
-            else
-            {
-              if (tempV.imag() > 0)
-              {
-                tempV = tempV + Cplx(biasValues[j],-biasValues[j]);
-                symIndex += pointsPerQuadrant;
-              }
-              else
-              {
-                tempV = tempV + Cplx(biasValues[j],biasValues[j]);
-                symIndex += 2*pointsPerQuadrant;
-              }
-            }
-            pointsPerQuadrant = pointsPerQuadrant >> 2;
+            __m128 a = _mm_loadu_ps(in+2*i);
+            __m128 sign = _mm_mul_ps(a, s);
+            __m128 level = _mm_mul_ps(_mm_sub_ps(b, _mm_and_ps(a, absMask)), m);
+            _mm_storeu_ps(out+4*i, _mm_movelh_ps(sign, level));
+            _mm_storeu_ps(out+4*i+4, _mm_movehl_ps(level, sign));
           }
-          *outBegin = *outBegin<<4 | Qam16Lut_[symIndex];
-          count++;
+        }
+#endif
+        for(; i<n; i++)
+        {
+          float re = in[2*i];
+          float im = in[2*i+1];
+          out[4*i] = -scale*re;
+          out[4*i+1] = -scale*im;
+          out[4*i+2] = scale*(bias-fabsf(re));
+          out[4*i+3] = scale*(bias-fabsf(im));
         }
         break;
-      default : //BPSK
-        for(;inBegin!=inEnd;inBegin++)
+      default:
+        // Bits are set for negative real parts
+#ifdef __SSE2__
         {
-          if(count%8 == 0 && count!=0)
-            outBegin++;
-          (*inBegin).real() > 0 ? *outBegin = *outBegin<<1 | 0: *outBegin = *outBegin<<1 | 1;
-          count++;
+          __m128 s = _mm_set1_ps(scale);
+          for(; i+4<=n; i+=4)
+          {
+            __m128 re = _mm_shuffle_ps(_mm_loadu_ps(in+2*i),
+                                       _mm_loadu_ps(in+2*i+4),
+                                       _MM_SHUFFLE(2,0,2,0));
+            _mm_storeu_ps(out+i, _mm_mul_ps(re, s));
+          }
         }
+#endif
+        for(; i<n; i++)
+          out[i] = scale*in[2*i];
         break;
     }
-
-    return outBegin;
   }
 
-  /// Convenience function for logging.
-  std::string getName(){ return "QamDemodulator"; }
-
-
- private:
-
-  void createQam16Lut()
+  /// Write a block of float LLRs.
+  template <class OutputIterator>
+  static OutputIterator storeLlrs(const float* llrs, int n,
+                                  OutputIterator out, float*)
   {
-    using namespace std;
-    Qam16Lut_.push_back(15);
-    Qam16Lut_.push_back(13);
-    Qam16Lut_.push_back(12);
-    Qam16Lut_.push_back(14);
-
-    Qam16Lut_.push_back(5);
-    Qam16Lut_.push_back(7);
-    Qam16Lut_.push_back(6);
-    Qam16Lut_.push_back(4);
-
-    Qam16Lut_.push_back(0);
-    Qam16Lut_.push_back(2);
-    Qam16Lut_.push_back(3);
-    Qam16Lut_.push_back(1);
-
-    Qam16Lut_.push_back(10);
-    Qam16Lut_.push_back(8);
-    Qam16Lut_.push_back(9);
-    Qam16Lut_.push_back(11);
+    return std::copy(llrs, llrs+n, out);
   }
 
-  Uint8Vec Qam16Lut_;
+  /// Round and saturate a block of LLRs to int8_t.
+  template <class OutputIterator>
+  static OutputIterator storeLlrs(const float* llrs, int n,
+                                  OutputIterator out, int8_t*)
+  {
+    int i = 0;
+#ifdef __SSE2__
+    __m128 hi = _mm_set1_ps(127.0f);
+    __m128 lo = _mm_set1_ps(-127.0f);
+    for(; i+16<=n; i+=16)
+    {
+      __m128i q[4];
+      for(int j=0; j<4; j++)
+      {
+        __m128 v = _mm_loadu_ps(llrs+i+4*j);
+        q[j] = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(v, hi), lo));
+      }
+      __m128i packed = _mm_packs_epi16(_mm_packs_epi32(q[0], q[1]),
+                                       _mm_packs_epi32(q[2], q[3]));
+      int8_t bytes[16];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), packed);
+      out = std::copy(bytes, bytes+16, out);
+    }
+#endif
+    for(; i<n; i++)
+      *out++ = (int8_t)lrintf(std::max(std::min(llrs[i], 127.0f), -127.0f));
+    return out;
+  }
 };
 
 } // namespace iris
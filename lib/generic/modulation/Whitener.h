@@ -35,7 +35,18 @@
 #define MOD_WHITENER_H_
 
 #include <vector>
+#include <iterator>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "irisapi/TypeInfo.h"
+#include "modulation/Crc.h"
 
 namespace iris
 {
@@ -44,8 +55,19 @@ namespace iris
 namespace whitenerdetail
 {
 
-/// The code used to whiten incoming data
-uint8_t whitenCode[4096] = {
+/** The code used to whiten incoming data.
+ *
+ * Held as a static member of a class template so that it is defined
+ * once across all translation units which include this header.
+ */
+template<class Dummy>
+struct WhitenTables
+{
+  static const uint8_t code[4096];
+};
+
+template<class Dummy>
+const uint8_t WhitenTables<Dummy>::code[4096] = {
 	255,  63,   0,  16,   0,  12,   0,   5, 192,   3,  16,   1, 204,   0,  85, 192,
 	63,  16,  16,  12,  12,   5, 197, 195,  19,  17, 205, 204,  85, 149, 255,  47, 
 	0,  28,   0,   9, 192,   6, 208,   2, 220,   1, 153, 192, 106, 208,  47,  28, 
@@ -303,12 +325,22 @@ uint8_t whitenCode[4096] = {
 	199, 113, 146, 164, 109, 187, 109, 179, 109, 181, 237, 183,  13, 182, 133, 182, 
 	227,  54, 201, 214, 214, 222, 222, 216,  88,  90, 186, 187,  51,  51, 255,  63
 	};
-}
+
+typedef WhitenTables<void> Tables;
+
+/// The whitening code under its original name.
+static const uint8_t (&whitenCode)[4096] = Tables::code;
+
+} // namespace whitenerdetail
 
 /** A data whitener class
  *
  * The Whitener class simply provides a
  * static function to whiten a vector of data
+ *
+ * Contiguous uint8_t data is whitened 16 (SSE2) or 32 (AVX2) bytes at a
+ * time. The fused functions whiten and CRC data in a single pass, for
+ * use when building and checking frames.
  */
 class Whitener
 {
@@ -323,16 +355,131 @@ public:
 	template<class InputIterator>
 	static void whiten(InputIterator inBegin, InputIterator inEnd)
 	{
+		uint8_t* in = inBegin != inEnd ? contiguous(inBegin) : NULL;
+		if(in != NULL)
+		{
+			std::size_t len = std::distance(inBegin, inEnd);
+			for(std::size_t pos = 0; pos < len; pos += 4096)
+				whitenBlock(in+pos, std::min(len-pos, (std::size_t)4096), 0);
+			return;
+		}
+
 		// Supports input block sizes larger than the whitened table (4096)
-	  int count = 0;
+		const uint8_t* code = whitenerdetail::Tables::code;
+		int count = 0;
 		for(; inBegin != inEnd; ++inBegin, ++count)
 		{
-			*inBegin = *inBegin ^ whitenerdetail::whitenCode[count%4096];
+			*inBegin = *inBegin ^ code[count%4096];
 		}
 	}
 
+	/** Whiten some uint8_t data and return the crc of the result.
+	 *
+	 * Equivalent to whiten() followed by Crc::generate(), used to
+	 * dewhiten and check received data.
+	 *
+	 * @param inBegin Iterator to first data element.
+	 * @param inEnd   Iterator to one past last data element.
+	 */
+	template<class InputIterator>
+	static uint32_t whitenAndCrc(InputIterator inBegin, InputIterator inEnd)
+	{
+		return fused(inBegin, inEnd, false);
+	}
+
+	/** Generate the crc of some uint8_t data and then whiten it.
+	 *
+	 * Equivalent to Crc::generate() followed by whiten(), used to
+	 * check and whiten data for transmission.
+	 *
+	 * @param inBegin Iterator to first data element.
+	 * @param inEnd   Iterator to one past last data element.
+	 */
+	template<class InputIterator>
+	static uint32_t crcAndWhiten(InputIterator inBegin, InputIterator inEnd)
+	{
+		return fused(inBegin, inEnd, true);
+	}
+
 private:
   Whitener(){}; ///< Disable constructor by making it private
+
+	/// Number of bytes whitened and checked at a time by the fused functions.
+	static const int chunkLen_ = 256;
+
+	/// Contiguous input can be whitened in place directly.
+	static uint8_t* contiguous(std::vector<uint8_t>::iterator it)
+	{
+		return &*it;
+	}
+	static uint8_t* contiguous(uint8_t* it)
+	{
+		return it;
+	}
+	template<class Iterator>
+	static uint8_t* contiguous(Iterator)
+	{
+		return NULL;
+	}
+
+	/// Whiten len bytes using the code from offset (offset+len <= 4096).
+	static void whitenBlock(uint8_t* in, std::size_t len, std::size_t offset)
+	{
+		const uint8_t* code = whitenerdetail::Tables::code + offset;
+		std::size_t i = 0;
+#ifdef __AVX2__
+		for(; i+32 <= len; i += 32)
+		{
+			__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in+i));
+			__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(code+i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(in+i), _mm256_xor_si256(d, c));
+		}
+#endif
+#ifdef __SSE2__
+		for(; i+16 <= len; i += 16)
+		{
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in+i));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(code+i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(in+i), _mm_xor_si128(d, c));
+		}
+#endif
+		for(; i < len; i++)
+			in[i] ^= code[i];
+	}
+
+	/// Whiten and crc data in cache-sized chunks.
+	template<class InputIterator>
+	static uint32_t fused(InputIterator inBegin, InputIterator inEnd,
+	                      bool crcFirst)
+	{
+		uint8_t* in = inBegin != inEnd ? contiguous(inBegin) : NULL;
+		if(in == NULL)
+		{
+			uint32_t crc = 0;
+			if(crcFirst)
+				crc = Crc::generate(inBegin, inEnd);
+			whiten(inBegin, inEnd);
+			if(!crcFirst)
+				crc = Crc::generate(inBegin, inEnd);
+			return crc;
+		}
+
+		// Each chunk stays in cache between whitening and crc. Chunks
+		// divide the code length so never wrap part-way through the code.
+		std::size_t len = std::distance(inBegin, inEnd);
+		uint32_t crc = 0;
+		for(std::size_t pos = 0; pos < len; pos += chunkLen_)
+		{
+			std::size_t n = std::min(len-pos, (std::size_t)chunkLen_);
+			uint8_t* chunk = in+pos;
+			if(crcFirst)
+				crc = Crc::update(crc, chunk, chunk+n);
+			whitenBlock(chunk, n, pos%4096);
+			if(!crcFirst)
+				crc = Crc::update(crc, chunk, chunk+n);
+		}
+		return crc;
+	}
 };
 
 } // namespace iris
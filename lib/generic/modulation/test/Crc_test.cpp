@@ -36,6 +36,7 @@
 #include "Crc.h"
 
 #include <boost/test/unit_test.hpp>
+#include <deque>
 
 #include "irisapi/TypeInfo.h"
 
@@ -68,4 +69,41 @@ BOOST_AUTO_TEST_CASE(Crc_Test)
   BOOST_CHECK(crc != 0xAC148725); // Ensure checksum is different
 }
 
+BOOST_AUTO_TEST_CASE(Crc_Iterator_Test)
+{
+  // Contiguous and bytewise paths should agree for all lengths
+  vector< uint8_t > data(100);
+  for(int i=0; i<data.size(); ++i)
+    data[i] = (i*37+11) & 0xff;
+  deque< uint8_t > dData(data.begin(), data.end());
+
+  for(int len=0; len<=data.size(); ++len)
+  {
+    uint32_t a = Crc::generate(data.begin(), data.begin()+len);
+    uint32_t b = Crc::generate(dData.begin(), dData.begin()+len);
+    uint32_t c = Crc::generate(&data[0], &data[0]+len);
+    BOOST_CHECK_EQUAL(a, b);
+    BOOST_CHECK_EQUAL(a, c);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Crc_Update_Test)
+{
+  vector< uint8_t > data(256);
+  for(int i=0; i<data.size(); ++i)
+    data[i] = i;
+
+  // Crc the data in uneven pieces
+  uint32_t crc = 0;
+  int pieces[] = {1, 7, 8, 13, 64, 3, 160};
+  vector< uint8_t >::iterator it = data.begin();
+  for(int i=0; i<7; ++i)
+  {
+    crc = Crc::update(crc, it, it+pieces[i]);
+    it += pieces[i];
+  }
+
+  BOOST_CHECK(crc == 0xAC148725);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
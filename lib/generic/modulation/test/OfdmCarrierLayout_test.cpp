@@ -0,0 +1,125 @@
+/**
+ * \file lib/generic/modulation/OfdmCarrierLayout_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for OfdmCarrierLayout class.
+ */
+
+#define BOOST_TEST_MODULE OfdmCarrierLayout_Test
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <complex>
+
+#include "OfdmCarrierLayout.h"
+
+#include "irisapi/TypeInfo.h"
+
+using namespace iris;
+
+BOOST_AUTO_TEST_SUITE (OfdmCarrierLayout_Test)
+
+BOOST_AUTO_TEST_CASE(OfdmCarrierLayout_Default_Test)
+{
+  OfdmCarrierLayout layout;
+  layout.generate(192, 8, 55);
+
+  BOOST_CHECK(layout.numBins() == 256);
+  BOOST_CHECK(layout.numData() == 192);
+  BOOST_CHECK(layout.numPilot() == 8);
+
+  // Data carriers fall into runs between the pilots, DC and guards
+  int r[][2] = {{1,12},{14,24},{39,24},{64,24},{89,12},
+                {156,12},{169,24},{194,24},{219,24},{244,12}};
+  const OfdmCarrierLayout::RunVec& runs = layout.dataRuns();
+  BOOST_REQUIRE(runs.size() == 10);
+  int offset = 0;
+  for(int i=0;i<10;i++)
+  {
+    BOOST_CHECK(runs[i].bin == r[i][0]);
+    BOOST_CHECK(runs[i].length == r[i][1]);
+    BOOST_CHECK(runs[i].offset == offset);
+    offset += runs[i].length;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(OfdmCarrierLayout_GatherScatter_Test)
+{
+  OfdmCarrierLayout layout;
+  layout.generate(40, 8, 15);
+  const std::vector<int>& dataIndices = layout.dataIndices();
+
+  std::vector<int> bins(layout.numBins());
+  for(int i=0;i<bins.size();i++)
+    bins[i] = i;
+
+  // Gather should match indexing by data carrier
+  std::vector<int> data(layout.numData());
+  layout.gather(&bins[0], &data[0]);
+  BOOST_CHECK(data == dataIndices);
+
+  // Scatter should only touch data carriers
+  std::vector<int> out(layout.numBins(), -1);
+  layout.scatter(&data[0], &out[0]);
+  for(int i=0;i<out.size();i++)
+  {
+    bool isData = find(dataIndices.begin(), dataIndices.end(), i) != dataIndices.end();
+    BOOST_CHECK(out[i] == (isData ? i : -1));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(OfdmCarrierLayout_Rotate_Test)
+{
+  OfdmCarrierLayout layout;
+  layout.generate(40, 8, 15);
+  const std::vector<int>& dataIndices = layout.dataIndices();
+  int numBins = layout.numBins();
+
+  OfdmCarrierLayout::RunVec runs;
+  for(int shift=0;shift<numBins;shift++)
+  {
+    layout.rotateDataRuns(shift, runs);
+    BOOST_REQUIRE(runs.size() <= layout.maxRotatedRuns());
+
+    // Expand runs and compare with rotated indices
+    std::vector<int> rotated(layout.numData(), -1);
+    for(int i=0;i<runs.size();i++)
+    {
+      BOOST_REQUIRE(runs[i].bin+runs[i].length <= numBins);
+      for(int j=0;j<runs[i].length;j++)
+        rotated[runs[i].offset+j] = runs[i].bin+j;
+    }
+    for(int i=0;i<dataIndices.size();i++)
+      BOOST_CHECK(rotated[i] == (dataIndices[i]+shift)%numBins);
+  }
+
+  BOOST_CHECK_THROW(layout.rotateDataRuns(numBins, runs), IrisException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
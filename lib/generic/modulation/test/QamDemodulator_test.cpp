@@ -34,6 +34,7 @@
 #define BOOST_TEST_MODULE QamDemodulator_Test
 
 #include <boost/test/unit_test.hpp>
+#include <deque>
 
 #include "QamDemodulator.h"
 
@@ -176,4 +177,89 @@ BOOST_AUTO_TEST_CASE(QamDemodulator_Qam16_Test)
     BOOST_CHECK(output[i] == expected[i]);
 }
 
+BOOST_AUTO_TEST_CASE(QamDemodulator_Iterator_Test)
+{
+  // Contiguous and non-contiguous input should give the same result,
+  // including a partial byte at the end
+  vector< complex<float> > input;
+  for(int i=0;i<37;i++)
+    input.push_back(complex<float>(cosf(i*1.3f), sinf(i*0.7f)));
+  deque< complex<float> > dInput(input.begin(), input.end());
+
+  QamDemodulator q;
+  unsigned int depths[] = {BPSK, QPSK, QAM16};
+  for(int m=0;m<3;m++)
+  {
+    unsigned int M = depths[m];
+    vector<uint8_t> a((input.size()*M+7)/8, 0);
+    vector<uint8_t> b((input.size()*M+7)/8, 0);
+    vector<uint8_t>::iterator aIt, bIt;
+    aIt = q.demodulate(input.begin(), input.end(), a.begin(), a.end(), M);
+    bIt = q.demodulate(dInput.begin(), dInput.end(), b.begin(), b.end(), M);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK(aIt == a.end()-1);
+    BOOST_CHECK(bIt == b.end()-1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(QamDemodulator_Soft_Fail_Test)
+{
+  vector< complex<float> > input;
+  for(int i=0;i<16;i++)
+    input.push_back(complex<float>(1,0));
+
+  float output[63]; // Should be length 64
+
+  QamDemodulator q;
+  BOOST_CHECK_THROW(q.demodulateSoft(input.begin(), input.end(),
+                                     begin(output), end(output),
+                                     QAM16), IrisException);
+}
+
+BOOST_AUTO_TEST_CASE(QamDemodulator_Soft_Test)
+{
+  // Hard decisions from LLR signs should match demodulate
+  vector< complex<float> > input;
+  for(int i=0;i<64;i++)
+    input.push_back(complex<float>(1.2f*cosf(i*1.3f), 1.2f*sinf(i*0.7f)));
+
+  QamDemodulator q;
+  unsigned int depths[] = {BPSK, QPSK, QAM16};
+  for(int m=0;m<3;m++)
+  {
+    unsigned int M = depths[m];
+    vector<uint8_t> bytes(input.size()*M/8);
+    vector<float> llrs(input.size()*M);
+    q.demodulate(input.begin(), input.end(), bytes.begin(), bytes.end(), M);
+    BOOST_CHECK(q.demodulateSoft(input.begin(), input.end(),
+                                 llrs.begin(), llrs.end(), M) == llrs.end());
+
+    for(int i=0;i<llrs.size();i++)
+    {
+      int bit = (bytes[i/8] >> (7-i%8)) & 0x1;
+      BOOST_CHECK_EQUAL(bit, llrs[i] < 0 ? 1 : 0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(QamDemodulator_SoftInt8_Test)
+{
+  vector< complex<float> > input;
+  input.push_back(complex<float>(0.25f,-0.5f));
+  input.push_back(complex<float>(-100.0f,100.0f));
+
+  int8_t output[4];
+
+  QamDemodulator q;
+  BOOST_CHECK_NO_THROW(q.demodulateSoft(input.begin(), input.end(),
+                                        begin(output), end(output),
+                                        QPSK, 10.0f));
+
+  // LLRs are rounded and saturated
+  BOOST_CHECK_EQUAL(output[0], -2);
+  BOOST_CHECK_EQUAL(output[1], 5);
+  BOOST_CHECK_EQUAL(output[2], 127);
+  BOOST_CHECK_EQUAL(output[3], -127);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -36,6 +36,7 @@
 #include "Whitener.h"
 
 #include <boost/test/unit_test.hpp>
+#include <deque>
 
 #include "irisapi/TypeInfo.h"
 
@@ -67,4 +68,42 @@ BOOST_AUTO_TEST_CASE(Whitener_Test)
     BOOST_CHECK(data[i] == i%256);
 }
 
+BOOST_AUTO_TEST_CASE(Whitener_Iterator_Test)
+{
+  // Contiguous and non-contiguous data should be whitened identically
+  vector< uint8_t > data(5000);
+  for(int i=0; i<data.size(); ++i)
+    data[i] = (i*7)%256;
+  deque< uint8_t > dData(data.begin(), data.end());
+
+  Whitener::whiten(data.begin()+3, data.end());
+  Whitener::whiten(dData.begin()+3, dData.end());
+
+  BOOST_CHECK(equal(data.begin(), data.end(), dData.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(Whitener_Crc_Test)
+{
+  vector< uint8_t > data(6000);
+  for(int i=0; i<data.size(); ++i)
+    data[i] = (i*13)%256;
+
+  // Crc of the input, then whiten
+  vector< uint8_t > expected(data);
+  uint32_t expectedCrc = Crc::generate(expected.begin(), expected.end());
+  Whitener::whiten(expected.begin(), expected.end());
+
+  uint32_t crc = Whitener::crcAndWhiten(data.begin(), data.end());
+  BOOST_CHECK_EQUAL(crc, expectedCrc);
+  BOOST_CHECK(data == expected);
+
+  // Whiten, then crc of the output
+  Whitener::whiten(expected.begin(), expected.end());
+  expectedCrc = Crc::generate(expected.begin(), expected.end());
+
+  crc = Whitener::whitenAndCrc(data.begin(), data.end());
+  BOOST_CHECK_EQUAL(crc, expectedCrc);
+  BOOST_CHECK(data == expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+/**
+ * \file lib/generic/utility/AllocationCounter.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A heap allocation counter for tests and benchmarks. The replacement
+ * global operator new/delete are defined by IRIS_ALLOCATION_COUNTER_OPERATORS,
+ * which must be used in exactly one source file of a test or benchmark
+ * executable.
+ */
+
+#ifndef ALLOCATIONCOUNTER_H_
+#define ALLOCATIONCOUNTER_H_
+
+#include <cstdlib>
+#include <new>
+#include <boost/detail/atomic_count.hpp>
+
+namespace iris
+{
+
+/** Counts calls to the global operator new.
+ *
+ * Counting is off until start() is called. Use it to check that a
+ * component's steady state (e.g. process()) does not touch the heap.
+ * Allocations are counted from all threads.
+ */
+class AllocationCounter
+{
+public:
+  /// Reset the count and begin counting allocations.
+  static void start()
+  {
+    base() = count();
+    ++enabled();
+  }
+
+  /// Stop counting and return the number of allocations since start().
+  static long stop()
+  {
+    --enabled();
+    return count() - base();
+  }
+
+  /// Record an allocation (called from operator new).
+  static void record()
+  {
+    if(enabled() > 0)
+      ++count();
+  }
+
+private:
+  AllocationCounter(){}; ///< Disable constructor by making it private
+
+  static boost::detail::atomic_count& enabled()
+  {
+    static boost::detail::atomic_count e(0);
+    return e;
+  }
+  static boost::detail::atomic_count& count()
+  {
+    static boost::detail::atomic_count c(0);
+    return c;
+  }
+  static long& base() { static long b = 0; return b; }
+};
+
+} // namespace iris
+
+// Keep the replacements out of line, so gcc doesn't pair the inlined
+// malloc/free with new/delete at the call sites and warn
+#ifdef __GNUC__
+#define IRIS_ALLOCATION_COUNTER_NOINLINE __attribute__((noinline))
+#else
+#define IRIS_ALLOCATION_COUNTER_NOINLINE
+#endif
+
+/** Define the global operator new/delete which count allocations.
+ *
+ * Use this once, at file scope, in one source file of an executable.
+ */
+#define IRIS_ALLOCATION_COUNTER_OPERATORS                       \
+  IRIS_ALLOCATION_COUNTER_NOINLINE                              \
+  void* operator new(std::size_t size)                          \
+  {                                                             \
+    iris::AllocationCounter::record();                          \
+    void* p = std::malloc(size == 0 ? 1 : size);                \
+    if(p == NULL)                                               \
+      throw std::bad_alloc();                                   \
+    return p;                                                   \
+  }                                                             \
+  IRIS_ALLOCATION_COUNTER_NOINLINE                              \
+  void operator delete(void* p) throw()                         \
+  {                                                             \
+    std::free(p);                                               \
+  }                                                             \
+  IRIS_ALLOCATION_COUNTER_NOINLINE                              \
+  void operator delete(void* p, std::size_t) throw()            \
+  {                                                             \
+    std::free(p);                                               \
+  }
+
+#endif // ALLOCATIONCOUNTER_H_
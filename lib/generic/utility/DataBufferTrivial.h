@@ -59,7 +59,15 @@ class DataBufferTrivial
 {
 public:
 
-  explicit DataBufferTrivial(std::size_t buffer_size = 3)
+  /** Create a buffer.
+   *
+   * @param buffer_size   Initial number of DataSets in the buffer.
+   * @param reserve_size  Elements to reserve in each initial DataSet. Tests
+   *                      can use this (with a large enough buffer_size) to
+   *                      keep the buffer itself from allocating.
+   */
+  explicit DataBufferTrivial(std::size_t buffer_size = 3,
+                             std::size_t reserve_size = 0)
     :buffer_(buffer_size) ,
     isReadLocked_(false),
     isWriteLocked_(false),
@@ -72,6 +80,8 @@ public:
     typeIdentifier = TypeInfo<T>::identifier;
     if( typeIdentifier == -1)
       throw InvalidDataTypeException("Data type not supported");
+    for(std::size_t i=0; i<buffer_.size(); i++)
+      buffer_[i].data.reserve(reserve_size);
   };
 
   virtual ~DataBufferTrivial(){};
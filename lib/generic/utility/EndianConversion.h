@@ -37,6 +37,11 @@
 #include <boost/cstdint.hpp>
 #include <boost/detail/endian.hpp>
 #include <complex>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // define macros to switch byte order (only use with unsigned numbers!)
 #define _swapbytes16(x) (((x)>>8) | ((x)<<8))
@@ -267,5 +272,99 @@ inline T sys2lit(T x)
 }
 
 
+//! number of bytes in each word reversed by swap_bytes
+template <typename T>
+struct swap_word_size
+{
+  static const size_t value = sizeof(T);
+};
+
+//! complex numbers have their real and imaginary parts swapped separately
+template <typename T>
+struct swap_word_size<std::complex<T> >
+{
+  static const size_t value = sizeof(T);
+};
+
+//! reverses the bytes of n words of wordSize bytes from in to out (in may equal out)
+inline void swap_bytes_block(const void* in, void* out, size_t n, size_t wordSize)
+{
+  const unsigned char* src = static_cast<const unsigned char*>(in);
+  unsigned char* dst = static_cast<unsigned char*>(out);
+  size_t bytes = n*wordSize;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  // Reverse the 16-bit units within each word, then the bytes within each unit
+  if(wordSize == 2 || wordSize == 4 || wordSize == 8)
+  {
+    for(; i+16 <= bytes; i+=16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+      if(wordSize == 4)
+      {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,0,1));
+      }
+      else if(wordSize == 8)
+      {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0,1,2,3));
+      }
+      v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+      _mm_storeu_si128((__m128i*)(dst+i), v);
+    }
+  }
+#endif
+
+  for(; i < bytes; i+=wordSize)
+  {
+    if(wordSize == 2)
+    {
+      boost::uint16_t x;
+      memcpy(&x, src+i, 2);
+      x = _swapbytes16(x);
+      memcpy(dst+i, &x, 2);
+    }
+    else if(wordSize == 4)
+    {
+      boost::uint32_t x;
+      memcpy(&x, src+i, 4);
+      x = _swapbytes32(x);
+      memcpy(dst+i, &x, 4);
+    }
+    else if(wordSize == 8)
+    {
+      boost::uint64_t x;
+      memcpy(&x, src+i, 8);
+      x = _swapbytes64(x);
+      memcpy(dst+i, &x, 8);
+    }
+    else
+    {
+      unsigned char word[16];
+      memcpy(word, src+i, wordSize);
+      for(size_t k = 0; k < wordSize; ++k)
+        dst[i+k] = word[wordSize-1-k];
+    }
+  }
+}
+
+//! swaps the byte order of n elements from in to out, as swap_bytes does for each
+template <typename T>
+inline void swap_bytes_block(const T* in, T* out, size_t n)
+{
+  if(swap_word_size<T>::value == 1)
+  {
+    if(in != out)
+      memcpy(out, in, n*sizeof(T));
+    return;
+  }
+  swap_bytes_block(static_cast<const void*>(in), static_cast<void*>(out),
+                   n*(sizeof(T)/swap_word_size<T>::value),
+                   swap_word_size<T>::value);
+}
+
+
 
 #endif
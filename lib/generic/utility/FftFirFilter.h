@@ -0,0 +1,250 @@
+/**
+ * \file FftFirFilter.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * FIR filter using overlap-save fft convolution for long filters.
+ * Needs FFTW.
+ */
+
+#ifndef _FFTFIRFILTER_H_
+#define _FFTFIRFILTER_H_
+
+#include <vector>
+#include <algorithm>
+
+#include <boost/shared_ptr.hpp>
+#include "fftw3.h"
+#include "FirFilter.h"
+
+namespace iris
+{
+
+namespace firdetail
+{
+
+//! Is overlap-save fft filtering available for a set of filter types?
+//! Like the FirFilter fast paths, it works in complex<float> internally
+//! so is only enabled for float types.
+template<class InT, class CoeffT, class OutT>
+struct FftPath : boost::false_type {};
+
+template<>
+struct FftPath<float, float, float> : boost::true_type {};
+
+template<>
+struct FftPath<Cplx, float, Cplx> : boost::true_type {};
+
+template<>
+struct FftPath<Cplx, Cplx, Cplx> : boost::true_type {};
+
+} // end of firdetail namespace
+
+//! \brief Filters input data by applying an FIR filter with the
+//! given coefficients, using fft convolution for long filters.
+//!
+//! Float and complex<float> filters with at least fftTapThreshold taps use
+//! overlap-save fft convolution. All other filters are passed on to a
+//! FirFilter. Output is identical (to within rounding) in each case.
+template<class InT, class CoeffT = InT, class OutT = InT>
+class FftFirFilter
+{
+public:
+  //! Filters with this many taps or more use fft convolution
+  static const int fftTapThreshold = 64;
+
+  //! The filtering method in use
+  enum Mode
+  {
+    DIRECT = FirFilter<InT, CoeffT, OutT>::DIRECT,
+    SIMD = FirFilter<InT, CoeffT, OutT>::SIMD,
+    FFT
+  };
+
+  //! default constructor - no coefficients are set
+  FftFirFilter()
+    : mode_(DIRECT), history_(0), blockLength_(0)
+  {
+  }
+
+  //! constructor setting the filter coefficients
+  template<class It>
+  FftFirFilter(It coeff_start, It coeff_end)
+    : mode_(DIRECT), history_(0), blockLength_(0)
+  {
+    setCoeffs(coeff_start, coeff_end);
+  }
+
+  //! set the filter coefficients
+  template<class It>
+  void setCoeffs(It coeff_start, It coeff_end)
+  {
+    std::vector<CoeffT> coeffs(coeff_start, coeff_end);
+    if(HasFft::value && (int)coeffs.size() >= fftTapThreshold)
+    {
+      setupFft(coeffs, HasFft());
+    }
+    else
+    {
+      direct_.setCoeffs(coeffs.begin(), coeffs.end());
+      mode_ = (Mode)direct_.getMode();
+    }
+  }
+
+  //! get the filtering method chosen for the current coefficients
+  Mode getMode() const { return mode_; }
+
+  //! \brief Apply filter to given input sequence, writing output to output iterator.
+  //! Make sure that output has enough capacity to hold input.size() values.
+  //! \return Iterator pointing to one past the end of the output sequence.
+  template<class InIt, class OutIt>
+  OutIt filter(InIt istart, InIt iend, OutIt ostart)
+  {
+    if(mode_ == FFT)
+      return filterFft(istart, iend, ostart, HasFft());
+    return direct_.filter(istart, iend, ostart);
+  }
+
+private:
+  typedef firdetail::FftPath<InT, CoeffT, OutT> HasFft;
+  typedef firdetail::Cplx Cplx;
+  typedef firdetail::CplxVec CplxVec;
+  typedef boost::shared_ptr<fftwf_plan_s> PlanPtr;
+
+  //! \brief Overlap-save convolution, a block at a time.
+  //! work_ holds the last history_ input samples followed by a block
+  //! of up to blockLength_ new samples.
+  template<class InIt, class OutIt>
+  OutIt filterFft(InIt istart, InIt iend, OutIt ostart, boost::true_type)
+  {
+    while (istart != iend)
+    {
+      Cplx* block = &work_[history_];
+      int n = 0;
+      for(; n < blockLength_ && istart != iend; n++)
+        block[n] = firdetail::toCplx(*istart++);
+
+      ostart = fftBlock(n, ostart);
+
+      // keep the last history_ samples for the next block
+      std::copy(work_.begin() + n, work_.begin() + n + history_, work_.begin());
+    }
+    return ostart;
+  }
+
+  template<class InIt, class OutIt>
+  OutIt filterFft(InIt istart, InIt iend, OutIt ostart, boost::false_type)
+  {
+    return direct_.filter(istart, iend, ostart);
+  }
+
+  //! overlap-save convolution of n samples in work_
+  template<class OutIt>
+  OutIt fftBlock(int n, OutIt ostart)
+  {
+    fftwf_execute_dft(forward_.get(),
+                      reinterpret_cast<fftwf_complex*>(&work_[0]),
+                      reinterpret_cast<fftwf_complex*>(&freq_[0]));
+
+    float* f = reinterpret_cast<float*>(&freq_[0]);
+    const float* c = reinterpret_cast<const float*>(&fftCoeffs_[0]);
+    for(int i = 0; i < 2 * (int)freq_.size(); i += 2)
+    {
+      float re = f[i] * c[i] - f[i+1] * c[i+1];
+      float im = f[i] * c[i+1] + f[i+1] * c[i];
+      f[i] = re;
+      f[i+1] = im;
+    }
+
+    fftwf_execute_dft(inverse_.get(),
+                      reinterpret_cast<fftwf_complex*>(&freq_[0]),
+                      reinterpret_cast<fftwf_complex*>(&freq_[0]));
+
+    // the first history_ outputs are circular aliases - discard them
+    OutT y;
+    for(int i = 0; i < n; i++)
+    {
+      firdetail::fromCplx(freq_[history_ + i], y);
+      *ostart++ = y;
+    }
+    return ostart;
+  }
+
+  //! plan ffts and transform the coefficients
+  void setupFft(const std::vector<CoeffT>& coeffs, boost::true_type)
+  {
+    int numTaps = coeffs.size();
+    int fftSize = 1;
+    while(fftSize < 4 * numTaps)
+      fftSize *= 2;
+
+    history_ = numTaps - 1;
+    blockLength_ = fftSize - history_;
+    work_.assign(fftSize, Cplx(0, 0));
+    freq_.assign(fftSize, Cplx(0, 0));
+    fftCoeffs_.assign(fftSize, Cplx(0, 0));
+
+    // FFTW_MEASURE overwrites the arrays, so plan before filling them
+    fftwf_complex* work = reinterpret_cast<fftwf_complex*>(&work_[0]);
+    fftwf_complex* freq = reinterpret_cast<fftwf_complex*>(&freq_[0]);
+    forward_.reset(fftwf_plan_dft_1d(fftSize, work, freq, FFTW_FORWARD,
+                                     FFTW_MEASURE | FFTW_UNALIGNED),
+                   fftwf_destroy_plan);
+    inverse_.reset(fftwf_plan_dft_1d(fftSize, freq, freq, FFTW_BACKWARD,
+                                     FFTW_MEASURE | FFTW_UNALIGNED),
+                   fftwf_destroy_plan);
+
+    // fold the 1/fftSize ifft scaling into the coefficients
+    std::fill(work_.begin(), work_.end(), Cplx(0, 0));
+    for(int i = 0; i < numTaps; i++)
+      work_[i] = firdetail::toCplx(coeffs[i]) / (float)fftSize;
+    fftwf_execute_dft(forward_.get(), work,
+                      reinterpret_cast<fftwf_complex*>(&fftCoeffs_[0]));
+    std::fill(work_.begin(), work_.end(), Cplx(0, 0));
+    mode_ = FFT;
+  }
+
+  void setupFft(const std::vector<CoeffT>&, boost::false_type)
+  {
+  }
+
+  FirFilter<InT, CoeffT, OutT> direct_; //!< filter for short filters
+
+  Mode mode_; //!< filtering method in use
+  int history_; //!< input samples kept between blocks
+  int blockLength_; //!< max new input samples per block
+  CplxVec work_; //!< input history followed by current block
+  CplxVec freq_; //!< frequency domain block
+  CplxVec fftCoeffs_; //!< transformed coefficients
+  PlanPtr forward_; //!< forward fft of work_ into freq_ (shared by copies)
+  PlanPtr inverse_; //!< in-place inverse fft of freq_ (shared by copies)
+};
+
+} // end of iris namespace
+
+#endif
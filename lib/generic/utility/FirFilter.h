@@ -36,29 +36,116 @@
 
 #include <vector>
 #include <deque>
+#include <complex>
 #include <algorithm>
 
 #include <boost/lambda/lambda.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace iris
 {
 
-//! Filters input data by applying an FIR filter with the 
-//! given coefficients
+namespace firdetail
+{
+
+typedef std::complex<float> Cplx;
+typedef std::vector<Cplx>   CplxVec;
+
+//! Fast filter paths available for a set of filter types. The fast paths
+//! work in complex<float> internally so are only enabled for float types.
+template<class InT, class CoeffT, class OutT>
+struct FastPaths
+{
+  typedef boost::false_type simd; //!< SIMD direct-form filtering
+};
+
+template<>
+struct FastPaths<Cplx, float, Cplx>
+{
+  typedef boost::true_type simd;
+};
+
+template<>
+struct FastPaths<Cplx, Cplx, Cplx>
+{
+  typedef boost::true_type simd;
+};
+
+inline Cplx toCplx(float x) { return Cplx(x, 0); }
+inline Cplx toCplx(const Cplx& x) { return x; }
+inline void fromCplx(const Cplx& x, float& out) { out = x.real(); }
+inline void fromCplx(const Cplx& x, Cplx& out) { out = x; }
+
+//! \brief Complex dot product of numTaps samples with expanded coefficients.
+//! numTaps must be even. Each pair of taps is stored as 8 floats:
+//! (re0,re0,re1,re1) followed by (-im0,im0,-im1,im1), so no shuffling
+//! of the coefficients is needed.
+inline Cplx dotProduct(const Cplx* x, const float* coeffs, int numTaps)
+{
+  const float* xf = reinterpret_cast<const float*>(x);
+#ifdef __SSE2__
+  __m128 accRe = _mm_setzero_ps();
+  __m128 accIm = _mm_setzero_ps();
+  for(int i=0; i<numTaps; i+=2, xf+=4, coeffs+=8)
+  {
+    __m128 v = _mm_loadu_ps(xf);
+    __m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1));
+    accRe = _mm_add_ps(accRe, _mm_mul_ps(v, _mm_loadu_ps(coeffs)));
+    accIm = _mm_add_ps(accIm, _mm_mul_ps(swapped, _mm_loadu_ps(coeffs+4)));
+  }
+  accRe = _mm_add_ps(accRe, accIm);
+  accRe = _mm_add_ps(accRe, _mm_movehl_ps(accRe, accRe));
+  float out[4];
+  _mm_storeu_ps(out, accRe);
+  return Cplx(out[0], out[1]);
+#else
+  float acc[4] = {0, 0, 0, 0};
+  for(int i=0; i<numTaps; i+=2, xf+=4, coeffs+=8)
+    for(int j=0; j<4; j++)
+      acc[j] += xf[j]*coeffs[j] + xf[j^1]*coeffs[4+j];
+  return Cplx(acc[0]+acc[2], acc[1]+acc[3]);
+#endif
+}
+
+} // end of firdetail namespace
+
+//! \brief Filters input data by applying an FIR filter with the
+//! given coefficients.
+//!
+//! Complex<float> filters use a SIMD direct form. All other filters use a
+//! transposed direct form. Output is identical (to within rounding) in
+//! each case. FirFilter does not use fft convolution, so that it doesn't
+//! need FFTW: for long filters, use FftFirFilter (FftFirFilter.h) instead.
 template<class InT, class CoeffT = InT, class OutT = InT>
 class FirFilter
 {
 public:
+  //! Input samples per block for the SIMD direct form
+  static const int simdBlockLength = 256;
+
+  //! The filtering method in use
+  enum Mode
+  {
+    DIRECT,
+    SIMD
+  };
+
   //! default constructor - no coefficients are set
   FirFilter()
+    : mode_(DIRECT), history_(0)
   {
   }
 
   //! constructor setting the filter coefficients
   template<class It>
-  FirFilter(It coeff_start, It coeff_end) :
-    coeffs_(coeff_start, coeff_end), sums_(coeffs_.size() + 1)
+  FirFilter(It coeff_start, It coeff_end)
+    : mode_(DIRECT), history_(0)
   {
+    setCoeffs(coeff_start, coeff_end);
   }
 
   //! set the filter coefficients
@@ -69,13 +156,31 @@ public:
     coeffs_.assign(coeff_start, coeff_end);
     sums_.clear();
     sums_.resize(coeffs_.size() + 1);
+    setupSimd(typename Paths::simd());
   }
 
+  //! get the filtering method chosen for the current coefficients
+  Mode getMode() const { return mode_; }
+
   //! \brief Apply filter to given input sequence, writing output to output iterator.
   //! Make sure that output has enough capacity to hold input.size() values.
   //! \return Iterator pointing to one past the end of the output sequence.
   template<class InIt, class OutIt>
   OutIt filter(InIt istart, InIt iend, OutIt ostart)
+  {
+    if(mode_ == SIMD)
+      return filterSimd(istart, iend, ostart, typename Paths::simd());
+    return filterDirect(istart, iend, ostart);
+  }
+
+private:
+  typedef firdetail::FastPaths<InT, CoeffT, OutT> Paths;
+  typedef firdetail::Cplx Cplx;
+  typedef firdetail::CplxVec CplxVec;
+
+  //! transposed direct form, used for all types
+  template<class InIt, class OutIt>
+  OutIt filterDirect(InIt istart, InIt iend, OutIt ostart)
   {
     while (istart != iend)
     {
@@ -86,9 +191,78 @@ public:
     }
     return ostart;
   }
-private:
+
+  //! \brief SIMD direct form, a block at a time.
+  //! work_ holds the last history_ input samples followed by a block
+  //! of up to simdBlockLength new samples.
+  template<class InIt, class OutIt>
+  OutIt filterSimd(InIt istart, InIt iend, OutIt ostart, boost::true_type)
+  {
+    const int numTaps = history_ + 1;
+    OutT y;
+    while (istart != iend)
+    {
+      Cplx* block = &work_[history_];
+      int n = 0;
+      for(; n < simdBlockLength && istart != iend; n++)
+        block[n] = firdetail::toCplx(*istart++);
+
+      for(int i = 0; i < n; i++)
+      {
+        firdetail::fromCplx(firdetail::dotProduct(&work_[i], &simdCoeffs_[0], numTaps), y);
+        *ostart++ = y;
+      }
+
+      // keep the last history_ samples for the next block
+      std::copy(work_.begin() + n, work_.begin() + n + history_, work_.begin());
+    }
+    return ostart;
+  }
+
+  template<class InIt, class OutIt>
+  OutIt filterSimd(InIt istart, InIt iend, OutIt ostart, boost::false_type)
+  {
+    return filterDirect(istart, iend, ostart);
+  }
+
+  //! expand reversed coefficients, padded to an even number of taps
+  void setupSimd(boost::true_type)
+  {
+    if(coeffs_.size() < 2)
+    {
+      mode_ = DIRECT;
+      return;
+    }
+
+    int numTaps = coeffs_.size() + coeffs_.size() % 2;
+    simdCoeffs_.assign(numTaps * 4, 0);
+    for(int i = 0; i < numTaps; i++)
+    {
+      int k = numTaps - 1 - i;
+      Cplx c = k < (int)coeffs_.size() ? firdetail::toCplx(coeffs_[k]) : Cplx(0, 0);
+      float* e = &simdCoeffs_[(i / 2) * 8 + (i % 2) * 2];
+      e[0] = e[1] = c.real();
+      e[4] = -c.imag();
+      e[5] = c.imag();
+    }
+
+    history_ = numTaps - 1;
+    work_.assign(history_ + simdBlockLength, Cplx(0, 0));
+    mode_ = SIMD;
+  }
+
+  void setupSimd(boost::false_type)
+  {
+    mode_ = DIRECT;
+  }
+
   std::vector<CoeffT> coeffs_; //!< coefficient vector
   std::vector<OutT> sums_; //!< keeps sums in a delay line
+
+  Mode mode_; //!< filtering method in use
+  int history_; //!< input samples kept between blocks (SIMD)
+  CplxVec work_; //!< input history followed by current block
+  std::vector<float> simdCoeffs_; //!< expanded coefficients for dotProduct
 };
 
 //! \brief Upsampling & interpolating filter.
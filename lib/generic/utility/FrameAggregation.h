@@ -0,0 +1,352 @@
+/**
+ * \file lib/generic/utility/FrameAggregation.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Aggregation of small packets (SDUs) into one PHY frame and
+ * fragmentation of large ones, with a CRC on each piece (subframe).
+ */
+
+#ifndef UTILITY_FRAMEAGGREGATION_H_
+#define UTILITY_FRAMEAGGREGATION_H_
+
+#include <deque>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+#include "irisapi/Exceptions.h"
+#include "modulation/Crc.h"
+
+namespace iris
+{
+
+/** The layout of a subframe.
+ *
+ * A PHY frame holds a sequence of subframes, each holding a whole SDU or
+ * a fragment of one:                                                      <br>
+ *   | delimiter (8) | data (length) | crc (4) | padding to 4 bytes |       <br>
+ * and the delimiter is:                                                   <br>
+ *   | signature (1) | last flag + fragment no. (1) | length (2) |          <br>
+ *   | SDU id (2) | delimiter check (2) |                                   <br>
+ *
+ * The crc covers the delimiter and the data, so a damaged subframe is
+ * dropped without losing the others. The delimiter has a check of its
+ * own, so if one is damaged the receiver can find the next subframe by
+ * looking for a valid delimiter at each 4-byte boundary.
+ */
+struct Subframe
+{
+  static const std::size_t delimiterSize = 8;
+  static const std::size_t crcSize = 4;
+  static const std::size_t alignment = 4;
+  static const uint8_t signature = 0x4E;
+  static const int maxFragments = 128;
+
+  uint16_t id;          ///< Id of the SDU.
+  uint8_t fragment;     ///< Number of the fragment within the SDU.
+  bool last;            ///< Is this the last fragment of the SDU?
+  const uint8_t* data;  ///< The data.
+  uint16_t length;      ///< Bytes of data.
+
+  /// Bytes used by a subframe holding length bytes of data.
+  static std::size_t size(std::size_t length)
+  {
+    std::size_t n = delimiterSize + length + crcSize;
+    return (n + alignment-1) & ~(alignment-1);
+  }
+
+  /// Bytes of data which fit in a subframe of (at most) size bytes.
+  static std::size_t capacity(std::size_t size)
+  {
+    size &= ~(alignment-1);
+    return size > delimiterSize+crcSize ? size-delimiterSize-crcSize : 0;
+  }
+
+  /// Append a subframe to a frame.
+  template<typename Iter>
+  static void write(std::vector<uint8_t>& frame, uint16_t id, uint8_t fragment,
+                    bool last, Iter first, Iter end)
+  {
+    std::size_t length = std::distance(first, end);
+    std::size_t start = frame.size();
+    frame.resize(start+size(length));
+    uint8_t* p = &frame[start];
+    p[0] = signature;
+    p[1] = uint8_t((last ? 0x80 : 0) | (fragment & 0x7F));
+    p[2] = uint8_t(length >> 8);
+    p[3] = uint8_t(length);
+    p[4] = uint8_t(id >> 8);
+    p[5] = uint8_t(id);
+    uint16_t check = uint16_t(Crc::generate(p, p+6));
+    p[6] = uint8_t(check >> 8);
+    p[7] = uint8_t(check);
+    std::copy(first, end, p+delimiterSize);
+    uint32_t crc = Crc::generate(p, p+delimiterSize+length);
+    uint8_t* c = p+delimiterSize+length;
+    for(int i=0; i<4; i++)
+      c[i] = uint8_t(crc >> (24-8*i));
+  }
+
+  /** Read a subframe delimiter.
+   *
+   * @param p      The delimiter.
+   * @param avail  Bytes available from p.
+   * @return false if there is no valid delimiter at p.
+   */
+  bool readDelimiter(const uint8_t* p, std::size_t avail)
+  {
+    if(avail < delimiterSize || p[0] != signature)
+      return false;
+    uint16_t check = uint16_t(Crc::generate(p, p+6));
+    if(p[6] != uint8_t(check >> 8) || p[7] != uint8_t(check))
+      return false;
+    last = (p[1] & 0x80) != 0;
+    fragment = p[1] & 0x7F;
+    length = uint16_t((p[2] << 8) | p[3]);
+    id = uint16_t((p[4] << 8) | p[5]);
+    data = p+delimiterSize;
+    return delimiterSize+length+crcSize <= avail;
+  }
+
+  /// Check the crc of a subframe found by readDelimiter().
+  bool crcOk() const
+  {
+    const uint8_t* p = data-delimiterSize;
+    uint32_t crc = Crc::generate(p, data+length);
+    const uint8_t* c = data+length;
+    return crc == ((uint32_t)c[0] << 24 | (uint32_t)c[1] << 16 |
+                   (uint32_t)c[2] << 8 | (uint32_t)c[3]);
+  }
+};
+
+/** Packs SDUs into PHY frames of a given size.
+ *
+ * An SDU which fits in the current frame is added to it. One which does
+ * not, but fits in a frame of its own, starts a new frame. Larger SDUs are
+ * cut into fragments which fill the current frame and as many more as
+ * they need.
+ */
+class FrameAggregator
+{
+ public:
+  /** Create an aggregator.
+   *
+   * @param frameSize  Max bytes in a PHY frame.
+   */
+  explicit FrameAggregator(std::size_t frameSize)
+    :frameSize_(frameSize), nextId_(0)
+  {
+    if(Subframe::capacity(frameSize_) == 0)
+      throw IrisException("FrameAggregator: frame size is too small.");
+  }
+
+  /// Add an SDU, held in [first, end).
+  template<typename Iter>
+  void add(Iter first, Iter end)
+  {
+    std::size_t length = std::distance(first, end);
+    std::size_t maxData = Subframe::capacity(frameSize_);
+    // The first fragment may be short, so allow for one fewer
+    if(length > maxData*(Subframe::maxFragments-1))
+      throw IrisException("FrameAggregator: SDU is too big.");
+
+    // Start a new frame if the SDU fits in one and not in this one
+    if(frames_.empty() ||
+       (length > Subframe::capacity(space()) && length <= maxData))
+      newFrame();
+
+    uint16_t id = nextId_++;
+    uint8_t fragment = 0;
+    do
+    {
+      if(Subframe::capacity(space()) == 0)
+        newFrame();
+      std::size_t n = std::min(length, Subframe::capacity(space()));
+      Iter next = first;
+      std::advance(next, n);
+      length -= n;
+      Subframe::write(frames_.back(), id, fragment++, length == 0, first, next);
+      first = next;
+    }while(length > 0);
+  }
+
+  /// Number of frames held, including one still being filled.
+  std::size_t numFrames() const { return frames_.size(); }
+
+  /// Is the frame being filled too full for another subframe?
+  bool lastFrameFull() const
+  {
+    return !frames_.empty() && Subframe::capacity(space()) == 0;
+  }
+
+  /** Take the oldest frame.
+   *
+   * @param frame  Swapped with the frame.
+   * @param all    Also take the frame still being filled.
+   * @return false if there is no frame to take.
+   */
+  bool pop(std::vector<uint8_t>& frame, bool all)
+  {
+    if(frames_.empty() || (frames_.size() == 1 && !all && !lastFrameFull()))
+      return false;
+    frame.swap(frames_.front());
+    frames_.pop_front();
+    return true;
+  }
+
+ private:
+  std::size_t space() const
+  {
+    return frameSize_ - frames_.back().size();
+  }
+
+  void newFrame()
+  {
+    frames_.push_back(std::vector<uint8_t>());
+    frames_.back().reserve(frameSize_);
+  }
+
+  std::size_t frameSize_;
+  uint16_t nextId_;
+  std::deque< std::vector<uint8_t> > frames_;
+};
+
+/** Unpacks SDUs from PHY frames made by a FrameAggregator.
+ *
+ * The fragments of an SDU must arrive in order. If any is lost or
+ * damaged, the SDU is dropped.
+ */
+class FrameReassembler
+{
+ public:
+  FrameReassembler()
+    :id_(0), nextFragment_(0), subframes_(0), badSubframes_(0),
+     lostBytes_(0), paddingBytes_(0), droppedSdus_(0)
+  {}
+
+  /** Unpack a frame.
+   *
+   * @param frame  The frame.
+   * @param size   Bytes in the frame.
+   * @param sdus   Complete SDUs are appended to this.
+   */
+  void receive(const uint8_t* frame, std::size_t size,
+               std::vector< std::vector<uint8_t> >& sdus)
+  {
+    std::size_t pos = 0;
+    Subframe s;
+    while(pos < size)
+    {
+      if(!s.readDelimiter(frame+pos, size-pos))
+      {
+        // Zeros to the end of the frame are padding added by the PHY
+        std::size_t end = pos;
+        while(end < size && frame[end] == 0)
+          end++;
+        if(end == size)
+        {
+          paddingBytes_ += size-pos;
+          break;
+        }
+
+        // Look for the next delimiter
+        std::size_t skip = size-pos;
+        if(skip > Subframe::alignment)
+          skip = Subframe::alignment;
+        lostBytes_ += skip;
+        pos += skip;
+        continue;
+      }
+      pos += Subframe::size(s.length);
+      subframes_++;
+      if(!s.crcOk())
+      {
+        badSubframes_++;
+        continue;
+      }
+
+      if(s.fragment == 0)
+      {
+        if(nextFragment_ != 0)
+          droppedSdus_++;     // Never finished
+        partial_.clear();
+      }
+      else if(s.id != id_ || s.fragment != nextFragment_)
+      {
+        if(nextFragment_ != 0)
+          droppedSdus_++;
+        partial_.clear();
+        nextFragment_ = 0;
+        continue;
+      }
+      id_ = s.id;
+      nextFragment_ = s.fragment+1;
+
+      if(s.last && s.fragment == 0)
+      {
+        sdus.push_back(std::vector<uint8_t>(s.data, s.data+s.length));
+        nextFragment_ = 0;
+        continue;
+      }
+      partial_.insert(partial_.end(), s.data, s.data+s.length);
+      if(s.last)
+      {
+        sdus.push_back(std::vector<uint8_t>());
+        sdus.back().swap(partial_);
+        nextFragment_ = 0;
+      }
+    }
+  }
+
+  /// Subframes found.
+  uint64_t subframes() const { return subframes_; }
+  /// Subframes found with a bad crc.
+  uint64_t badSubframes() const { return badSubframes_; }
+  /// Bytes skipped while looking for a subframe.
+  uint64_t lostBytes() const { return lostBytes_; }
+  /// Bytes of zero padding found after the last subframe of a frame.
+  uint64_t paddingBytes() const { return paddingBytes_; }
+  /// SDUs dropped because a fragment was missing.
+  uint64_t droppedSdus() const { return droppedSdus_; }
+
+ private:
+  uint16_t id_;                   ///< Id of the SDU being reassembled.
+  int nextFragment_;              ///< Next fragment expected (0 = none).
+  std::vector<uint8_t> partial_;  ///< Fragments so far.
+  uint64_t subframes_;
+  uint64_t badSubframes_;
+  uint64_t lostBytes_;
+  uint64_t paddingBytes_;
+  uint64_t droppedSdus_;
+};
+
+} // namespace iris
+
+#endif // UTILITY_FRAMEAGGREGATION_H_
@@ -0,0 +1,407 @@
+/**
+ * \file lib/generic/utility/LockFreeQueue.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A bounded, lock-free queue for passing items (e.g. StackDataSets)
+ * between threads, with batched popping and a choice of what to do
+ * when the queue is full. Needs Boost.Atomic (Boost 1.53 or later).
+ */
+
+#ifndef UTILITY_LOCKFREEQUEUE_H_
+#define UTILITY_LOCKFREEQUEUE_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include "irisapi/Exceptions.h"
+
+namespace iris
+{
+
+/** A bounded, lock-free queue.
+ *
+ * Any number of threads can push and pop (so it serves as an MPSC or
+ * SPSC queue). Items live in a ring of cells, each with a sequence
+ * number which says whether it is ready to be written or read, so
+ * pushing and popping only need an atomic increment of a position.
+ *
+ * Blocking calls sleep on a condition variable, but a thread only takes
+ * the mutex to wake a sleeper when one is actually waiting - a busy
+ * consumer costs its producers nothing. Waits are boost::thread
+ * interruption points.
+ *
+ * When the queue is full, push() follows the queue's Policy:           <br>
+ *   BLOCK        wait for space                                        <br>
+ *   DROP_OLDEST  discard the item at the head of the queue             <br>
+ *   DROP_NEWEST  discard the new item
+ */
+template<typename T>
+class LockFreeQueue
+{
+ public:
+  enum Policy
+  {
+    BLOCK,
+    DROP_OLDEST,
+    DROP_NEWEST
+  };
+
+  /** Create a queue.
+   *
+   * @param capacity  Max items in the queue (rounded up to a power of 2).
+   * @param policy    What push() does when the queue is full.
+   */
+  explicit LockFreeQueue(std::size_t capacity, Policy policy = BLOCK)
+    :policy_(policy), pushPos_(0), popPos_(0), pushed_(0), dropped_(0),
+     highWater_(0), consumersWaiting_(0), producersWaiting_(0)
+  {
+    capacity_ = 2;
+    while(capacity_ < capacity)
+      capacity_ *= 2;
+    mask_ = capacity_-1;
+    cells_ = new Cell[capacity_];
+    for(std::size_t i=0; i<capacity_; i++)
+      cells_[i].seq.store(i, boost::memory_order_relaxed);
+  }
+
+  ~LockFreeQueue()
+  {
+    delete[] cells_;
+  }
+
+  /// Get the Policy named "block", "dropoldest" or "dropnewest".
+  static Policy policyFromString(const std::string& name)
+  {
+    if(name == "block")
+      return BLOCK;
+    if(name == "dropoldest")
+      return DROP_OLDEST;
+    if(name == "dropnewest")
+      return DROP_NEWEST;
+    throw IrisException("Unknown queue policy " + name);
+  }
+
+  /// Push an item if there is room, without blocking.
+  bool tryPush(const T& item)
+  {
+    if(!enqueue(item))
+      return false;
+    itemPushed();
+    return true;
+  }
+
+  /** Push an item, following the queue's policy if it is full.
+   *
+   * @return false if the queue was full and an item was dropped.
+   */
+  bool push(const T& item)
+  {
+    if(tryPush(item))
+      return true;
+
+    switch(policy_)
+    {
+      case DROP_NEWEST:
+        dropped_.fetch_add(1, boost::memory_order_relaxed);
+        return false;
+      case DROP_OLDEST:
+        while(!tryPush(item))
+        {
+          T oldest;
+          if(dequeue(oldest))
+            dropped_.fetch_add(1, boost::memory_order_relaxed);
+        }
+        return false;
+      default:
+        {
+          WaitCount count(producersWaiting_);
+          boost::unique_lock<boost::mutex> lock(mutex_);
+          while(!enqueue(item))
+            notFull_.wait(lock);
+        }
+        itemPushed();
+        return true;
+    }
+  }
+
+  /// Pop an item if there is one, without blocking.
+  bool tryPop(T& item)
+  {
+    if(!dequeue(item))
+      return false;
+    itemPopped();
+    return true;
+  }
+
+  /// Pop an item, waiting for one if the queue is empty.
+  T pop()
+  {
+    T item;
+    while(!tryPop(item))
+      waitForItem();
+    return item;
+  }
+
+  /** Pop up to max items without blocking.
+   *
+   * @param out  The items are appended to out.
+   * @return The number of items popped.
+   */
+  std::size_t tryPopBatch(std::vector<T>& out, std::size_t max)
+  {
+    std::size_t n = 0;
+    T item;
+    while(n < max && dequeue(item))
+    {
+      out.push_back(item);
+      n++;
+    }
+    if(n > 0)
+      itemPopped();
+    return n;
+  }
+
+  /** Pop up to max items, waiting for at least one.
+   *
+   * @param out  The items are appended to out.
+   * @return The number of items popped.
+   */
+  std::size_t popBatch(std::vector<T>& out, std::size_t max)
+  {
+    std::size_t n;
+    while((n = tryPopBatch(out, max)) == 0)
+      waitForItem();
+    return n;
+  }
+
+  /** Pop up to max items, waiting up to timeout for at least one.
+   *
+   * @param out  The items are appended to out.
+   * @return The number of items popped (0 if the wait timed out).
+   */
+  std::size_t popBatch(std::vector<T>& out, std::size_t max,
+                       boost::posix_time::time_duration timeout)
+  {
+    boost::system_time deadline = boost::get_system_time() + timeout;
+    std::size_t n;
+    while((n = tryPopBatch(out, max)) == 0)
+      if(!waitForItem(deadline))
+        return tryPopBatch(out, max);
+    return n;
+  }
+
+  /// Number of items in the queue (approximate if in use).
+  std::size_t size() const
+  {
+    std::size_t push = pushPos_.load(boost::memory_order_relaxed);
+    std::size_t pop = popPos_.load(boost::memory_order_relaxed);
+    return push > pop ? push-pop : 0;
+  }
+
+  std::size_t capacity() const { return capacity_; }
+  Policy policy() const { return policy_; }
+
+  /// Items pushed since the queue was created.
+  uint64_t pushed() const { return pushed_.load(boost::memory_order_relaxed); }
+  /// Items dropped because the queue was full.
+  uint64_t dropped() const { return dropped_.load(boost::memory_order_relaxed); }
+  /// Largest number of items that have been in the queue.
+  std::size_t highWater() const { return highWater_.load(boost::memory_order_relaxed); }
+
+ private:
+  struct Cell
+  {
+    boost::atomic<std::size_t> seq;   ///< Position this cell is ready for.
+    T item;
+  };
+
+  /// Counts a waiting thread for as long as it is in scope.
+  struct WaitCount
+  {
+    boost::atomic<int>& count;
+    WaitCount(boost::atomic<int>& c) :count(c)
+    {
+      count.fetch_add(1, boost::memory_order_seq_cst);
+      boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    }
+    ~WaitCount()
+    {
+      count.fetch_sub(1, boost::memory_order_relaxed);
+    }
+  };
+
+  /// Claim the cell at pushPos_ and write item into it.
+  bool enqueue(const T& item)
+  {
+    std::size_t pos = pushPos_.load(boost::memory_order_relaxed);
+    while(true)
+    {
+      Cell& cell = cells_[pos & mask_];
+      std::size_t seq = cell.seq.load(boost::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+      if(diff == 0)
+      {
+        if(pushPos_.compare_exchange_weak(pos, pos+1, boost::memory_order_relaxed))
+        {
+          cell.item = item;
+          cell.seq.store(pos+1, boost::memory_order_release);
+          return true;
+        }
+      }
+      else if(diff < 0)
+      {
+        return false;   // Full
+      }
+      else
+      {
+        pos = pushPos_.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Claim the cell at popPos_ and take the item from it.
+  bool dequeue(T& item)
+  {
+    std::size_t pos = popPos_.load(boost::memory_order_relaxed);
+    while(true)
+    {
+      Cell& cell = cells_[pos & mask_];
+      std::size_t seq = cell.seq.load(boost::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos+1);
+      if(diff == 0)
+      {
+        if(popPos_.compare_exchange_weak(pos, pos+1, boost::memory_order_relaxed))
+        {
+          item = cell.item;
+          cell.item = T();    // Don't hold on to the item
+          cell.seq.store(pos+capacity_, boost::memory_order_release);
+          return true;
+        }
+      }
+      else if(diff < 0)
+      {
+        return false;   // Empty
+      }
+      else
+      {
+        pos = popPos_.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Is there an item ready at the head of the queue?
+  bool itemReady() const
+  {
+    std::size_t pos = popPos_.load(boost::memory_order_relaxed);
+    return cells_[pos & mask_].seq.load(boost::memory_order_acquire) == pos+1;
+  }
+
+  void itemPushed()
+  {
+    pushed_.fetch_add(1, boost::memory_order_relaxed);
+    std::size_t depth = size();
+    std::size_t high = highWater_.load(boost::memory_order_relaxed);
+    while(depth > high &&
+          !highWater_.compare_exchange_weak(high, depth, boost::memory_order_relaxed))
+      ;
+
+    //Pairs with the seq_cst increment in WaitCount, so either we see the
+    //waiter or it sees our item
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if(consumersWaiting_.load(boost::memory_order_relaxed) > 0)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      notEmpty_.notify_all();
+    }
+  }
+
+  void itemPopped()
+  {
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if(producersWaiting_.load(boost::memory_order_relaxed) > 0)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      notFull_.notify_all();
+    }
+  }
+
+  void waitForItem()
+  {
+    WaitCount count(consumersWaiting_);
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while(!itemReady())
+      notEmpty_.wait(lock);
+  }
+
+  /// Returns false if the deadline passed first.
+  bool waitForItem(const boost::system_time& deadline)
+  {
+    WaitCount count(consumersWaiting_);
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while(!itemReady())
+      if(!notEmpty_.timed_wait(lock, deadline))
+        return itemReady();
+    return true;
+  }
+
+  LockFreeQueue(const LockFreeQueue&);
+  LockFreeQueue& operator=(const LockFreeQueue&);
+
+  Policy policy_;
+  std::size_t capacity_;
+  std::size_t mask_;
+  Cell* cells_;
+
+  // Keep the positions on their own cache lines
+  char pad0_[64];
+  boost::atomic<std::size_t> pushPos_;
+  char pad1_[64];
+  boost::atomic<std::size_t> popPos_;
+  char pad2_[64];
+
+  boost::atomic<uint64_t> pushed_;
+  boost::atomic<uint64_t> dropped_;
+  boost::atomic<std::size_t> highWater_;
+
+  boost::atomic<int> consumersWaiting_;
+  boost::atomic<int> producersWaiting_;
+  boost::mutex mutex_;
+  boost::condition_variable notEmpty_;
+  boost::condition_variable notFull_;
+};
+
+} // namespace iris
+
+#endif // UTILITY_LOCKFREEQUEUE_H_
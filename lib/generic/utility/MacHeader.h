@@ -0,0 +1,192 @@
+/**
+ * \file lib/generic/utility/MacHeader.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A compact, fixed-layout binary MAC header which is written to and read
+ * from the front of a frame in place.
+ */
+
+#ifndef UTILITY_MACHEADER_H_
+#define UTILITY_MACHEADER_H_
+
+#include <deque>
+#include <string>
+#include <cctype>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+#include "irisapi/Exceptions.h"
+
+namespace iris
+{
+
+/** A fixed-layout binary MAC header.
+ *
+ * The header is 20 bytes, with all fields in network byte order:         <br>
+ *   | version (1) | type (1) | destination (6) | source (6) |             <br>
+ *   | seqno (4) | length (2) |                                            <br>
+ *
+ * Addresses are 48-bit. The length is that of the payload which follows
+ * the header, so any padding added below the MAC is removed when the
+ * header is pulled off.
+ */
+struct MacHeader
+{
+  static const std::size_t size = 20;       ///< Bytes in the header.
+  static const uint8_t currentVersion = 1;  ///< Version written to headers.
+
+  uint8_t type;           ///< Frame type, defined by the MAC.
+  uint64_t destination;   ///< 48-bit destination address.
+  uint64_t source;        ///< 48-bit source address.
+  uint32_t seqno;         ///< Sequence number.
+  uint16_t length;        ///< Bytes of payload after the header.
+
+  MacHeader()
+    :type(0), destination(0), source(0), seqno(0), length(0)
+  {}
+
+  /// Write the header to out (size bytes).
+  void write(uint8_t* out) const
+  {
+    out[0] = currentVersion;
+    out[1] = type;
+    writeAddress(out+2, destination);
+    writeAddress(out+8, source);
+    for(int i=0; i<4; i++)
+      out[14+i] = uint8_t(seqno >> (24-8*i));
+    out[18] = uint8_t(length >> 8);
+    out[19] = uint8_t(length);
+  }
+
+  /** Read the header from in (size bytes).
+   *
+   * @return false if the header has the wrong version.
+   */
+  bool read(const uint8_t* in)
+  {
+    if(in[0] != currentVersion)
+      return false;
+    type = in[1];
+    destination = readAddress(in+2);
+    source = readAddress(in+8);
+    seqno = 0;
+    for(int i=0; i<4; i++)
+      seqno = (seqno << 8) | in[14+i];
+    length = uint16_t((in[18] << 8) | in[19]);
+    return true;
+  }
+
+  /// Set the length to the size of data and add the header to its front.
+  void push(std::deque<uint8_t>& data)
+  {
+    setLength(data.size());
+    uint8_t header[size];
+    write(header);
+    data.insert(data.begin(), header, header+size);
+  }
+
+  /** Read the header from the front of data and remove it.
+   *
+   * Anything after the payload is removed too.
+   * @return false (leaving data unchanged) if the header is invalid or
+   * the payload is shorter than its length.
+   */
+  bool pull(std::deque<uint8_t>& data)
+  {
+    if(data.size() < size)
+      return false;
+    uint8_t header[size];
+    std::copy(data.begin(), data.begin()+size, header);
+    if(!read(header) || data.size()-size < length)
+      return false;
+    data.erase(data.begin(), data.begin()+size);
+    data.resize(length);
+    return true;
+  }
+
+  /** Parse an address written as 12 hex digits (optionally separated by ':').
+   *
+   * @throw IrisException if the address is invalid.
+   */
+  static uint64_t parseAddress(const std::string& address)
+  {
+    uint64_t a = 0;
+    int digits = 0;
+    for(std::size_t i=0; i<address.size(); i++)
+    {
+      char c = address[i];
+      if(c == ':' && i%3 == 2)
+        continue;
+      if(!isxdigit((unsigned char)c) || digits == 12)
+        throw IrisException("Invalid MAC address " + address);
+      int v = isdigit((unsigned char)c) ? c-'0' : tolower((unsigned char)c)-'a'+10;
+      a = (a << 4) | v;
+      digits++;
+    }
+    if(digits != 12)
+      throw IrisException("Invalid MAC address " + address);
+    return a;
+  }
+
+  /// Write an address as 12 lower case hex digits.
+  static std::string formatAddress(uint64_t address)
+  {
+    static const char hex[] = "0123456789abcdef";
+    std::string s(12, '0');
+    for(int i=11; i>=0; i--, address >>= 4)
+      s[i] = hex[address & 0xF];
+    return s;
+  }
+
+ private:
+  void setLength(std::size_t n)
+  {
+    if(n > 0xFFFF)
+      throw IrisException("MacHeader: payload too long.");
+    length = uint16_t(n);
+  }
+
+  static void writeAddress(uint8_t* out, uint64_t address)
+  {
+    for(int i=0; i<6; i++)
+      out[i] = uint8_t(address >> (40-8*i));
+  }
+
+  static uint64_t readAddress(const uint8_t* in)
+  {
+    uint64_t a = 0;
+    for(int i=0; i<6; i++)
+      a = (a << 8) | in[i];
+    return a;
+  }
+};
+
+} // namespace iris
+
+#endif // UTILITY_MACHEADER_H_
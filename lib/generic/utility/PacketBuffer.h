@@ -0,0 +1,284 @@
+/**
+ * \file lib/generic/utility/PacketBuffer.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A contiguous, reference counted packet buffer allocated from a pool.
+ * Space is kept free in front of and behind the data so that headers
+ * and trailers can be added and stripped in place.
+ */
+
+#ifndef UTILITY_PACKETBUFFER_H_
+#define UTILITY_PACKETBUFFER_H_
+
+#include <new>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "irisapi/Exceptions.h"
+
+namespace iris
+{
+
+class PacketPool;
+
+/** A packet of bytes with headroom and tailroom.
+ *
+ * The layout of the storage is:                                           <br>
+ *   | headroom | data ...... | tailroom |                                  <br>
+ *
+ * push() and pull() grow and shrink the data at the front, put() and
+ * trim() at the back. None of them move the data.
+ *
+ * PacketBuffers are created by a PacketPool and held through a PacketPtr.
+ * When the last PacketPtr goes, the storage returns to the pool.
+ */
+class PacketBuffer
+{
+ public:
+  uint8_t* data() { return buf_+head_; }
+  const uint8_t* data() const { return buf_+head_; }
+  uint8_t* begin() { return data(); }
+  uint8_t* end() { return data()+len_; }
+  std::size_t size() const { return len_; }
+  bool empty() const { return len_ == 0; }
+  std::size_t headroom() const { return head_; }
+  std::size_t tailroom() const { return capacity_-head_-len_; }
+  std::size_t capacity() const { return capacity_; }
+
+  /// Add n bytes to the front of the data, returning the new front.
+  uint8_t* push(std::size_t n)
+  {
+    if(n > head_)
+      throw IrisException("PacketBuffer: not enough headroom.");
+    head_ -= n;
+    len_ += n;
+    return data();
+  }
+
+  /// Remove n bytes from the front of the data, returning the new front.
+  uint8_t* pull(std::size_t n)
+  {
+    if(n > len_)
+      throw IrisException("PacketBuffer: pulled more than the packet size.");
+    head_ += n;
+    len_ -= n;
+    return data();
+  }
+
+  /// Add n bytes to the back of the data, returning a pointer to them.
+  uint8_t* put(std::size_t n)
+  {
+    if(n > tailroom())
+      throw IrisException("PacketBuffer: not enough tailroom.");
+    uint8_t* p = end();
+    len_ += n;
+    return p;
+  }
+
+  /// Shorten the data to n bytes.
+  void trim(std::size_t n)
+  {
+    len_ = std::min(len_, n);
+  }
+
+  /// Empty the packet, leaving headroom bytes free at the front.
+  void reset(std::size_t headroom)
+  {
+    head_ = std::min(headroom, capacity_);
+    len_ = 0;
+  }
+
+  /// Append bytes from [first, last) (e.g. a std::deque<uint8_t>).
+  template<typename Iter>
+  void append(Iter first, Iter last)
+  {
+    std::size_t n = std::distance(first, last);
+    std::copy(first, last, put(n));
+  }
+
+ private:
+  friend class PacketPool;
+  friend void intrusive_ptr_add_ref(PacketBuffer* p);
+  friend void intrusive_ptr_release(PacketBuffer* p);
+
+  PacketBuffer(PacketPool* pool, uint8_t* buf, std::size_t capacity)
+    :buf_(buf), capacity_(capacity), head_(0), len_(0), pool_(pool), refs_(0)
+  {}
+
+  uint8_t* buf_;              ///< Start of the storage.
+  std::size_t capacity_;      ///< Size of the storage.
+  std::size_t head_;          ///< Offset of the data in the storage.
+  std::size_t len_;           ///< Size of the data.
+  PacketPool* pool_;          ///< Pool to return the storage to.
+  boost::detail::atomic_count refs_;
+};
+
+typedef boost::intrusive_ptr<PacketBuffer> PacketPtr;
+
+/** A pool of PacketBuffers.
+ *
+ * Each packet is a single block holding the PacketBuffer and its storage.
+ * Blocks of the pool's block size are kept on a free list and reused, so
+ * a steady flow of packets does not touch the heap. Larger packets get
+ * a block of their own, which is freed when the packet is released.
+ *
+ * The pool must outlive every packet allocated from it.
+ */
+class PacketPool
+{
+ public:
+  static const std::size_t defaultHeadroom = 128;    ///< Room for headers.
+  static const std::size_t defaultBlockSize = 16384; ///< Fits an IP packet.
+
+  /** Create a pool.
+   *
+   * @param blockSize  Storage in each pooled block.
+   * @param maxFree    Max blocks kept for reuse (more are freed).
+   */
+  explicit PacketPool(std::size_t blockSize = defaultBlockSize,
+                      std::size_t maxFree = 1024)
+    :blockSize_(blockSize), maxFree_(maxFree)
+  {
+    free_.reserve(maxFree_);
+  }
+
+  ~PacketPool()
+  {
+    for(std::size_t i=0; i<free_.size(); i++)
+      std::free(free_[i]);
+  }
+
+  /** Get an empty packet.
+   *
+   * @param size      Bytes of data (tailroom) needed after the headroom.
+   * @param headroom  Bytes to leave free at the front.
+   */
+  PacketPtr allocate(std::size_t size, std::size_t headroom = defaultHeadroom)
+  {
+    std::size_t capacity = std::max(blockSize_, headroom+size);
+    void* block = NULL;
+    if(capacity == blockSize_)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if(!free_.empty())
+      {
+        block = free_.back();
+        free_.pop_back();
+      }
+    }
+    if(block == NULL)
+    {
+      block = std::malloc(headerSize()+capacity);
+      if(block == NULL)
+        throw std::bad_alloc();
+    }
+
+    PacketBuffer* p = new(block) PacketBuffer(
+        this, static_cast<uint8_t*>(block)+headerSize(), capacity);
+    p->reset(headroom);
+    return PacketPtr(p);
+  }
+
+  /// Get a packet holding a copy of [first, last).
+  template<typename Iter>
+  PacketPtr copy(Iter first, Iter last, std::size_t headroom = defaultHeadroom)
+  {
+    PacketPtr p = allocate(std::distance(first, last), headroom);
+    p->append(first, last);
+    return p;
+  }
+
+  /// Number of blocks waiting to be reused.
+  std::size_t freeBlocks()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return free_.size();
+  }
+
+  /// A pool shared by the packets of one component library.
+  static PacketPool& defaultPool()
+  {
+    static PacketPool pool;
+    return pool;
+  }
+
+ private:
+  friend void intrusive_ptr_release(PacketBuffer* p);
+
+  /// Bytes at the start of a block holding the PacketBuffer itself.
+  static std::size_t headerSize()
+  {
+    return (sizeof(PacketBuffer)+63) & ~(std::size_t)63;
+  }
+
+  void release(PacketBuffer* p)
+  {
+    std::size_t capacity = p->capacity_;
+    p->~PacketBuffer();
+    if(capacity == blockSize_)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if(free_.size() < maxFree_)
+      {
+        free_.push_back(p);
+        return;
+      }
+    }
+    std::free(p);
+  }
+
+  PacketPool(const PacketPool&);
+  PacketPool& operator=(const PacketPool&);
+
+  std::size_t blockSize_;     ///< Storage in each pooled block.
+  std::size_t maxFree_;       ///< Max blocks on the free list.
+  std::vector<void*> free_;   ///< Blocks ready for reuse.
+  boost::mutex mutex_;
+};
+
+inline void intrusive_ptr_add_ref(PacketBuffer* p)
+{
+  ++p->refs_;
+}
+
+inline void intrusive_ptr_release(PacketBuffer* p)
+{
+  if(--p->refs_ == 0)
+    p->pool_->release(p);
+}
+
+} // namespace iris
+
+#endif // UTILITY_PACKETBUFFER_H_
@@ -0,0 +1,170 @@
+/**
+ * \file lib/generic/utility/ReceiveWindow.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * The receive side of a selective-repeat ARQ: frames which arrive out of
+ * order are held until the ones before them arrive, then passed on in
+ * order.
+ */
+
+#ifndef UTILITY_RECEIVEWINDOW_H_
+#define UTILITY_RECEIVEWINDOW_H_
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+namespace iris
+{
+
+/** A selective-repeat receive window.
+ *
+ * Frames are numbered by sequence number. The window holds the frames
+ * received after the last one passed on in order (lastInOrder()), up to
+ * size() frames ahead of it. When the frame after lastInOrder() arrives,
+ * it and the frames held behind it are passed on.
+ *
+ * A sender which gives up on a frame must tell the receiver, or the
+ * window would wait for that frame for ever. skipTo() takes the oldest
+ * sequence number the sender still has in flight and passes on whatever
+ * is held before it, leaving gaps where frames were lost.
+ */
+template<typename T>
+class ReceiveWindow
+{
+ public:
+  /** Create a window.
+   *
+   * @param size  Frames held beyond lastInOrder() (at least 1).
+   */
+  explicit ReceiveWindow(std::size_t size = 1)
+    :items_(size > 0 ? size : 1), held_(items_.size(), false), last_(0)
+  {}
+
+  /// Frames held beyond lastInOrder().
+  std::size_t size() const { return items_.size(); }
+
+  /// The sequence number of the last frame passed on in order.
+  uint32_t lastInOrder() const { return last_; }
+
+  /// Drop any frames held and start again after lastInOrder.
+  void reset(uint32_t lastInOrder = 0)
+  {
+    for(std::size_t i=0; i<items_.size(); i++)
+    {
+      items_[i] = T();
+      held_[i] = false;
+    }
+    last_ = lastInOrder;
+  }
+
+  /** Add a frame.
+   *
+   * @param seqno    Sequence number of the frame.
+   * @param item     The frame.
+   * @param inOrder  Frames which can now be passed on are appended to this.
+   * @return false if the frame is a duplicate or outside the window.
+   */
+  bool add(uint32_t seqno, const T& item, std::vector<T>& inOrder)
+  {
+    if(seqno <= last_ || seqno > uint64_t(last_) + items_.size())
+      return false;
+    std::size_t i = seqno % items_.size();
+    if(held_[i])
+      return false;
+    items_[i] = item;
+    held_[i] = true;
+    collect(inOrder);
+    return true;
+  }
+
+  /** The sender will not send any frame before base again.
+   *
+   * Frames held before base are passed on and the window moves up to
+   * base. Does nothing if base is not beyond lastInOrder()+1.
+   *
+   * @param inOrder  Frames which can now be passed on are appended to this.
+   */
+  void skipTo(uint32_t base, std::vector<T>& inOrder)
+  {
+    if(base <= last_ + 1 || last_ == 0xFFFFFFFF)
+      return;
+    uint32_t skipped = base - 1 - last_;
+    for(uint32_t n=0; n<skipped && n<items_.size(); n++)
+    {
+      std::size_t i = (last_ + 1 + n) % items_.size();
+      if(held_[i])
+        take(i, inOrder);
+    }
+    last_ = base - 1;
+    collect(inOrder);
+  }
+
+  /** Which frames beyond lastInOrder()+1 are held.
+   *
+   * Bit i is set if frame lastInOrder()+2+i is held, for i up to
+   * min(size()-1, 64).
+   */
+  uint64_t heldBitmap() const
+  {
+    uint64_t bitmap = 0;
+    for(std::size_t i=0; i+1<items_.size() && i<64; i++)
+      if(held_[(last_ + 2 + i) % items_.size()])
+        bitmap |= uint64_t(1) << i;
+    return bitmap;
+  }
+
+ private:
+  /// Pass on the frames following lastInOrder().
+  void collect(std::vector<T>& inOrder)
+  {
+    while(true)
+    {
+      std::size_t i = (last_ + 1) % items_.size();
+      if(!held_[i])
+        break;
+      take(i, inOrder);
+      last_++;
+    }
+  }
+
+  void take(std::size_t i, std::vector<T>& inOrder)
+  {
+    inOrder.push_back(items_[i]);
+    items_[i] = T();
+    held_[i] = false;
+  }
+
+  std::vector<T> items_;    ///< Frames held, by seqno % size()
+  std::vector<bool> held_;  ///< Which of items_ are held
+  uint32_t last_;           ///< Last seqno passed on in order
+};
+
+} // namespace iris
+
+#endif // UTILITY_RECEIVEWINDOW_H_
@@ -0,0 +1,143 @@
+/**
+ * \file lib/generic/utility/SampleHeader.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A small fixed-size header carried in front of each packet of a sample
+ * stream sent over the network. It lets a receiver detect lost packets
+ * and recover the timeStamp and sampleRate of the data.
+ */
+
+#ifndef UTILITY_SAMPLEHEADER_H_
+#define UTILITY_SAMPLEHEADER_H_
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace iris
+{
+
+/** Header for a packet of samples.
+ *
+ * The header is 32 bytes, all fields big-endian:                          <br>
+ *   0  uint16  magic (0x4952)                                             <br>
+ *   2  uint8   version (1)                                                <br>
+ *   3  uint8   flags (reserved, 0)                                        <br>
+ *   4  uint32  sequence number                                            <br>
+ *   8  uint32  payload length in bytes                                    <br>
+ *  12  uint32  reserved (0)                                               <br>
+ *  16  float64 timeStamp of the first sample in the payload               <br>
+ *  24  float64 sampleRate                                                 <br>
+ *
+ * The size is a multiple of 16 so the payload which follows stays aligned
+ * for every sample type.
+ */
+struct SampleHeader
+{
+  static const std::size_t size = 32;       ///< Encoded size in bytes.
+  static const uint16_t magic = 0x4952;     ///< "IR"
+  static const uint8_t version = 1;
+
+  uint32_t sequence;      ///< Packet sequence number.
+  uint32_t length;        ///< Payload length in bytes.
+  double timeStamp;       ///< Timestamp of the first sample.
+  double sampleRate;      ///< Sample rate of the stream.
+
+  SampleHeader()
+    :sequence(0), length(0), timeStamp(0), sampleRate(0)
+  {}
+
+  /// Write the header into size bytes at out.
+  void encode(uint8_t* out) const
+  {
+    put16(out, magic);
+    out[2] = version;
+    out[3] = 0;
+    put32(out+4, sequence);
+    put32(out+8, length);
+    put32(out+12, 0);
+    putDouble(out+16, timeStamp);
+    putDouble(out+24, sampleRate);
+  }
+
+  /** Read the header from the first len bytes at in.
+   *
+   * @return false if len is too short or the magic and version don't match.
+   */
+  bool decode(const uint8_t* in, std::size_t len)
+  {
+    if(len < size || get16(in) != magic || in[2] != version)
+      return false;
+    sequence = get32(in+4);
+    length = get32(in+8);
+    timeStamp = getDouble(in+16);
+    sampleRate = getDouble(in+24);
+    return true;
+  }
+
+ private:
+  static void put16(uint8_t* p, uint16_t v)
+  {
+    p[0] = v >> 8;
+    p[1] = v;
+  }
+  static void put32(uint8_t* p, uint32_t v)
+  {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+  }
+  static void putDouble(uint8_t* p, double d)
+  {
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    put32(p, (uint32_t)(v >> 32));
+    put32(p+4, (uint32_t)v);
+  }
+  static uint16_t get16(const uint8_t* p)
+  {
+    return (uint16_t)((p[0] << 8) | p[1]);
+  }
+  static uint32_t get32(const uint8_t* p)
+  {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+  }
+  static double getDouble(const uint8_t* p)
+  {
+    uint64_t v = ((uint64_t)get32(p) << 32) | get32(p+4);
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+  }
+};
+
+} // namespace iris
+
+#endif // UTILITY_SAMPLEHEADER_H_
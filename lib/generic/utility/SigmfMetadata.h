@@ -0,0 +1,369 @@
+/**
+ * \file lib/generic/utility/SigmfMetadata.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Metadata for a SigMF capture: a raw data file with a JSON metadata
+ * file alongside it (see https://github.com/gnuradio/SigMF).
+ */
+
+#ifndef UTILITY_SIGMFMETADATA_H_
+#define UTILITY_SIGMFMETADATA_H_
+
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "irisapi/Exceptions.h"
+
+namespace iris
+{
+
+/** Metadata for a SigMF capture.
+ *
+ * Each capture segment gives the sample index and timeStamp at which it
+ * starts. A segment is started wherever the timestamps of the data are
+ * discontinuous, and also at regular intervals, so that the segments
+ * form a sparse index from time to sample. The exact timeStamp (in
+ * seconds) and any change of sample rate are kept in "iris:" extension
+ * fields; core:datetime is the timeStamp read as seconds since the epoch.
+ *
+ * The segments are also indexed by timeStamp, so that findSample can
+ * seek by time with a binary search even when the timestamps of the data
+ * jump backwards.
+ */
+class SigmfMetadata
+{
+ public:
+  /// A capture segment.
+  struct Capture
+  {
+    uint64_t sampleStart;   ///< Index of the first sample in the segment.
+    double timeStamp;       ///< Timestamp of the first sample.
+    double sampleRate;      ///< Sample rate of the segment.
+  };
+  typedef std::vector<Capture> CaptureVec;
+
+  std::string datatype;     ///< SigMF datatype, e.g. "cf32_le".
+  double sampleRate;        ///< Sample rate of the capture (0 = unknown).
+  double frequency;         ///< Centre frequency (0 = unknown).
+  std::string description;  ///< Free text description.
+  CaptureVec captures;      ///< Capture segments, in order.
+
+  SigmfMetadata()
+    :sampleRate(0), frequency(0)
+  {}
+
+  /// Name of the metadata file for a data file.
+  static std::string metaFileName(const std::string& dataFileName)
+  {
+    size_t dot = dataFileName.find_last_of('.');
+    size_t slash = dataFileName.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      return dataFileName + ".sigmf-meta";
+    return dataFileName.substr(0, dot) + ".sigmf-meta";
+  }
+
+  /** Get the SigMF datatype for an Iris data type name.
+   *
+   * @return An empty string if the type has no SigMF equivalent.
+   */
+  static std::string toSigmfType(const std::string& irisType, bool bigEndian)
+  {
+    std::string t;
+    if(irisType == "uint8_t") return "ru8";
+    if(irisType == "int8_t") return "ri8";
+    if(irisType == "uint16_t") t = "ru16";
+    else if(irisType == "int16_t") t = "ri16";
+    else if(irisType == "uint32_t") t = "ru32";
+    else if(irisType == "int32_t") t = "ri32";
+    else if(irisType == "float") t = "rf32";
+    else if(irisType == "double") t = "rf64";
+    else if(irisType == "complex<float>") t = "cf32";
+    else if(irisType == "complex<double>") t = "cf64";
+    else return "";
+    return t + (bigEndian ? "_be" : "_le");
+  }
+
+  /** Get the Iris data type name for a SigMF datatype.
+   *
+   * @return An empty string if the type is not supported.
+   */
+  static std::string toIrisType(const std::string& sigmfType)
+  {
+    std::string t = sigmfType.substr(0, sigmfType.find('_'));
+    if(t == "ru8") return "uint8_t";
+    if(t == "ri8") return "int8_t";
+    if(t == "ru16") return "uint16_t";
+    if(t == "ri16") return "int16_t";
+    if(t == "ru32") return "uint32_t";
+    if(t == "ri32") return "int32_t";
+    if(t == "rf32") return "float";
+    if(t == "rf64") return "double";
+    if(t == "cf32") return "complex<float>";
+    if(t == "cf64") return "complex<double>";
+    return "";
+  }
+
+  /// Is the data big endian?
+  bool isBigEndian() const
+  {
+    return datatype.size() > 3 &&
+        datatype.compare(datatype.size()-3, 3, "_be") == 0;
+  }
+
+  /** Add data to the capture, starting a new segment if needed.
+   *
+   * @param sample      Index of the first sample of the data.
+   * @param numSamples  Number of samples.
+   * @param timeStamp   Timestamp of the first sample.
+   * @param rate        Sample rate of the data (0 = unknown).
+   * @param interval    Start a segment at least this often (seconds).
+   */
+  void addData(uint64_t sample, uint64_t numSamples, double timeStamp,
+               double rate, double interval)
+  {
+    if(captures.empty() && sampleRate <= 0)
+      sampleRate = rate;
+
+    bool start = captures.empty();
+    if(!start && rate > 0)
+    {
+      const Capture& last = captures.back();
+      double expected = last.timeStamp;
+      if(last.sampleRate > 0)
+        expected += (sample-last.sampleStart)/last.sampleRate;
+      start = rate != last.sampleRate ||
+              std::fabs(timeStamp-expected) > 0.5/rate ||
+              (interval > 0 && timeStamp-last.timeStamp >= interval);
+    }
+    if(start && numSamples > 0)
+    {
+      if(timeIndex_.size() != captures.size())
+        indexCaptures();
+      Capture c = {sample, timeStamp, rate};
+      captures.push_back(c);
+      timeIndex_.insert(std::upper_bound(timeIndex_.begin(), timeIndex_.end(),
+                                         timeStamp, CompareTime(captures)),
+                        captures.size()-1);
+    }
+  }
+
+  /** Find the sample at a given time, using a binary search of the time index.
+   *
+   * Gives the nearest sample in the segment which starts latest at or
+   * before that time (the earliest such segment if several start at the
+   * same time). Times before the first segment or in a gap after that
+   * segment give the first sample of the next segment to start after
+   * that time.
+   */
+  uint64_t findSample(double timeStamp) const
+  {
+    if(captures.empty())
+      return 0;
+    if(timeIndex_.size() != captures.size())
+      indexCaptures();
+
+    const std::vector<size_t>& index = timeIndex_;
+    CompareTime compare(captures);
+    std::vector<size_t>::const_iterator next =
+        std::upper_bound(index.begin(), index.end(), timeStamp, compare);
+    if(next == index.begin())
+      return captures[*next].sampleStart;
+
+    //Of the segments starting at the same time, use the earliest
+    std::vector<size_t>::const_iterator it =
+        std::lower_bound(index.begin(), next, captures[*(next-1)].timeStamp, compare);
+    size_t i = *it;
+    const Capture& c = captures[i];
+    double offset = c.sampleRate > 0 ? (timeStamp-c.timeStamp)*c.sampleRate : 0;
+    uint64_t sample = c.sampleStart + (uint64_t)(offset+0.5);
+    if(i+1 == captures.size() || sample < captures[i+1].sampleStart ||
+       next == index.end())
+      return sample;
+    return captures[*next].sampleStart;
+  }
+
+  /** Find the timeStamp of a sample, using a binary search of the segments.
+   *
+   * @param sample  Index of the sample.
+   * @param rate    Set to the sample rate at that sample.
+   */
+  double findTime(uint64_t sample, double& rate) const
+  {
+    rate = sampleRate;
+    if(captures.empty())
+      return 0;
+    CaptureVec::const_iterator it =
+        std::upper_bound(captures.begin(), captures.end(), sample,
+                         compareSample);
+    if(it == captures.begin())
+      return 0;
+    const Capture& c = *(it-1);
+    rate = c.sampleRate;
+    return c.timeStamp + (rate > 0 ? (sample-c.sampleStart)/rate : 0);
+  }
+
+  /// Write the metadata as JSON.
+  void write(std::ostream& out) const
+  {
+    out << std::setprecision(17);
+    out << "{\n  \"global\": {\n";
+    out << "    \"core:datatype\": \"" << datatype << "\",\n";
+    if(sampleRate > 0)
+      out << "    \"core:sample_rate\": " << sampleRate << ",\n";
+    if(!description.empty())
+      out << "    \"core:description\": \"" << escape(description) << "\",\n";
+    out << "    \"core:recorder\": \"Iris\",\n";
+    out << "    \"core:version\": \"1.0.0\"\n";
+    out << "  },\n  \"captures\": [";
+    for(size_t i=0; i<captures.size(); i++)
+    {
+      const Capture& c = captures[i];
+      out << (i ? ",\n" : "\n") << "    {";
+      out << "\"core:sample_start\": " << c.sampleStart;
+      if(frequency > 0)
+        out << ", \"core:frequency\": " << frequency;
+      out << ", \"core:datetime\": \"" << isoTime(c.timeStamp) << "\"";
+      out << ", \"iris:timestamp\": " << c.timeStamp;
+      if(c.sampleRate != sampleRate)
+        out << ", \"iris:sample_rate\": " << c.sampleRate;
+      out << "}";
+    }
+    out << "\n  ],\n  \"annotations\": []\n}\n";
+  }
+
+  /// Read the metadata from JSON.
+  void read(std::istream& in)
+  {
+    using boost::property_tree::ptree;
+    ptree tree;
+    try
+    {
+      boost::property_tree::read_json(in, tree);
+      datatype = tree.get<std::string>("global.core:datatype");
+      sampleRate = tree.get<double>("global.core:sample_rate", 0);
+      description = tree.get<std::string>("global.core:description", "");
+      frequency = 0;
+      captures.clear();
+      ptree& caps = tree.get_child("captures");
+      for(ptree::iterator it=caps.begin(); it!=caps.end(); ++it)
+      {
+        Capture c;
+        c.sampleStart = it->second.get<uint64_t>("core:sample_start");
+        c.timeStamp = it->second.get<double>("iris:timestamp", 0);
+        c.sampleRate = it->second.get<double>("iris:sample_rate", sampleRate);
+        if(frequency == 0)
+          frequency = it->second.get<double>("core:frequency", 0);
+        captures.push_back(c);
+      }
+      indexCaptures();
+    }
+    catch(boost::property_tree::ptree_error& e)
+    {
+      throw IrisException(std::string("Invalid SigMF metadata: ") + e.what());
+    }
+  }
+
+ private:
+  /// Indices of the captures, ordered by timeStamp and then by index.
+  mutable std::vector<size_t> timeIndex_;
+
+  /// Orders capture indices by the timeStamp of the capture.
+  struct CompareTime
+  {
+    const CaptureVec& captures;
+    CompareTime(const CaptureVec& c) : captures(c) {}
+    bool operator()(double t, size_t i) const { return t < captures[i].timeStamp; }
+    bool operator()(size_t i, double t) const { return captures[i].timeStamp < t; }
+    bool operator()(size_t i, size_t j) const { return captures[i].timeStamp < captures[j].timeStamp; }
+  };
+
+  /// Rebuild the time index, e.g. after the captures were read.
+  void indexCaptures() const
+  {
+    timeIndex_.resize(captures.size());
+    for(size_t i=0; i<captures.size(); i++)
+      timeIndex_[i] = i;
+    std::stable_sort(timeIndex_.begin(), timeIndex_.end(), CompareTime(captures));
+  }
+
+  static bool compareSample(uint64_t s, const Capture& c)
+  {
+    return s < c.sampleStart;
+  }
+
+  static std::string escape(const std::string& s)
+  {
+    std::string out;
+    for(size_t i=0; i<s.size(); i++)
+    {
+      if(s[i] == '"' || s[i] == '\\')
+        out += '\\';
+      out += s[i];
+    }
+    return out;
+  }
+
+  /// Format seconds since the epoch as ISO-8601 UTC.
+  static std::string isoTime(double t)
+  {
+    // Round to whole nanoseconds first, so the fraction can't print as 1
+    double whole = std::floor(t);
+    long nanos = (long)std::floor((t-whole)*1e9 + 0.5);
+    if(nanos >= 1000000000L)
+    {
+      whole += 1;
+      nanos -= 1000000000L;
+    }
+    time_t secs = (time_t)whole;
+    tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &secs);
+#else
+    gmtime_r(&secs, &utc);
+#endif
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &utc);
+    char frac[32];
+    snprintf(frac, sizeof(frac), ".%09ld", nanos);
+    return std::string(buf) + frac + "Z";
+  }
+};
+
+} // namespace iris
+
+#endif // UTILITY_SIGMFMETADATA_H_
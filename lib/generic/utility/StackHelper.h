@@ -41,11 +41,18 @@
 #ifndef STACKHELPER_H
 #define STACKHELPER_H
 
+#include <vector>
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
 #include <irisapi/StackDataBuffer.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
 #include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format.h>
+#include <google/protobuf/wire_format_lite.h>
 
 
 namespace iris
@@ -57,12 +64,16 @@ public:
     /**
      * \brief Tries to deserialize a StackDataSet into ProtoBuf object.
      *
-     * This function first copies the StackDataSet into a continous data
-     * structure and then tries to desierialize it into a given ProtoBuf
-     * object. If the StackDataSet does not contain a proper Protobuf
-     * object the function returns false. If yes, and the object contains
-     * any payload, only the payload of the packet remains inside the
-     * StackDataSet for further processing.
+     * If the StackDataSet does not contain a proper Protobuf object the
+     * function returns false. If yes, and the object contains any payload,
+     * only the payload of the packet remains inside the StackDataSet for
+     * further processing.
+     *
+     * When the packet holds a single payload (as written by
+     * mergeAndSerializeDataset) only the fields in front of and after it
+     * are copied and parsed, and they are then erased from the
+     * StackDataSet. The payload itself is not copied, and is not added to
+     * the ProtoBuf object.
      *
      * \param frame the StackDataSet
      * \param protobuf the ProtocolBuffer data structure
@@ -71,18 +82,35 @@ public:
     template<typename T>
     static bool deserializeAndStripDataset(boost::shared_ptr<StackDataSet> frame, T &protobuf)
     {
-        // copy frame into vector first
-        std::vector<uint8_t> buffer(frame->data.begin(), frame->data.end());
+        // copy the start of the frame, which should hold the fields in front of the payload
+        uint8_t header[maxHeaderSize];
+        size_t total = frame->data.size();
+        size_t avail = std::min(total, sizeof(header));
+        std::copy(frame->data.begin(), frame->data.begin() + avail, header);
+
+        size_t tagOffset, payloadOffset, payloadEnd;
+        if (findPayload(header, avail, total, payloadField(protobuf), tagOffset, payloadOffset, payloadEnd)
+            && total - payloadEnd <= maxHeaderSize) {
+            // and the end, which holds the fields after the payload
+            uint8_t trailer[maxHeaderSize];
+            std::copy(frame->data.begin() + payloadEnd, frame->data.end(), trailer);
+            if (parseAround(protobuf, header, tagOffset, trailer, total - payloadEnd)) {
+                frame->data.erase(frame->data.begin() + payloadEnd, frame->data.end());
+                frame->data.erase(frame->data.begin(), frame->data.begin() + payloadOffset);
+                return true;
+            }
+        }
 
+        // otherwise copy frame into vector and parse everything
+        std::vector<uint8_t> buffer(frame->data.begin(), frame->data.end());
         if (!protobuf.ParseFromArray((void*)&buffer.front(), buffer.size())) {
             return false;
         }
 
         // retrieve payload from packet which is the first element in RepeatedPtrField
         if (protobuf.mutable_payload()->size() == 1) {
-            std::string payload = protobuf.mutable_payload()->Get(0);
-            frame->data.clear();
-            frame->data.insert(frame->data.end(), payload.c_str(), payload.c_str() + payload.size());
+            const std::string& payload = protobuf.payload(0);
+            frame->data.assign(payload.begin(), payload.end());
         }
         return true;
     }
@@ -95,6 +123,11 @@ public:
      * to a protobuf object which is then serialized. The StackDataSet is
      * then filled with the resulting binary data.
      *
+     * The payload is not copied: the fields numbered below it are
+     * serialized and inserted in front of it, and the fields numbered above
+     * it are appended after it, so the packet is in field order just as
+     * if the payload had been added to the protobuf object.
+     *
      * \param frame the StackDataSet
      * \param protobuf the ProtocolBuffer data structure
      * \return void
@@ -102,18 +135,24 @@ public:
     template<typename T>
     static void mergeAndSerializeDataset(boost::shared_ptr<StackDataSet> frame, T &protobuf)
     {
-        // construct vector from deque and add to protobuf packet
-        std::vector<uint8_t> payload(frame->data.begin(), frame->data.end());
-        protobuf.add_payload(&payload.front(), payload.size());
-
-        // serialize whole packet into "old" payload vector
-        payload.clear();
-        payload.resize(protobuf.ByteSize());
-        protobuf.SerializeWithCachedSizesToArray(&payload.front());
-
-        // clear "old" Iris frame and construct new one from payload
-        frame->data.clear();
-        frame->data.insert(frame->data.begin(), payload.begin(), payload.end());
+        FieldList before, after;
+        listFields(protobuf, before, after);
+        size_t payloadSize = frame->data.size();
+        size_t size = headerSize(protobuf, before, payloadSize);
+        size_t trailerSize = fieldsSize(protobuf, after);
+        if (std::max(size, trailerSize) <= maxHeaderSize) {
+            uint8_t buffer[maxHeaderSize];
+            writeHeader(buffer, protobuf, before, payloadSize);
+            frame->data.insert(frame->data.begin(), buffer, buffer + size);
+            writeFields(buffer, protobuf, after);
+            frame->data.insert(frame->data.end(), buffer, buffer + trailerSize);
+        } else {
+            std::vector<uint8_t> buffer(std::max(size, trailerSize));
+            writeHeader(&buffer.front(), protobuf, before, payloadSize);
+            frame->data.insert(frame->data.begin(), buffer.begin(), buffer.begin() + size);
+            writeFields(&buffer.front(), protobuf, after);
+            frame->data.insert(frame->data.end(), buffer.begin(), buffer.begin() + trailerSize);
+        }
     }
 
 
@@ -149,6 +188,139 @@ public:
             std::cout << std::endl;
         std::cout << boost::format("--------") << std::endl;
     }
+
+private:
+    /// Fields in front of and after the payload are each expected to fit in this
+    static const size_t maxHeaderSize = 256;
+
+    typedef std::vector<const google::protobuf::FieldDescriptor*> FieldList;
+
+    /// Field number of the payload field of a ProtoBuf object
+    static int payloadField(const google::protobuf::Message &protobuf)
+    {
+        const google::protobuf::FieldDescriptor *field =
+            protobuf.GetDescriptor()->FindFieldByName("payload");
+        return field ? field->number() : 0;
+    }
+
+    /// The fields set in protobuf, in field order, split into those numbered below and above the payload
+    static void listFields(google::protobuf::Message &protobuf, FieldList &before, FieldList &after)
+    {
+        protobuf.ByteSize(); // caches the sizes used by writeFields
+        int field = payloadField(protobuf);
+        protobuf.GetReflection()->ListFields(protobuf, &before);
+        FieldList::iterator it = before.begin();
+        while (it != before.end() && (*it)->number() < field)
+            ++it;
+        after.assign(it, before.end());
+        before.erase(it, before.end());
+    }
+
+    /// Serialized size of the given fields of protobuf
+    static size_t fieldsSize(const google::protobuf::Message &protobuf, const FieldList &fields)
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < fields.size(); i++)
+            size += google::protobuf::internal::WireFormat::FieldByteSize(fields[i], protobuf);
+        return size;
+    }
+
+    /// Write the given fields of protobuf (after listFields)
+    static void writeFields(uint8_t *out, const google::protobuf::Message &protobuf, const FieldList &fields)
+    {
+        if (fields.empty())
+            return;
+        google::protobuf::io::ArrayOutputStream array(out, fieldsSize(protobuf, fields));
+        google::protobuf::io::CodedOutputStream output(&array);
+        for (size_t i = 0; i < fields.size(); i++)
+            google::protobuf::internal::WireFormat::SerializeFieldWithCachedSizes(fields[i], protobuf, &output);
+    }
+
+    /// Size of the fields in front of the payload plus the tag and length of the payload
+    static size_t headerSize(const google::protobuf::Message &protobuf, const FieldList &before,
+                             size_t payloadSize)
+    {
+        using google::protobuf::io::CodedOutputStream;
+        using google::protobuf::internal::WireFormatLite;
+        uint32_t tag = WireFormatLite::MakeTag(payloadField(protobuf),
+                                               WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+        return fieldsSize(protobuf, before) + CodedOutputStream::VarintSize32(tag)
+            + CodedOutputStream::VarintSize32(payloadSize);
+    }
+
+    /// Write the fields in front of the payload and the tag and length of the payload
+    static void writeHeader(uint8_t *out, const google::protobuf::Message &protobuf,
+                            const FieldList &before, size_t payloadSize)
+    {
+        using google::protobuf::io::CodedOutputStream;
+        using google::protobuf::internal::WireFormatLite;
+        uint32_t tag = WireFormatLite::MakeTag(payloadField(protobuf),
+                                               WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+        size_t size = fieldsSize(protobuf, before);
+        writeFields(out, protobuf, before);
+        out = CodedOutputStream::WriteVarint32ToArray(tag, out + size);
+        CodedOutputStream::WriteVarint32ToArray(payloadSize, out);
+    }
+
+    /**
+     * Parse the fields around a payload into protobuf.
+     *
+     * \return false if the fields don't parse, or hold another payload.
+     */
+    template<typename T>
+    static bool parseAround(T &protobuf, const uint8_t *header, size_t headerSize,
+                            const uint8_t *trailer, size_t trailerSize)
+    {
+        if (!protobuf.ParsePartialFromArray((const void*)header, headerSize))
+            return false;
+        if (trailerSize > 0) {
+            google::protobuf::io::CodedInputStream in(trailer, trailerSize);
+            if (!protobuf.MergePartialFromCodedStream(&in) || !in.ConsumedEntireMessage())
+                return false;
+        }
+        return protobuf.IsInitialized() && protobuf.payload_size() == 0;
+    }
+
+    /**
+     * Find the first payload field of a serialized packet.
+     *
+     * \param data the start of the packet
+     * \param avail bytes available at data
+     * \param total size of the whole packet
+     * \param field field number of the payload
+     * \param tagOffset set to the offset of the payload tag
+     * \param payloadOffset set to the offset of the payload data
+     * \param payloadEnd set to the offset just past the payload data
+     * \return false if no payload tag is found within the first avail
+     * bytes, or the payload runs past the end of the packet.
+     */
+    static bool findPayload(const uint8_t *data, size_t avail, size_t total, int field,
+                            size_t &tagOffset, size_t &payloadOffset, size_t &payloadEnd)
+    {
+        using google::protobuf::io::CodedInputStream;
+        using google::protobuf::internal::WireFormatLite;
+        if (field == 0)
+            return false;
+
+        CodedInputStream in(data, avail);
+        while (true) {
+            tagOffset = in.CurrentPosition();
+            uint32_t tag = in.ReadTag();
+            if (tag == 0)
+                return false;
+            if (WireFormatLite::GetTagFieldNumber(tag) == field &&
+                WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+                uint32_t length;
+                if (!in.ReadVarint32(&length))
+                    return false;
+                payloadOffset = in.CurrentPosition();
+                payloadEnd = payloadOffset + length;
+                return payloadEnd <= total;
+            }
+            if (!WireFormatLite::SkipField(&in, tag))
+                return false;
+        }
+    }
 };
 
 } // end of iris namespace
@@ -0,0 +1,282 @@
+/**
+ * \file lib/generic/utility/TimerWheel.h
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * A hashed timing wheel for keeping many timers (e.g. one per frame
+ * awaiting acknowledgement) with O(1) start and cancel.
+ */
+
+#ifndef UTILITY_TIMERWHEEL_H_
+#define UTILITY_TIMERWHEEL_H_
+
+#include <vector>
+#include <limits>
+#include <boost/cstdint.hpp>
+
+namespace iris
+{
+
+/** A hashed timing wheel.
+ *
+ * Time is counted in ticks, whose length is up to the user. Each timer
+ * is kept in the slot for its expiry tick modulo the number of slots, so
+ * starting and cancelling a timer take constant time, and advancing the
+ * wheel only looks at the slots for the ticks that have passed. Timers
+ * further ahead than one turn of the wheel share a slot with nearer ones
+ * and are skipped until their turn comes round.
+ *
+ * The timers are kept in a pool and linked into their slots by index.
+ * Expired and cancelled timers go back to the pool, so once the pool has
+ * grown to the most timers running at once (see reserve()), starting a
+ * timer does not allocate.
+ *
+ * Each timer carries a value of type T which is handed back when it
+ * expires. The wheel is not thread-safe.
+ */
+template<typename T>
+class TimerWheel
+{
+ public:
+  typedef uint64_t Tick;
+
+ private:
+  static const std::size_t none = ~std::size_t(0);
+
+  struct Timer
+  {
+    Tick expiry;
+    T value;
+    std::size_t prev;   ///< Previous timer in the slot, or in the pool
+    std::size_t next;   ///< Next timer in the slot, or in the pool
+    uint32_t id;        ///< Tells a running timer from a reused one (0 if free)
+  };
+
+  struct Slot
+  {
+    std::size_t head;
+    std::size_t tail;
+    Slot() :head(none), tail(none) {}
+  };
+
+ public:
+  /// Identifies a running timer, for cancel().
+  class Handle
+  {
+   public:
+    Handle() :index_(none), id_(0) {}
+    /// Is the timer running? (A handle is not cleared when its timer expires.)
+    bool active() const { return index_ != none; }
+   private:
+    friend class TimerWheel;
+    std::size_t index_;
+    uint32_t id_;
+  };
+
+  /** Create a wheel.
+   *
+   * @param numSlots  Slots in the wheel (rounded up to a power of 2).
+   * @param now       The current tick.
+   */
+  explicit TimerWheel(std::size_t numSlots = 1024, Tick now = 0)
+    :now_(now), size_(0), free_(none), lastId_(0)
+  {
+    std::size_t n = 1;
+    while(n < numSlots)
+      n *= 2;
+    slots_.resize(n);
+    mask_ = n-1;
+  }
+
+  /// The tick the wheel has been advanced to.
+  Tick now() const { return now_; }
+  /// Number of running timers.
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  /// Make room for n running timers, so that starting them won't allocate.
+  void reserve(std::size_t n)
+  {
+    while(timers_.size() < n)
+    {
+      timers_.push_back(Timer());
+      release(timers_.size()-1);
+    }
+  }
+
+  /** Start a timer.
+   *
+   * @param value  Returned by advance() when the timer expires.
+   * @param delay  Ticks from now until it expires (at least 1).
+   */
+  Handle start(const T& value, Tick delay)
+  {
+    if(free_ == none)
+      reserve(timers_.size()+1);
+    std::size_t i = free_;
+    free_ = timers_[i].next;
+
+    Timer& t = timers_[i];
+    t.expiry = now_ + (delay > 0 ? delay : 1);
+    t.value = value;
+    if(++lastId_ == 0)
+      lastId_ = 1;
+    t.id = lastId_;
+
+    // Add to the back of the slot, so timers expiring together keep their order
+    Slot& slot = slots_[t.expiry & mask_];
+    t.prev = slot.tail;
+    t.next = none;
+    if(slot.tail == none)
+      slot.head = i;
+    else
+      timers_[slot.tail].next = i;
+    slot.tail = i;
+    size_++;
+
+    Handle h;
+    h.index_ = i;
+    h.id_ = t.id;
+    return h;
+  }
+
+  /** Cancel a timer.
+   *
+   * Does nothing if the handle is not active or its timer has already
+   * expired.
+   */
+  void cancel(Handle& h)
+  {
+    if(h.active() && timers_[h.index_].id == h.id_)
+    {
+      unlink(h.index_);
+      release(h.index_);
+    }
+    h = Handle();
+  }
+
+  /** Advance the wheel to tick now, collecting the timers that expire.
+   *
+   * @param now      The new tick (ignored if not later than now()).
+   * @param expired  The values of the expired timers are appended to this,
+   *                 in order of expiry.
+   * @return The number of timers that expired.
+   */
+  std::size_t advance(Tick now, std::vector<T>& expired)
+  {
+    std::size_t n = 0;
+    // Past a full turn, every slot is visited anyway
+    Tick from = now_+1;
+    if(now > now_ && now-now_ > slots_.size())
+      from = now-slots_.size()+1;
+    for(Tick t=from; t<=now && size_>0; t++)
+    {
+      std::size_t i = slots_[t & mask_].head;
+      while(i != none)
+      {
+        std::size_t next = timers_[i].next;
+        if(timers_[i].expiry <= now)
+        {
+          expired.push_back(timers_[i].value);
+          unlink(i);
+          release(i);
+          n++;
+        }
+        i = next;
+      }
+    }
+    if(now > now_)
+      now_ = now;
+    return n;
+  }
+
+  /** Ticks from now until the next timer expires.
+   *
+   * @return std::numeric_limits<Tick>::max() if no timers are running.
+   */
+  Tick nextExpiry() const
+  {
+    if(size_ == 0)
+      return std::numeric_limits<Tick>::max();
+
+    // Look for a timer due within one turn of the wheel
+    for(Tick d=1; d<=slots_.size(); d++)
+    {
+      std::size_t i = slots_[(now_+d) & mask_].head;
+      for(; i!=none; i=timers_[i].next)
+        if(timers_[i].expiry <= now_+d)
+          return d;
+    }
+
+    // All timers are further away
+    Tick next = std::numeric_limits<Tick>::max();
+    for(std::size_t s=0; s<slots_.size(); s++)
+      for(std::size_t i=slots_[s].head; i!=none; i=timers_[i].next)
+        if(timers_[i].expiry-now_ < next)
+          next = timers_[i].expiry-now_;
+    return next;
+  }
+
+ private:
+  /// Take timer i out of its slot.
+  void unlink(std::size_t i)
+  {
+    Timer& t = timers_[i];
+    Slot& slot = slots_[t.expiry & mask_];
+    if(t.prev == none)
+      slot.head = t.next;
+    else
+      timers_[t.prev].next = t.next;
+    if(t.next == none)
+      slot.tail = t.prev;
+    else
+      timers_[t.next].prev = t.prev;
+    size_--;
+  }
+
+  /// Put timer i back in the pool.
+  void release(std::size_t i)
+  {
+    timers_[i].id = 0;
+    timers_[i].value = T();
+    timers_[i].next = free_;
+    free_ = i;
+  }
+
+  std::vector<Timer> timers_;   ///< Running timers and the pool
+  std::vector<Slot> slots_;
+  std::size_t mask_;
+  Tick now_;
+  std::size_t size_;
+  std::size_t free_;            ///< First timer in the pool
+  uint32_t lastId_;
+};
+
+} // namespace iris
+
+#endif // UTILITY_TIMERWHEEL_H_
@@ -0,0 +1,82 @@
+/**
+ * \file lib/generic/utility/test/EndianConversion_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for EndianConversion functions.
+ */
+
+#define BOOST_TEST_MODULE EndianConversion_Test
+
+#include "EndianConversion.h"
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+using namespace std;
+
+// Check the block swap against swap_bytes for every length up to n,
+// both in place and out of place
+template<typename T>
+void checkBlock(size_t n)
+{
+  vector<T> in(n), out(n);
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(&in[0]);
+  for(size_t i=0; i<n*sizeof(T); i++)
+    bytes[i] = (unsigned char)(i*7+3);
+
+  for(size_t len=0; len<=n; len++)
+  {
+    swap_bytes_block(&in[0], &out[0], len);
+    for(size_t i=0; i<len; i++)
+    {
+      T expected = swap_bytes(in[i]);
+      BOOST_REQUIRE(memcmp(&out[i], &expected, sizeof(T)) == 0);
+    }
+  }
+
+  vector<T> inPlace(in);
+  swap_bytes_block(&inPlace[0], &inPlace[0], n);
+  BOOST_CHECK(memcmp(&inPlace[0], &out[0], n*sizeof(T)) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE (EndianConversion_Test)
+
+BOOST_AUTO_TEST_CASE(EndianConversion_Block_Test)
+{
+  checkBlock<boost::uint8_t>(40);
+  checkBlock<boost::uint16_t>(40);
+  checkBlock<boost::int32_t>(40);
+  checkBlock<boost::uint64_t>(40);
+  checkBlock<float>(40);
+  checkBlock<double>(40);
+  checkBlock< complex<float> >(40);
+  checkBlock< complex<double> >(40);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
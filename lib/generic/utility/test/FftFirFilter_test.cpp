@@ -0,0 +1,157 @@
+/**
+ * \file lib/generic/utility/test/FirFilter_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for FftFirFilter class.
+ */
+
+#define BOOST_TEST_MODULE FftFirFilter_Test
+
+#include "FftFirFilter.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <deque>
+
+using namespace std;
+using namespace iris;
+
+typedef complex<float>  Cplx;
+typedef complex<double> CplxD;
+
+// Reference convolution y[n] = sum_k c[k]x[n-k]
+template<class InT, class CoeffT>
+vector<CplxD> convolve(const vector<InT>& x, const vector<CoeffT>& c)
+{
+  vector<CplxD> y(x.size());
+  for(int n=0; n<x.size(); n++)
+    for(int k=0; k<c.size() && k<=n; k++)
+      y[n] += CplxD(c[k]) * CplxD(x[n-k]);
+  return y;
+}
+
+float randFloat()
+{
+  return rand()/(float)RAND_MAX - 0.5f;
+}
+
+void randomize(vector<float>& v)
+{
+  for(int i=0; i<v.size(); i++)
+    v[i] = randFloat();
+}
+
+void randomize(vector<Cplx>& v)
+{
+  for(int i=0; i<v.size(); i++)
+    v[i] = Cplx(randFloat(), randFloat());
+}
+
+// Filter x in uneven chunks and compare with the reference
+template<class InT, class CoeffT>
+void checkFilter(int numTaps, int mode)
+{
+  vector<CoeffT> coeffs(numTaps);
+  vector<InT> x(3000);
+  randomize(coeffs);
+  randomize(x);
+
+  FftFirFilter<InT, CoeffT> f(coeffs.begin(), coeffs.end());
+  BOOST_CHECK_EQUAL((int)f.getMode(), mode);
+
+  vector<InT> y(x.size());
+  int chunks[] = {1, 7, 500, 2, 1000, 33};
+  int pos = 0;
+  for(int i=0; pos < x.size(); i=(i+1)%6)
+  {
+    int n = min(chunks[i], (int)x.size()-pos);
+    typename vector<InT>::iterator out =
+        f.filter(x.begin()+pos, x.begin()+pos+n, y.begin()+pos);
+    BOOST_REQUIRE(out == y.begin()+pos+n);
+    pos += n;
+  }
+
+  vector<CplxD> ref = convolve(x, coeffs);
+  for(int i=0; i<x.size(); i++)
+    BOOST_REQUIRE_SMALL(abs(CplxD(y[i]) - ref[i]), 1e-4);
+}
+
+BOOST_AUTO_TEST_SUITE (FftFirFilter_Test)
+
+BOOST_AUTO_TEST_CASE(FftFirFilter_Fft_Test)
+{
+  typedef FftFirFilter<Cplx> F;
+  checkFilter<Cplx, Cplx>(F::fftTapThreshold, F::FFT);
+  checkFilter<Cplx, Cplx>(301, F::FFT);
+  checkFilter<Cplx, float>(100, F::FFT);
+  checkFilter<float, float>(F::fftTapThreshold, F::FFT);
+  checkFilter<float, float>(257, F::FFT);
+}
+
+BOOST_AUTO_TEST_CASE(FftFirFilter_Short_Test)
+{
+  // Short filters are passed on to a FirFilter
+  typedef FftFirFilter<Cplx> F;
+  checkFilter<Cplx, Cplx>(F::fftTapThreshold-1, F::SIMD);
+  checkFilter<float, float>(F::fftTapThreshold-1, F::DIRECT);
+
+  int c[] = {1, 2, 3};
+  int x[] = {1, 0, 0, 1, 1, 0};
+  int expected[] = {1, 2, 3, 1, 3, 5};
+  FftFirFilter<int> f(c, c+3);
+  BOOST_CHECK_EQUAL(f.getMode(), FftFirFilter<int>::DIRECT);
+  int y[6];
+  f.filter(x, x+6, y);
+  BOOST_CHECK_EQUAL_COLLECTIONS(y, y+6, expected, expected+6);
+}
+
+BOOST_AUTO_TEST_CASE(FftFirFilter_Copy_Test)
+{
+  // Copies share fft plans but keep their own state
+  vector<Cplx> coeffs(100);
+  vector<Cplx> x(1000);
+  randomize(coeffs);
+  randomize(x);
+
+  FftFirFilter<Cplx> f1(coeffs.begin(), coeffs.end());
+  FftFirFilter<Cplx> f2(f1);
+  vector<Cplx> y1(x.size()), y2(x.size());
+  f1.filter(x.begin(), x.end(), y1.begin());
+  f2.filter(x.begin(), x.end(), y2.begin());
+  BOOST_CHECK(y1 == y2);
+
+  // Generic input and output iterators
+  FftFirFilter<Cplx> f3(coeffs.begin(), coeffs.end());
+  deque<Cplx> dx(x.begin(), x.end());
+  vector<Cplx> y3;
+  f3.filter(dx.begin(), dx.end(), back_inserter(y3));
+  BOOST_CHECK(y1 == y3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,185 @@
+/**
+ * \file lib/generic/utility/test/FrameAggregation_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ * Main test file for FrameAggregator and FrameReassembler.
+ */
+
+#define BOOST_TEST_MODULE FrameAggregation_Test
+
+#include "FrameAggregation.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+typedef vector<uint8_t> Bytes;
+
+static Bytes makeSdu(size_t size, int seed)
+{
+  Bytes b(size);
+  for(size_t i=0; i<size; i++)
+    b[i] = uint8_t(seed + i*7);
+  return b;
+}
+
+/// Aggregate the SDUs and return the frames.
+static vector<Bytes> aggregate(const vector<Bytes>& sdus, size_t frameSize)
+{
+  FrameAggregator agg(frameSize);
+  for(size_t i=0; i<sdus.size(); i++)
+    agg.add(sdus[i].begin(), sdus[i].end());
+  vector<Bytes> frames;
+  Bytes f;
+  while(agg.pop(f, true))
+  {
+    BOOST_CHECK(f.size() <= frameSize);
+    frames.push_back(f);
+  }
+  return frames;
+}
+
+BOOST_AUTO_TEST_SUITE (FrameAggregation_Test)
+
+BOOST_AUTO_TEST_CASE(FrameAggregation_Aggregate_Test)
+{
+  // 20 small SDUs (860 bytes of subframes) fit in 4 frames of 256 bytes
+  vector<Bytes> sdus;
+  for(int i=0; i<20; i++)
+    sdus.push_back(makeSdu(20+i, i));
+  vector<Bytes> frames = aggregate(sdus, 256);
+  BOOST_CHECK_EQUAL(frames.size(), 4u);
+
+  // The PHY pads each frame out with zeros
+  size_t padding = 0;
+  for(size_t i=0; i<frames.size(); i++)
+  {
+    padding += 256 - frames[i].size();
+    frames[i].resize(256, 0);
+  }
+  BOOST_CHECK(padding > 0);
+
+  FrameReassembler re;
+  vector<Bytes> out;
+  for(size_t i=0; i<frames.size(); i++)
+    re.receive(&frames[i][0], frames[i].size(), out);
+  BOOST_REQUIRE_EQUAL(out.size(), sdus.size());
+  for(size_t i=0; i<sdus.size(); i++)
+    BOOST_CHECK(out[i] == sdus[i]);
+  BOOST_CHECK_EQUAL(re.subframes(), 20u);
+  BOOST_CHECK_EQUAL(re.badSubframes(), 0u);
+  BOOST_CHECK_EQUAL(re.lostBytes(), 0u);
+  BOOST_CHECK_EQUAL(re.paddingBytes(), padding);
+}
+
+BOOST_AUTO_TEST_CASE(FrameAggregation_Fragment_Test)
+{
+  vector<Bytes> sdus;
+  sdus.push_back(makeSdu(100, 1));
+  sdus.push_back(makeSdu(1500, 2));   // Fragmented
+  sdus.push_back(makeSdu(200, 3));    // Starts a new frame rather than fragmenting
+  sdus.push_back(makeSdu(0, 4));
+  vector<Bytes> frames = aggregate(sdus, 256);
+
+  FrameReassembler re;
+  vector<Bytes> out;
+  for(size_t i=0; i<frames.size(); i++)
+    re.receive(&frames[i][0], frames[i].size(), out);
+  BOOST_REQUIRE_EQUAL(out.size(), sdus.size());
+  for(size_t i=0; i<sdus.size(); i++)
+    BOOST_CHECK(out[i] == sdus[i]);
+  BOOST_CHECK_EQUAL(re.subframes(), 1+7+1+1u);
+
+  // An SDU which fits in the space left but not with its delimiter and
+  // crc starts a new frame rather than being fragmented
+  vector<Bytes> tight;
+  tight.push_back(makeSdu(100, 5));
+  tight.push_back(makeSdu(256-Subframe::size(100)-4, 6));
+  frames = aggregate(tight, 256);
+  BOOST_REQUIRE_EQUAL(frames.size(), 2u);
+  FrameReassembler tightRe;
+  out.clear();
+  for(size_t i=0; i<frames.size(); i++)
+    tightRe.receive(&frames[i][0], frames[i].size(), out);
+  BOOST_CHECK_EQUAL(tightRe.subframes(), 2u);
+
+  FrameAggregator agg(64);
+  Bytes big(52*127+1);
+  BOOST_CHECK_THROW(agg.add(big.begin(), big.end()), IrisException);
+  BOOST_CHECK_THROW(FrameAggregator tiny(12), IrisException);
+}
+
+BOOST_AUTO_TEST_CASE(FrameAggregation_Pop_Test)
+{
+  // Only full frames are taken unless all are asked for
+  FrameAggregator agg(64);
+  Bytes sdu = makeSdu(20, 0);
+  agg.add(sdu.begin(), sdu.end());
+  Bytes f;
+  BOOST_CHECK(!agg.pop(f, false));
+  BOOST_CHECK(!agg.lastFrameFull());
+  agg.add(sdu.begin(), sdu.end());
+  BOOST_CHECK(agg.lastFrameFull());
+  BOOST_CHECK(agg.pop(f, false));
+  BOOST_CHECK_EQUAL(f.size(), 64u);
+  BOOST_CHECK_EQUAL(agg.numFrames(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(FrameAggregation_Error_Test)
+{
+  vector<Bytes> sdus;
+  for(int i=0; i<6; i++)
+    sdus.push_back(makeSdu(30, i));
+  sdus.push_back(makeSdu(600, 6));
+  sdus.push_back(makeSdu(30, 7));
+  vector<Bytes> frames = aggregate(sdus, 256);
+  BOOST_REQUIRE(frames.size() >= 3);
+
+  // Damage the data of the 2nd SDU and the delimiter of the 4th
+  frames[0][Subframe::size(30) + Subframe::delimiterSize + 5] ^= 1;
+  frames[0][3*Subframe::size(30) + 2] ^= 0x10;
+  // Lose the 2nd fragment of the big SDU
+  frames.erase(frames.begin()+2);
+
+  FrameReassembler re;
+  vector<Bytes> out;
+  for(size_t i=0; i<frames.size(); i++)
+    re.receive(&frames[i][0], frames[i].size(), out);
+  BOOST_REQUIRE_EQUAL(out.size(), 5u);
+  BOOST_CHECK(out[0] == sdus[0]);
+  BOOST_CHECK(out[1] == sdus[2]);
+  BOOST_CHECK(out[2] == sdus[4]);
+  BOOST_CHECK(out[3] == sdus[5]);
+  BOOST_CHECK(out[4] == sdus[7]);
+  BOOST_CHECK_EQUAL(re.badSubframes(), 1u);
+  BOOST_CHECK_EQUAL(re.lostBytes(), Subframe::size(30));
+  BOOST_CHECK_EQUAL(re.droppedSdus(), 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+/**
+ * \file lib/generic/utility/test/LockFreeQueue_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for LockFreeQueue.
+ */
+
+#define BOOST_TEST_MODULE LockFreeQueue_Test
+
+#include "LockFreeQueue.h"
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+typedef LockFreeQueue<int> IntQueue;
+
+BOOST_AUTO_TEST_SUITE (LockFreeQueue_Test)
+
+BOOST_AUTO_TEST_CASE(LockFreeQueue_Basic_Test)
+{
+  IntQueue q(5);
+  BOOST_CHECK_EQUAL(q.capacity(), 8u);
+
+  int x;
+  BOOST_CHECK(!q.tryPop(x));
+  for(int i=0; i<8; i++)
+    BOOST_CHECK(q.tryPush(i));
+  BOOST_CHECK(!q.tryPush(8));
+  BOOST_CHECK_EQUAL(q.size(), 8u);
+  BOOST_CHECK_EQUAL(q.highWater(), 8u);
+
+  BOOST_CHECK(q.tryPop(x));
+  BOOST_CHECK_EQUAL(x, 0);
+  vector<int> batch;
+  BOOST_CHECK_EQUAL(q.popBatch(batch, 4), 4u);
+  BOOST_CHECK_EQUAL(q.tryPopBatch(batch, 100), 3u);
+  BOOST_REQUIRE_EQUAL(batch.size(), 7u);
+  for(int i=0; i<7; i++)
+    BOOST_CHECK_EQUAL(batch[i], i+1);
+  BOOST_CHECK_EQUAL(q.size(), 0u);
+  BOOST_CHECK_EQUAL(q.pushed(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(LockFreeQueue_Policy_Test)
+{
+  IntQueue newest(4, IntQueue::DROP_NEWEST);
+  IntQueue oldest(4, IntQueue::DROP_OLDEST);
+  for(int i=0; i<10; i++)
+  {
+    BOOST_CHECK_EQUAL(newest.push(i), i < 4);
+    BOOST_CHECK_EQUAL(oldest.push(i), i < 4);
+  }
+  BOOST_CHECK_EQUAL(newest.dropped(), 6u);
+  BOOST_CHECK_EQUAL(oldest.dropped(), 6u);
+
+  vector<int> a, b;
+  newest.tryPopBatch(a, 10);
+  oldest.tryPopBatch(b, 10);
+  BOOST_REQUIRE_EQUAL(a.size(), 4u);
+  BOOST_REQUIRE_EQUAL(b.size(), 4u);
+  BOOST_CHECK_EQUAL(a.front(), 0);
+  BOOST_CHECK_EQUAL(b.front(), 6);
+  BOOST_CHECK_EQUAL(b.back(), 9);
+
+  BOOST_CHECK(IntQueue::policyFromString("dropoldest") == IntQueue::DROP_OLDEST);
+  BOOST_CHECK_THROW(IntQueue::policyFromString("none"), IrisException);
+}
+
+void produce(IntQueue* q, int id, int n)
+{
+  for(int i=0; i<n; i++)
+    q->push(id*n+i);
+}
+
+BOOST_AUTO_TEST_CASE(LockFreeQueue_Threads_Test)
+{
+  // Blocking producers and consumer, with a small queue so both block
+  const int numProducers = 4, n = 20000;
+  IntQueue q(16);
+  boost::thread_group producers;
+  for(int p=0; p<numProducers; p++)
+    producers.create_thread(boost::bind(produce, &q, p, n));
+
+  vector<int> last(numProducers, -1);
+  vector<int> batch;
+  int received = 0;
+  while(received < numProducers*n)
+  {
+    batch.clear();
+    received += q.popBatch(batch, 32);
+    for(size_t i=0; i<batch.size(); i++)
+    {
+      // Items from each producer arrive in order
+      int p = batch[i]/n;
+      BOOST_REQUIRE_GT(batch[i], last[p]);
+      last[p] = batch[i];
+    }
+  }
+  producers.join_all();
+  BOOST_CHECK_EQUAL(q.dropped(), 0u);
+  BOOST_CHECK_EQUAL(q.size(), 0u);
+}
+
+void consumeOne(IntQueue* q, int* out)
+{
+  *out = q->pop();
+}
+
+BOOST_AUTO_TEST_CASE(LockFreeQueue_Interrupt_Test)
+{
+  IntQueue q(4);
+  int x = -1;
+  boost::thread t(boost::bind(consumeOne, &q, &x));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  q.push(42);
+  t.join();
+  BOOST_CHECK_EQUAL(x, 42);
+
+  // A blocked consumer can be interrupted
+  boost::thread u(boost::bind(consumeOne, &q, &x));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  u.interrupt();
+  BOOST_CHECK(u.timed_join(boost::posix_time::seconds(5)));
+}
+
+BOOST_AUTO_TEST_CASE(LockFreeQueue_Timeout_Test)
+{
+  IntQueue q(4);
+  vector<int> batch;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  BOOST_CHECK_EQUAL(q.popBatch(batch, 4, boost::posix_time::milliseconds(20)), 0u);
+  boost::posix_time::time_duration waited =
+      boost::posix_time::microsec_clock::universal_time() - start;
+  BOOST_CHECK(waited >= boost::posix_time::milliseconds(15));
+
+  boost::thread t(boost::bind(produce, &q, 0, 2));
+  BOOST_CHECK(q.popBatch(batch, 4, boost::posix_time::seconds(5)) > 0);
+  t.join();
+  BOOST_CHECK_EQUAL(batch.front(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
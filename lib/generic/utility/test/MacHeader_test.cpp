@@ -0,0 +1,104 @@
+/**
+ * \file lib/generic/utility/test/MacHeader_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ * Main test file for MacHeader.
+ */
+
+#define BOOST_TEST_MODULE MacHeader_Test
+
+#include "MacHeader.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+BOOST_AUTO_TEST_SUITE (MacHeader_Test)
+
+BOOST_AUTO_TEST_CASE(MacHeader_Address_Test)
+{
+  BOOST_CHECK_EQUAL(MacHeader::parseAddress("aabbcc111111"), 0xaabbcc111111ULL);
+  BOOST_CHECK_EQUAL(MacHeader::parseAddress("AA:BB:CC:11:11:1f"), 0xaabbcc11111fULL);
+  BOOST_CHECK_EQUAL(MacHeader::formatAddress(0x00f0f0f0f0f0ULL), "00f0f0f0f0f0");
+  BOOST_CHECK_THROW(MacHeader::parseAddress("aabbcc11111"), IrisException);
+  BOOST_CHECK_THROW(MacHeader::parseAddress("aabbcc1111111"), IrisException);
+  BOOST_CHECK_THROW(MacHeader::parseAddress("aabbcc11111g"), IrisException);
+  BOOST_CHECK_THROW(MacHeader::parseAddress("aab:bcc111111"), IrisException);
+}
+
+BOOST_AUTO_TEST_CASE(MacHeader_Deque_Test)
+{
+  MacHeader h;
+  h.type = 1;
+  h.destination = 0xaabbcc222222ULL;
+  h.source = 0xaabbcc111111ULL;
+  h.seqno = 0x01020304;
+
+  deque<uint8_t> data;
+  for(int i=0; i<100; i++)
+    data.push_back(i);
+  h.push(data);
+  BOOST_REQUIRE_EQUAL(data.size(), 100+MacHeader::size);
+  BOOST_CHECK_EQUAL(data[0], int(MacHeader::currentVersion));
+  BOOST_CHECK_EQUAL(data[2], 0xaa);
+  BOOST_CHECK_EQUAL(data[14], 0x01);
+  BOOST_CHECK_EQUAL(data[17], 0x04);
+  BOOST_CHECK_EQUAL(data[19], 100);
+  BOOST_CHECK_EQUAL(data[20], 0);
+
+  // Padding after the payload is removed
+  data.push_back(0xff);
+  data.push_back(0xff);
+  MacHeader r;
+  BOOST_REQUIRE(r.pull(data));
+  BOOST_CHECK_EQUAL(r.type, 1);
+  BOOST_CHECK_EQUAL(r.destination, h.destination);
+  BOOST_CHECK_EQUAL(r.source, h.source);
+  BOOST_CHECK_EQUAL(r.seqno, h.seqno);
+  BOOST_CHECK_EQUAL(r.length, 100);
+  BOOST_REQUIRE_EQUAL(data.size(), 100u);
+  BOOST_CHECK_EQUAL(data[0], 0);
+  BOOST_CHECK_EQUAL(data[99], 99);
+
+  // Truncated frames and other versions are rejected
+  h.push(data);
+  data.pop_back();
+  BOOST_CHECK(!r.pull(data));
+  BOOST_CHECK_EQUAL(data.size(), 99+MacHeader::size);
+  data.push_back(0);
+  data[0] = 0x0a;
+  BOOST_CHECK(!r.pull(data));
+  deque<uint8_t> shortData(10, uint8_t(MacHeader::currentVersion));
+  BOOST_CHECK(!r.pull(shortData));
+
+  deque<uint8_t> tooLong(70000);
+  BOOST_CHECK_THROW(h.push(tooLong), IrisException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,119 @@
+/**
+ * \file lib/generic/utility/test/PacketBuffer_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for PacketBuffer.
+ */
+
+#define BOOST_TEST_MODULE PacketBuffer_Test
+
+#include "PacketBuffer.h"
+#include "AllocationCounter.h"
+
+#include <deque>
+#include <boost/test/unit_test.hpp>
+
+// Count heap allocations in this executable
+IRIS_ALLOCATION_COUNTER_OPERATORS
+
+using namespace std;
+using namespace iris;
+
+BOOST_AUTO_TEST_SUITE (PacketBuffer_Test)
+
+BOOST_AUTO_TEST_CASE(PacketBuffer_HeadTail_Test)
+{
+  PacketPool pool(2048);
+  PacketPtr p = pool.allocate(100, 16);
+  BOOST_CHECK_EQUAL(p->headroom(), 16u);
+  BOOST_CHECK_EQUAL(p->size(), 0u);
+  BOOST_CHECK_EQUAL(p->tailroom(), 2048u-16);
+
+  uint8_t* payload = p->put(4);
+  memcpy(payload, "data", 4);
+  memcpy(p->push(3), "hdr", 3);
+  memcpy(p->put(3), "crc", 3);
+  BOOST_CHECK_EQUAL(string(p->begin(), p->end()), "hdrdatacrc");
+  BOOST_CHECK_EQUAL(p->headroom(), 13u);
+
+  // Stripping doesn't move the data
+  BOOST_CHECK(p->pull(3) == payload);
+  p->trim(4);
+  BOOST_CHECK_EQUAL(string(p->begin(), p->end()), "data");
+
+  BOOST_CHECK_THROW(p->push(17), IrisException);
+  BOOST_CHECK_THROW(p->pull(5), IrisException);
+  BOOST_CHECK_THROW(p->put(4096), IrisException);
+}
+
+BOOST_AUTO_TEST_CASE(PacketBuffer_Pool_Test)
+{
+  PacketPool pool(2048, 2);
+  {
+    PacketPtr a = pool.allocate(10);
+    PacketPtr b = a;
+    a.reset();
+    BOOST_CHECK_EQUAL(pool.freeBlocks(), 0u);
+  }
+  BOOST_CHECK_EQUAL(pool.freeBlocks(), 1u);
+
+  // Reusing pooled blocks doesn't touch the heap
+  AllocationCounter::start();
+  for(int i=0; i<100; i++)
+  {
+    PacketPtr a = pool.allocate(1500);
+    a->put(1500);
+  }
+  BOOST_CHECK_EQUAL(AllocationCounter::stop(), 0);
+
+  // Big packets get their own block, which isn't pooled
+  {
+    PacketPtr big = pool.allocate(5000, 64);
+    BOOST_CHECK_EQUAL(big->tailroom(), 5000u);
+  }
+  BOOST_CHECK_EQUAL(pool.freeBlocks(), 1u);
+
+  // No more than maxFree blocks are kept
+  {
+    PacketPtr a = pool.allocate(1), b = pool.allocate(1), c = pool.allocate(1);
+  }
+  BOOST_CHECK_EQUAL(pool.freeBlocks(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(PacketBuffer_Copy_Test)
+{
+  deque<uint8_t> d;
+  for(int i=0; i<300; i++)
+    d.push_back(i);
+  PacketPtr p = PacketPool::defaultPool().copy(d.begin(), d.end(), 32);
+  BOOST_CHECK_EQUAL(p->headroom(), 32u);
+  BOOST_CHECK(deque<uint8_t>(p->begin(), p->end()) == d);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+/**
+ * \file lib/generic/utility/test/ReceiveWindow_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ * Main test file for ReceiveWindow.
+ */
+
+#define BOOST_TEST_MODULE ReceiveWindow_Test
+
+#include "ReceiveWindow.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+typedef ReceiveWindow<int> IntWindow;
+
+BOOST_AUTO_TEST_SUITE (ReceiveWindow_Test)
+
+BOOST_AUTO_TEST_CASE(ReceiveWindow_Reorder_Test)
+{
+  IntWindow w(4);
+  vector<int> out;
+
+  BOOST_CHECK(w.add(1, 10, out));
+  BOOST_REQUIRE_EQUAL(out.size(), 1u);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 1u);
+
+  // 2 is late, 3 and 4 are held
+  BOOST_CHECK(w.add(3, 30, out));
+  BOOST_CHECK(w.add(4, 40, out));
+  BOOST_CHECK(!w.add(4, 40, out));   // Duplicate
+  BOOST_CHECK(!w.add(6, 60, out));   // Beyond the window
+  BOOST_CHECK(!w.add(1, 10, out));   // Already passed on
+  BOOST_CHECK_EQUAL(out.size(), 1u);
+  BOOST_CHECK_EQUAL(w.heldBitmap(), 3u);
+
+  BOOST_CHECK(w.add(2, 20, out));
+  BOOST_REQUIRE_EQUAL(out.size(), 4u);
+  BOOST_CHECK_EQUAL(out[1], 20);
+  BOOST_CHECK_EQUAL(out[2], 30);
+  BOOST_CHECK_EQUAL(out[3], 40);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 4u);
+  BOOST_CHECK_EQUAL(w.heldBitmap(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(ReceiveWindow_Skip_Test)
+{
+  // Frame 3 is lost more times than the sender retries, so never arrives
+  IntWindow w(4);
+  vector<int> out;
+  for(uint32_t s=1; s<=6; s++)
+    if(s != 3)
+      w.add(s, s, out);
+  BOOST_CHECK_EQUAL(out.size(), 2u);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 2u);
+
+  // Frames beyond the window can't get in...
+  BOOST_CHECK(!w.add(7, 7, out));
+
+  // ...until the sender, having given up on 3, says its window starts at 7
+  w.skipTo(7, out);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 6u);
+  BOOST_CHECK(w.add(7, 7, out));
+  BOOST_CHECK(w.add(8, 8, out));
+  BOOST_REQUIRE_EQUAL(out.size(), 7u);
+  int expected[] = {1, 2, 4, 5, 6, 7, 8};
+  for(size_t i=0; i<out.size(); i++)
+    BOOST_CHECK_EQUAL(out[i], expected[i]);
+
+  // An old window start changes nothing
+  w.skipTo(5, out);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(ReceiveWindow_SkipHeld_Test)
+{
+  // Frames held at and beyond the new start stay in order
+  IntWindow w(8);
+  vector<int> out;
+  w.add(3, 3, out);
+  w.add(5, 5, out);
+  w.add(6, 6, out);
+  w.add(8, 8, out);
+  w.skipTo(5, out);
+  BOOST_REQUIRE_EQUAL(out.size(), 3u);
+  BOOST_CHECK_EQUAL(out[0], 3);
+  BOOST_CHECK_EQUAL(out[1], 5);
+  BOOST_CHECK_EQUAL(out[2], 6);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 6u);
+  BOOST_CHECK_EQUAL(w.heldBitmap(), 1u);
+
+  // A jump far ahead empties the window
+  w.skipTo(1000, out);
+  BOOST_REQUIRE_EQUAL(out.size(), 4u);
+  BOOST_CHECK_EQUAL(out[3], 8);
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 999u);
+
+  w.reset();
+  BOOST_CHECK_EQUAL(w.lastInOrder(), 0u);
+  BOOST_CHECK(w.add(1, 1, out));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
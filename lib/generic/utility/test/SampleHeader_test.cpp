@@ -0,0 +1,98 @@
+/**
+ * \file lib/generic/utility/test/SampleHeader_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for SampleHeader.
+ */
+
+#define BOOST_TEST_MODULE SampleHeader_Test
+
+#include "SampleHeader.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+BOOST_AUTO_TEST_SUITE (SampleHeader_Test)
+
+BOOST_AUTO_TEST_CASE(SampleHeader_Layout_Test)
+{
+  SampleHeader h;
+  h.sequence = 0x01020304;
+  h.length = 1316;
+  h.timeStamp = 1.0;
+  h.sampleRate = 2.0;
+
+  uint8_t buf[SampleHeader::size];
+  h.encode(buf);
+  BOOST_CHECK_EQUAL(buf[0], 0x49);
+  BOOST_CHECK_EQUAL(buf[1], 0x52);
+  BOOST_CHECK_EQUAL(buf[2], 1);
+  BOOST_CHECK_EQUAL(buf[4], 0x01);
+  BOOST_CHECK_EQUAL(buf[7], 0x04);
+  BOOST_CHECK_EQUAL(buf[10], 1316 >> 8);
+  BOOST_CHECK_EQUAL(buf[11], 1316 & 0xff);
+  BOOST_CHECK_EQUAL(buf[16], 0x3f);   // 1.0 = 0x3ff0000000000000
+  BOOST_CHECK_EQUAL(buf[17], 0xf0);
+  BOOST_CHECK_EQUAL(buf[24], 0x40);   // 2.0 = 0x4000000000000000
+}
+
+BOOST_AUTO_TEST_CASE(SampleHeader_RoundTrip_Test)
+{
+  SampleHeader h;
+  h.sequence = 0xfffffffe;
+  h.length = 8192;
+  h.timeStamp = 1234567.891011;
+  h.sampleRate = 2.5e6;
+
+  uint8_t buf[SampleHeader::size];
+  h.encode(buf);
+
+  SampleHeader d;
+  BOOST_REQUIRE(d.decode(buf, sizeof(buf)));
+  BOOST_CHECK_EQUAL(d.sequence, h.sequence);
+  BOOST_CHECK_EQUAL(d.length, h.length);
+  BOOST_CHECK_EQUAL(d.timeStamp, h.timeStamp);
+  BOOST_CHECK_EQUAL(d.sampleRate, h.sampleRate);
+}
+
+BOOST_AUTO_TEST_CASE(SampleHeader_Invalid_Test)
+{
+  SampleHeader h;
+  uint8_t buf[SampleHeader::size];
+  h.encode(buf);
+
+  SampleHeader d;
+  BOOST_CHECK(!d.decode(buf, SampleHeader::size-1));
+  buf[0] = 0;
+  BOOST_CHECK(!d.decode(buf, sizeof(buf)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,149 @@
+/**
+ * \file lib/generic/utility/test/SigmfMetadata_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for SigmfMetadata.
+ */
+
+#define BOOST_TEST_MODULE SigmfMetadata_Test
+
+#include "SigmfMetadata.h"
+
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+BOOST_AUTO_TEST_SUITE (SigmfMetadata_Test)
+
+BOOST_AUTO_TEST_CASE(SigmfMetadata_Types_Test)
+{
+  BOOST_CHECK_EQUAL(SigmfMetadata::toSigmfType("complex<float>", false), "cf32_le");
+  BOOST_CHECK_EQUAL(SigmfMetadata::toSigmfType("int16_t", true), "ri16_be");
+  BOOST_CHECK_EQUAL(SigmfMetadata::toSigmfType("uint8_t", true), "ru8");
+  BOOST_CHECK_EQUAL(SigmfMetadata::toSigmfType("long double", false), "");
+  BOOST_CHECK_EQUAL(SigmfMetadata::toIrisType("cf64_be"), "complex<double>");
+  BOOST_CHECK_EQUAL(SigmfMetadata::toIrisType("ri8"), "int8_t");
+  BOOST_CHECK_EQUAL(SigmfMetadata::toIrisType("ci16_le"), "");
+  BOOST_CHECK_EQUAL(SigmfMetadata::metaFileName("dir.x/cap.sigmf-data"),
+                    "dir.x/cap.sigmf-meta");
+  BOOST_CHECK_EQUAL(SigmfMetadata::metaFileName("dir.x/cap"),
+                    "dir.x/cap.sigmf-meta");
+}
+
+BOOST_AUTO_TEST_CASE(SigmfMetadata_Index_Test)
+{
+  SigmfMetadata m;
+  // 1000 samples/s in blocks of 100, with a 10s gap after 500 samples
+  for(int i=0; i<10; i++)
+  {
+    double t = 100 + i*0.1 + (i >= 5 ? 10 : 0);
+    m.addData(i*100, 100, t, 1000, 0.25);
+  }
+  // Segments at 0, 300 (interval), 500 (gap), 800 (interval)
+  BOOST_REQUIRE_EQUAL(m.captures.size(), 4u);
+  BOOST_CHECK_EQUAL(m.captures[1].sampleStart, 300u);
+  BOOST_CHECK_EQUAL(m.captures[2].sampleStart, 500u);
+  BOOST_CHECK_EQUAL(m.captures[3].sampleStart, 800u);
+
+  BOOST_CHECK_EQUAL(m.findSample(50), 0u);
+  BOOST_CHECK_EQUAL(m.findSample(100.25), 250u);
+  BOOST_CHECK_EQUAL(m.findSample(105), 500u);     // In the gap
+  BOOST_CHECK_EQUAL(m.findSample(110.6), 600u);
+  BOOST_CHECK_EQUAL(m.findSample(110.95), 950u);
+
+  // Time jumps back 1s after 1000 samples
+  m.addData(1000, 500, 110.0, 1000, 0);
+  BOOST_REQUIRE_EQUAL(m.captures.size(), 5u);
+  BOOST_CHECK_EQUAL(m.findSample(110.2), 1200u);  // Only in the last segment
+  BOOST_CHECK_EQUAL(m.findSample(110.6), 600u);   // In both - take the first
+  BOOST_CHECK_EQUAL(m.findSample(109), 1000u);    // Before the last segment
+  BOOST_CHECK_EQUAL(m.findSample(50), 0u);
+
+  // Another segment starting at the same time as one before it
+  m.addData(1500, 100, 110.5, 2000, 0);
+  BOOST_REQUIRE_EQUAL(m.captures.size(), 6u);
+  BOOST_CHECK_EQUAL(m.findSample(110.55), 550u);  // Tie - take the earliest
+
+  // The index is rebuilt from the captures read back
+  std::stringstream ss;
+  m.write(ss);
+  SigmfMetadata r;
+  r.read(ss);
+  BOOST_CHECK_EQUAL(r.findSample(110.2), 1200u);
+  BOOST_CHECK_EQUAL(r.findSample(110.55), 550u);
+  BOOST_CHECK_EQUAL(r.findSample(105), 1000u);
+
+  // ...and after the captures are changed directly
+  r.captures.erase(r.captures.begin()+4, r.captures.end());
+  BOOST_CHECK_EQUAL(r.findSample(105), 500u);
+
+  double rate;
+  BOOST_CHECK_CLOSE(m.findTime(450, rate), 100.45, 1e-9);
+  BOOST_CHECK_CLOSE(m.findTime(650, rate), 110.65, 1e-9);
+  BOOST_CHECK_EQUAL(rate, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(SigmfMetadata_RoundTrip_Test)
+{
+  SigmfMetadata m;
+  m.datatype = "cf32_le";
+  m.frequency = 2.4e9;
+  m.description = "a \"test\"";
+  m.addData(0, 100, 1371225600.5, 1e6, 1);
+  m.addData(100, 100, 1371225700.25, 2e6, 1);
+
+  m.addData(200, 100, 99.9999999999, 2e6, 0);
+
+  stringstream ss;
+  m.write(ss);
+  BOOST_CHECK(ss.str().find("\"core:datetime\": \"2013-06-14T16:00:00.500000000Z\"")
+              != string::npos);
+  // Rounds up into the next second
+  BOOST_CHECK(ss.str().find("\"core:datetime\": \"1970-01-01T00:01:40.000000000Z\"")
+              != string::npos);
+
+  SigmfMetadata r;
+  r.read(ss);
+  BOOST_CHECK_EQUAL(r.datatype, "cf32_le");
+  BOOST_CHECK_EQUAL(r.sampleRate, 1e6);
+  BOOST_CHECK_EQUAL(r.frequency, 2.4e9);
+  BOOST_CHECK_EQUAL(r.description, m.description);
+  BOOST_REQUIRE_EQUAL(r.captures.size(), 3u);
+  BOOST_CHECK_EQUAL(r.captures[1].sampleStart, 100u);
+  BOOST_CHECK_EQUAL(r.captures[1].timeStamp, 1371225700.25);
+  BOOST_CHECK_EQUAL(r.captures[1].sampleRate, 2e6);
+  BOOST_CHECK(!r.isBigEndian());
+
+  stringstream bad("{\"global\": {}}");
+  BOOST_CHECK_THROW(r.read(bad), IrisException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,164 @@
+/**
+ * \file lib/generic/utility/test/StackHelper_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ *
+ * Main test file for StackHelper.
+ */
+
+#define BOOST_TEST_MODULE StackHelper_Test
+
+#include "StackHelper.h"
+#include "stackhelper_test.pb.h"
+
+#include <string>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace iris;
+
+typedef boost::shared_ptr<StackDataSet> FramePtr;
+
+// A frame holding numBytes bytes of payload
+FramePtr makeFrame(int numBytes)
+{
+  FramePtr frame(new StackDataSet);
+  for(int i=0; i<numBytes; i++)
+    frame->data.push_back((uint8_t)(i*7));
+  return frame;
+}
+
+// The packet as protobuf itself would serialize it, payload included
+string serialize(TestPacket packet, const FramePtr frame)
+{
+  string payload(frame->data.begin(), frame->data.end());
+  packet.add_payload(payload);
+  string out;
+  packet.SerializeToString(&out);
+  return out;
+}
+
+TestPacket makePacket(bool trailer, int sourceLength = 12)
+{
+  TestPacket packet;
+  packet.set_source(string(sourceLength, 'a'));
+  packet.set_seqno(42);
+  if(trailer)
+  {
+    packet.set_bitmap(0x123456789ULL);
+    packet.set_note("after the payload");
+  }
+  return packet;
+}
+
+BOOST_AUTO_TEST_SUITE (StackHelper_Test)
+
+BOOST_AUTO_TEST_CASE(StackHelper_RoundTrip_Test)
+{
+  int sizes[] = {0, 1, 127, 128, 1500, 70000};
+  for(int t=0; t<2; t++)
+  {
+    for(int i=0; i<6; i++)
+    {
+      FramePtr frame = makeFrame(sizes[i]);
+      FramePtr orig = makeFrame(sizes[i]);
+      TestPacket packet = makePacket(t == 1);
+
+      // Same bytes as SerializeToString, in field order
+      StackHelper::mergeAndSerializeDataset(frame, packet);
+      BOOST_CHECK(string(frame->data.begin(), frame->data.end()) ==
+                  serialize(packet, orig));
+
+      TestPacket parsed;
+      BOOST_REQUIRE(StackHelper::deserializeAndStripDataset(frame, parsed));
+      BOOST_CHECK_EQUAL(parsed.source(), packet.source());
+      BOOST_CHECK_EQUAL(parsed.seqno(), 42u);
+      BOOST_CHECK_EQUAL(parsed.has_bitmap(), t == 1);
+      BOOST_CHECK_EQUAL(parsed.bitmap(), packet.bitmap());
+      BOOST_CHECK_EQUAL(parsed.note(), packet.note());
+      BOOST_CHECK_EQUAL(parsed.payload_size(), 0);
+      BOOST_CHECK(frame->data == orig->data);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(StackHelper_LongHeader_Test)
+{
+  // Fields too long for the header buffer on the stack
+  FramePtr frame = makeFrame(100);
+  FramePtr orig = makeFrame(100);
+  TestPacket packet = makePacket(true, 1000);
+  packet.set_note(string(1000, 'n'));
+
+  StackHelper::mergeAndSerializeDataset(frame, packet);
+  BOOST_CHECK(string(frame->data.begin(), frame->data.end()) ==
+              serialize(packet, orig));
+
+  TestPacket parsed;
+  BOOST_REQUIRE(StackHelper::deserializeAndStripDataset(frame, parsed));
+  BOOST_CHECK_EQUAL(parsed.source(), packet.source());
+  BOOST_CHECK_EQUAL(parsed.note(), packet.note());
+  BOOST_CHECK(frame->data == orig->data);
+}
+
+BOOST_AUTO_TEST_CASE(StackHelper_Layouts_Test)
+{
+  // All fields in front of the payload
+  TestPacket packet = makePacket(true);
+  string bytes;
+  packet.SerializeToString(&bytes);
+  bytes += string("\x1a\x02hi", 4);
+  FramePtr frame(new StackDataSet);
+  frame->data.assign(bytes.begin(), bytes.end());
+  TestPacket parsed;
+  BOOST_REQUIRE(StackHelper::deserializeAndStripDataset(frame, parsed));
+  BOOST_CHECK_EQUAL(parsed.note(), packet.note());
+  BOOST_CHECK_EQUAL(string(frame->data.begin(), frame->data.end()), "hi");
+
+  // Two payloads - both are left in the protobuf, and the frame unchanged
+  packet.add_payload("ab");
+  packet.add_payload("cd");
+  packet.SerializeToString(&bytes);
+  frame->data.assign(bytes.begin(), bytes.end());
+  BOOST_REQUIRE(StackHelper::deserializeAndStripDataset(frame, parsed));
+  BOOST_CHECK_EQUAL(parsed.payload_size(), 2);
+  BOOST_CHECK_EQUAL(frame->data.size(), bytes.size());
+
+  // No payload
+  packet.clear_payload();
+  packet.SerializeToString(&bytes);
+  frame->data.assign(bytes.begin(), bytes.end());
+  BOOST_REQUIRE(StackHelper::deserializeAndStripDataset(frame, parsed));
+  BOOST_CHECK_EQUAL(parsed.seqno(), 42u);
+
+  // Not a packet
+  frame->data.assign(10, 0xff);
+  BOOST_CHECK(!StackHelper::deserializeAndStripDataset(frame, parsed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+/**
+ * \file lib/generic/utility/test/TimerWheel_test.cpp
+ * \version 1.0
+ *
+ * \section COPYRIGHT
+ *
+ * Copyright 2012-2013 The Iris Project Developers. See the
+ * COPYRIGHT file at the top-level directory of this distribution
+ * and at http://www.softwareradiosystems.com/iris/copyright.html.
+ *
+ * \section LICENSE
+ *
+ * This file is part of the Iris Project.
+ *
+ * Iris is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * Iris is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * A copy of the GNU Lesser General Public License can be found in
+ * the LICENSE file in the top-level directory of this distribution
+ * and at http://www.gnu.org/licenses/.
+ *
+ * \section DESCRIPTION
+ * Main test file for TimerWheel.
+ */
+
+#define BOOST_TEST_MODULE TimerWheel_Test
+
+#include "TimerWheel.h"
+#include "AllocationCounter.h"
+
+#include <boost/test/unit_test.hpp>
+
+// Count heap allocations in this executable
+IRIS_ALLOCATION_COUNTER_OPERATORS
+
+using namespace std;
+using namespace iris;
+
+typedef TimerWheel<int> IntWheel;
+
+BOOST_AUTO_TEST_SUITE (TimerWheel_Test)
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Basic_Test)
+{
+  IntWheel w(8, 100);
+  BOOST_CHECK(w.empty());
+  BOOST_CHECK_EQUAL(w.nextExpiry(), numeric_limits<IntWheel::Tick>::max());
+
+  w.start(1, 5);
+  w.start(2, 3);
+  IntWheel::Handle h = w.start(3, 4);
+  w.start(4, 0);    // Expires on the next tick
+  BOOST_CHECK_EQUAL(w.size(), 4u);
+  BOOST_CHECK_EQUAL(w.nextExpiry(), 1u);
+
+  vector<int> expired;
+  BOOST_CHECK_EQUAL(w.advance(101, expired), 1u);
+  BOOST_CHECK_EQUAL(w.nextExpiry(), 2u);
+
+  w.cancel(h);
+  BOOST_CHECK(!h.active());
+  w.cancel(h);      // Does nothing
+  BOOST_CHECK_EQUAL(w.size(), 2u);
+
+  BOOST_CHECK_EQUAL(w.advance(104, expired), 1u);
+  BOOST_CHECK_EQUAL(w.advance(104, expired), 0u);
+  BOOST_CHECK_EQUAL(w.advance(110, expired), 1u);
+  BOOST_REQUIRE_EQUAL(expired.size(), 3u);
+  BOOST_CHECK_EQUAL(expired[0], 4);
+  BOOST_CHECK_EQUAL(expired[1], 2);
+  BOOST_CHECK_EQUAL(expired[2], 1);
+  BOOST_CHECK(w.empty());
+  BOOST_CHECK_EQUAL(w.now(), 110u);
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Wrap_Test)
+{
+  // Timers many turns ahead share slots with near ones
+  IntWheel w(4);
+  w.start(1, 2);
+  w.start(2, 10);
+  w.start(3, 50);
+  BOOST_CHECK_EQUAL(w.nextExpiry(), 2u);
+
+  vector<int> expired;
+  for(IntWheel::Tick t=1; t<=9; t++)
+    w.advance(t, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 1u);
+  BOOST_CHECK_EQUAL(w.nextExpiry(), 1u);
+  w.advance(10, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 2u);
+  BOOST_CHECK_EQUAL(expired[1], 2);
+
+  // Only the far timer is left
+  BOOST_CHECK_EQUAL(w.nextExpiry(), 40u);
+
+  // Jumping more than a turn still finds it
+  w.advance(49, expired);
+  BOOST_CHECK_EQUAL(expired.size(), 2u);
+  w.advance(1000, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 3u);
+  BOOST_CHECK_EQUAL(expired[2], 3);
+  BOOST_CHECK(w.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Many_Test)
+{
+  IntWheel w(64);
+  vector<IntWheel::Handle> handles;
+  for(int i=0; i<1000; i++)
+    handles.push_back(w.start(i, 1 + i%200));
+  for(int i=0; i<1000; i+=2)
+    w.cancel(handles[i]);
+  BOOST_CHECK_EQUAL(w.size(), 500u);
+
+  vector<int> expired;
+  IntWheel::Tick t = 0;
+  while(!w.empty())
+  {
+    t += w.nextExpiry();
+    size_t before = expired.size();
+    BOOST_CHECK(w.advance(t, expired) > 0);
+    for(size_t i=before; i<expired.size(); i++)
+      BOOST_CHECK_EQUAL((IntWheel::Tick)(1 + expired[i]%200), t);
+  }
+  BOOST_CHECK_EQUAL(expired.size(), 500u);
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Reuse_Test)
+{
+  IntWheel w(16);
+  w.reserve(8);
+  vector<int> expired;
+  expired.reserve(8);
+
+  // Running timers come from the pool once it is big enough
+  AllocationCounter::start();
+  IntWheel::Tick t = 0;
+  for(int i=0; i<100; i++)
+  {
+    IntWheel::Handle h = w.start(i, 3);
+    for(int j=0; j<7; j++)
+      w.start(i, 1+j%5);
+    w.cancel(h);
+    t += 5;
+    w.advance(t, expired);
+    expired.clear();
+  }
+  BOOST_CHECK_EQUAL(AllocationCounter::stop(), 0);
+  BOOST_CHECK(w.empty());
+
+  // An expired handle doesn't cancel the timer which reused its place
+  IntWheel::Handle old = w.start(1, 1);
+  w.advance(t+1, expired);
+  IntWheel::Handle h = w.start(2, 1);
+  w.cancel(old);
+  BOOST_CHECK(!old.active());
+  BOOST_CHECK_EQUAL(w.size(), 1u);
+  w.advance(t+2, expired);
+  BOOST_REQUIRE_EQUAL(expired.size(), 2u);
+  BOOST_CHECK_EQUAL(expired[1], 2);
+  BOOST_CHECK(h.active());
+}
+
+BOOST_AUTO_TEST_SUITE_END()